@@ -24,6 +24,7 @@
 
 #include <list>
 #include <cmath>
+#include <atomic>
 
 
 
@@ -33,6 +34,7 @@
 #include <QHeaderView>
 #include <QStyledItemDelegate>
 #include <QThreadPool>
+#include <QSemaphore>
 
 
 
@@ -90,6 +92,44 @@ public:
 
 
 
+/* State shared by threads processing items of one call to ParallelItems::process(). */
+class ParallelItemsState {
+public:
+	ParallelItemsState(int new_n_items, const std::function<void(int)> & new_process_item, BackgroundJob * new_job)
+		: n_items(new_n_items), process_item(new_process_item), job(new_job) {};
+
+	void process_next_items(void);
+
+	const int n_items;
+	const std::function<void(int)> & process_item;
+	BackgroundJob * job = nullptr;
+
+	std::atomic<int> next_idx{0};
+	std::atomic<bool> aborted{false};
+	int processed_count = 0;
+	std::mutex progress_mutex;
+	QSemaphore workers_done;
+};
+
+
+
+
+/* Helper that processes items in another thread of the pool. */
+class ParallelItemsWorker : public QRunnable {
+public:
+	ParallelItemsWorker(ParallelItemsState & new_state) : state(new_state) {};
+	void run(void) override
+	{
+		this->state.process_next_items();
+		this->state.workers_done.release();
+	}
+private:
+	ParallelItemsState & state;
+};
+
+
+
+
 BackgroundJob::~BackgroundJob()
 {
 	qDebug() << SG_PREFIX_I "destructing job" << this->description << ", job index"
@@ -178,6 +218,58 @@ void BackgroundJob::run_in_background(__attribute__((unused)) ThreadPoolType poo
 
 
 
+void ParallelItemsState::process_next_items(void)
+{
+	while (!this->aborted) {
+		const int idx = this->next_idx++;
+		if (idx >= this->n_items) {
+			break;
+		}
+
+		this->process_item(idx);
+
+		if (this->job) {
+			std::lock_guard<std::mutex> lock(this->progress_mutex);
+			const int count = ++this->processed_count;
+			/* Progress also detects abort request via the returned value. */
+			const bool end_job = this->job->set_progress_state(100 * count / this->n_items);
+			if (end_job) {
+				this->aborted = true; /* Abort all threads. */
+			}
+		}
+	}
+}
+
+
+
+
+bool ParallelItems::process(int n_items, const std::function<void(int)> & process_item, BackgroundJob * job)
+{
+	ParallelItemsState state(n_items, process_item, job);
+
+	/* Don't start helpers if no thread is free. Using tryStart()
+	   guarantees that helpers are already running when we wait
+	   for them below, so this can't deadlock the pool. */
+	int n_workers = 0;
+	for (int i = 1; i < n_items; i++) {
+		ParallelItemsWorker * worker = new ParallelItemsWorker(state);
+		if (!QThreadPool::globalInstance()->tryStart(worker)) {
+			delete worker;
+			break;
+		}
+		n_workers++;
+	}
+	qDebug() << SG_PREFIX_I << "Processing" << n_items << "items with" << n_workers << "helper threads";
+
+	state.process_next_items();
+	state.workers_done.acquire(n_workers);
+
+	return !state.aborted;
+}
+
+
+
+
 void BackgroundWindow::remove_job(QStandardItem * item)
 {
 	QStandardItem * parent_item = this->model->invisibleRootItem();
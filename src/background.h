@@ -27,6 +27,7 @@
 #include <list>
 #include <cstdint>
 #include <mutex>
+#include <functional>
 
 
 
@@ -96,6 +97,26 @@ namespace SlavGPS {
 
 
 
+	/* Processes items of a task in parallel: calling thread is
+	   joined by helper threads from global thread pool, as many
+	   as the pool has free. */
+	class ParallelItems {
+	public:
+		/* @param process_item is called once for each index in
+		   range [0, n_items), in any thread and in any order.
+
+		   If @param job is given, its progress is updated after
+		   each item, and request for termination of the job
+		   stops processing of remaining items.
+
+		   @return true when all items have been processed
+		   @return false if processing has been terminated before processing all items */
+		static bool process(int n_items, const std::function<void(int)> & process_item, BackgroundJob * job = nullptr);
+	};
+
+
+
+
 	class BackgroundWindow : public QDialog {
 		Q_OBJECT
 	public:
@@ -197,6 +197,17 @@ bool LatLonBBox::intersects_with(const LatLonBBox & bbox) const
 
 
 
+bool LatLonBBox::intersects_with_or_touches(const LatLonBBox & bbox) const
+{
+	return this->south <= bbox.north
+		&& this->north >= bbox.south
+		&& this->east >= bbox.west
+		&& this->west <= bbox.east;
+}
+
+
+
+
 sg_ret LatLonBBox::expand_with_lat_lon(const LatLon & lat_lon)
 {
 	if (!lat_lon.is_valid()) {
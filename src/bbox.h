@@ -123,6 +123,12 @@ namespace SlavGPS {
 		 */
 		bool intersects_with(const LatLonBBox & bbox) const;
 
+		/* Like intersects_with(), but bboxes that only touch
+		   each other at their edges (or bboxes of zero width
+		   or height lying on such edge) also match, the same
+		   way as points on edges match in contains_point(). */
+		bool intersects_with_or_touches(const LatLonBBox & bbox) const;
+
 		/* Make the given LatLonBBox larger by expanding it to include given LatLon. */
 		sg_ret expand_with_lat_lon(const LatLon & lat_lon);
 
@@ -705,7 +705,7 @@ LoadStatus DataSourceOSMMyTraces::acquire_into_layer(AcquireContext & acquire_co
 	   however since we may create the layer - need to do the update here. */
 	if (got_something) {
 		Layer * layer_last = (Layer *) vtl_last;
-		layer_last->emit_tree_item_changed("OSM My Traces - acquire into layer");
+		layer_last->emit_tree_item_changed_in_background("OSM My Traces - acquire into layer");
 	}
 
 	/* ATM The user is only informed if all getting *all* of the traces failed. */
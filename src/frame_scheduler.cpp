@@ -0,0 +1,358 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <algorithm>
+
+
+
+
+#include <QDebug>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QEvent>
+#include <QMouseEvent>
+
+
+
+
+#include "frame_scheduler.h"
+#include "window.h"
+#include "viewport_internal.h"
+#include "globals.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "Frame Scheduler"
+
+/* Frames requested by background activities are drawn not more
+   often than once per this many refresh periods of display. */
+#define BACKGROUND_FRAME_INTERVAL_FACTOR 4
+
+
+
+
+static UserInputCounter * g_user_input_counter = nullptr;
+static uint64_t g_user_input_count = 0;
+
+
+
+
+void UserInputCounter::install(void)
+{
+	if (nullptr != g_user_input_counter) {
+		return;
+	}
+	g_user_input_counter = new UserInputCounter(QCoreApplication::instance());
+	QCoreApplication::instance()->installEventFilter(g_user_input_counter);
+}
+
+
+
+
+uint64_t UserInputCounter::get_count(void)
+{
+	return g_user_input_count;
+}
+
+
+
+
+bool UserInputCounter::eventFilter(QObject * object, QEvent * event)
+{
+	/* Events generated by application itself are not user input.
+	   An event propagated to parent widgets may be counted more
+	   than once, but only changes of the count matter. */
+	if (event->spontaneous()) {
+		switch (event->type()) {
+		case QEvent::MouseButtonPress:
+		case QEvent::MouseButtonRelease:
+		case QEvent::MouseButtonDblClick:
+		case QEvent::Wheel:
+		case QEvent::KeyPress:
+			g_user_input_count++;
+			break;
+		case QEvent::MouseMove:
+			/* Only dragging, moving of mouse over viewport is not a reason to give up a frame. */
+			if (((QMouseEvent *) event)->buttons() != Qt::NoButton) {
+				g_user_input_count++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return QObject::eventFilter(object, event);
+}
+
+
+
+
+FrameScheduler::FrameScheduler(Window * new_window, GisViewport * new_gisview) : QObject(new_window)
+{
+	this->window = new_window;
+	this->gisview = new_gisview;
+
+	const QScreen * screen = QGuiApplication::primaryScreen();
+	if (screen && screen->refreshRate() > 1.0) {
+		this->frame_interval = std::max(1, (int) (1000.0 / screen->refreshRate()));
+	}
+	qDebug() << SG_PREFIX_I << "Frame interval is" << this->frame_interval << "ms";
+
+	UserInputCounter::install();
+
+	this->timer.setSingleShot(true);
+	connect(&this->timer, SIGNAL (timeout(void)), this, SLOT (draw_frame_cb(void)));
+
+	this->remaining_stage_timer.setSingleShot(true);
+	connect(&this->remaining_stage_timer, SIGNAL (timeout(void)), this, SLOT (draw_remaining_stage_cb(void)));
+}
+
+
+
+
+void FrameScheduler::request_frame(FramePriority priority, bool new_reuse_layers_cache, const QString & reason)
+{
+	this->counters.n_requests++;
+	this->n_pending_requests++;
+
+	if (FramePriority::UserInput == priority) {
+		/* Don't make user wait for layers drawn for old state of viewport. */
+		this->cancel_progressive_frame();
+	}
+
+	this->redraw_pending = true;
+	this->reuse_layers_cache = this->reuse_layers_cache && new_reuse_layers_cache;
+	if (!this->reasons.contains(reason)) {
+		this->reasons.push_back(reason);
+	}
+
+	this->schedule(priority);
+}
+
+
+
+
+void FrameScheduler::request_pan_frame(const Coord & old_center)
+{
+	this->counters.n_requests++;
+	this->n_pending_requests++;
+
+	this->cancel_progressive_frame();
+
+	/* Contents of viewport correspond to center from before
+	   the first of pending pans. */
+	if (!this->pan_pending) {
+		this->pan_pending = true;
+		this->pan_old_center = old_center;
+	}
+
+	this->schedule(FramePriority::UserInput);
+}
+
+
+
+
+void FrameScheduler::discard_pending_requests(void)
+{
+	this->cancel_progressive_frame();
+	this->counters.n_coalesced_requests += this->n_pending_requests;
+	this->reset_pending_requests();
+}
+
+
+
+
+void FrameScheduler::reset_pending_requests(void)
+{
+	this->n_pending_requests = 0;
+
+	this->redraw_pending = false;
+	this->reuse_layers_cache = true;
+	this->pan_pending = false;
+	this->reasons.clear();
+
+	this->timer.stop();
+}
+
+
+
+
+void FrameScheduler::cancel_progressive_frame(void)
+{
+	if (!this->progressive_frame_pending) {
+		return;
+	}
+
+	qDebug() << SG_PREFIX_I << "Cancelling second stage of progressive frame";
+	this->progressive_token.cancel();
+	this->progressive_frame_pending = false;
+	this->remaining_stage_timer.stop();
+	this->counters.n_cancelled_frames++;
+
+	/* Viewport shows only some layers, and its pixmap can't be
+	   moved by pan. Next frame must draw everything. */
+	this->redraw_pending = true;
+}
+
+
+
+
+const FrameSchedulerCounters & FrameScheduler::get_counters(void) const
+{
+	return this->counters;
+}
+
+
+
+
+void FrameScheduler::schedule(FramePriority priority)
+{
+	int min_interval = this->frame_interval;
+	if (FramePriority::Background == priority) {
+		min_interval *= BACKGROUND_FRAME_INTERVAL_FACTOR;
+	}
+
+	int delay = 0;
+	if (this->since_last_frame.isValid()) {
+		delay = std::max(0, min_interval - (int) this->since_last_frame.elapsed());
+	}
+
+	if (this->timer.isActive() && this->timer.remainingTime() <= delay) {
+		/* Frame will be drawn soon enough. */
+		return;
+	}
+
+	this->timer.start(delay);
+}
+
+
+
+
+void FrameScheduler::draw_frame_cb(void)
+{
+	if (0 == this->n_pending_requests) {
+		return;
+	}
+	if (this->drawing) {
+		/* Event loop has been run while a frame is being drawn. Try again later. */
+		this->timer.start(this->frame_interval);
+		return;
+	}
+
+	/* Requests made while the frame is being drawn will be
+	   served by next frame. */
+	const bool do_redraw = this->redraw_pending;
+	const bool do_reuse_layers_cache = this->reuse_layers_cache;
+	const Coord old_center = this->pan_old_center;
+	const int n_requests = this->n_pending_requests;
+	qDebug() << SG_PREFIX_D << "Drawing frame for" << n_requests << "requests:" << this->reasons.join(", ") << (this->pan_pending ? "pan" : "");
+	this->counters.n_coalesced_requests += n_requests - 1;
+	this->reset_pending_requests();
+
+	this->frame_timer.start();
+	this->drawing = true;
+
+	if (do_redraw && this->window->can_draw_tree_items_progressively(this->gisview)) {
+		this->progressive_token = RenderCancellationToken::create();
+		this->progressive_input_count = UserInputCounter::get_count();
+		this->window->draw_tree_items_base_stage(this->gisview, do_reuse_layers_cache, this->progressive_token);
+		this->drawing = false;
+
+		/* Remaining layers will be drawn after events that
+		   are already waiting (e.g. user input) are handled. */
+		this->progressive_frame_pending = true;
+		this->remaining_stage_timer.start(0);
+		this->since_last_frame.start();
+		return;
+	}
+
+	if (do_redraw) {
+		this->window->draw_tree_items(this->gisview, do_reuse_layers_cache);
+	} else {
+		this->window->draw_tree_items_after_pan(this->gisview, old_center);
+	}
+	this->drawing = false;
+
+	this->finish_frame();
+}
+
+
+
+
+void FrameScheduler::draw_remaining_stage_cb(void)
+{
+	if (!this->progressive_frame_pending || this->progressive_token.is_cancelled()) {
+		return;
+	}
+
+	if (!this->remaining_stage_interrupted) {
+		this->progressive_token.cancel_on_user_input(this->frame_interval, this->progressive_input_count);
+	}
+
+	this->drawing = true;
+	this->window->draw_tree_items_remaining_stage(this->gisview, this->progressive_token);
+	this->drawing = false;
+
+	if (this->progressive_token.is_cancelled()) {
+		if (this->progressive_frame_pending) {
+			/* Token has been cancelled by user input, not
+			   by request for newer frame. Draw the frame
+			   again once the input is handled. */
+			qDebug() << SG_PREFIX_I << "Second stage of progressive frame has been interrupted";
+			this->progressive_frame_pending = false;
+			this->remaining_stage_interrupted = true;
+			this->counters.n_cancelled_frames++;
+			this->counters.n_interrupted_frames++;
+			this->request_frame(FramePriority::UserInput, true, "interrupted frame");
+		}
+		/* Otherwise newer frame has been requested while the layers were drawn. */
+		return;
+	}
+	this->progressive_frame_pending = false;
+	this->remaining_stage_interrupted = false;
+
+	this->finish_frame();
+}
+
+
+
+
+void FrameScheduler::finish_frame(void)
+{
+	const double frame_time = this->frame_timer.nsecsElapsed() / 1000000.0;
+	this->counters.n_frames++;
+	this->counters.last_frame_time = frame_time;
+	this->counters.max_frame_time = std::max(this->counters.max_frame_time, frame_time);
+	this->counters.total_frame_time += frame_time;
+	this->since_last_frame.start();
+
+	qDebug() << SG_PREFIX_D << "Frame drawn in" << frame_time << "ms; frames:" << this->counters.n_frames
+		 << ", cancelled frames:" << this->counters.n_cancelled_frames
+		 << ", interrupted frames:" << this->counters.n_interrupted_frames
+		 << ", requests:" << this->counters.n_requests << ", coalesced requests:" << this->counters.n_coalesced_requests;
+}
@@ -0,0 +1,201 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_FRAME_SCHEDULER_H_
+#define _SG_FRAME_SCHEDULER_H_
+
+
+
+
+#include <cstdint>
+
+
+
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+
+
+
+
+#include "coord.h"
+#include "viewport.h"
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class Window;
+	class GisViewport;
+
+
+
+
+	enum class FramePriority {
+		Background, /* E.g. a map tile has been downloaded. */
+		UserInput   /* E.g. viewport has been panned or zoomed by user. */
+	};
+
+
+
+
+	/**
+	   @brief Counter of user input events (mouse buttons,
+	   mouse drags, mouse wheel and keyboard) handled by
+	   application
+
+	   Drawing code compares the count with count from
+	   beginning of a frame to see if the user has done
+	   something since then. Other events (e.g. timers or
+	   signals from background jobs) aren't counted.
+	*/
+	class UserInputCounter : public QObject {
+		Q_OBJECT
+	public:
+		/* Install event filter on application. Call this from GUI thread. */
+		static void install(void);
+
+		/* Call this only from GUI thread. */
+		static uint64_t get_count(void);
+
+	protected:
+		bool eventFilter(QObject * object, QEvent * event) override;
+
+	private:
+		UserInputCounter(QObject * parent) : QObject(parent) {};
+	};
+
+
+
+
+	class FrameSchedulerCounters {
+	public:
+		uint64_t n_requests = 0;
+		/* Requests that didn't need a frame of their own. */
+		uint64_t n_coalesced_requests = 0;
+		uint64_t n_frames = 0;
+		/* Progressive frames abandoned after their first stage. */
+		uint64_t n_cancelled_frames = 0;
+		/* Second stages abandoned because of user input. */
+		uint64_t n_interrupted_frames = 0;
+
+		/* Times of drawing of frames, in milliseconds. */
+		double last_frame_time = 0.0;
+		double max_frame_time = 0.0;
+		double total_frame_time = 0.0;
+	};
+
+
+
+
+	/**
+	   @brief Scheduler of redraws of main viewport of a window
+
+	   Requests for redraw are not served immediately. They
+	   are recorded, and one frame serving all recorded
+	   requests is drawn at most once per refresh period of
+	   display. Frames requested by user input are drawn at
+	   the next refresh period, frames requested by background
+	   activities (e.g. downloads of map tiles) less often.
+
+	   If possible, a frame is drawn progressively (see
+	   Window::draw_tree_items_base_stage()). A request made
+	   by user input between the two stages of such frame
+	   cancels the second stage. The second stage is also
+	   given up when it takes longer than a refresh period and
+	   user input has been handled since beginning of the
+	   frame. Layers drawn before that are kept in layers
+	   cache, and the frame is drawn again.
+	*/
+	class FrameScheduler : public QObject {
+		Q_OBJECT
+	public:
+		FrameScheduler(Window * window, GisViewport * gisview);
+
+		/* See Window::draw_tree_items() for meaning of @param reuse_layers_cache. */
+		void request_frame(FramePriority priority, bool reuse_layers_cache, const QString & reason);
+
+		/* Center of viewport has been moved by pan tool from @param old_center. */
+		void request_pan_frame(const Coord & old_center);
+
+		/* Forget recorded requests, e.g. because the viewport
+		   has been redrawn from scratch without the scheduler. */
+		void discard_pending_requests(void);
+
+		const FrameSchedulerCounters & get_counters(void) const;
+
+	private slots:
+		void draw_frame_cb(void);
+		void draw_remaining_stage_cb(void);
+
+	private:
+		void schedule(FramePriority priority);
+		void reset_pending_requests(void);
+		void cancel_progressive_frame(void);
+		void finish_frame(void);
+
+		Window * window = nullptr;
+		GisViewport * gisview = nullptr;
+
+		QTimer timer;
+		QElapsedTimer since_last_frame;
+		QElapsedTimer frame_timer;
+		int frame_interval = 16; /* [milliseconds] */
+
+		/* Recorded requests. */
+		int n_pending_requests = 0;
+		bool redraw_pending = false;
+		bool reuse_layers_cache = true;
+		bool pan_pending = false;
+		Coord pan_old_center;
+		QStringList reasons;
+
+		/* Progressive frame waiting for its second stage. */
+		bool progressive_frame_pending = false;
+		QTimer remaining_stage_timer;
+		RenderCancellationToken progressive_token;
+		/* Count of user input events at beginning of the frame. */
+		uint64_t progressive_input_count = 0;
+		/* Second stage of previous progressive frame has
+		   been interrupted by user input. Don't
+		   interrupt it again, so that continuous input
+		   can't keep the layers from being drawn. */
+		bool remaining_stage_interrupted = false;
+
+		/* Protection against drawing of a frame from event
+		   loop run while another frame is being drawn. */
+		bool drawing = false;
+
+		FrameSchedulerCounters counters;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_FRAME_SCHEDULER_H_ */
@@ -353,6 +353,25 @@ QString GeotagExif::get_object_comment(const QString & file_full_path)
 
 
 
+static QString geotag_get_exif_datetime(Exiv2::ExifData & exif_data)
+{
+	QString date_time;
+
+	/* Prefer 'Photo' version over 'Image'. */
+	if (false == SGExif::get_string(exif_data, date_time, "Exif.Photo.DateTimeOriginal")) {
+		qDebug() << SG_PREFIX_W << "Failed to get Photo Date Time Original";
+		if (false == SGExif::get_string(exif_data, date_time, "Exif.Image.DateTimeOriginal")) {
+			qDebug() << SG_PREFIX_W << "Failed to get Image Date Time Original";
+			/* We can't do anything more. */
+		}
+	}
+
+	return date_time;
+}
+
+
+
+
 /**
    @file_full_path: The image file to process
 
@@ -370,14 +389,7 @@ QString GeotagExif::get_object_datetime(const QString & file_full_path)
 	Exiv2::ExifData &exif_data = image->exifData();
 
 	if (!exif_data.empty()) {
-		/* Prefer 'Photo' version over 'Image'. */
-		if (false == SGExif::get_string(exif_data, date_time, "Exif.Photo.DateTimeOriginal")) {
-			qDebug() << SG_PREFIX_W << "Failed to get Photo Date Time Original";
-			if (false == SGExif::get_string(exif_data, date_time, "Exif.Image.DateTimeOriginal")) {
-				qDebug() << SG_PREFIX_W << "Failed to get Image Date Time Original";
-				/* We can't do anything more. */
-			}
-		}
+		date_time = geotag_get_exif_datetime(exif_data);
 	}
 
 	return date_time;
@@ -386,6 +398,47 @@ QString GeotagExif::get_object_datetime(const QString & file_full_path)
 
 
 
+/**
+   @file_full_path: The image file to process
+   @info:           Information read from the file
+
+   Returns: sg_ret::ok if file has EXIF data
+*/
+sg_ret GeotagExif::get_object_info(const QString & file_full_path, GeotagExifInfo & info)
+{
+	try {
+		Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(file_full_path.toUtf8().constData());
+		if (NULL == image.get()) {
+			return sg_ret::err;
+		}
+		image->readMetadata();
+		Exiv2::ExifData &exif_data = image->exifData();
+		if (exif_data.empty()) {
+			return sg_ret::err;
+		}
+
+		float lat;
+		float lon;
+		info.has_gps_info = (SGExif::get_float(exif_data, lat, "Exif.GPSInfo.GPSLatitude") && SGExif::get_float(exif_data, lon, "Exif.GPSInfo.GPSLongitude"));
+		if (info.has_gps_info) {
+			geotag_exif_get_gps_info(exif_data, info.lat_lon, info.altitude);
+		}
+
+		info.datetime = geotag_get_exif_datetime(exif_data);
+		info.name = geotag_get_exif_name(exif_data);
+		info.comment = geotag_get_exif_comment(exif_data);
+
+	} catch (const Exiv2::AnyError & error) {
+		qDebug() << SG_PREFIX_W << "Can't read EXIF data from" << file_full_path << ":" << error.what();
+		return sg_ret::err;
+	}
+
+	return sg_ret::ok;
+}
+
+
+
+
 /**
    @file_full_path: The image file to process
    @has_GPS_info: Returns whether the file has existing GPS information
@@ -494,6 +547,50 @@ Exiv2::ExifData SGExif::get_exif_data(const QString & file_full_path)
 
 
 
+bool SGExif::get_thumbnail_info(const QString & file_full_path, sg_exif_image_orientation & orientation, QByteArray & embedded_thumbnail)
+{
+	try {
+		Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(file_full_path.toUtf8().constData());
+		if (image.get() == 0) {
+			return false;
+		}
+		image->readMetadata();
+		Exiv2::ExifData & exif_data = image->exifData();
+		if (exif_data.empty()) {
+			return false;
+		}
+
+		uint16_t value;
+		if (SGExif::get_uint16(exif_data, value, "Exif.Image.Orientation")) {
+			orientation = value;
+		}
+
+		Exiv2::ExifThumbC exif_thumb(exif_data);
+		Exiv2::DataBuf buffer = exif_thumb.copy();
+		if (buffer.size_ > 0) {
+			embedded_thumbnail = QByteArray((const char *) buffer.pData_, buffer.size_);
+		}
+	} catch (const Exiv2::AnyError & error) {
+		/* Not necessarily an error: file may be in a format not supported by Exiv2. */
+		qDebug() << SG_PREFIX_W << "Can't read EXIF data from" << file_full_path << ":" << error.what();
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+void SGExif::init(void)
+{
+	/* Initialization of XMP parser is not thread-safe. */
+	Exiv2::XmpParser::initialize();
+}
+
+
+
+
 bool SGExif::get_image_orientation(sg_exif_image_orientation & result, const QString & file_full_path)
 {
         uint16_t orientation;
@@ -29,6 +29,7 @@
 
 
 
+#include <QByteArray>
 #include <QString>
 
 
@@ -62,9 +63,28 @@ namespace SlavGPS {
 
 
 
+	/* Information used by geotagging, read from EXIF data of a file in one go. */
+	class GeotagExifInfo {
+	public:
+		bool has_gps_info = false; /* File has GPS latitude/longitude. */
+		LatLon lat_lon;            /* Valid only if file has GPS latitude, longitude and altitude. */
+		Altitude altitude;
+		QString datetime;          /* In EXIF_DATE_FORMAT. */
+		QString name;
+		QString comment;
+	};
+
+
+
+
 	class GeotagExif {
 
 	public:
+		/* Unlike other methods, this one opens and parses the
+		   file only once, and doesn't fail on files that
+		   can't be opened by Exiv2. */
+		static sg_ret get_object_info(const QString & file_full_path, GeotagExifInfo & info);
+
 		static Waypoint * create_waypoint_from_file(const QString & file_full_path, CoordMode coord_mode);
 
 		static QString get_object_name(const QString & file_full_path);
@@ -94,6 +114,15 @@ namespace SlavGPS {
 		static bool get_uint16(Exiv2::ExifData & exif_data, uint16_t & val, const char * key);
 
 		static bool get_image_orientation(sg_exif_image_orientation & result, const QString & file_full_path);
+
+		/* Get orientation of image and thumbnail image embedded
+		   in EXIF data (empty if there is no such thumbnail).
+		   Unlike other methods, it doesn't fail on files without
+		   EXIF data, and can be called from non-GUI threads. */
+		static bool get_thumbnail_info(const QString & file_full_path, sg_exif_image_orientation & orientation, QByteArray & embedded_thumbnail);
+
+		/* Must be called once, from main thread, before using Exiv2 in other threads. */
+		static void init(void);
 	};
 
 
@@ -688,3 +688,19 @@ bool Layer::is_layer(void) const
 {
 	return true;
 }
+
+
+
+
+uint64_t Layer::get_content_version(void) const
+{
+	return this->content_version;
+}
+
+
+
+
+void Layer::increment_content_version(void)
+{
+	this->content_version++;
+}
@@ -24,6 +24,7 @@
 
 
 
+#include <atomic>
 #include <cstdint>
 
 
@@ -121,6 +122,20 @@ namespace SlavGPS {
 
 		void draw_tree_item(__attribute__((unused)) GisViewport * gisview, __attribute__((unused)) bool highlight_selected, __attribute__((unused)) bool parent_is_selected) override { return; };
 
+		/* Can the layer be drawn in a thread other than main
+		   thread? Such layer must only read its data during
+		   drawing: it can't create pixmaps, start background
+		   jobs or touch widgets. Data of layers doesn't change
+		   while a frame is drawn, because main thread is busy
+		   drawing the frame. */
+		virtual bool supports_parallel_drawing(void) const { return false; };
+
+		/* Called in main thread right before the layer is
+		   drawn in other thread. Tree view can be used only in
+		   main thread, so this is the place to get from tree
+		   view everything that is needed for drawing. */
+		virtual void prepare_parallel_drawing(void) { return; };
+
 		virtual QString get_tooltip(void) const;
 
 		bool handle_selection_in_tree(void);
@@ -199,6 +214,13 @@ namespace SlavGPS {
 
 		bool is_layer(void) const override;
 
+		/* Version of contents of the layer, incremented each
+		   time the layer or any tree item in it is changed.
+		   Used to decide if a cached image of the layer is
+		   still up to date. */
+		uint64_t get_content_version(void) const;
+		void increment_content_version(void);
+
 
 		/* GUI. */
 		QIcon get_icon(void);
@@ -212,6 +234,10 @@ namespace SlavGPS {
 		LayerInterface * interface = NULL;
 		QMenu * right_click_menu = NULL;
 
+	private:
+		/* Incremented also from background threads. */
+		std::atomic<uint64_t> content_version{0};
+
 	protected slots:
 		virtual void location_info_cb(void);
 
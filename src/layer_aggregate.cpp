@@ -24,6 +24,7 @@
 
 
 #include <list>
+#include <vector>
 #include <cstring>
 #include <cstdlib>
 #include <cassert>
@@ -114,7 +115,7 @@ Layer * LayerAggregateInterface::unmarshall(Pickle & pickle, GisViewport * gisvi
 		Layer * child_layer = Layer::unmarshall(pickle, gisview);
 		if (child_layer) {
 			aggregate->unattached_children.push_front(child_layer);
-			QObject::connect(child_layer, SIGNAL (tree_item_changed(const QString &)), aggregate, SLOT (child_tree_item_changed_cb(const QString &)));
+			QObject::connect(child_layer, SIGNAL (tree_item_changed(const QString &, bool)), aggregate, SLOT (child_tree_item_changed_cb(const QString &, bool)));
 		}
 	}
 #endif
@@ -170,13 +171,66 @@ sg_ret LayerAggregate::add_child_item(TreeItem * child_tree_item)
  */
 void LayerAggregate::draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
 {
-	__attribute__((unused)) Layer * trigger = gisview->get_trigger();
+	this->draw_stage(gisview, highlight_selected, parent_is_selected, LayersDrawStage::All);
+}
+
+
+
+
+void LayerAggregate::draw_stage(GisViewport * gisview, bool highlight_selected, bool parent_is_selected, LayersDrawStage stage)
+{
+	/* Cache keeps images of children of top-level layer only. */
+	GisViewportLayersCache * cache = gisview->get_layers_cache();
+	if (nullptr != cache && (cache->is_drawing() || !this->is_top_level_layer())) {
+		cache = nullptr;
+	}
+	if (nullptr != cache && LayersDrawStage::Remaining != stage) {
+		cache->begin_frame();
+	}
 
 	const int rows = this->child_rows_count();
-	for (int row = 0; row < rows; row++) {
+	int row_begin = 0;
+	int row_end = rows;
+	switch (stage) {
+	case LayersDrawStage::Base:
+		row_end = this->get_base_layers_count();
+		break;
+	case LayersDrawStage::Remaining:
+		row_begin = this->get_base_layers_count();
+		break;
+	default:
+		break;
+	}
+
+	if (nullptr != cache && Preferences::get_parallel_rendering()) {
+		this->draw_children_in_parallel(cache, gisview, highlight_selected, parent_is_selected, row_begin, row_end);
+	} else {
+		this->draw_children(cache, gisview, highlight_selected, parent_is_selected, row_begin, row_end);
+	}
+
+	/* Images of layers not drawn in cancelled frame may
+	   still be needed. */
+	if (nullptr != cache && LayersDrawStage::Base != stage && !gisview->get_render_token().is_cancelled()) {
+		cache->end_frame();
+	}
+}
+
+
+
+
+void LayerAggregate::draw_children(GisViewportLayersCache * cache, GisViewport * gisview, bool highlight_selected, bool parent_is_selected, int row_begin, int row_end)
+{
+	__attribute__((unused)) Layer * trigger = gisview->get_trigger();
+
+	for (int row = row_begin; row < row_end; row++) {
+		if (gisview->render_is_cancelled()) {
+			qDebug() << SG_PREFIX_I << "Drawing of layers has been cancelled before row" << row << "/" << row_end;
+			return;
+		}
+
 		TreeItem * child = nullptr;
 		if (sg_ret::ok != this->child_from_row(row, &child)) {
-			qDebug() << SG_PREFIX_E << "Failed to get child item in row" << row << "/" << rows;
+			qDebug() << SG_PREFIX_E << "Failed to get child item in row" << row << "/" << row_end;
 			return;
 		}
 
@@ -198,10 +252,68 @@ void LayerAggregate::draw_tree_item(GisViewport * gisview, bool highlight_select
 			layer->draw_tree_item(gisview, false, false);
 		}
 #else
-		qDebug() << SG_PREFIX_I << "Calling draw_tree_item(" << highlight_selected << parent_is_selected << ") for" << child->get_name();
-		child->draw_tree_item(gisview, highlight_selected, parent_is_selected);
+		if (nullptr != cache && child->is_layer()) {
+			cache->draw_layer((Layer *) child, gisview, highlight_selected, parent_is_selected);
+		} else {
+			qDebug() << SG_PREFIX_I << "Calling draw_tree_item(" << highlight_selected << parent_is_selected << ") for" << child->get_name();
+			child->draw_tree_item(gisview, highlight_selected, parent_is_selected);
+		}
+#endif
+	}
+}
+
+
+
+
+void LayerAggregate::draw_children_in_parallel(GisViewportLayersCache * cache, GisViewport * gisview, bool highlight_selected, bool parent_is_selected, int row_begin, int row_end)
+{
+	if (gisview->render_is_cancelled()) {
+		qDebug() << SG_PREFIX_I << "Drawing of layers has been cancelled";
+		return;
+	}
+
+	std::vector<Layer *> layers;
+	for (int row = row_begin; row < row_end; row++) {
+		TreeItem * child = nullptr;
+		if (sg_ret::ok != this->child_from_row(row, &child) || !child->is_layer()) {
+			qDebug() << SG_PREFIX_E << "Failed to get child layer in row" << row << "/" << row_end;
+			return;
+		}
+		layers.push_back((Layer *) child);
+	}
+
+	cache->draw_layers(layers, gisview, highlight_selected, parent_is_selected);
+}
+
+
+
+
+int LayerAggregate::get_base_layers_count(void) const
+{
+	/* Children are drawn in order of rows, so only leading
+	   base layers can be drawn before other layers. */
+	const int rows = this->child_rows_count();
+	int count = 0;
+	for (; count < rows; count++) {
+		TreeItem * child = nullptr;
+		if (sg_ret::ok != this->child_from_row(count, &child) || !child->is_layer()) {
+			break;
+		}
+
+		const Layer * layer = (const Layer *) child;
+		const bool is_base = layer->m_kind == LayerKind::Map
+			|| layer->m_kind == LayerKind::DEM
+			|| layer->m_kind == LayerKind::Georef
+#ifdef HAVE_LIBMAPNIK
+			|| layer->m_kind == LayerKind::Mapnik
 #endif
+			;
+		if (!is_base && layer->is_visible()) {
+			break;
+		}
 	}
+
+	return count;
 }
 
 
@@ -484,7 +596,7 @@ sg_ret LayerAggregate::delete_child_item(TreeItem * item, __attribute__((unused)
 
 	if (was_visible) {
 		qDebug() << SG_PREFIX_SIGNAL << "Layer" << this->get_name() << "emits 'changed' signal";
-		emit this->tree_item_changed(this->get_name());
+		emit this->tree_item_changed(this->get_name(), false);
 	}
 
 	return sg_ret::ok;;
@@ -764,7 +876,7 @@ sg_ret LayerAggregate::accept_dropped_child(TreeItem * tree_item, int row)
 		qDebug() << SG_PREFIX_I << "Attaching item" << tree_item->get_name() << "to tree under" << this->get_name();
 		this->tree_view->attach_to_tree(this, tree_item, row);
 
-		QObject::connect(tree_item, SIGNAL (tree_item_changed(const QString &)), this, SLOT (child_tree_item_changed_cb(const QString &)));
+		QObject::connect(tree_item, SIGNAL (tree_item_changed(const QString &, bool)), this, SLOT (child_tree_item_changed_cb(const QString &, bool)));
 	}
 
 	return sg_ret::ok;
@@ -49,12 +49,25 @@ namespace SlavGPS {
 
 	/* Forward declarations. */
 	class GisViewport;
+	class GisViewportLayersCache;
 	class Track;
 	class Waypoint;
 
 
 
 
+	/* Stages of progressive drawing of children of top-level
+	   layer: base layers (e.g. maps, DEMs) are drawn and shown
+	   first, other layers are drawn in second stage. */
+	enum class LayersDrawStage {
+		All,
+		Base,
+		Remaining
+	};
+
+
+
+
 	class LayerAggregateInterface : public LayerInterface {
 	public:
 		LayerAggregateInterface();
@@ -71,7 +84,15 @@ namespace SlavGPS {
 		~LayerAggregate();
 
 
+		/* Aggregate layer isn't drawn in worker thread (see
+		   Layer::supports_parallel_drawing()), because its
+		   children are found through tree view. */
 		void draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+		void draw_stage(GisViewport * gisview, bool highlight_selected, bool parent_is_selected, LayersDrawStage stage);
+
+		/* Number of leading children that are drawn in
+		   LayersDrawStage::Base stage. */
+		int get_base_layers_count(void) const;
 		QString get_tooltip(void) const;
 		void marshall(Pickle & pickle);
 		void change_coord_mode(CoordMode mode);
@@ -97,6 +118,11 @@ namespace SlavGPS {
 
 		std::list<Layer const *> get_child_layers(void) const;
 
+	private:
+		/* Draw children in rows from @param row_begin up to (but not including) @param row_end. */
+		void draw_children(GisViewportLayersCache * cache, GisViewport * gisview, bool highlight_selected, bool parent_is_selected, int row_begin, int row_end);
+		void draw_children_in_parallel(GisViewportLayersCache * cache, GisViewport * gisview, bool highlight_selected, bool parent_is_selected, int row_begin, int row_end);
+
 	private slots:
 		void children_visibility_on_cb(void);
 		void children_visibility_off_cb(void);
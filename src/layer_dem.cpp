@@ -22,6 +22,7 @@
 
 
 
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
@@ -41,6 +42,9 @@
 #include <QDebug>
 #include <QHash>
 #include <QDir>
+#include <QPainter>
+#include <QPolygonF>
+#include <QLineF>
 
 
 
@@ -50,6 +54,7 @@
 #include "layer_dem.h"
 #include "layer_dem_dem.h"
 #include "layer_dem_dem_cache.h"
+#include "layer_dem_contours.h"
 #include "map_cache.h"
 #include "file.h"
 #include "dialog.h"
@@ -95,6 +100,7 @@ static SGVariant scale_max_elev_initial_iu(Altitude(1000.0, AltitudeType::Unit::
 /* Upper limit is that high in case if units are feet. */
 static ParameterScale<double> scale_min_elev_iu(0.0, 30000.0, scale_min_elev_initial_iu, 10, 1);
 static ParameterScale<double> scale_max_elev_iu(1.0, 30000.0, scale_max_elev_initial_iu, 10, 1);
+static ParameterScale<int> scale_contour_interval(10, 1000, SGVariant((int32_t) 100, SGVariantType::Int), 10, 0);
 
 
 
@@ -116,6 +122,7 @@ static WidgetIntEnumerationData dem_drawing_type_enum = {
 	{
 		SGLabelID(QObject::tr("Elevation"), (int) DEMDrawingType::Elevation),
 		SGLabelID(QObject::tr("Gradient"), (int) DEMDrawingType::Gradient),
+		SGLabelID(QObject::tr("Contour Lines"), (int) DEMDrawingType::Contours),
 	},
 	(int) DEMDrawingType::Elevation,
 };
@@ -138,6 +145,7 @@ enum {
 	PARAM_DRAWING_TYPE,
 	PARAM_MIN_ELEV,
 	PARAM_MAX_ELEV,
+	PARAM_CONTOUR_INTERVAL,
 	NUM_PARAMS
 };
 
@@ -151,6 +159,7 @@ static ParameterSpecification dem_layer_param_specs[] = {
 	{ PARAM_DRAWING_TYPE, "type",     SGVariantType::Enumeration,   PARAMETER_GROUP_GENERIC, QObject::tr("Drawing Type:"),    WidgetType::IntEnumeration,  &dem_drawing_type_enum, NULL,           "" },
 	{ PARAM_MIN_ELEV,     "min_elev", SGVariantType::AltitudeType,  PARAMETER_GROUP_GENERIC, QObject::tr("Min Elev:"),        WidgetType::AltitudeWidget,  &scale_min_elev_iu,     NULL,           "" },
 	{ PARAM_MAX_ELEV,     "max_elev", SGVariantType::AltitudeType,  PARAMETER_GROUP_GENERIC, QObject::tr("Max Elev:"),        WidgetType::AltitudeWidget,  &scale_max_elev_iu,     NULL,           "" },
+	{ PARAM_CONTOUR_INTERVAL, "contour_interval", SGVariantType::Int, PARAMETER_GROUP_GENERIC, QObject::tr("Contour Interval (m):"), WidgetType::SpinBoxInt, &scale_contour_interval, NULL,   QObject::tr("Elevation difference between contour lines, used when drawing type is 'Contour Lines'") },
 	{ NUM_PARAMS,         "",         SGVariantType::Empty,         PARAMETER_GROUP_GENERIC, "",                              WidgetType::None,            NULL,                   NULL,           "" }, /* Guard. */
 };
 
@@ -306,27 +315,21 @@ void DEMLoadJob::run(void)
 /**
    \brief Load a group of DEM tiles into program's cache
 
+   The files are loaded in parallel: this job's thread is joined by
+   helper threads from the same (local) thread pool, as many as the
+   pool has available.
+
    \return true when function processed all files (successfully or unsuccessfully)
    \return false if function was interrupted after detecting request for end of processing
 */
 bool DEMLoadJob::load_files_into_cache(void)
 {
-	size_t dem_count = 0;
-	const size_t dem_total = this->file_paths.size();
-
-	for (auto iter = this->file_paths.begin(); iter != this->file_paths.end(); iter++) {
-		if (!DEMCache::load_file_into_cache(*iter)) {
-			qDebug() << SG_PREFIX_E << "Failed to load into cache file" << *iter;
-		}
-
-		dem_count++;
-		/* Progress also detects abort request via the returned value. */
-		const bool end_job = this->set_progress_state(((double) dem_count) / dem_total);
-		if (end_job) {
-			return false; /* Abort thread. */
-		}
-	}
-	return true;
+	return ParallelItems::process(this->file_paths.size(), [this](int idx) {
+			const QString & file_path = this->file_paths.at(idx);
+			if (!DEMCache::load_file_into_cache(file_path)) {
+				qDebug() << SG_PREFIX_E << "Failed to load into cache file" << file_path;
+			}
+		}, this);
 }
 
 
@@ -387,6 +390,13 @@ bool LayerDEM::set_param_value(param_id_t param_id, const SGVariant & param_valu
 		this->dem_drawing_type = (DEMDrawingType) param_value.u.val_int;
 		break;
 
+	case PARAM_CONTOUR_INTERVAL:
+		/* Interval is a divisor in drawing of contour lines, so
+		   value from file (or from anywhere else) is clamped to
+		   valid range. */
+		this->contour_interval = std::min(std::max((int) param_value.u.val_int, scale_contour_interval.min), scale_contour_interval.max);
+		break;
+
 	case PARAM_MIN_ELEV:
 		if (is_file_operation) {
 			/* Value stored in .vik file is always in
@@ -432,9 +442,11 @@ bool LayerDEM::set_param_value(param_id_t param_id, const SGVariant & param_valu
 	case PARAM_FILES: {
 		/* Clear out old settings - if any commonalities with new settings they will have to be read again. */
 		DEMCache::unload_from_cache(this->files);
+		DEMContoursCache::unload(this->files);
 
 		/* Set file list so any other intermediate screen drawing updates will show currently loaded DEMs by the working thread. */
 		this->files = param_value.val_string_list;
+		DEMContoursCache::load(this->files);
 
 		qDebug() << SG_PREFIX_D << "List of files:";
 		if (!this->files.empty()) {
@@ -493,6 +505,10 @@ SGVariant LayerDEM::get_param_value(param_id_t param_id, bool is_file_operation)
 		rv = SGVariant((int32_t) this->dem_drawing_type, dem_layer_param_specs[PARAM_DRAWING_TYPE].type_id);
 		break;
 
+	case PARAM_CONTOUR_INTERVAL:
+		rv = SGVariant((int32_t) this->contour_interval, SGVariantType::Int);
+		break;
+
 	case PARAM_COLOR:
 		rv = SGVariant(this->base_color);
 		break;
@@ -697,14 +713,44 @@ bool LatLonRectCalculator::get_rectangle(const LatLon & counter, QRectF & rect)
 
 
 
+/* Uniform access to elevation samples of either full-resolution DEM
+   or one of its overviews. Drawing code iterates over cells of
+   DEMSamples without caring which of the two it is. */
+class DEMSamples {
+public:
+	DEMSamples() {}
+	DEMSamples(const DEM & dem, const DEMOverview * overview) : m_dem(&dem), m_overview(overview) {}
+
+	int32_t factor(void) const { return this->m_overview ? this->m_overview->factor : 1; }
+	int32_t n_columns(void) const { return this->m_overview ? this->m_overview->n_columns : this->m_dem->n_columns; }
+	int32_t n_rows(int32_t col) const { return this->m_overview ? this->m_overview->n_rows : this->m_dem->columns[col]->m_size; }
+
+	/* Overviews are drawn with mean elevation of a block of samples. */
+	int16_t get_elev(int32_t col, int32_t row) const { return this->m_overview ? this->m_overview->get_mean(col, row) : this->m_dem->columns[col]->m_points[row]; }
+
+private:
+	const DEM * m_dem = nullptr;
+	const DEMOverview * m_overview = nullptr;
+};
+
+
+
+
 /* Maybe 'Bounds' is not the best word. Just a class that holds most
    of constants for drawing DEM in LatLon coordinates. */
 class LatLonBounds {
 public:
 	LatLonBounds(const GisViewport & gisview, const DEM & dem, const LayerDEM & layer);
 
+	/* Full-resolution data or overview, depending on zoom level. */
+	DEMSamples samples;
+
+	/* Step between drawn cells, in cells of this->samples. */
 	unsigned int skip_factor = 0;
+	/* Step between drawn cells, in samples of full-resolution DEM. */
+	unsigned int total_skip_factor = 0;
 
+	/* Size of a cell of this->samples. */
 	double north_scale_deg = 0;
 	double east_scale_deg = 0;
 
@@ -726,10 +772,14 @@ public:
 
 LatLonBounds::LatLonBounds(const GisViewport & gisview, const DEM & dem, const LayerDEM & layer)
 {
-	this->skip_factor = ceil(gisview.get_viking_scale().get_x() / 80); /* TODO_LATER: smarter calculation. */
+	this->total_skip_factor = ceil(gisview.get_viking_scale().get_x() / 80); /* TODO_LATER: smarter calculation. */
+
+	this->samples = DEMSamples(dem, dem.get_overview(this->total_skip_factor));
+	const int32_t factor = this->samples.factor();
+	this->skip_factor = std::max(1, (int) this->total_skip_factor / factor);
 
-	this->north_scale_deg = dem.scale.y / 3600.0;
-	this->east_scale_deg = dem.scale.x / 3600.0;
+	this->north_scale_deg = dem.scale.y * factor / 3600.0;
+	this->east_scale_deg = dem.scale.x * factor / 3600.0;
 
 	const LatLonBBox viewport_bbox = gisview.get_bbox();
 	double start_lat_arcsec = std::max(viewport_bbox.south.value() * 3600.0, dem.min_north_seconds);
@@ -737,12 +787,18 @@ LatLonBounds::LatLonBounds(const GisViewport & gisview, const DEM & dem, const L
 	double start_lon_arcsec = std::max(viewport_bbox.west.unbound_value() * 3600.0, dem.min_east_seconds);
 	double end_lon_arcsec   = std::min(viewport_bbox.east.unbound_value() * 3600.0, dem.max_east_seconds);
 
-	this->start_lat = floor(start_lat_arcsec / dem.scale.y) * north_scale_deg;
-	this->end_lat   = ceil(end_lat_arcsec / dem.scale.y) * north_scale_deg;
-	this->start_lon = floor(start_lon_arcsec / dem.scale.x) * east_scale_deg;
-	this->end_lon   = ceil(end_lon_arcsec / dem.scale.x) * east_scale_deg;
+	int32_t full_res_col = 0;
+	int32_t full_res_row = 0;
+	dem.east_north_to_col_row(start_lon_arcsec, start_lat_arcsec, &full_res_col, &full_res_row);
+	this->start_col = full_res_col / factor;
+	this->start_row = full_res_row / factor;
 
-	dem.east_north_to_col_row(start_lon_arcsec, start_lat_arcsec, &this->start_col, &this->start_row);
+	/* Cell of overview is drawn at center of block of samples that it covers. */
+	const double center_offset = (factor - 1) / 2.0;
+	this->start_lat = (dem.min_north_seconds + (this->start_row * factor + center_offset) * dem.scale.y) / 3600.0;
+	this->end_lat   = ceil(end_lat_arcsec / dem.scale.y) * dem.scale.y / 3600.0;
+	this->start_lon = (dem.min_east_seconds + (this->start_col * factor + center_offset) * dem.scale.x) / 3600.0;
+	this->end_lon   = ceil(end_lon_arcsec / dem.scale.x) * dem.scale.x / 3600.0;
 
 	if (layer.dem_drawing_type == DEMDrawingType::Gradient) {
 		this->gradient_skip_factor = this->skip_factor;
@@ -757,15 +813,15 @@ LatLonBounds::LatLonBounds(const GisViewport & gisview, const DEM & dem, const L
 
 class LatLonIter {
 public:
-	void begin_x(const LatLonBounds & bounds)                  { this->col = bounds.start_col;          this->lat_lon.lon = bounds.start_lon; }
+	void begin_x(const LatLonBounds & bounds) { this->col = bounds.start_col;          this->lat_lon.lon = bounds.start_lon; }
 	/* NOTE: (iter.lat_lon.lon <= bounds.end_lon + bounds.east_scale_deg * bounds.skip_factor) is neccessary so in high zoom modes,
 	   the leftmost column does also get drawn, if the center point is out of viewport. */
-	bool valid_x(const LatLonBounds & bounds, const DEM & dem) { return (this->col < dem.n_columns) && (this->lat_lon.lon <= bounds.end_lon + bounds.east_scale_deg * bounds.skip_factor); }
-	void inc_x(const LatLonBounds & bounds)                    { this->col += bounds.skip_factor;       this->lat_lon.lon += bounds.east_scale_deg * bounds.skip_factor; }
+	bool valid_x(const LatLonBounds & bounds) { return (this->col < bounds.samples.n_columns()) && (this->lat_lon.lon <= bounds.end_lon + bounds.east_scale_deg * bounds.skip_factor); }
+	void inc_x(const LatLonBounds & bounds)   { this->col += bounds.skip_factor;       this->lat_lon.lon += bounds.east_scale_deg * bounds.skip_factor; }
 
-	void begin_y(const LatLonBounds & bounds)                  { this->row = bounds.start_row;                             this->lat_lon.lat = bounds.start_lat; }
-	bool valid_y(const LatLonBounds & bounds, const DEM & dem) { return (this->row < dem.columns[this->col]->m_size) && (this->lat_lon.lat <= bounds.end_lat); }
-	void inc_y(const LatLonBounds & bounds)                    { this->row += bounds.skip_factor;                          this->lat_lon.lat += bounds.north_scale_deg * bounds.skip_factor; }
+	void begin_y(const LatLonBounds & bounds) { this->row = bounds.start_row;                                   this->lat_lon.lat = bounds.start_lat; }
+	bool valid_y(const LatLonBounds & bounds) { return (this->row < bounds.samples.n_rows(this->col)) && (this->lat_lon.lat <= bounds.end_lat); }
+	void inc_y(const LatLonBounds & bounds)   { this->row += bounds.skip_factor;                                this->lat_lon.lat += bounds.north_scale_deg * bounds.skip_factor; }
 
 	LatLon lat_lon;
 	int32_t col = 0;
@@ -804,44 +860,27 @@ int16_t ElevationCalculator::calculate_elevation(int16_t elev, const DEMMinMax &
 
 class GradientCalculator {
 public:
-	class Columns {
-	public:
-		Columns(const DEM & dem, int32_t col, int32_t gradient_skip_factor)
-		{
-			/* Get previous and next column. Catch out-of-bound. */
-			this->cur_column = dem.columns[col];
-
-
-			int32_t prev_col = col - gradient_skip_factor;
-			if (prev_col < 0) {
-				prev_col = 0;
-			}
-			this->prev_column = dem.columns[prev_col];
-
-
-			int32_t next_col = col + gradient_skip_factor;
-			if (next_col >= dem.n_columns) {
-				next_col = dem.n_columns - 1;
-			}
-			this->next_column = dem.columns[next_col];
-		}
-
-		DEMColumn * cur_column = nullptr;
-		DEMColumn * prev_column = nullptr;
-		DEMColumn * next_column = nullptr;
-	};
-
 	/* Calculate and sum gradient in all directions. */
-	static int16_t calculate_gradient(int16_t elev, const DEM & dem, int32_t row, int32_t col, const LatLonBounds & bounds);
+	static int16_t calculate_gradient(int16_t elev, int32_t row, int32_t col, const LatLonBounds & bounds);
 };
 
 
 
 
-int16_t GradientCalculator::calculate_gradient(int16_t elev, const DEM & dem, int32_t row, int32_t col, const LatLonBounds & bounds)
+int16_t GradientCalculator::calculate_gradient(int16_t elev, int32_t row, int32_t col, const LatLonBounds & bounds)
 {
 	int16_t result = 0;
-	const GradientCalculator::Columns cols(dem, col, bounds.gradient_skip_factor);
+	const DEMSamples & samples = bounds.samples;
+
+	/* Get previous and next column. Catch out-of-bound. */
+	int32_t prev_col = col - bounds.gradient_skip_factor;
+	if (prev_col < 0) {
+		prev_col = 0;
+	}
+	int32_t next_col = col + bounds.gradient_skip_factor;
+	if (next_col >= samples.n_columns()) {
+		next_col = samples.n_columns() - 1;
+	}
 
 	/* Calculate gradient from height points all around the current one. */
 	{
@@ -851,27 +890,27 @@ int16_t GradientCalculator::calculate_gradient(int16_t elev, const DEM & dem, in
 		} else {
 			prev_row = row - bounds.gradient_skip_factor;
 		}
-		result += get_height_difference(elev, cols.prev_column->m_points[prev_row]);
-		result += get_height_difference(elev, cols.cur_column->m_points[prev_row]);
-		result += get_height_difference(elev, cols.next_column->m_points[prev_row]);
+		result += get_height_difference(elev, samples.get_elev(prev_col, prev_row));
+		result += get_height_difference(elev, samples.get_elev(col, prev_row));
+		result += get_height_difference(elev, samples.get_elev(next_col, prev_row));
 	}
 
 	{
-		result += get_height_difference(elev, cols.prev_column->m_points[row]);
-		result += get_height_difference(elev, cols.next_column->m_points[row]);
+		result += get_height_difference(elev, samples.get_elev(prev_col, row));
+		result += get_height_difference(elev, samples.get_elev(next_col, row));
 	}
 
 	{
 		int32_t next_row = row + bounds.gradient_skip_factor;
-		if (next_row >= cols.cur_column->m_size) {
+		if (next_row >= samples.n_rows(col)) {
 			next_row = row;
 		}
-		result += get_height_difference(elev, cols.prev_column->m_points[next_row]);
-		result += get_height_difference(elev, cols.cur_column->m_points[next_row]);
-		result += get_height_difference(elev, cols.next_column->m_points[next_row]);
+		result += get_height_difference(elev, samples.get_elev(prev_col, next_row));
+		result += get_height_difference(elev, samples.get_elev(col, next_row));
+		result += get_height_difference(elev, samples.get_elev(next_col, next_row));
 	}
 
-	result = result / ((bounds.skip_factor > 1) ? log(bounds.skip_factor) : 0.55); /* FIXME: better calc. */
+	result = result / ((bounds.total_skip_factor > 1) ? log(bounds.total_skip_factor) : 0.55); /* FIXME: better calc. */
 
 	/* Prevent value to be too small/too large, so it can safely be used as array index. */
 	if (result < bounds.min_max.min_elevation) {
@@ -898,10 +937,10 @@ void LayerDEM::draw_dem_lat_lon(GisViewport * gisview, const DEM & dem)
 	const LatLonRectCalculator rect_calculator(gisview->get_coord_mode(), bounds.north_scale_deg, bounds.east_scale_deg, gisview, bounds.skip_factor);
 
 	LatLonIter iter;
-	for (iter.begin_x(bounds); iter.valid_x(bounds, dem); iter.inc_x(bounds)) {
-		for (iter.begin_y(bounds); iter.valid_y(bounds, dem); iter.inc_y(bounds)) {
+	for (iter.begin_x(bounds); iter.valid_x(bounds); iter.inc_x(bounds)) {
+		for (iter.begin_y(bounds); iter.valid_y(bounds); iter.inc_y(bounds)) {
 
-			int16_t elev = dem.columns[iter.col]->m_points[iter.row];
+			int16_t elev = bounds.samples.get_elev(iter.col, iter.row);
 			if (elev == DEM::invalid_elevation) {
 				continue; /* Don't draw invalid elevation. */
 			}
@@ -914,7 +953,7 @@ void LayerDEM::draw_dem_lat_lon(GisViewport * gisview, const DEM & dem)
 
 			if (this->dem_drawing_type == DEMDrawingType::Gradient) {
 
-				int16_t change = GradientCalculator::calculate_gradient(elev, dem, iter.row, iter.col, bounds);
+				int16_t change = GradientCalculator::calculate_gradient(elev, iter.row, iter.col, bounds);
 
 				int idx = get_palette_index(change, bounds.min_max, this->gradients.size());
 				gisview->fill_rectangle(this->gradients.m_values[idx], rect);
@@ -945,8 +984,16 @@ public:
 	UTMBounds() {}
 	sg_ret init(const GisViewport & gisview, const DEM & dem, const LayerDEM & layer);
 
+	/* Full-resolution data or overview, depending on zoom level. */
+	DEMSamples samples;
+
+	/* Step between drawn cells, in cells of this->samples. */
 	unsigned int skip_factor = 0;
 
+	/* Size of a cell of this->samples, in meters. */
+	double cell_x = 0;
+	double cell_y = 0;
+
 	double start_eas = 0;
 	double end_eas   = 0;
 	double start_nor = 0;
@@ -971,13 +1018,13 @@ public:
 		this->utm = UTM(NAN, NAN, dem.utm.zone(), dem.utm.band_letter());
 	}
 
-	void begin_x(const UTMBounds & bounds)                  { this->col = bounds.start_col;                             this->utm.set_easting(bounds.start_eas); }
-	bool valid_x(const UTMBounds & bounds, const DEM & dem) { return (this->col >= 0 && this->col < dem.n_columns)  && (this->utm.get_easting() <= bounds.end_eas); }
-	void inc_x(const UTMBounds & bounds, const DEM & dem)   { this->col += bounds.skip_factor;                          this->utm.shift_easting_by(dem.scale.x * bounds.skip_factor); }
+	void begin_x(const UTMBounds & bounds) { this->col = bounds.start_col;                                        this->utm.set_easting(bounds.start_eas); }
+	bool valid_x(const UTMBounds & bounds) { return (this->col >= 0 && this->col < bounds.samples.n_columns())  && (this->utm.get_easting() <= bounds.end_eas); }
+	void inc_x(const UTMBounds & bounds)   { this->col += bounds.skip_factor;                                     this->utm.shift_easting_by(bounds.cell_x * bounds.skip_factor); }
 
-	void begin_y(const UTMBounds & bounds)                  { this->row = bounds.start_row;                                             this->utm.set_northing(bounds.start_nor); }
-	bool valid_y(const UTMBounds & bounds, const DEM & dem) { return (this->row >= 0 && this->row < dem.columns[this->col]->m_size) && (this->utm.get_northing() <= bounds.end_nor); }
-	void inc_y(const UTMBounds & bounds, const DEM & dem)   { this->row += bounds.skip_factor;                                          this->utm.shift_northing_by(dem.scale.y * bounds.skip_factor);  }
+	void begin_y(const UTMBounds & bounds) { this->row = bounds.start_row;                                                  this->utm.set_northing(bounds.start_nor); }
+	bool valid_y(const UTMBounds & bounds) { return (this->row >= 0 && this->row < bounds.samples.n_rows(this->col)) && (this->utm.get_northing() <= bounds.end_nor); }
+	void inc_y(const UTMBounds & bounds)   { this->row += bounds.skip_factor;                                               this->utm.shift_northing_by(bounds.cell_y * bounds.skip_factor);  }
 
 	UTM utm;
 	int32_t col = 0;
@@ -989,7 +1036,13 @@ public:
 
 sg_ret UTMBounds::init(const GisViewport & gisview, const DEM & dem, const LayerDEM & layer)
 {
-	this->skip_factor = ceil(gisview.get_viking_scale().get_x() / 10); /* TODO_LATER: smarter calculation. */
+	const unsigned int total_skip_factor = ceil(gisview.get_viking_scale().get_x() / 10); /* TODO_LATER: smarter calculation. */
+
+	this->samples = DEMSamples(dem, dem.get_overview(total_skip_factor));
+	const int32_t factor = this->samples.factor();
+	this->skip_factor = std::max(1, (int) total_skip_factor / factor);
+	this->cell_x = dem.scale.x * factor;
+	this->cell_y = dem.scale.y * factor;
 
 	Coord coord_ul = gisview.screen_corner_to_coord(ScreenCorner::UpperLeft);
 	Coord coord_ur = gisview.screen_corner_to_coord(ScreenCorner::UpperRight);
@@ -1029,14 +1082,19 @@ sg_ret UTMBounds::init(const GisViewport & gisview, const DEM & dem, const Layer
 		this->end_eas = dem.max_east_seconds;
 	}
 
-	this->start_nor = floor(this->start_nor / dem.scale.y) * dem.scale.y;
+	int32_t full_res_col = 0;
+	int32_t full_res_row = 0;
+	dem.east_north_to_col_row(this->start_eas, this->start_nor, &full_res_col, &full_res_row);
+	this->start_col = full_res_col / factor;
+	this->start_row = full_res_row / factor;
+
+	/* Cell of overview is drawn at center of block of samples that it covers. */
+	const double center_offset = (factor - 1) / 2.0;
+	this->start_nor = dem.min_north_seconds + (this->start_row * factor + center_offset) * dem.scale.y;
 	this->end_nor   = ceil(this->end_nor / dem.scale.y) * dem.scale.y;
-	this->start_eas = floor(this->start_eas / dem.scale.x) * dem.scale.x;
+	this->start_eas = dem.min_east_seconds + (this->start_col * factor + center_offset) * dem.scale.x;
 	this->end_eas   = ceil(this->end_eas / dem.scale.x) * dem.scale.x;
 
-
-	dem.east_north_to_col_row(start_eas, start_nor, &this->start_col, &this->start_row);
-
 	this->min_max.min_elevation = layer.min_elev.ll_value();
 	this->min_max.max_elevation = layer.max_elev.ll_value();
 
@@ -1056,10 +1114,10 @@ void LayerDEM::draw_dem_utm(GisViewport * gisview, const DEM & dem)
 	const CoordMode viewport_coord_mode = gisview->get_coord_mode();
 	UTMIter iter(dem);
 
-	for (iter.begin_x(bounds); iter.valid_x(bounds, dem); iter.inc_x(bounds, dem)) {
-		for (iter.begin_y(bounds); iter.valid_y(bounds, dem); iter.inc_y(bounds, dem)) {
+	for (iter.begin_x(bounds); iter.valid_x(bounds); iter.inc_x(bounds)) {
+		for (iter.begin_y(bounds); iter.valid_y(bounds); iter.inc_y(bounds)) {
 
-			int16_t elev = dem.columns[iter.col]->m_points[iter.row];
+			int16_t elev = bounds.samples.get_elev(iter.col, iter.row);
 			if (elev == DEM::invalid_elevation) {
 				continue; /* Don't draw invalid elevation. */
 			}
@@ -1084,6 +1142,144 @@ void LayerDEM::draw_dem_utm(GisViewport * gisview, const DEM & dem)
 
 
 
+/* Every n-th contour line is drawn thicker and is labelled. */
+#define CONTOUR_INDEX_LINE_STEP 5
+/* Index contour lines shorter than this (in pixels) are not labelled. */
+#define CONTOUR_LABEL_MIN_LENGTH 100
+
+
+
+
+static void draw_contour_label(QPainter & painter, const QPolygonF & polyline, const QString & label)
+{
+	double length = 0.0;
+	for (int i = 1; i < polyline.size(); i++) {
+		length += QLineF(polyline[i - 1], polyline[i]).length();
+	}
+	if (length < CONTOUR_LABEL_MIN_LENGTH) {
+		return;
+	}
+
+	/* Put the label on segment that contains middle point of the line. */
+	double distance = 0.0;
+	for (int i = 1; i < polyline.size(); i++) {
+		const QLineF segment(polyline[i - 1], polyline[i]);
+		distance += segment.length();
+		if (distance < length / 2) {
+			continue;
+		}
+
+		/* Keep text upright. */
+		double angle = atan2(segment.dy(), segment.dx()) * 180.0 / M_PI;
+		if (angle > 90.0) {
+			angle -= 180.0;
+		} else if (angle < -90.0) {
+			angle += 180.0;
+		}
+
+		painter.save();
+		painter.translate(segment.center());
+		painter.rotate(angle);
+		painter.drawText(QRectF(-CONTOUR_LABEL_MIN_LENGTH / 2, -10, CONTOUR_LABEL_MIN_LENGTH, 20), Qt::AlignCenter, label);
+		painter.restore();
+		break;
+	}
+}
+
+
+
+
+void LayerDEM::draw_dem_contours(GisViewport * gisview, const QString & dem_file_path, const std::shared_ptr<DEM> & dem)
+{
+	const LatLonBBox viewport_bbox = gisview->get_bbox();
+	if (!dem->intersect(viewport_bbox)) {
+		qDebug() << SG_PREFIX_I << "DEM does not overlap with viewport, not drawing contour lines";
+		return;
+	}
+
+	/* Trace contours on grid with cells not larger than ~2
+	   pixels: full-resolution DEM when zoomed in, one of
+	   overviews when zoomed out. */
+	double cell_size_m = dem->scale.y;
+	if (dem->horiz_units == DEMHorizontalUnit::LatLonArcSeconds) {
+		cell_size_m = DEG2RAD(dem->scale.y / 3600.0) * 6378137;
+	}
+	const int32_t wanted_factor = std::max(1, (int) floor(2 * gisview->get_viking_scale().get_x() / cell_size_m));
+	const DEMOverview * overview = dem->get_overview(wanted_factor);
+	const int32_t factor = overview ? overview->factor : 1;
+
+	if (DEMContoursCache::request(dem_file_path, this->contour_interval, factor)) {
+		DEMContoursJob * job = new DEMContoursJob(dem_file_path, dem, this->contour_interval, factor);
+		job->set_description(QObject::tr("Generating DEM contour lines"));
+		QObject::connect(job, SIGNAL (contours_ready(void)), this, SLOT (on_contours_ready_cb(void)));
+		job->run_in_background(ThreadPoolType::Local);
+	}
+
+	/* Until the requested contours are ready, draw contours generated for other zoom level (if any). */
+	std::shared_ptr<const DEMContours> contours = DEMContoursCache::get(dem_file_path, this->contour_interval, factor);
+	if (!contours) {
+		qDebug() << SG_PREFIX_I << "Contour lines for" << dem_file_path << "not generated yet";
+		return;
+	}
+
+	/* Conversion of vertices to coordinates in viewport's
+	   coord mode is done once, only projection to screen is
+	   done in each frame. */
+	const std::shared_ptr<const std::vector<std::vector<Coord>>> coords = contours->get_coords(*dem, gisview->get_coord_mode());
+
+	const QColor contour_color(0x8b, 0x45, 0x13);
+	const QPen pen(contour_color, 1);
+	const QPen index_pen(contour_color, 2);
+
+	QPainter & painter = gisview->get_painter();
+	std::vector<const Coord *> line_coords;
+	std::vector<ScreenPos> positions;
+	QPolygonF polyline;
+
+	for (size_t i = 0; i < contours->lines.size(); i++) {
+		const DEMContourLine & line = contours->lines[i];
+		if (!viewport_bbox.intersects_with(line.bbox)) {
+			continue;
+		}
+
+		line_coords.clear();
+		for (const Coord & coord : (*coords)[i]) {
+			line_coords.push_back(&coord);
+		}
+		/* Positions of points that can't be projected are NaN, they are handled below. */
+		gisview->coords_to_screen_pos(line_coords, positions);
+
+		const bool is_index_line = 0 == (line.elevation % (CONTOUR_INDEX_LINE_STEP * this->contour_interval));
+		painter.setPen(is_index_line ? index_pen : pen);
+		const Altitude elevation(line.elevation, AltitudeType::Unit::E::Metres);
+		const QString label = is_index_line ? elevation.convert_to_unit(Preferences::get_unit_height()).to_string() : QString();
+
+		/* Line is split at points that can't be projected,
+		   so that the gap isn't bridged with straight line. */
+		polyline.clear();
+		for (size_t p = 0; p <= positions.size(); p++) {
+			if (p < positions.size() && !std::isnan(positions[p].x()) && !std::isnan(positions[p].y())) {
+				polyline << QPointF(positions[p].x(), positions[p].y());
+				continue;
+			}
+
+			if (polyline.size() > 1) {
+				painter.drawPolyline(polyline);
+				if (is_index_line) {
+					draw_contour_label(painter, polyline, label);
+				}
+			}
+			polyline.clear();
+		}
+	}
+
+	/* Reset painter. */
+	painter.setPen(QPen());
+}
+
+
+
+
 void draw_loaded_dem_box(__attribute__((unused)) GisViewport * gisview)
 {
 #ifdef TODO_LATER
@@ -1135,31 +1331,41 @@ const QString srtm_file_name(int lat, int lon)
 
 
 
-/* Return the continent for the specified lat, lon. */
-static bool srtm_get_continent_dir(QString & continent_dir, int lat, int lon)
+/* Coords -> continent. */
+static QHash<QString, QString> srtm_create_continents(void)
 {
-	static QHash<QString, QString> continents; /* Coords -> continent. */
-
 	extern const char *_srtm_continent_data[];
 
-	if (continents.isEmpty()) {
+	QHash<QString, QString> continents;
 
-		const char ** s = _srtm_continent_data;
-		while (*s != (char *)-1) {
-			const char * continent = *s++;
-			while (*s) {
-				continents.insert(QString(*s), QString(continent));
-				s++;
-			}
+	const char ** s = _srtm_continent_data;
+	while (*s != (char *)-1) {
+		const char * continent = *s++;
+		while (*s) {
+			continents.insert(QString(*s), QString(continent));
 			s++;
 		}
+		s++;
 	}
 
+	return continents;
+}
+
+
+
+/* Return the continent for the specified lat, lon. */
+static bool srtm_get_continent_dir(QString & continent_dir, int lat, int lon)
+{
+	/* Initialization of static local variable is thread-safe,
+	   and the function is called by DEM layers drawn in worker
+	   threads. */
+	static const QHash<QString, QString> continents = srtm_create_continents();
+
 	QString coords = srtm_file_name(lat, lon);
 	coords.remove(".hgt.zip");
 
-	auto iter = continents.find(coords);
-	if (iter == continents.end()) {
+	auto iter = continents.constFind(coords);
+	if (iter == continents.constEnd()) {
 		return false;
 	} else {
 		continent_dir = *iter;
@@ -1181,7 +1387,12 @@ void LayerDEM::draw_tree_item(GisViewport * gisview, __attribute__((unused)) boo
 #endif
 	}
 
+	const LatLonBBox viewport_bbox = gisview->get_bbox();
 	for (auto iter = this->files.begin(); iter != this->files.end(); iter++) {
+		if (gisview->render_is_cancelled()) {
+			qDebug() << SG_PREFIX_I << "Drawing of DEM files has been cancelled";
+			return;
+		}
 
 		/* FIXME: dereferencing this iterator may fail when two things happen at the same time:
 		   - layer is drawn,
@@ -1198,12 +1409,17 @@ void LayerDEM::draw_tree_item(GisViewport * gisview, __attribute__((unused)) boo
 		   is executed, the iter becomes invalid and
 		   dereferencing it crashes the program. */
 		const QString dem_file_path = *iter;
-		DEM * dem = DEMCache::get(dem_file_path);
+		/* DEMs outside of viewport are not brought back to memory if they have been evicted from cache. */
+		std::shared_ptr<DEM> dem = DEMCache::get(dem_file_path, viewport_bbox);
 		if (dem) {
 			qDebug() << SG_PREFIX_I << "Got file" << dem_file_path << "from cache, will now draw it";
-			this->draw_dem(gisview, *dem);
+			if (this->dem_drawing_type == DEMDrawingType::Contours) {
+				this->draw_dem_contours(gisview, dem_file_path, dem);
+			} else {
+				this->draw_dem(gisview, *dem);
+			}
 		} else {
-			qDebug() << SG_PREFIX_E << "Failed to get file" << dem_file_path << "from cache, not drawing";
+			qDebug() << SG_PREFIX_I << "File" << dem_file_path << "not available in cache or not in viewport, not drawing";
 		}
 	}
 }
@@ -1211,6 +1427,15 @@ void LayerDEM::draw_tree_item(GisViewport * gisview, __attribute__((unused)) boo
 
 
 
+bool LayerDEM::supports_parallel_drawing(void) const
+{
+	/* Contour lines are generated by background jobs started during drawing. */
+	return this->dem_drawing_type != DEMDrawingType::Contours;
+}
+
+
+
+
 LayerDEM::LayerDEM()
 {
 	qDebug() << SG_PREFIX_I << "LayerDEM::LayerDEM()";
@@ -1233,6 +1458,7 @@ LayerDEM::LayerDEM()
 LayerDEM::~LayerDEM()
 {
 	DEMCache::unload_from_cache(this->files);
+	DEMContoursCache::unload(this->files);
 	this->files.clear();
 }
 
@@ -1503,6 +1729,7 @@ bool LayerDEM::add_file(const QString & dem_file_full_path)
 			this->files.push_front(dem_file_full_path);
 			qDebug () << SG_PREFIX_I << "Will now load file" << dem_file_full_path << "from cache";
 			DEMCache::load_file_into_cache(dem_file_full_path);
+			DEMContoursCache::load(QStringList(dem_file_full_path));
 		} else {
 			qDebug() << SG_PREFIX_I << dem_file_full_path << ": file size is zero";
 		}
@@ -1737,7 +1964,16 @@ static bool dem_layer_download_click(__attribute__((unused)) Layer * vdl, __attr
 void LayerDEM::on_loading_to_cache_completed_cb(void)
 {
 	qDebug() << SG_PREFIX_SIGNAL << "Will emit 'layer changed' after loading list of files";
-	this->emit_tree_item_changed("DEM - loading to cache completed");
+	this->emit_tree_item_changed_in_background("DEM - loading to cache completed");
+}
+
+
+
+
+void LayerDEM::on_contours_ready_cb(void)
+{
+	qDebug() << SG_PREFIX_SIGNAL << "Will emit 'layer changed' after generating contour lines";
+	this->emit_tree_item_changed_in_background("DEM - contour lines generated");
 }
 
 
@@ -1749,7 +1985,7 @@ sg_ret LayerDEM::handle_downloaded_file_cb(const QString & file_full_path)
 
 	if (this->add_file(file_full_path)) {
 		qDebug() << SG_PREFIX_SIGNAL << "Will emit 'layer changed' after downloading file";
-		this->emit_tree_item_changed("Indicating change to DEM Layer after downloading a file");
+		this->emit_tree_item_changed_in_background("Indicating change to DEM Layer after downloading a file");
 	}
 
 	return sg_ret::ok;
@@ -26,6 +26,7 @@
 
 
 #include <vector>
+#include <memory>
 
 
 
@@ -55,6 +56,7 @@ namespace SlavGPS {
 	enum class DEMDrawingType {
 		Elevation = 0,
 		Gradient,
+		Contours,
 	};
 
 
@@ -89,6 +91,7 @@ namespace SlavGPS {
 
 		/* Layer interface methods. */
 		void draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+		bool supports_parallel_drawing(void) const override;
 		QString get_tooltip(void) const;
 		bool add_file(const QString & dem_file_path);
 		void draw_dem(GisViewport * gisview, const DEM & dem);
@@ -97,6 +100,7 @@ namespace SlavGPS {
 
 		void draw_dem_lat_lon(GisViewport * gisview, const DEM & dem);
 		void draw_dem_utm(GisViewport * gisview, const DEM & dem);
+		void draw_dem_contours(GisViewport * gisview, const QString & dem_file_path, const std::shared_ptr<DEM> & dem);
 		bool download_selected_tile(const QMouseEvent * event, const LayerTool * tool);
 
 		DEMPalette colors;
@@ -111,6 +115,7 @@ namespace SlavGPS {
 		QColor base_color; /* Minimum elevation color, selected in layer's properties window. */
 		DEMSource dem_source = DEMSource::SRTM;
 		DEMDrawingType dem_drawing_type = DEMDrawingType::Elevation;
+		int contour_interval = 100; /* Meters. */
 
 
 	public slots:
@@ -119,6 +124,7 @@ namespace SlavGPS {
 	private slots:
 		void location_info_cb(void);
 		void on_loading_to_cache_completed_cb(void);
+		void on_contours_ready_cb(void);
 	};
 
 
@@ -0,0 +1,691 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+
+
+
+#include <QDebug>
+
+
+
+
+#include "layer_dem_contours.h"
+#include "coords.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "DEM Contours"
+
+
+
+
+/* Max distance (in cells of sampled grid) between simplified contour line and original contour line. */
+#define CONTOUR_SIMPLIFICATION_TOLERANCE 0.5
+
+/* Limit of total count of points of contour lines in cache. */
+#define CONTOURS_CACHE_MAX_POINTS (4 * 1000 * 1000)
+
+
+
+
+/* Piece of contour line crossing one cell of grid. Ends of the
+   piece are identified by edges of grid that they lie on. */
+struct ContourSegment {
+	uint64_t edge_a;
+	uint64_t edge_b;
+};
+
+
+
+
+/* Edges of a cell that are crossed by contour line, for each
+   combination of corners above contour level (bit 0: south-west
+   corner, bit 1: south-east, bit 2: north-east, bit 3: north-west).
+
+   Edges are numbered 0: south, 1: east, 2: north, 3: west.
+
+   Cases 5 and 10 are saddles. Entries in the table are valid when
+   center of the cell is above contour level. When the center is
+   below the level, entries of the other saddle case are used. */
+static const int8_t cell_segments[16][4] = {
+	{ -1, -1, -1, -1 },
+	{  3,  0, -1, -1 },
+	{  0,  1, -1, -1 },
+	{  3,  1, -1, -1 },
+	{  1,  2, -1, -1 },
+	{  0,  1,  2,  3 },
+	{  0,  2, -1, -1 },
+	{  2,  3, -1, -1 },
+	{  2,  3, -1, -1 },
+	{  0,  2, -1, -1 },
+	{  3,  0,  1,  2 },
+	{  1,  2, -1, -1 },
+	{  3,  1, -1, -1 },
+	{  0,  1, -1, -1 },
+	{  3,  0, -1, -1 },
+	{ -1, -1, -1, -1 },
+};
+
+
+
+
+/* Grid of elevations on which contours are traced: either
+   full-resolution DEM data or one of DEM's overviews. */
+class ContourGrid {
+public:
+	ContourGrid(const DEM & dem, const DEMOverview * overview);
+
+	int16_t get_elev(int32_t col, int32_t row) const;
+
+	/* Edge between (col, row) and (col + 1, row). */
+	uint64_t horizontal_edge(int32_t col, int32_t row) const { return 2 * ((uint64_t) row * this->n_columns + col); }
+	/* Edge between (col, row) and (col, row + 1). */
+	uint64_t vertical_edge(int32_t col, int32_t row) const { return 2 * ((uint64_t) row * this->n_columns + col) + 1; }
+
+	/* Position (in cells of grid) at which contour line of given level crosses given edge. */
+	QPointF edge_point(uint64_t edge, int level) const;
+
+	int32_t n_columns = 0;
+	int32_t n_rows = 0;
+
+private:
+	const DEM & m_dem;
+	const DEMOverview * m_overview = NULL;
+};
+
+
+
+
+ContourGrid::ContourGrid(const DEM & dem, const DEMOverview * overview) : m_dem(dem), m_overview(overview)
+{
+	if (this->m_overview) {
+		this->n_columns = this->m_overview->n_columns;
+		this->n_rows = this->m_overview->n_rows;
+	} else {
+		this->n_columns = this->m_dem.n_columns;
+		for (int32_t col = 0; col < this->m_dem.n_columns; col++) {
+			this->n_rows = std::max(this->n_rows, this->m_dem.columns[col]->m_size);
+		}
+	}
+}
+
+
+
+
+int16_t ContourGrid::get_elev(int32_t col, int32_t row) const
+{
+	if (this->m_overview) {
+		/* Overview cells represent mean elevation of block of samples. */
+		return this->m_overview->get_mean(col, row);
+	}
+
+	/* Columns of some DEMs (DEM24k) may have different sizes. */
+	const DEMColumn * column = this->m_dem.columns[col];
+	if (row >= column->m_size) {
+		return DEM::invalid_elevation;
+	}
+	return column->m_points[row];
+}
+
+
+
+
+QPointF ContourGrid::edge_point(uint64_t edge, int level) const
+{
+	const uint64_t cell = edge / 2;
+	const int32_t col = cell % this->n_columns;
+	const int32_t row = cell / this->n_columns;
+
+	/* Contour line crosses only edges with one end below and
+	   one end at/above the level, so v1 != v0. */
+	if (edge % 2 == 0) {
+		const int16_t v0 = this->get_elev(col, row);
+		const int16_t v1 = this->get_elev(col + 1, row);
+		return QPointF(col + (level - v0) / (double) (v1 - v0), row);
+	} else {
+		const int16_t v0 = this->get_elev(col, row);
+		const int16_t v1 = this->get_elev(col, row + 1);
+		return QPointF(col, row + (level - v0) / (double) (v1 - v0));
+	}
+}
+
+
+
+
+static double squared_distance_to_segment(const QPointF & point, const QPointF & a, const QPointF & b)
+{
+	const double dx = b.x() - a.x();
+	const double dy = b.y() - a.y();
+	const double len2 = dx * dx + dy * dy;
+
+	double t = 0.0;
+	if (len2 > 0.0) {
+		t = ((point.x() - a.x()) * dx + (point.y() - a.y()) * dy) / len2;
+		t = std::max(0.0, std::min(1.0, t));
+	}
+
+	const double px = a.x() + t * dx - point.x();
+	const double py = a.y() + t * dy - point.y();
+	return px * px + py * py;
+}
+
+
+
+
+static void simplify_line(const std::vector<QPointF> & input, double tolerance, std::vector<QPointF> & output)
+{
+	output.clear();
+	if (input.size() < 3) {
+		output = input;
+		return;
+	}
+
+	std::vector<bool> keep(input.size(), false);
+	keep.front() = true;
+	keep.back() = true;
+
+	const double tolerance2 = tolerance * tolerance;
+
+	/* Iterative Douglas-Peucker: long contour lines would make recursion too deep. */
+	std::vector<std::pair<size_t, size_t>> ranges;
+	ranges.push_back(std::make_pair((size_t) 0, input.size() - 1));
+	while (!ranges.empty()) {
+		const size_t first = ranges.back().first;
+		const size_t last = ranges.back().second;
+		ranges.pop_back();
+
+		double max_distance2 = 0.0;
+		size_t max_idx = first;
+		for (size_t i = first + 1; i < last; i++) {
+			const double distance2 = squared_distance_to_segment(input[i], input[first], input[last]);
+			if (distance2 > max_distance2) {
+				max_distance2 = distance2;
+				max_idx = i;
+			}
+		}
+
+		if (max_distance2 > tolerance2) {
+			keep[max_idx] = true;
+			ranges.push_back(std::make_pair(first, max_idx));
+			ranges.push_back(std::make_pair(max_idx, last));
+		}
+	}
+
+	for (size_t i = 0; i < input.size(); i++) {
+		if (keep[i]) {
+			output.push_back(input[i]);
+		}
+	}
+}
+
+
+
+
+/* Join segments of contour lines of one level into chains of edges. */
+static void stitch_segments(const std::vector<ContourSegment> & segments, std::vector<std::deque<uint64_t>> & chains)
+{
+	/* Each edge is shared by at most two segments (one in each neighbouring cell). */
+	std::unordered_map<uint64_t, std::pair<int, int>> segments_at_edge;
+	segments_at_edge.reserve(segments.size() * 2);
+	for (size_t i = 0; i < segments.size(); i++) {
+		for (const uint64_t edge : { segments[i].edge_a, segments[i].edge_b }) {
+			auto & slot = segments_at_edge.emplace(edge, std::make_pair(-1, -1)).first->second;
+			if (slot.first == -1) {
+				slot.first = i;
+			} else {
+				slot.second = i;
+			}
+		}
+	}
+
+	std::vector<bool> used(segments.size(), false);
+	auto get_next_segment = [&](uint64_t edge) {
+		const std::pair<int, int> & slot = segments_at_edge[edge];
+		if (slot.first != -1 && !used[slot.first]) {
+			return slot.first;
+		}
+		if (slot.second != -1 && !used[slot.second]) {
+			return slot.second;
+		}
+		return -1;
+	};
+
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (used[i]) {
+			continue;
+		}
+		used[i] = true;
+
+		std::deque<uint64_t> chain = { segments[i].edge_a, segments[i].edge_b };
+
+		int next = -1;
+		while (-1 != (next = get_next_segment(chain.back()))) {
+			used[next] = true;
+			chain.push_back(segments[next].edge_a == chain.back() ? segments[next].edge_b : segments[next].edge_a);
+		}
+		while (-1 != (next = get_next_segment(chain.front()))) {
+			used[next] = true;
+			chain.push_front(segments[next].edge_a == chain.front() ? segments[next].edge_b : segments[next].edge_a);
+		}
+
+		chains.push_back(std::move(chain));
+	}
+}
+
+
+
+
+static LatLon dem_position_to_lat_lon(const DEM & dem, double east, double north)
+{
+	if (dem.horiz_units == DEMHorizontalUnit::UTMMeters) {
+		return UTM::to_lat_lon(UTM(north, east, dem.utm.zone(), dem.utm.band_letter()));
+	} else {
+		return LatLon(north / 3600.0, east / 3600.0);
+	}
+}
+
+
+
+
+sg_ret DEMContours::generate(const DEM & dem, BackgroundJob * job)
+{
+	this->lines.clear();
+	if (this->interval <= 0) {
+		qDebug() << SG_PREFIX_E << "Invalid contour interval" << this->interval;
+		return sg_ret::err;
+	}
+
+	const DEMOverview * overview = NULL;
+	if (this->factor > 1) {
+		overview = dem.get_overview(this->factor);
+	}
+	this->factor = overview ? overview->factor : 1;
+
+	const ContourGrid grid(dem, overview);
+	if (grid.n_columns < 2 || grid.n_rows < 2) {
+		return sg_ret::ok;
+	}
+
+	/* Segments of contour lines, grouped by level. */
+	std::map<int, std::vector<ContourSegment>> segments;
+
+	for (int32_t col = 0; col < grid.n_columns - 1; col++) {
+		if (job && job->test_termination_condition()) {
+			return sg_ret::err;
+		}
+
+		for (int32_t row = 0; row < grid.n_rows - 1; row++) {
+			const int16_t sw = grid.get_elev(col, row);
+			const int16_t se = grid.get_elev(col + 1, row);
+			const int16_t ne = grid.get_elev(col + 1, row + 1);
+			const int16_t nw = grid.get_elev(col, row + 1);
+			if (sw == DEM::invalid_elevation || se == DEM::invalid_elevation
+			    || ne == DEM::invalid_elevation || nw == DEM::invalid_elevation) {
+				continue;
+			}
+
+			const int lowest = std::min(std::min(sw, se), std::min(ne, nw));
+			const int highest = std::max(std::max(sw, se), std::max(ne, nw));
+
+			const uint64_t edges[4] = {
+				grid.horizontal_edge(col, row),
+				grid.vertical_edge(col + 1, row),
+				grid.horizontal_edge(col, row + 1),
+				grid.vertical_edge(col, row)
+			};
+
+			/* Only levels in range (lowest, highest] cross the cell. */
+			for (int level = (floor((double) lowest / this->interval) + 1) * this->interval; level <= highest; level += this->interval) {
+				unsigned int idx = (sw >= level) | ((se >= level) << 1) | ((ne >= level) << 2) | ((nw >= level) << 3);
+				if (idx == 5 || idx == 10) {
+					if ((sw + se + ne + nw) / 4.0 < level) {
+						idx = 15 - idx;
+					}
+				}
+
+				const int8_t * cell = cell_segments[idx];
+				std::vector<ContourSegment> & level_segments = segments[level];
+				level_segments.push_back({ edges[cell[0]], edges[cell[1]] });
+				if (cell[2] != -1) {
+					level_segments.push_back({ edges[cell[2]], edges[cell[3]] });
+				}
+			}
+		}
+	}
+
+	/* Center of overview's cell is at center of block of samples that it covers. */
+	const double center_offset = (this->factor - 1) / 2.0;
+
+	std::vector<QPointF> grid_points;
+	std::vector<QPointF> simplified;
+	for (auto iter = segments.begin(); iter != segments.end(); iter++) {
+		if (job && job->test_termination_condition()) {
+			return sg_ret::err;
+		}
+
+		const int level = iter->first;
+		std::vector<std::deque<uint64_t>> chains;
+		stitch_segments(iter->second, chains);
+
+		for (const std::deque<uint64_t> & chain : chains) {
+			grid_points.clear();
+			for (const uint64_t edge : chain) {
+				grid_points.push_back(grid.edge_point(edge, level));
+			}
+			simplify_line(grid_points, CONTOUR_SIMPLIFICATION_TOLERANCE, simplified);
+
+			DEMContourLine line;
+			line.elevation = level;
+			line.points.reserve(simplified.size());
+
+			double min_east = INFINITY, max_east = -INFINITY, min_north = INFINITY, max_north = -INFINITY;
+			for (const QPointF & point : simplified) {
+				const double east = dem.min_east_seconds + (point.x() * this->factor + center_offset) * dem.scale.x;
+				const double north = dem.min_north_seconds + (point.y() * this->factor + center_offset) * dem.scale.y;
+				line.points.push_back(QPointF(east, north));
+
+				min_east = std::min(min_east, east);
+				max_east = std::max(max_east, east);
+				min_north = std::min(min_north, north);
+				max_north = std::max(max_north, north);
+			}
+			line.bbox = LatLonBBox(dem_position_to_lat_lon(dem, min_east, min_north), dem_position_to_lat_lon(dem, max_east, max_north));
+
+			this->lines.push_back(std::move(line));
+		}
+	}
+
+	qDebug() << SG_PREFIX_I << "Generated" << this->lines.size() << "contour lines with interval" << this->interval << "and factor" << this->factor;
+
+	return sg_ret::ok;
+}
+
+
+
+
+std::shared_ptr<const std::vector<std::vector<Coord>>> DEMContours::get_coords(const DEM & dem, CoordMode coord_mode) const
+{
+	std::lock_guard<std::mutex> lock(this->coords_mutex);
+
+	std::shared_ptr<const std::vector<std::vector<Coord>>> & cached = CoordMode::UTM == coord_mode ? this->utm_coords : this->lat_lon_coords;
+	if (cached) {
+		return cached;
+	}
+
+	std::shared_ptr<std::vector<std::vector<Coord>>> coords(new std::vector<std::vector<Coord>>(this->lines.size()));
+	for (size_t i = 0; i < this->lines.size(); i++) {
+		std::vector<Coord> & line_coords = (*coords)[i];
+		line_coords.reserve(this->lines[i].points.size());
+		for (const QPointF & point : this->lines[i].points) {
+			if (dem.horiz_units == DEMHorizontalUnit::UTMMeters) {
+				line_coords.push_back(Coord(UTM(point.y(), point.x(), dem.utm.zone(), dem.utm.band_letter()), coord_mode));
+			} else {
+				line_coords.push_back(Coord(LatLon(point.y() / 3600.0, point.x() / 3600.0), coord_mode));
+			}
+		}
+	}
+	cached = coords;
+
+	return cached;
+}
+
+
+
+
+size_t DEMContours::n_points(void) const
+{
+	size_t result = 0;
+	for (const DEMContourLine & line : this->lines) {
+		result += line.points.size();
+	}
+	return result;
+}
+
+
+
+
+/* Contours in cache, with information used to limit size of cache. */
+class DEMContoursCacheEntry {
+public:
+	std::shared_ptr<const DEMContours> contours;
+	size_t n_points = 0;
+	uint64_t last_use = 0;
+};
+
+
+
+
+static std::mutex contours_cache_mutex;
+
+/* Generated contours, for each DEM file. */
+static std::map<QString, std::vector<DEMContoursCacheEntry>> contours_cache;
+
+/* Total count of points of contours in cache. */
+static size_t contours_cache_n_points = 0;
+
+/* Incremented on each use of contours in cache. */
+static uint64_t contours_cache_use_counter = 0;
+
+/* Contours that are being generated, for each DEM file. Pairs of interval/factor. */
+static std::map<QString, std::set<std::pair<int, int32_t>>> contours_pending;
+
+/* Count of layers using each DEM file. */
+static std::map<QString, unsigned int> contours_users;
+
+
+
+
+std::shared_ptr<const DEMContours> DEMContoursCache::get(const QString & dem_file_path, int interval, int32_t factor)
+{
+	std::lock_guard<std::mutex> lock(contours_cache_mutex);
+
+	auto iter = contours_cache.find(dem_file_path);
+	if (iter == contours_cache.end()) {
+		return nullptr;
+	}
+
+	/* Exact match or, until the exact match becomes
+	   available, contours with the closest factor. */
+	DEMContoursCacheEntry * result = nullptr;
+	for (DEMContoursCacheEntry & entry : iter->second) {
+		if (entry.contours->interval != interval) {
+			continue;
+		}
+		if (nullptr == result || std::abs(entry.contours->factor - factor) < std::abs(result->contours->factor - factor)) {
+			result = &entry;
+		}
+	}
+	if (nullptr == result) {
+		return nullptr;
+	}
+
+	result->last_use = ++contours_cache_use_counter;
+	return result->contours;
+}
+
+
+
+
+bool DEMContoursCache::request(const QString & dem_file_path, int interval, int32_t factor)
+{
+	std::lock_guard<std::mutex> lock(contours_cache_mutex);
+
+	auto iter = contours_cache.find(dem_file_path);
+	if (iter != contours_cache.end()) {
+		for (const DEMContoursCacheEntry & entry : iter->second) {
+			if (entry.contours->interval == interval && entry.contours->factor == factor) {
+				return false;
+			}
+		}
+	}
+
+	/* 'second' is false if the request is already pending. */
+	return contours_pending[dem_file_path].insert(std::make_pair(interval, factor)).second;
+}
+
+
+
+
+void DEMContoursCache::add(const QString & dem_file_path, int interval, int32_t factor, const std::shared_ptr<const DEMContours> & contours)
+{
+	std::lock_guard<std::mutex> lock(contours_cache_mutex);
+
+	auto pending = contours_pending.find(dem_file_path);
+	if (pending == contours_pending.end() || 0 == pending->second.erase(std::make_pair(interval, factor))) {
+		/* Files have been unloaded while contours were being generated. */
+		qDebug() << SG_PREFIX_I << "Discarding contours of unloaded file" << dem_file_path;
+		return;
+	}
+
+	DEMContoursCacheEntry new_entry;
+	new_entry.contours = contours;
+	new_entry.n_points = contours->n_points();
+	new_entry.last_use = ++contours_cache_use_counter;
+	contours_cache[dem_file_path].push_back(new_entry);
+	contours_cache_n_points += new_entry.n_points;
+
+	/* Forget least recently used contours, but never the
+	   ones just added: they have been requested for drawing. */
+	while (contours_cache_n_points > CONTOURS_CACHE_MAX_POINTS) {
+		std::vector<DEMContoursCacheEntry> * oldest_entries = nullptr;
+		size_t oldest_idx = 0;
+		for (auto iter = contours_cache.begin(); iter != contours_cache.end(); iter++) {
+			for (size_t i = 0; i < iter->second.size(); i++) {
+				const DEMContoursCacheEntry & entry = iter->second[i];
+				if (entry.last_use == new_entry.last_use) {
+					continue;
+				}
+				if (nullptr == oldest_entries || entry.last_use < (*oldest_entries)[oldest_idx].last_use) {
+					oldest_entries = &iter->second;
+					oldest_idx = i;
+				}
+			}
+		}
+		if (nullptr == oldest_entries) {
+			break;
+		}
+
+		qDebug() << SG_PREFIX_I << "Forgetting contours with" << (*oldest_entries)[oldest_idx].n_points << "points, cache size is" << contours_cache_n_points << "points";
+		contours_cache_n_points -= (*oldest_entries)[oldest_idx].n_points;
+		oldest_entries->erase(oldest_entries->begin() + oldest_idx);
+	}
+}
+
+
+
+
+void DEMContoursCache::cancel_request(const QString & dem_file_path, int interval, int32_t factor)
+{
+	std::lock_guard<std::mutex> lock(contours_cache_mutex);
+
+	auto pending = contours_pending.find(dem_file_path);
+	if (pending != contours_pending.end()) {
+		pending->second.erase(std::make_pair(interval, factor));
+	}
+}
+
+
+
+
+void DEMContoursCache::load(const QStringList & file_paths)
+{
+	std::lock_guard<std::mutex> lock(contours_cache_mutex);
+
+	for (auto iter = file_paths.begin(); iter != file_paths.end(); iter++) {
+		contours_users[*iter]++;
+	}
+}
+
+
+
+
+void DEMContoursCache::unload(const QStringList & file_paths)
+{
+	std::lock_guard<std::mutex> lock(contours_cache_mutex);
+
+	for (auto iter = file_paths.begin(); iter != file_paths.end(); iter++) {
+		auto users = contours_users.find(*iter);
+		if (users == contours_users.end()) {
+			qDebug() << SG_PREFIX_W << "Unloading contours of file that has not been loaded:" << *iter;
+			continue;
+		}
+		if (--users->second > 0) {
+			/* Other layer still uses the file. */
+			continue;
+		}
+		contours_users.erase(users);
+		auto cached = contours_cache.find(*iter);
+		if (cached != contours_cache.end()) {
+			for (const DEMContoursCacheEntry & entry : cached->second) {
+				contours_cache_n_points -= entry.n_points;
+			}
+			contours_cache.erase(cached);
+		}
+		contours_pending.erase(*iter);
+	}
+}
+
+
+
+
+DEMContoursJob::DEMContoursJob(const QString & new_dem_file_path, const std::shared_ptr<DEM> & new_dem, int new_interval, int32_t new_factor)
+{
+	this->dem_file_path = new_dem_file_path;
+	this->dem = new_dem;
+	this->interval = new_interval;
+	this->factor = new_factor;
+
+	this->n_items = 1;
+}
+
+
+
+
+void DEMContoursJob::run(void)
+{
+	std::shared_ptr<DEMContours> contours(new DEMContours(this->interval, this->factor));
+	if (sg_ret::ok != contours->generate(*this->dem, this)) {
+		qDebug() << SG_PREFIX_I << "Generating of contours for" << this->dem_file_path << "was cancelled";
+		/* Drop the pending request so that it can be made again. */
+		DEMContoursCache::cancel_request(this->dem_file_path, this->interval, this->factor);
+		return;
+	}
+
+	DEMContoursCache::add(this->dem_file_path, this->interval, this->factor, contours);
+	this->set_progress_state(100);
+
+	emit this->contours_ready();
+}
@@ -0,0 +1,179 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_LAYER_DEM_CONTOURS_H_
+#define _SG_LAYER_DEM_CONTOURS_H_
+
+
+
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+
+
+
+#include <QString>
+#include <QStringList>
+#include <QPointF>
+
+
+
+
+#include "globals.h"
+#include "background.h"
+#include "bbox.h"
+#include "coord.h"
+#include "layer_dem_dem.h"
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class DEMContourLine {
+	public:
+		int16_t elevation = 0;
+
+		/* Vertices of the line, in DEM's horizontal units (arc seconds or UTM meters). */
+		std::vector<QPointF> points;
+
+		/* Area covered by the line, used to skip lines outside of viewport. */
+		LatLonBBox bbox;
+	};
+
+
+
+
+	/**
+	   @brief Contour lines of one DEM, for one contour interval and one level of detail
+
+	   Lines are traced with marching squares over either
+	   full-resolution DEM data (@param factor == 1) or over an
+	   overview of DEM (@param factor > 1), and are simplified
+	   with Douglas-Peucker algorithm.
+	*/
+	class DEMContours {
+	public:
+		DEMContours(int interval, int32_t factor) : interval(interval), factor(factor) {}
+
+		/* @param job (if not NULL) is used to report progress and to detect cancellation. */
+		sg_ret generate(const DEM & dem, BackgroundJob * job = NULL);
+
+		/* Vertices of lines as coordinates in given coord
+		   mode, one vector per line. Conversion is done on
+		   first call for given mode, and its result is kept
+		   for next frames. @param dem is the DEM for which
+		   the contours have been generated. */
+		std::shared_ptr<const std::vector<std::vector<Coord>>> get_coords(const DEM & dem, CoordMode coord_mode) const;
+
+		/* Total count of vertices of all lines. */
+		size_t n_points(void) const;
+
+		int interval = 0;
+		int32_t factor = 1;
+
+		std::vector<DEMContourLine> lines;
+
+	private:
+		mutable std::mutex coords_mutex;
+		mutable std::shared_ptr<const std::vector<std::vector<Coord>>> utm_coords;
+		mutable std::shared_ptr<const std::vector<std::vector<Coord>>> lat_lon_coords;
+	};
+
+
+
+
+	/**
+	   @brief Contours generated for DEM files
+
+	   Contours of a file are kept as long as the file is used
+	   by a layer, but the cache doesn't hold more than a limit
+	   of points of contour lines: least recently used contours
+	   are forgotten when new ones are added.
+	*/
+	class DEMContoursCache {
+	public:
+		/**
+		   @brief Get contours of given DEM file that are the best match for given interval and factor
+
+		   If contours for exactly this factor haven't been
+		   generated yet, contours for other factor (with the
+		   same interval) are returned, so that something can
+		   be drawn while the exact ones are being generated.
+
+		   @return nullptr if nothing is available for given file and interval
+		*/
+		static std::shared_ptr<const DEMContours> get(const QString & dem_file_path, int interval, int32_t factor);
+
+		/**
+		   @brief Register request for generating contours
+
+		   @return true if caller should start a job generating the contours
+		   @return false if the contours are already in cache or are being generated
+		*/
+		static bool request(const QString & dem_file_path, int interval, int32_t factor);
+
+		/* Put into cache contours generated for request registered with request(). */
+		static void add(const QString & dem_file_path, int interval, int32_t factor, const std::shared_ptr<const DEMContours> & contours);
+		static void cancel_request(const QString & dem_file_path, int interval, int32_t factor);
+
+		/* Register users of contours of given files. Like
+		   DEMCache, contours of a file are kept as long as
+		   any layer uses the file. */
+		static void load(const QStringList & file_paths);
+
+		/* Unregister users of contours of given files (e.g.
+		   when the files are removed from layer), and forget
+		   contours of files that have no other users. */
+		static void unload(const QStringList & file_paths);
+	};
+
+
+
+
+	class DEMContoursJob : public BackgroundJob {
+		Q_OBJECT
+	public:
+		DEMContoursJob(const QString & dem_file_path, const std::shared_ptr<DEM> & dem, int interval, int32_t factor);
+
+		void run(void);
+
+		QString dem_file_path;
+		std::shared_ptr<DEM> dem;
+		int interval = 0;
+		int32_t factor = 1;
+
+	signals:
+		void contours_ready(void);
+	};
+
+
+
+
+}
+
+
+
+
+#endif /* #ifndef _SG_LAYER_DEM_CONTOURS_H_ */
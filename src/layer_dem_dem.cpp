@@ -28,6 +28,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <cassert>
+#include <algorithm>
 
 
 
@@ -49,6 +50,7 @@
 #include "bbox.h"
 #include "coords.h"
 #include "layer_dem_dem.h"
+#include "measurements.h"
 #include "file_utils.h"
 #include "globals.h"
 #include "util.h"
@@ -107,6 +109,9 @@ DEM::~DEM()
 	for (int32_t i = 0; i < this->n_columns; i++) {
 		delete this->columns[i];
 	}
+	for (auto iter = this->overviews.begin(); iter != this->overviews.end(); iter++) {
+		delete *iter;
+	}
 }
 
 
@@ -147,137 +152,185 @@ int16_t DEM::get_elev_at_east_north_no_interpolation(double east_seconds, double
 
 
 
-bool DEM::get_ref_points_elevation_distance(double east_seconds, double north_seconds, int16_t * elevations, int16_t * distances) const
-{
-	int32_t cols[4];
-	int32_t rows[4];
-	LatLon lat_lon[4];
+/* Same value as in coords.cpp. */
+static const double g_equatorial_radius = 6378137;
 
-	if (east_seconds > this->max_east_seconds
-	    || east_seconds < this->min_east_seconds
-	    || north_seconds > this->max_north_seconds
-	    || north_seconds < this->min_north_seconds) {
 
-		return false;  /* Got nothing. */
-	}
-
-	const LatLon pos(north_seconds / 3600, east_seconds / 3600);
-
-	/* order of the data: sw, nw, ne, se */
-	/* sw */
-	cols[0] = (int32_t) floor((east_seconds - this->min_east_seconds) / this->scale.x);
-	rows[0] = (int32_t) floor((north_seconds - this->min_north_seconds) / this->scale.y);
-	lat_lon[0].lon = (this->min_east_seconds + this->scale.x * cols[0]) / 3600;
-	lat_lon[0].lat = (this->min_north_seconds + this->scale.y * rows[0]) / 3600;
-	/* nw */
-	cols[1] = cols[0];
-	rows[1] = rows[0] + 1;
-	lat_lon[1].lon = lat_lon[0].lon.bound_value();
-	lat_lon[1].lat = lat_lon[0].lat.value() + this->scale.y / 3600.0;
-	/* ne */
-	cols[2] = cols[0] + 1;
-	rows[2] = rows[0] + 1;
-	lat_lon[2].lon = lat_lon[0].lon.bound_value() + this->scale.x / 3600.0;
-	lat_lon[2].lat = lat_lon[0].lat.value() + this->scale.y / 3600.0;
-	/* se */
-	cols[3] = cols[0] + 1;
-	rows[3] = rows[0];
-	lat_lon[3].lon = lat_lon[0].lon.bound_value() + this->scale.x / 3600.0;
-	lat_lon[3].lat = lat_lon[0].lat.value();
 
-	for (int i = 0; i < 4; i++) {
-		elevations[i] = this->get_elev_at_col_row(cols[i], rows[i]);
-		if (elevations[i] == DEM::invalid_elevation) {
-			return false;
-		}
-		distances[i] = LatLon::get_distance(pos, lat_lon[i]);
-	}
 
-#if 0   /* Debug. */
-	for (int i = 0; i < 4; i++) {
-		qDebug() << SG_PREFIX_D << i << ":" << lat_lon[i].lat.value() << lat_lon[i].lon << distances[i] << elevs[i];
+void DEM::build_interpolation_tables(void)
+{
+	int32_t n_rows = 0;
+	for (int32_t col = 0; col < this->n_columns; col++) {
+		n_rows = std::max(n_rows, this->columns[col]->m_size);
 	}
-	qDebug() << SG_PREFIX_D << "north_scale =" this->north_scale;
-#endif
 
-	return true;  /* All OK. */
+	this->cell_width_m.resize(n_rows);
+
+	if (this->horiz_units == DEMHorizontalUnit::LatLonArcSeconds) {
+		const double meters_per_arcsec = DEG2RAD(1.0 / 3600.0) * g_equatorial_radius;
+		this->cell_height_m = this->scale.y * meters_per_arcsec;
+		for (int32_t row = 0; row < n_rows; row++) {
+			/* Use latitude of middle of the cell. */
+			const double lat_deg = (this->min_north_seconds + (row + 0.5) * this->scale.y) / 3600.0;
+			this->cell_width_m[row] = this->scale.x * meters_per_arcsec * cos(DEG2RAD(lat_deg));
+		}
+	} else {
+		this->cell_height_m = this->scale.y;
+		for (int32_t row = 0; row < n_rows; row++) {
+			this->cell_width_m[row] = this->scale.x;
+		}
+	}
 }
 
 
 
 
-int16_t DEM::get_elev_at_east_north_simple_interpolation(double east_seconds, double north_seconds) const
+/**
+   Fill @param cell with samples of cell with south-west corner at
+   given @param col, @param row, and precompute its coefficients.
+*/
+void DEM::load_cell(int32_t col, int32_t row, DEMCell & cell) const
 {
-	int16_t elevations[4] = { 0 };
-	int16_t distances[4] = { 0 };
-	if (!this->get_ref_points_elevation_distance(east_seconds, north_seconds, elevations, distances)) {
-		return DEM::invalid_elevation;
+	cell.col = col;
+	cell.row = row;
+	cell.valid = false;
+
+	if (col < 0 || row < 0 || col + 1 >= this->n_columns) {
+		return;
+	}
+	const DEMColumn * west = this->columns[col];
+	const DEMColumn * east = this->columns[col + 1];
+	if (row + 1 >= west->m_size || row + 1 >= east->m_size) {
+		return;
 	}
 
+	cell.elevations[0] = west->m_points[row];
+	cell.elevations[1] = west->m_points[row + 1];
+	cell.elevations[2] = east->m_points[row + 1];
+	cell.elevations[3] = east->m_points[row];
 	for (int i = 0; i < 4; i++) {
-		if (distances[i] < 1) {
-			return elevations[i];
+		if (cell.elevations[i] == DEM::invalid_elevation) {
+			return;
 		}
 	}
 
-	const double t =
-		(double) elevations[0] / distances[0]
-		+ (double) elevations[1] / distances[1]
-		+ (double) elevations[2] / distances[2]
-		+ (double) elevations[3] / distances[3];
-
-	const double b =
-		1.0 / distances[0]
-		+ 1.0 / distances[1]
-		+ 1.0 / distances[2]
-		+ 1.0 / distances[3];
+	const double sw = cell.elevations[0];
+	const double nw = cell.elevations[1];
+	const double ne = cell.elevations[2];
+	const double se = cell.elevations[3];
+	cell.a = sw;
+	cell.b = se - sw;
+	cell.c = nw - sw;
+	cell.d = ne - nw - se + sw;
+
+	if (row < (int32_t) this->cell_width_m.size()) {
+		cell.width_m = this->cell_width_m[row];
+	} else {
+		/* Interpolation tables not built. Relative weights are still correct if cell is treated as square. */
+		cell.width_m = 1.0;
+	}
+	cell.height_m = this->cell_width_m.empty() ? 1.0 : this->cell_height_m;
 
-	return (t/b);
+	cell.valid = true;
 }
 
 
 
 
-int16_t DEM::get_elev_at_east_north_shepard_interpolation(double east_seconds, double north_seconds) const
+/**
+   Interpolate elevation at given position.
+
+   DEMInterpolation::Simple uses bilinear kernel.
+   DEMInterpolation::Best uses inverse-distance-squared (Shepard) kernel.
+
+   @param cell: cell used in previous call; it is reloaded only if the position falls into a different cell
+*/
+int16_t DEM::get_elev_at_east_north_interpolated(double east_seconds, double north_seconds, DEMInterpolation method, DEMCell & cell) const
 {
-	int16_t elevations[4] = { 0 };
-	int16_t distances[4] = { 0 };
-	if (!this->get_ref_points_elevation_distance(east_seconds, north_seconds, elevations, distances)) {
+	if (east_seconds > this->max_east_seconds
+	    || east_seconds < this->min_east_seconds
+	    || north_seconds > this->max_north_seconds
+	    || north_seconds < this->min_north_seconds) {
+
 		return DEM::invalid_elevation;
 	}
 
-	int16_t max_dist = 0;
-	for (int i = 0; i < 4; i++) {
-		if (distances[i] < 1) {
-			return elevations[i];
-		}
-		if (distances[i] > max_dist) {
-			max_dist = distances[i];
-		}
+	const double x = (east_seconds - this->min_east_seconds) / this->scale.x;
+	const double y = (north_seconds - this->min_north_seconds) / this->scale.y;
+	const int32_t col = (int32_t) floor(x);
+	const int32_t row = (int32_t) floor(y);
+
+	if (col != cell.col || row != cell.row) {
+		this->load_cell(col, row, cell);
+	}
+	if (!cell.valid) {
+		return DEM::invalid_elevation;
 	}
 
-	double t = 0.0;
-	double b = 0.0;
+	const double fx = x - col;
+	const double fy = y - row;
 
-#ifdef TODO_MAYBE
-	/* Derived method by Franke & Nielson. Does not seem to work too well here. */
-	for (int i = 0; i < 4; i++) {
-		const double tmp = pow((1.0 * (max_dist - distances[i]) / max_dist * distances[i]), 2);
-		t += tmp * elevations[i];
-		b += tmp;
+	if (method == DEMInterpolation::Simple) {
+		return (int16_t) lround(cell.a + cell.b * fx + cell.c * fy + cell.d * fx * fy);
 	}
-#endif
 
+	/* Squared distances (in meters) to sw, nw, ne, se. */
+	const double dx_west = fx * cell.width_m;
+	const double dx_east = (1.0 - fx) * cell.width_m;
+	const double dy_south = fy * cell.height_m;
+	const double dy_north = (1.0 - fy) * cell.height_m;
+	const double distances2[4] = {
+		dx_west * dx_west + dy_south * dy_south,
+		dx_west * dx_west + dy_north * dy_north,
+		dx_east * dx_east + dy_north * dy_north,
+		dx_east * dx_east + dy_south * dy_south
+	};
+
+	double t = 0.0;
+	double b = 0.0;
 	for (int i = 0; i < 4; i++) {
-		const double tmp = pow((1.0 / distances[i]), 2);
-		t += tmp * elevations[i];
-		b += tmp;
+		if (distances2[i] < 1.0) {
+			/* Closer than one meter to a sample. */
+			return cell.elevations[i];
+		}
+		const double weight = 1.0 / distances2[i];
+		t += weight * cell.elevations[i];
+		b += weight;
 	}
 
-	qDebug() << SG_PREFIX_D << "Shepard Interpolation: t =" << t << "b =" << b << "t/b =" << t/b;
+	return (int16_t) lround(t / b);
+}
+
+
 
-	return (t/b);
 
+void DEM::get_elevs_at_east_north(const double * east, const double * north, size_t count, DEMInterpolation method, int16_t * elevs) const
+{
+	DEMCell cell;
+
+	switch (method) {
+	case DEMInterpolation::None:
+		for (size_t i = 0; i < count; i++) {
+			if (elevs[i] == DEM::invalid_elevation) {
+				elevs[i] = this->get_elev_at_east_north_no_interpolation(east[i], north[i]);
+			}
+		}
+		break;
+
+	case DEMInterpolation::Simple:
+	case DEMInterpolation::Best:
+		for (size_t i = 0; i < count; i++) {
+			if (elevs[i] == DEM::invalid_elevation) {
+				elevs[i] = this->get_elev_at_east_north_interpolated(east[i], north[i], method, cell);
+			}
+		}
+		break;
+
+	default:
+		qDebug() << SG_PREFIX_E << "Unexpected interpolation method" << (int) method;
+		break;
+	}
 }
 
 
@@ -293,6 +346,25 @@ void DEM::east_north_to_col_row(double east_seconds, double north_seconds, int32
 
 
 bool DEM::intersect(const LatLonBBox & other_bbox) const
+{
+	const LatLonBBox bbox = this->get_bbox();
+	if (!bbox.is_valid()) {
+		return false;
+	}
+
+	const bool result = bbox.intersects_with(other_bbox);
+
+	qDebug() << SG_PREFIX_I << "DEM's bbox:" << bbox;
+	qDebug() << SG_PREFIX_I << "Other bbox:" << other_bbox;
+	qDebug() << SG_PREFIX_I << "Intersect: " << (result ? "true" : "false");
+
+	return result;
+}
+
+
+
+
+LatLonBBox DEM::get_bbox(void) const
 {
 	LatLon dem_northeast;
 	LatLon dem_southwest;
@@ -317,7 +389,7 @@ bool DEM::intersect(const LatLonBBox & other_bbox) const
 	} else {
 		/* Unknown horiz_units - this shouldn't normally happen.
 		   Thus can't work out positions to use. */
-		return false;
+		return LatLonBBox(); /* Invalid by default. */
 	}
 
 	LatLonBBox bbox;
@@ -327,13 +399,24 @@ bool DEM::intersect(const LatLonBBox & other_bbox) const
 	bbox.west = dem_southwest.lon.bound_value();
 	bbox.validate();
 
-	const bool result = bbox.intersects_with(other_bbox);
+	return bbox;
+}
 
-	qDebug() << SG_PREFIX_I << "DEM's bbox:" << bbox;
-	qDebug() << SG_PREFIX_I << "Other bbox:" << other_bbox;
-	qDebug() << SG_PREFIX_I << "Intersect: " << (result ? "true" : "false");
 
-	return result;
+
+
+size_t DEM::get_size_bytes(void) const
+{
+	size_t size = sizeof (DEM);
+
+	for (int32_t i = 0; i < this->n_columns; i++) {
+		size += sizeof (DEMColumn) + this->columns[i]->m_size * sizeof (int16_t);
+	}
+	for (auto iter = this->overviews.begin(); iter != this->overviews.end(); iter++) {
+		size += sizeof (DEMOverview) + 3 * (*iter)->m_mean.size() * sizeof (int16_t);
+	}
+
+	return size;
 }
 
 
@@ -351,15 +434,153 @@ DEMColumn::DEMColumn(double east, double south, int32_t size)
 
 
 
+DEMColumn::DEMColumn(double east, double south, int32_t size, int16_t * external_points)
+{
+	this->m_east = east;
+	this->m_south = south;
+	this->m_size = size;
+
+	this->m_points = external_points;
+	this->m_owns_points = false;
+}
+
+
+
+
 DEMColumn::~DEMColumn()
 {
-	free(this->m_points);
+	if (this->m_owns_points) {
+		free(this->m_points);
+	}
 	this->m_points = nullptr;
 }
 
 
 
 
+DEMOverview::DEMOverview(int32_t new_factor, int32_t new_n_columns, int32_t new_n_rows)
+{
+	this->factor = new_factor;
+	this->n_columns = new_n_columns;
+	this->n_rows = new_n_rows;
+
+	const size_t n_cells = (size_t) this->n_columns * this->n_rows;
+	this->m_mean.resize(n_cells, DEM::invalid_elevation);
+}
+
+
+
+
+/* Overviews with fewer columns or rows than this are not worth building. */
+static const int32_t g_overview_min_size = 8;
+
+
+
+
+/**
+   Build overview that is two times coarser than source data.
+
+   @param source_mean: accessor of source data; it must return
+   DEM::invalid_elevation for cells outside of the source grid.
+*/
+template <typename MeanFn>
+static DEMOverview * build_overview_level(int32_t factor, int32_t source_n_columns, int32_t source_n_rows, MeanFn source_mean)
+{
+	const int32_t n_columns = (source_n_columns + 1) / 2;
+	const int32_t n_rows = (source_n_rows + 1) / 2;
+	DEMOverview * overview = new DEMOverview(factor, n_columns, n_rows);
+
+	for (int32_t col = 0; col < n_columns; col++) {
+		for (int32_t row = 0; row < n_rows; row++) {
+			int32_t sum = 0;
+			int32_t count = 0;
+
+			for (int32_t src_col = 2 * col; src_col < 2 * col + 2; src_col++) {
+				for (int32_t src_row = 2 * row; src_row < 2 * row + 2; src_row++) {
+					const int16_t mean = source_mean(src_col, src_row);
+					if (DEM::invalid_elevation == mean) {
+						continue;
+					}
+					sum += mean;
+					count++;
+				}
+			}
+
+			if (0 == count) {
+				continue; /* Cell is left as invalid elevation. */
+			}
+
+			const size_t idx = (size_t) col * n_rows + row;
+			overview->m_mean[idx] = (int16_t) (sum / count);
+		}
+	}
+
+	return overview;
+}
+
+
+
+
+/**
+   Overviews are calculated on column/row indices only. For DEMs with
+   columns of different sizes (DEM24k) the shorter columns are padded
+   with invalid elevation.
+*/
+void DEM::build_overviews(void)
+{
+	if (!this->overviews.empty()) {
+		qDebug() << SG_PREFIX_W << "Overviews have already been built";
+		return;
+	}
+
+	int32_t n_rows = 0;
+	for (int32_t col = 0; col < this->n_columns; col++) {
+		n_rows = std::max(n_rows, this->columns[col]->m_size);
+	}
+	if (this->n_columns < 2 * g_overview_min_size || n_rows < 2 * g_overview_min_size) {
+		return;
+	}
+
+	/* Level 1: built from full-resolution samples. */
+	auto dem_elev = [this](int32_t col, int32_t row) {
+		return this->get_elev_at_col_row(col, row);
+	};
+	this->overviews.push_back(build_overview_level(2, this->n_columns, n_rows, dem_elev));
+
+	/* Next levels: built from previous level. */
+	while (true) {
+		const DEMOverview * prev = this->overviews.back();
+		if (prev->n_columns < 2 * g_overview_min_size || prev->n_rows < 2 * g_overview_min_size) {
+			break;
+		}
+
+		auto prev_mean = [prev](int32_t col, int32_t row) {
+			return (col < prev->n_columns && row < prev->n_rows) ? prev->get_mean(col, row) : DEM::invalid_elevation;
+		};
+		this->overviews.push_back(build_overview_level(2 * prev->factor, prev->n_columns, prev->n_rows, prev_mean));
+	}
+
+	qDebug() << SG_PREFIX_I << "Built" << this->overviews.size() << "overview levels, coarsest factor =" << this->overviews.back()->factor;
+}
+
+
+
+
+const DEMOverview * DEM::get_overview(int32_t skip_factor) const
+{
+	const DEMOverview * result = nullptr;
+	for (auto iter = this->overviews.begin(); iter != this->overviews.end(); iter++) {
+		if ((*iter)->factor > skip_factor) {
+			break;
+		}
+		result = *iter;
+	}
+	return result;
+}
+
+
+
+
 
 sg_ret DEM::get_elev_by_coord(const Coord & coord, DEMInterpolation method, int16_t & elev) const
 {
@@ -390,12 +611,11 @@ sg_ret DEM::get_elev_by_coord(const Coord & coord, DEMInterpolation method, int1
 		return sg_ret::ok;
 
 	case DEMInterpolation::Simple:
-		elev = this->get_elev_at_east_north_simple_interpolation(lon, lat);
-		return sg_ret::ok;
-
-	case DEMInterpolation::Best:
-		elev = this->get_elev_at_east_north_shepard_interpolation(lon, lat);
+	case DEMInterpolation::Best: {
+		DEMCell cell;
+		elev = this->get_elev_at_east_north_interpolated(lon, lat, method, cell);
 		return sg_ret::ok;
+	}
 
 	default:
 		qDebug() << SG_PREFIX_E << "Unexpected interpolation method" << (int) method;
@@ -92,10 +92,44 @@ namespace SlavGPS {
 
 
 
+	/*
+	  Four DEM samples surrounding a position, with precomputed
+	  interpolation coefficients. Consecutive lookups (e.g. for
+	  trackpoints of a dense track) often fall into the same cell,
+	  and then the coefficients are reused.
+	*/
+	class DEMCell {
+	public:
+		int32_t col = -1;
+		int32_t row = -1;
+		bool valid = false;
+
+		/* Order of samples: sw, nw, ne, se. */
+		int16_t elevations[4] = { 0, 0, 0, 0 };
+
+		/* Bilinear kernel: elev = a + b * fx + c * fy + d * fx * fy,
+		   where fx, fy are fractional position in the cell. */
+		double a = 0.0;
+		double b = 0.0;
+		double c = 0.0;
+		double d = 0.0;
+
+		/* Size of the cell in meters, for inverse-distance kernel. */
+		double width_m = 0.0;
+		double height_m = 0.0;
+	};
+
+
+
+
 	class DEMColumn {
 
 	public:
 		DEMColumn(double east, double south, int32_t size);
+		/* Column of points stored in memory owned by someone
+		   else (e.g. memory-mapped file). The column will
+		   not free the memory. */
+		DEMColumn(double east, double south, int32_t size, int16_t * external_points);
 		~DEMColumn();
 
 		/* East-West coordinate for ALL items in the column. */
@@ -106,6 +140,38 @@ namespace SlavGPS {
 
 		int32_t m_size = 0;
 		int16_t * m_points = nullptr;
+
+	private:
+		bool m_owns_points = true;
+	};
+
+
+
+
+	/**
+	   @brief Downsampled copy of DEM's elevation data
+
+	   Each cell of an overview holds mean elevation of a block
+	   of factor x factor samples of full-resolution DEM. Overviews
+	   are used when drawing zoomed-out viewport, so that cost of
+	   drawing depends on number of pixels in viewport, and not on
+	   number of samples in DEM.
+
+	   Data is stored column after column, like in DEM itself.
+	*/
+	class DEMOverview {
+	public:
+		DEMOverview(int32_t factor, int32_t n_columns, int32_t n_rows);
+
+		int16_t get_mean(int32_t col, int32_t row) const { return this->m_mean[col * this->n_rows + row]; }
+
+		/* How many samples of full-resolution DEM (in each direction) are covered by one cell of overview. */
+		int32_t factor = 1;
+
+		int32_t n_columns = 0;
+		int32_t n_rows = 0;
+
+		std::vector<int16_t> m_mean;
 	};
 
 
@@ -132,9 +198,56 @@ namespace SlavGPS {
 
 		bool intersect(const LatLonBBox & other_bbox) const;
 
+		/**
+		   @brief Get bounding box of area covered by DEM
+
+		   Returned bbox is invalid if DEM's horizontal unit is unknown.
+		*/
+		LatLonBBox get_bbox(void) const;
+
+		/* Get size of DEM's data (samples and overviews) in memory (in bytes). */
+		size_t get_size_bytes(void) const;
+
+		/**
+		   @brief Get elevations at many positions at once
+
+		   Positions are given in DEM's horizontal units (arc
+		   seconds or UTM meters). Only elements of @param elevs
+		   that are equal to DEM::invalid_elevation are
+		   calculated, so the function can be called for
+		   consecutive DEMs with the same output array.
+		   Elements for positions not covered by this DEM are
+		   left untouched.
+		*/
+		void get_elevs_at_east_north(const double * east, const double * north, size_t count, DEMInterpolation method, int16_t * elevs) const;
+
+		/**
+		   @brief Precompute data used by interpolation kernels
+
+		   Call this only once, after DEM data has been read from file.
+		*/
+		void build_interpolation_tables(void);
+
+		/**
+		   @brief Build overviews (2x, 4x, 8x, ...) of DEM data
+
+		   Call this only once, after DEM data has been read from file.
+		*/
+		void build_overviews(void);
+
+		/**
+		   @brief Get the coarsest overview that is still not coarser than @param skip_factor
+
+		   @return nullptr if full-resolution data should be used
+		*/
+		const DEMOverview * get_overview(int32_t skip_factor) const;
+
 		int32_t n_columns = 0;
 		std::vector<DEMColumn *> columns;
 
+		/* Ordered from the finest (factor = 2) to the coarsest. */
+		std::vector<DEMOverview *> overviews;
+
 		DEMHorizontalUnit horiz_units = DEMHorizontalUnit::LatLonArcSeconds;
 		DEMVerticalUnit orig_vert_units = DEMVerticalUnit::Decimeters; /* Original, always converted to meters when loading. */
 
@@ -167,11 +280,15 @@ namespace SlavGPS {
 
 	private:
 		int16_t get_elev_at_east_north_no_interpolation(double east_seconds, double north_seconds) const;
-		int16_t get_elev_at_east_north_simple_interpolation(double east_seconds, double north_seconds) const;
-		int16_t get_elev_at_east_north_shepard_interpolation(double east_seconds, double north_seconds) const;
+		int16_t get_elev_at_east_north_interpolated(double east_seconds, double north_seconds, DEMInterpolation method, DEMCell & cell) const;
 		int16_t get_elev_at_col_row(int32_t col, int32_t row) const;
 
-		bool get_ref_points_elevation_distance(double east_seconds, double north_seconds, int16_t * elevations, int16_t * distances) const;
+		void load_cell(int32_t col, int32_t row, DEMCell & cell) const;
+
+		/* Width of DEM cell in meters, for each row of DEM. In LatLon DEMs it depends on latitude. */
+		std::vector<double> cell_width_m;
+		/* Height of DEM cell in meters. */
+		double cell_height_m = 0.0;
 	};
 
 
@@ -24,6 +24,8 @@
 
 #include <unordered_map>
 #include <cstdlib>
+#include <mutex>
+#include <limits>
 
 
 
@@ -31,6 +33,7 @@
 #include "layer_dem_dem_cache.h"
 #include "layer_dem_dem_srtm.h"
 #include "background.h"
+#include "preferences.h"
 
 
 
@@ -45,13 +48,19 @@ using namespace SlavGPS;
 
 
 
-class LoadedDEM { /* TODO_LATER: to be replaced with smart pointer. */
+class LoadedDEM {
 public:
-	LoadedDEM(DEM * dem);
-	~LoadedDEM();
+	LoadedDEM(const std::shared_ptr<DEM> & dem);
+
+	/* nullptr if DEM's data has been evicted from memory. */
+	std::shared_ptr<DEM> dem;
+
+	/* Area covered by DEM, known also after eviction of DEM's data. */
+	LatLonBBox bbox;
 
-	DEM * dem = NULL;
 	unsigned int ref_count = 0;
+	size_t size_bytes = 0;
+	uint64_t last_used = 0;
 };
 
 
@@ -72,27 +81,41 @@ struct MyQHasher
 
 /* File path -> DEM. */
 static std::unordered_map<QString, LoadedDEM *, MyQHasher> loaded_dems;
+static std::mutex dem_cache_mutex;
 
+static size_t current_cache_size_bytes = 0; /* [Bytes] */
+static uint64_t use_counter = 0; /* Source of LoadedDEM::last_used values. */
 
+static ParameterScale<int> scale_cache_size(16, 16384, SGVariant((int32_t) VIK_CONFIG_DEMCACHE_SIZE, SGVariantType::Int), 16, 0);
+
+static ParameterSpecification prefs[] = {
+	{ 0, PREFERENCES_NAMESPACE_GENERAL "demcache_size", SGVariantType::Int, PARAMETER_GROUP_GENERIC, QObject::tr("DEM cache memory size (MB):"), WidgetType::SpinBoxInt, &scale_cache_size, NULL, "" },
+};
 
 
+
+
+static std::shared_ptr<DEM> read_dem(const QString & file_full_path);
 static void dem_cache_unref(const QString & file_path);
+static void dem_cache_set_dem(LoadedDEM * ldem, const std::shared_ptr<DEM> & dem);
+static void dem_cache_evict_over_budget(const LoadedDEM * keep);
+static std::shared_ptr<DEM> dem_cache_reload(const QString & file_path);
 
 
 
 
-LoadedDEM::LoadedDEM(DEM * new_dem)
+LoadedDEM::LoadedDEM(const std::shared_ptr<DEM> & new_dem)
 {
-	this->dem = new_dem;
+	this->bbox = new_dem->get_bbox();
 	this->ref_count++;
 }
 
 
 
 
-LoadedDEM::~LoadedDEM()
+void DEMCache::init(void)
 {
-	delete this->dem;
+	Preferences::register_parameter_instance(prefs[0], scale_cache_size.initial);
 }
 
 
@@ -100,10 +123,103 @@ LoadedDEM::~LoadedDEM()
 
 void DEMCache::uninit(void)
 {
+	std::lock_guard<std::mutex> lock(dem_cache_mutex);
+
 	for (auto iter = loaded_dems.begin(); iter != loaded_dems.end(); iter++) {
 		delete (*iter).second;
 	}
 	loaded_dems.clear();
+	current_cache_size_bytes = 0;
+}
+
+
+
+
+static std::shared_ptr<DEM> read_dem(const QString & file_full_path)
+{
+	DEM * dem = nullptr;
+
+	const DEMSource source = DEM::recognize_source_type(file_full_path);
+	switch (source) {
+	case DEMSource::SRTM:
+		dem = new DEMSRTM();
+		break;
+#ifdef VIK_CONFIG_DEM24K
+	case DEMSource::DEM24k:
+		dem = new DEM24K();
+		break;
+#endif
+	default:
+		dem = nullptr;
+		break;
+	};
+
+	if (nullptr == dem) {
+		return nullptr;
+	}
+
+	if (sg_ret::ok != dem->read_from_file(file_full_path)) {
+		delete dem;
+		return nullptr;
+	}
+	/* Done only once per DEM, so that drawing of zoomed-out
+	   viewport and elevation lookups are cheap. */
+	dem->build_overviews();
+	dem->build_interpolation_tables();
+
+	return std::shared_ptr<DEM>(dem);
+}
+
+
+
+
+/* Call with dem_cache_mutex locked. */
+static void dem_cache_set_dem(LoadedDEM * ldem, const std::shared_ptr<DEM> & dem)
+{
+	current_cache_size_bytes -= ldem->size_bytes;
+
+	ldem->dem = dem;
+	ldem->size_bytes = dem ? dem->get_size_bytes() : 0;
+	ldem->last_used = ++use_counter;
+
+	current_cache_size_bytes += ldem->size_bytes;
+}
+
+
+
+
+/**
+   Evict data of least recently used DEMs until memory used by cache
+   is within budget.
+
+   Call with dem_cache_mutex locked.
+
+   @param keep: DEM that must not be evicted (e.g. because it has just been loaded)
+*/
+static void dem_cache_evict_over_budget(const LoadedDEM * keep)
+{
+	/* TODO_LATER: that should be done on preference change only... */
+	const size_t max_cache_size_bytes = (size_t) Preferences::get_param_value(PREFERENCES_NAMESPACE_GENERAL "demcache_size").u.val_int * 1024 * 1024;
+
+	while (current_cache_size_bytes > max_cache_size_bytes) {
+		auto oldest = loaded_dems.end();
+		for (auto iter = loaded_dems.begin(); iter != loaded_dems.end(); iter++) {
+			const LoadedDEM * ldem = (*iter).second;
+			if (ldem == keep || nullptr == ldem->dem) {
+				continue;
+			}
+			if (oldest == loaded_dems.end() || ldem->last_used < (*oldest).second->last_used) {
+				oldest = iter;
+			}
+		}
+		if (oldest == loaded_dems.end()) {
+			break; /* Nothing more can be evicted. */
+		}
+
+		qDebug() << SG_PREFIX_I << "Evicting DEM" << (*oldest).first << "from memory, cache size =" << current_cache_size_bytes << "Bytes, max cache size =" << max_cache_size_bytes << "Bytes";
+		/* Anyone still using the DEM keeps it alive through shared pointer. */
+		dem_cache_set_dem((*oldest).second, nullptr);
+	}
 }
 
 
@@ -122,52 +238,57 @@ void DEMCache::uninit(void)
    The tile may been sitting on disc before, or may have been just
    downloaded - the function gets called just the same.
 
+   The function can be called from many threads at the same time.
+
    \param file_full_path: path to data file with tile data
 
    \return DEM object representing a tile
 */
-DEM * DEMCache::load_file_into_cache(const QString & file_full_path)
+std::shared_ptr<DEM> DEMCache::load_file_into_cache(const QString & file_full_path)
 {
-	auto iter = loaded_dems.find(file_full_path);
-	if (iter != loaded_dems.end()) { /* Found. */
-		(*iter).second->ref_count++;
-		return (*iter).second->dem;
-	} else {
-		DEM * dem = nullptr;
-
-		const DEMSource source = DEM::recognize_source_type(file_full_path);
-		switch (source) {
-		case DEMSource::SRTM:
-			dem = new DEMSRTM();
-			break;
-#ifdef VIK_CONFIG_DEM24K
-		case DEMSource::DEM24k:
-			dem = new DEM24K();
-			break;
-#endif
-		default:
-			dem = nullptr;
-			break;
-		};
-
-		if (nullptr == dem) {
-			return nullptr;
+	{
+		std::lock_guard<std::mutex> lock(dem_cache_mutex);
+		auto iter = loaded_dems.find(file_full_path);
+		if (iter != loaded_dems.end()) { /* Found. */
+			LoadedDEM * ldem = (*iter).second;
+			if (ldem->dem) {
+				ldem->ref_count++;
+				ldem->last_used = ++use_counter;
+				return ldem->dem;
+			}
 		}
+	}
 
-		if (sg_ret::ok != dem->read_from_file(file_full_path)) {
-			delete dem;
-			return nullptr;
-		}
+	/* Reading is done without lock, so that many files can be read in parallel. */
+	std::shared_ptr<DEM> dem = read_dem(file_full_path);
+	if (nullptr == dem) {
+		return nullptr;
+	}
 
-		LoadedDEM * ldem = new LoadedDEM(dem);
+	std::lock_guard<std::mutex> lock(dem_cache_mutex);
+	LoadedDEM * ldem = nullptr;
+	auto iter = loaded_dems.find(file_full_path);
+	if (iter != loaded_dems.end()) {
+		/* Other thread was faster, or the DEM has been evicted. */
+		ldem = (*iter).second;
+		ldem->ref_count++;
+		if (nullptr == ldem->dem) {
+			dem_cache_set_dem(ldem, dem);
+		}
+	} else {
+		ldem = new LoadedDEM(dem);
 		loaded_dems[file_full_path] = ldem;
-		return dem;
+		dem_cache_set_dem(ldem, dem);
 	}
+	dem_cache_evict_over_budget(ldem);
+
+	return ldem->dem;
 }
 
 
 
 
+/* Call with dem_cache_mutex locked. */
 static void dem_cache_unref(const QString & file_path)
 {
 	auto iter = loaded_dems.find(file_path);
@@ -177,9 +298,41 @@ static void dem_cache_unref(const QString & file_path)
 	}
 	(*iter).second->ref_count--;
 	if ((*iter).second->ref_count == 0) {
-		loaded_dems.erase(iter);
+		dem_cache_set_dem((*iter).second, nullptr);
 		delete (*iter).second;
+		loaded_dems.erase(iter);
+	}
+}
+
+
+
+
+/**
+   Read again data of DEM that has been evicted from memory.
+
+   Call without dem_cache_mutex locked.
+*/
+static std::shared_ptr<DEM> dem_cache_reload(const QString & file_path)
+{
+	qDebug() << SG_PREFIX_I << "Reloading evicted DEM" << file_path;
+
+	std::shared_ptr<DEM> dem = read_dem(file_path);
+	if (nullptr == dem) {
+		return nullptr;
 	}
+
+	std::lock_guard<std::mutex> lock(dem_cache_mutex);
+	auto iter = loaded_dems.find(file_path);
+	if (iter == loaded_dems.end()) {
+		/* DEM has been removed from cache while we were reading it. */
+		return nullptr;
+	}
+	LoadedDEM * ldem = (*iter).second;
+	if (nullptr == ldem->dem) {
+		dem_cache_set_dem(ldem, dem);
+		dem_cache_evict_over_budget(ldem);
+	}
+	return ldem->dem;
 }
 
 
@@ -192,13 +345,46 @@ static void dem_cache_unref(const QString & file_path)
  * Assumes that its in there already,
  * although it could not be if earlier load failed.
  */
-DEM * DEMCache::get(const QString & file_path)
+std::shared_ptr<DEM> DEMCache::get(const QString & file_path)
 {
-	auto iter = loaded_dems.find(file_path);
-	if (iter != loaded_dems.end()) {
-		return (*iter).second->dem;
+	{
+		std::lock_guard<std::mutex> lock(dem_cache_mutex);
+		auto iter = loaded_dems.find(file_path);
+		if (iter == loaded_dems.end()) {
+			return nullptr;
+		}
+		LoadedDEM * ldem = (*iter).second;
+		if (ldem->dem) {
+			ldem->last_used = ++use_counter;
+			return ldem->dem;
+		}
 	}
-	return NULL;
+
+	return dem_cache_reload(file_path);
+}
+
+
+
+
+std::shared_ptr<DEM> DEMCache::get(const QString & file_path, const LatLonBBox & area)
+{
+	{
+		std::lock_guard<std::mutex> lock(dem_cache_mutex);
+		auto iter = loaded_dems.find(file_path);
+		if (iter == loaded_dems.end()) {
+			return nullptr;
+		}
+		LoadedDEM * ldem = (*iter).second;
+		if (!ldem->bbox.intersects_with(area)) {
+			return nullptr;
+		}
+		if (ldem->dem) {
+			ldem->last_used = ++use_counter;
+			return ldem->dem;
+		}
+	}
+
+	return dem_cache_reload(file_path);
 }
 
 
@@ -213,6 +399,8 @@ DEM * DEMCache::get(const QString & file_path)
 */
 void DEMCache::unload_from_cache(QStringList & file_paths)
 {
+	std::lock_guard<std::mutex> lock(dem_cache_mutex);
+
 	for (int i = 0; i < file_paths.size(); i++) {
 		dem_cache_unref(file_paths.at(i));
 	}
@@ -226,30 +414,273 @@ Altitude DEMCache::get_elev_by_coord(const Coord & coord, DEMInterpolation metho
 {
 	Altitude result; /* Invalid by default. */
 
-	if (loaded_dems.empty()) {
-		return result;
+	/* Evicted DEMs that cover the coordinate. */
+	QStringList evicted_file_paths;
+	const LatLon lat_lon = coord.get_lat_lon();
+
+	{
+		std::lock_guard<std::mutex> lock(dem_cache_mutex);
+
+		if (loaded_dems.empty()) {
+			return result;
+		}
+
+		for (auto iter = loaded_dems.begin(); iter != loaded_dems.end(); ++iter) {
+			LoadedDEM * ldem = (*iter).second;
+			if (nullptr == ldem->dem) {
+				if (ldem->bbox.contains_point(lat_lon)) {
+					evicted_file_paths.push_back((*iter).first);
+				}
+				continue;
+			}
+
+			int16_t elev = DEM::invalid_elevation;
+
+			if (sg_ret::ok != ldem->dem->get_elev_by_coord(coord, method, elev)) {
+				/* Some logic error that is certain to repeat
+				   in next iteration. */
+				qDebug() << SG_PREFIX_E << "Can't find elevation by coordinates";
+				return result;
+			}
+			if (DEM::invalid_elevation == elev) {
+				/* These coordinates aren't covered by this
+				   DEM, try next DEM. */
+				continue;
+			}
+
+			ldem->last_used = ++use_counter;
+			result = Altitude(elev, AltitudeType::Unit::E::Metres); /* This is DEM, so meters. */
+			return result;
+		}
 	}
 
-	for (auto iter = loaded_dems.begin(); iter != loaded_dems.end(); ++iter) {
-		int16_t elev = DEM::invalid_elevation;
+	/* None of DEMs present in memory covers the coordinate. Bring back evicted ones. */
+	for (int i = 0; i < evicted_file_paths.size(); i++) {
+		std::shared_ptr<DEM> dem = dem_cache_reload(evicted_file_paths.at(i));
+		if (nullptr == dem) {
+			continue;
+		}
 
-		if (sg_ret::ok != (*iter).second->dem->get_elev_by_coord(coord, method, elev)) {
-			/* Some logic error that is certain to repeat
-			   in next iteration. */
-			qDebug() << SG_PREFIX_E << "Can't find elevation by coordinates";
+		int16_t elev = DEM::invalid_elevation;
+		if (sg_ret::ok == dem->get_elev_by_coord(coord, method, elev) && DEM::invalid_elevation != elev) {
+			result = Altitude(elev, AltitudeType::Unit::E::Metres); /* This is DEM, so meters. */
 			break;
 		}
-		if (DEM::invalid_elevation == elev) {
-			/* These coordinates aren't covered by this
-			   DEM, try next DEM. */
+	}
+
+	return result;
+}
+
+
+
+
+/**
+   Positions of coordinates in units of DEMs, calculated once for all
+   DEMs with the same horizontal units (and for all DEMs in the same
+   UTM zone).
+*/
+class DEMPositions {
+public:
+	DEMPositions(const std::vector<Coord> & coords);
+
+	/* Get positions in units of @param dem. The arrays are
+	   valid until next call. */
+	void get(const DEM & dem, const double ** east, const double ** north);
+
+	const std::vector<LatLon> & get_lat_lons(void) const { return this->m_lat_lons; }
+
+	/* Area covered by all coordinates. */
+	const LatLonBBox & get_bbox(void) const { return this->m_bbox; }
+
+private:
+	const std::vector<Coord> & m_coords;
+	std::vector<LatLon> m_lat_lons;
+	LatLonBBox m_bbox;
+
+	std::vector<double> m_lat_lon_east;  /* [arc seconds] */
+	std::vector<double> m_lat_lon_north; /* [arc seconds] */
+
+	std::vector<double> m_utm_east;
+	std::vector<double> m_utm_north;
+	UTM m_utm_zone; /* Zone for which m_utm_east/m_utm_north have been calculated. */
+	bool m_utm_calculated = false;
+};
+
+
+
+
+DEMPositions::DEMPositions(const std::vector<Coord> & coords) : m_coords(coords)
+{
+	const size_t count = this->m_coords.size();
+	this->m_lat_lons.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		this->m_lat_lons[i] = this->m_coords[i].get_lat_lon();
+		if (this->m_lat_lons[i].is_valid()) {
+			this->m_bbox.expand_with_lat_lon(this->m_lat_lons[i]);
+		}
+	}
+	this->m_bbox.validate();
+}
+
+
+
+
+void DEMPositions::get(const DEM & dem, const double ** east, const double ** north)
+{
+	const size_t count = this->m_coords.size();
+
+	if (dem.horiz_units == DEMHorizontalUnit::LatLonArcSeconds) {
+		if (this->m_lat_lon_east.empty()) {
+			this->m_lat_lon_east.resize(count);
+			this->m_lat_lon_north.resize(count);
+			for (size_t i = 0; i < count; i++) {
+				this->m_lat_lon_east[i] = this->m_lat_lons[i].lon.bound_value() * 3600;
+				this->m_lat_lon_north[i] = this->m_lat_lons[i].lat.value() * 3600;
+			}
+		}
+		*east = this->m_lat_lon_east.data();
+		*north = this->m_lat_lon_north.data();
+
+	} else {
+		if (!this->m_utm_calculated || !UTM::is_the_same_zone(this->m_utm_zone, dem.utm)) {
+			/* Positions outside of DEM's UTM zone are moved far
+			   away so that they are never found in the DEM. */
+			this->m_utm_east.resize(count);
+			this->m_utm_north.resize(count);
+			for (size_t i = 0; i < count; i++) {
+				const UTM utm = this->m_coords[i].get_utm();
+				if (UTM::is_the_same_zone(utm, dem.utm)) {
+					this->m_utm_east[i] = utm.get_easting();
+					this->m_utm_north[i] = utm.get_northing();
+				} else {
+					this->m_utm_east[i] = std::numeric_limits<double>::lowest();
+					this->m_utm_north[i] = std::numeric_limits<double>::lowest();
+				}
+			}
+			this->m_utm_zone = dem.utm;
+			this->m_utm_calculated = true;
+		}
+		*east = this->m_utm_east.data();
+		*north = this->m_utm_north.data();
+	}
+}
+
+
+
+
+/* Look up elevations of positions not found yet in given DEM.
+   Return count of positions found in the DEM. */
+static size_t get_elevs_from_dem(const DEM & dem, DEMPositions & positions, size_t count, DEMInterpolation method, int16_t * elevs, size_t n_missing)
+{
+	const double * east = NULL;
+	const double * north = NULL;
+	positions.get(dem, &east, &north);
+	dem.get_elevs_at_east_north(east, north, count, method, elevs);
+
+	size_t n_still_missing = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (elevs[i] == DEM::invalid_elevation) {
+			n_still_missing++;
+		}
+	}
+	return n_missing - n_still_missing;
+}
+
+
+
+
+void DEMCache::get_elevs_by_coords(const std::vector<Coord> & coords, DEMInterpolation method, std::vector<Altitude> & results)
+{
+	const size_t count = coords.size();
+	results.assign(count, Altitude());
+	if (0 == count) {
+		return;
+	}
+
+	std::vector<int16_t> elevs(count, DEM::invalid_elevation);
+	DEMPositions positions(coords);
+	const LatLonBBox & area = positions.get_bbox();
+	if (!area.is_valid()) {
+		return;
+	}
+	size_t n_missing = count;
+
+	/* Take references to DEMs that may cover the coordinates
+	   while holding the lock, and do the calculations without
+	   the lock. */
+	std::vector<std::pair<QString, std::shared_ptr<DEM>>> resident_dems;
+	std::vector<std::pair<QString, LatLonBBox>> evicted_dems;
+	{
+		std::lock_guard<std::mutex> lock(dem_cache_mutex);
+		for (auto iter = loaded_dems.begin(); iter != loaded_dems.end(); ++iter) {
+			LoadedDEM * ldem = (*iter).second;
+			/* Batch with single coordinate on edge of DEM has bbox of zero size on the edge. */
+			if (!ldem->bbox.intersects_with_or_touches(area)) {
+				continue;
+			}
+			if (ldem->dem) {
+				resident_dems.push_back(std::make_pair((*iter).first, ldem->dem));
+			} else {
+				evicted_dems.push_back(std::make_pair((*iter).first, ldem->bbox));
+			}
+		}
+	}
+
+	/* Only DEMs that had elevations of some of coordinates
+	   count as used. */
+	QStringList used_file_paths;
+	for (auto iter = resident_dems.begin(); iter != resident_dems.end() && n_missing > 0; ++iter) {
+		const size_t n_found = get_elevs_from_dem(*(*iter).second, positions, count, method, elevs.data(), n_missing);
+		if (n_found > 0) {
+			n_missing -= n_found;
+			used_file_paths.push_back((*iter).first);
+		}
+	}
+	if (!used_file_paths.empty()) {
+		std::lock_guard<std::mutex> lock(dem_cache_mutex);
+		for (int i = 0; i < used_file_paths.size(); i++) {
+			auto iter = loaded_dems.find(used_file_paths.at(i));
+			if (iter != loaded_dems.end() && (*iter).second->dem) {
+				(*iter).second->last_used = ++use_counter;
+			}
+		}
+	}
+
+	/* Bring back evicted DEMs that cover coordinates not found in DEMs present in memory. */
+	const std::vector<LatLon> & lat_lons = positions.get_lat_lons();
+	for (auto iter = evicted_dems.begin(); iter != evicted_dems.end() && n_missing > 0; ++iter) {
+		bool needed = false;
+		for (size_t i = 0; i < count; i++) {
+			if (elevs[i] == DEM::invalid_elevation && (*iter).second.contains_point(lat_lons[i])) {
+				needed = true;
+				break;
+			}
+		}
+		if (!needed) {
 			continue;
 		}
 
-		result = Altitude(elev, AltitudeType::Unit::E::Metres); /* This is DEM, so meters. */
-		break;
+		std::shared_ptr<DEM> dem = dem_cache_reload((*iter).first);
+		if (nullptr == dem) {
+			continue;
+		}
+		n_missing -= get_elevs_from_dem(*dem, positions, count, method, elevs.data(), n_missing);
 	}
 
-	return result;
+	for (size_t i = 0; i < count; i++) {
+		if (elevs[i] != DEM::invalid_elevation) {
+			results[i] = Altitude(elevs[i], AltitudeType::Unit::E::Metres); /* This is DEM, so meters. */
+		}
+	}
+}
+
+
+
+
+size_t DEMCache::get_size_bytes(void)
+{
+	std::lock_guard<std::mutex> lock(dem_cache_mutex);
+	return current_cache_size_bytes;
 }
 
 
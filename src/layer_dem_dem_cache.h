@@ -25,6 +25,8 @@
 
 
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 
 
@@ -34,6 +36,7 @@
 
 
 
+#include "bbox.h"
 #include "layer_dem_dem.h"
 #include "coord.h"
 
@@ -50,16 +53,49 @@ namespace SlavGPS {
 
 
 
+	/*
+	  Cache of DEMs loaded into memory.
+
+	  Amount of memory used by DEMs is kept within a budget
+	  configured in preferences. When the budget is exceeded, data
+	  of least recently used DEMs is evicted from memory. Evicted
+	  DEMs are still known to the cache and are loaded again
+	  (transparently to callers) when they are needed.
+
+	  All functions of the cache can be called from multiple threads.
+	*/
 	class DEMCache {
 	public:
+		static void init(void); /* For module initialization. */
 		static void uninit(void); /* For module deinitialization. */
 
-		static DEM * load_file_into_cache(const QString & file_full_path);
-		static void  unload_from_cache(QStringList & file_paths);
+		static std::shared_ptr<DEM> load_file_into_cache(const QString & file_full_path);
+		static void unload_from_cache(QStringList & file_paths);
+
+		static std::shared_ptr<DEM> get(const QString & file_path);
+
+		/**
+		   @brief Get DEM only if it covers at least part of @param area
 
-		static DEM * get(const QString & file_path);
+		   DEM that doesn't cover the area is not re-loaded
+		   into memory if it has been evicted.
+		*/
+		static std::shared_ptr<DEM> get(const QString & file_path, const LatLonBBox & area);
 
 		static Altitude get_elev_by_coord(const Coord & coord, DEMInterpolation method);
+
+		/**
+		   @brief Get elevations for many coordinates at once
+
+		   Much faster than calling get_elev_by_coord() for
+		   each coordinate, e.g. for all trackpoints of a track.
+
+		   @param results: altitudes for @param coords; invalid altitude for coordinates not covered by any DEM
+		*/
+		static void get_elevs_by_coords(const std::vector<Coord> & coords, DEMInterpolation method, std::vector<Altitude> & results);
+
+		/* Get size of DEM data present in memory (in bytes). */
+		static size_t get_size_bytes(void);
 	};
 
 
@@ -23,6 +23,12 @@
 
 
 
+#include <cstdio>
+#include <cstring>
+
+
+
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <endian.h>
@@ -32,12 +38,17 @@
 
 
 #include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QHash>
 
 
 
 
 #include "compression.h"
+#include "file_utils.h"
 #include "layer_dem_dem_srtm.h"
+#include "map_cache.h"
 #include "vikutils.h"
 
 
@@ -58,6 +69,184 @@ static const int g_secs_per_degree = 60 * 60;
 
 
 
+/*
+  Cache of decompressed tiles.
+
+  Each file in the cache starts with NativeTileHeader, followed by
+  samples of the tile in host byte order, laid out column after
+  column (southernmost sample first), exactly as DEMColumn::m_points
+  expects them. This allows the file to be mapped read-only and used
+  as backing store of DEM without any copying or conversion, and lets
+  the kernel share the pages between sessions and processes.
+*/
+#define NATIVE_TILE_MAGIC "SGSRTM1"
+#define NATIVE_TILE_BYTE_ORDER 0x01020304
+
+
+
+
+struct NativeTileHeader {
+	char magic[8];
+	uint32_t byte_order;   /* Detects cache files copied from host with different endianness. */
+	int32_t n_rows;        /* Tiles are square: number of rows == number of columns. */
+	int32_t arcsec;
+	int32_t reserved;
+	int64_t source_size;   /* Size and modification time of source .hgt/.hgt.zip file, used to detect stale cache entries. */
+	int64_t source_mtime;
+};
+
+
+
+
+static QString native_tile_file_full_path(const QString & source_file_full_path)
+{
+	QString tile_name = file_base_name(source_file_full_path);
+	tile_name.remove(".hgt.zip");
+	tile_name.remove(".hgt");
+
+	/* Files with the same name but with different contents
+	   (e.g. 1-arc-sec and 3-arc-sec versions of a tile) may be
+	   present in different directories. */
+	const unsigned int path_hash = qHash(source_file_full_path, 0);
+
+	return MapCache::get_dir() + QString("srtm-native%1%2-%3.sgdem").arg(QDir::separator()).arg(tile_name).arg(path_hash, 8, 16, QChar('0'));
+}
+
+
+
+
+DEMSRTM::~DEMSRTM()
+{
+	if (this->native_contents) {
+		this->native_file.unmap(this->native_contents);
+		this->native_contents = nullptr;
+	}
+	this->native_file.close();
+}
+
+
+
+
+/**
+   @brief Try to use a tile from cache of decompressed tiles as backing store of this DEM
+
+   @return sg_ret::ok if valid and up-to-date tile was found in cache and mapped
+   @return sg_ret::err otherwise
+*/
+sg_ret DEMSRTM::map_native_tile(const QString & native_file_full_path, const QFileInfo & source_info)
+{
+	this->native_file.setFileName(native_file_full_path);
+	if (!this->native_file.exists()) {
+		return sg_ret::err;
+	}
+	if (!this->native_file.open(QIODevice::ReadOnly)) {
+		qDebug() << SG_PREFIX_W << "Can't open cached tile" << native_file_full_path << this->native_file.error();
+		return sg_ret::err;
+	}
+
+	const qint64 file_size = this->native_file.size();
+	if (file_size < (qint64) sizeof (NativeTileHeader)) {
+		qDebug() << SG_PREFIX_W << "Cached tile" << native_file_full_path << "is too short";
+		this->native_file.close();
+		return sg_ret::err;
+	}
+
+	unsigned char * contents = this->native_file.map(0, file_size);
+	if (!contents) {
+		qDebug() << SG_PREFIX_W << "Can't map cached tile" << native_file_full_path << this->native_file.error();
+		this->native_file.close();
+		return sg_ret::err;
+	}
+
+	NativeTileHeader header;
+	memcpy(&header, contents, sizeof (header));
+
+	const bool valid = 0 == strncmp(header.magic, NATIVE_TILE_MAGIC, sizeof (header.magic))
+		&& header.byte_order == NATIVE_TILE_BYTE_ORDER
+		&& (header.arcsec == 1 || header.arcsec == 3)
+		&& header.n_rows > 0
+		&& file_size == (qint64) (sizeof (NativeTileHeader) + (size_t) header.n_rows * header.n_rows * sizeof (int16_t))
+		&& header.source_size == source_info.size()
+		&& header.source_mtime == source_info.lastModified().toMSecsSinceEpoch();
+	if (!valid) {
+		qDebug() << SG_PREFIX_I << "Cached tile" << native_file_full_path << "is invalid or stale";
+		this->native_file.unmap(contents);
+		this->native_file.close();
+		return sg_ret::err;
+	}
+
+	this->native_contents = contents;
+
+	const int32_t num_rows = header.n_rows;
+	const int32_t num_cols = num_rows;
+	this->scale.x = header.arcsec;
+	this->scale.y = header.arcsec;
+
+	int16_t * samples = (int16_t *) (this->native_contents + sizeof (NativeTileHeader));
+	this->columns.reserve(num_cols);
+	for (int32_t col = 0; col < num_cols; col++) {
+		this->n_columns++;
+		DEMColumn * new_column = new DEMColumn(this->min_east_seconds + header.arcsec * col, this->min_north_seconds, num_rows, samples + (size_t) col * num_rows);
+		this->columns.push_back(new_column);
+	}
+
+	return sg_ret::ok;
+}
+
+
+
+
+/**
+   @brief Save decompressed, converted samples of a tile in cache of decompressed tiles
+
+   @param samples: samples in native byte order, in column-major order
+*/
+sg_ret DEMSRTM::write_native_tile(const QString & native_file_full_path, const QFileInfo & source_info, int arcsec, int32_t num_rows, const std::vector<int16_t> & samples) const
+{
+	if (sg_ret::ok != FileUtils::create_directory_for_file(native_file_full_path)) {
+		return sg_ret::err;
+	}
+
+	NativeTileHeader header;
+	memset(&header, 0, sizeof (header));
+	strncpy(header.magic, NATIVE_TILE_MAGIC, sizeof (header.magic));
+	header.byte_order = NATIVE_TILE_BYTE_ORDER;
+	header.n_rows = num_rows;
+	header.arcsec = arcsec;
+	header.source_size = source_info.size();
+	header.source_mtime = source_info.lastModified().toMSecsSinceEpoch();
+
+	/* Write to temporary file and rename it, so that other
+	   processes never see partially written tile. */
+	const QString tmp_file_full_path = native_file_full_path + QString(".%1.tmp").arg(getpid());
+	QFile tmp_file(tmp_file_full_path);
+	if (!tmp_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qDebug() << SG_PREFIX_W << "Can't open file" << tmp_file_full_path << "for writing:" << tmp_file.error();
+		return sg_ret::err;
+	}
+
+	const qint64 data_size = samples.size() * sizeof (int16_t);
+	if (tmp_file.write((const char *) &header, sizeof (header)) != (qint64) sizeof (header)
+	    || tmp_file.write((const char *) samples.data(), data_size) != data_size) {
+		qDebug() << SG_PREFIX_W << "Failed to write cached tile" << tmp_file_full_path << tmp_file.error();
+		tmp_file.close();
+		tmp_file.remove();
+		return sg_ret::err;
+	}
+	tmp_file.close();
+
+	if (0 != rename(tmp_file_full_path.toUtf8().constData(), native_file_full_path.toUtf8().constData())) {
+		qDebug() << SG_PREFIX_W << "Failed to rename" << tmp_file_full_path << "to" << native_file_full_path;
+		tmp_file.remove();
+		return sg_ret::err;
+	}
+
+	return sg_ret::ok;
+}
+
+
+
+
 /**
    \reviewed 2019-01-28
 */
@@ -119,6 +308,16 @@ sg_ret DEMSRTM::read_from_file(const QString & file_full_path)
 	this->n_columns = 0;
 
 
+	/* Fast path: tile has been already decompressed and
+	   converted, either in this session or in previous one. */
+	const QFileInfo source_info(file_full_path);
+	const QString native_file_full_path = native_tile_file_full_path(file_full_path);
+	if (sg_ret::ok == this->map_native_tile(native_file_full_path, source_info)) {
+		qDebug() << SG_PREFIX_I << "Using cached tile" << native_file_full_path << "for" << file_full_path;
+		return sg_ret::ok;
+	}
+
+
 	QFile file(file_full_path);
 	if (!file.open(QIODevice::ReadOnly)) {
 		qDebug() << SG_PREFIX_E << "Can't open file" << file_full_path << file.error();
@@ -165,6 +364,9 @@ sg_ret DEMSRTM::read_from_file(const QString & file_full_path)
 		arcsec = 1;
 	} else {
 		qDebug() << SG_PREFIX_W << "File" << file_name << "does not have right size, dem size = " << dem_size;
+		if (is_zip) {
+			free(dem_contents);
+		}
 		file.unmap(file_contents);
 		file.close();
 		return sg_ret::err;
@@ -172,20 +374,14 @@ sg_ret DEMSRTM::read_from_file(const QString & file_full_path)
 
 	const int32_t num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
 	const int32_t num_cols = num_rows;
-	this->scale.x = arcsec;
-	this->scale.y = arcsec;
-
-	this->columns.reserve(num_cols);
-	for (int col = 0; col < num_cols; col++) {
-		this->n_columns++;
-		DEMColumn * new_column = new DEMColumn(this->min_east_seconds + arcsec * col, this->min_north_seconds, num_rows);
-		this->columns.push_back(new_column);
-	}
 
+	/* Convert into native byte order and into layout of DEM
+	   columns. File stores rows from north to south. */
+	std::vector<int16_t> samples((size_t) num_rows * num_cols);
 	int32_t point = 0;
 	for (int32_t row = (num_rows - 1); row >= 0; row--) {
 		for (int32_t col = 0; col < num_cols; col++) {
-			this->columns[col]->m_points[row] = be16toh(dem_contents[point]);
+			samples[(size_t) col * num_rows + row] = be16toh(dem_contents[point]);
 			point++;
 		}
 	}
@@ -195,5 +391,29 @@ sg_ret DEMSRTM::read_from_file(const QString & file_full_path)
 	}
 	file.unmap(file_contents);
 	file.close();
+
+
+	/* Next time (in this or other process) the tile will be
+	   taken from cache. */
+	if (sg_ret::ok == this->write_native_tile(native_file_full_path, source_info, arcsec, num_rows, samples)
+	    && sg_ret::ok == this->map_native_tile(native_file_full_path, source_info)) {
+
+		qDebug() << SG_PREFIX_I << "Saved tile" << file_full_path << "in cache as" << native_file_full_path;
+		return sg_ret::ok;
+	}
+
+
+	/* Cache of decompressed tiles is not available. Keep the samples on heap. */
+	this->scale.x = arcsec;
+	this->scale.y = arcsec;
+
+	this->columns.reserve(num_cols);
+	for (int col = 0; col < num_cols; col++) {
+		this->n_columns++;
+		DEMColumn * new_column = new DEMColumn(this->min_east_seconds + arcsec * col, this->min_north_seconds, num_rows);
+		memcpy(new_column->m_points, samples.data() + (size_t) col * num_rows, num_rows * sizeof (int16_t));
+		this->columns.push_back(new_column);
+	}
+
 	return sg_ret::ok;
 }
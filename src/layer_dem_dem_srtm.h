@@ -25,6 +25,17 @@
 
 
 
+#include <vector>
+
+
+
+
+#include <QFile>
+#include <QFileInfo>
+
+
+
+
 #include "layer_dem_dem.h"
 
 
@@ -35,7 +46,19 @@ namespace SlavGPS {
 
 	class DEMSRTM : public DEM {
 	public:
+		~DEMSRTM();
+
 		sg_ret read_from_file(const QString & file_full_path) override;
+
+	private:
+		sg_ret map_native_tile(const QString & native_file_full_path, const QFileInfo & source_info);
+		sg_ret write_native_tile(const QString & native_file_full_path, const QFileInfo & source_info, int arcsec, int32_t num_rows, const std::vector<int16_t> & samples) const;
+
+		/* Read-only mapping of tile from cache of decompressed,
+		   native-endian tiles. When the mapping is present,
+		   columns of this DEM point directly into it. */
+		QFile native_file;
+		unsigned char * native_contents = nullptr;
 	};
 
 
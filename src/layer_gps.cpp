@@ -587,7 +587,7 @@ sg_ret LayerGPS::attach_unattached_children(void)
 		}
 		qDebug() << SG_PREFIX_I << "Attaching item" << trw->get_name() << "to tree under" << this->get_name();
 		this->attach_child_to_tree(trw); /* Will call attach_unattached_children() for TRW's child items. */
-		QObject::connect(trw, SIGNAL (tree_item_changed(const QString &)), this, SLOT (child_tree_item_changed_cb(const QString &)));
+		QObject::connect(trw, SIGNAL (tree_item_changed(const QString &, bool)), this, SLOT (child_tree_item_changed_cb(const QString &, bool)));
 	}
 
 	return sg_ret::ok;
@@ -1062,7 +1062,7 @@ void GPSSession::run(void)
 					this->trw->post_read(this->gisview, true);
 					/* View the data available. */
 					this->trw->move_viewport_to_show_all(this->gisview) ;
-					this->trw->emit_tree_item_changed("GPS Session - post read"); /* NB update from background thread. */
+					this->trw->emit_tree_item_changed_in_background("GPS Session - post read"); /* NB update from background thread. */
 				}
 			}
 		} else {
@@ -1576,9 +1576,9 @@ void LayerGPS::rt_gpsd_raw_hook(void)
 
 	/* Update from background thread. */
 	if (viewport_shifted) {
-		this->emit_tree_item_changed("Requesting redrawing of all layers because viewport has been shifted after adding new tp");
+		this->emit_tree_item_changed_in_background("Requesting redrawing of all layers because viewport has been shifted after adding new tp");
 	} else {
-		this->trw_children[GPS_CHILD_LAYER_TRW_REALTIME]->emit_tree_item_changed("Requesting redrawing of Realtime TRW Layer after adding new tp");
+		this->trw_children[GPS_CHILD_LAYER_TRW_REALTIME]->emit_tree_item_changed_in_background("Requesting redrawing of Realtime TRW Layer after adding new tp");
 	}
 }
 
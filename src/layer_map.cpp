@@ -2099,7 +2099,7 @@ QString SlavGPS::to_string(MapDownloadMode download_mode)
 
 sg_ret LayerMap::handle_downloaded_tile_cb(void)
 {
-	this->emit_tree_item_changed("Indicating change to layer in response to downloading new map tile");
+	this->emit_tree_item_changed_in_background("Indicating change to layer in response to downloading new map tile");
 	return sg_ret::ok;
 }
 
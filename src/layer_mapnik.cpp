@@ -724,7 +724,7 @@ void RenderJob::run(void)
 		/* We weren't told to terminate this background task,
 		   so we can proceed to ask for displaying of rendered
 		   tile. */
-		this->layer->emit_tree_item_changed("Indicating ending of rendering of Mapnik tile from background job");
+		this->layer->emit_tree_item_changed_in_background("Indicating ending of rendering of Mapnik tile from background job");
 	}
 	return;
 }
@@ -819,7 +819,7 @@ QPixmap LayerMapnik::get_pixmap(const TileInfo & tile_info)
 			   caller of get_pixmap(), without the need to
 			   emit signal? */
 			this->render_tile_now(tile_info);
-			this->emit_tree_item_changed("Indicating ending of rendering of Mapnik tile from foreground job");
+			this->emit_tree_item_changed_in_background("Indicating ending of rendering of Mapnik tile from foreground job");
 		}
 	}
 
@@ -860,6 +860,10 @@ void LayerMapnik::draw_tree_item(GisViewport * gisview, __attribute__((unused))
 
 	for (tile_iter.x = range.horiz_first_idx; tile_iter.x <= range.horiz_last_idx; tile_iter.x++) {
 		for (tile_iter.y = range.vert_first_idx; tile_iter.y <= range.vert_last_idx; tile_iter.y++) {
+			if (gisview->render_is_cancelled()) {
+				qDebug() << SG_PREFIX_I << "Drawing of Mapnik tiles has been cancelled";
+				return;
+			}
 			this->draw_tile(gisview, tile_iter);
 		}
 	}
@@ -720,9 +720,9 @@ void LayerTRW::wp_image_cache_flush(void)
 
 
 
-void LayerTRW::wp_image_cache_add(const CachedPixmap & cached_pixmap)
+void LayerTRW::wp_image_cache_add(const QString & image_full_path, const CachedPixmap & cached_pixmap)
 {
-	this->wp_image_cache.add(cached_pixmap);
+	this->wp_image_cache.add(image_full_path, cached_pixmap);
 }
 
 
@@ -1217,8 +1217,17 @@ static unsigned int strcase_hash(gconstpointer v)
 
 void LayerTRW::draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
 {
+	/* In worker thread use snapshot taken in main thread. */
+	DrawSnapshot snapshot;
+	if (this->parallel_draw_snapshot.valid) {
+		snapshot = std::move(this->parallel_draw_snapshot);
+		this->parallel_draw_snapshot = DrawSnapshot();
+	} else {
+		this->take_draw_snapshot(snapshot);
+	}
+
 	/* Check the layer for visibility (including all the parents' visibilities). */
-	if (!this->tree_view->get_tree_item_visibility_with_parents(this)) {
+	if (!snapshot.visible) {
 		return;
 	}
 
@@ -1232,27 +1241,86 @@ void LayerTRW::draw_tree_item(GisViewport * gisview, bool highlight_selected, bo
 		return;
 	}
 
-	if (this->m_tracks.is_visible()) {
+	/* Labels of tracks, routes and waypoints are culled together. */
+	this->painter->begin_labels();
+
+	if (snapshot.tracks_visible) {
 		qDebug() << SG_PREFIX_I << "Calling function to draw tracks, highlight:" << highlight_selected << item_is_selected;
-		this->m_tracks.draw_tree_item(gisview, highlight_selected, item_is_selected);
+		this->m_tracks.draw_tracks(gisview, snapshot.tracks, highlight_selected, item_is_selected);
 	}
 
-	if (this->m_routes.is_visible()) {
+	if (snapshot.routes_visible) {
 		qDebug() << SG_PREFIX_I << "Calling function to draw routes, highlight:" << highlight_selected << item_is_selected;
-		this->m_routes.draw_tree_item(gisview, highlight_selected, item_is_selected);
+		this->m_routes.draw_tracks(gisview, snapshot.routes, highlight_selected, item_is_selected);
 	}
 
-	if (this->m_waypoints.is_visible()) {
+	if (snapshot.waypoints_visible) {
 		qDebug() << SG_PREFIX_I << "Calling function to draw waypoints, highlight:" << highlight_selected << item_is_selected;
-		this->m_waypoints.draw_tree_item(gisview, highlight_selected, item_is_selected);
+		this->m_waypoints.draw_waypoints(gisview, highlight_selected, item_is_selected);
 	}
 
+	this->painter->end_labels();
+
 	return;
 }
 
 
 
 
+void LayerTRW::take_draw_snapshot(DrawSnapshot & snapshot) const
+{
+	snapshot = DrawSnapshot();
+	snapshot.valid = true;
+
+	snapshot.visible = this->tree_view->get_tree_item_visibility_with_parents(this);
+	if (!snapshot.visible) {
+		return;
+	}
+
+	snapshot.tracks_visible = this->m_tracks.is_visible() && this->m_tracks.is_drawable();
+	if (snapshot.tracks_visible) {
+		this->m_tracks.get_tracks_in_draw_order(snapshot.tracks);
+	}
+
+	snapshot.routes_visible = this->m_routes.is_visible() && this->m_routes.is_drawable();
+	if (snapshot.routes_visible) {
+		this->m_routes.get_tracks_in_draw_order(snapshot.routes);
+	}
+
+	snapshot.waypoints_visible = this->m_waypoints.is_visible() && this->m_waypoints.is_drawable();
+}
+
+
+
+
+bool LayerTRW::supports_parallel_drawing(void) const
+{
+	/* Images and Garmin symbols of waypoints are QPixmaps, and
+	   QPixmaps can be painted only in GUI thread. Images are
+	   also loaded into pixmaps when they are drawn for the
+	   first time. */
+	if ((this->painter->draw_wp_images || this->painter->draw_wp_symbols)
+	    && this->m_waypoints.is_visible()
+	    && !this->m_waypoints.attached_empty()) {
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+void LayerTRW::prepare_parallel_drawing(void)
+{
+	/* Tree model (and persistent indices of items in it)
+	   can't be used by worker thread. */
+	this->take_draw_snapshot(this->parallel_draw_snapshot);
+}
+
+
+
+
 sg_ret LayerTRW::attach_unattached_children(void)
 {
 	qDebug() << SG_PREFIX_D;
@@ -1991,7 +2059,7 @@ sg_ret LayerTRW::add_track(Track * trk)
 			} else {
 				this->add_track(trk);
 			}
-			QObject::connect(trk, SIGNAL (tree_item_changed(const QString &)), this, SLOT (child_tree_item_changed_cb(const QString &)));
+			QObject::connect(trk, SIGNAL (tree_item_changed(const QString &, bool)), this, SLOT (child_tree_item_changed_cb(const QString &, bool)));
 
 			if (this->route_finder_check_added_track) {
 				trk->remove_dup_points(); /* Make "double point" track work to undo. */
@@ -2066,6 +2134,7 @@ sg_ret LayerTRW::add_waypoint(Waypoint * wp)
 			qDebug() << SG_PREFIX_E << "Failed to add waypoint to Waypoints container attached to Model";
 			return sg_ret::err;
 		}
+		this->m_waypoints.invalidate_index();
 
 		return sg_ret::ok;
 	} else {
@@ -2170,6 +2239,7 @@ sg_ret LayerTRW::remove_child(TreeItem * tree_item)
 			this->tree_view->detach_tree_item(&this->m_routes);
 		}
 	} else if (tree_item->get_type_id() == Waypoint::type_id()) {
+		this->m_waypoints.invalidate_index();
 		if (this->m_waypoints.attached_size() == 0) {
 			this->tree_view->detach_tree_item(&this->m_waypoints);
 		}
@@ -2242,6 +2312,7 @@ void LayerTRW::delete_all_waypoints()
 	this->m_waypoints.name_generator.reset();
 
 	this->m_waypoints.clear();
+	this->m_waypoints.invalidate_index();
 	this->tree_view->detach_tree_item(&this->m_waypoints);
 	this->m_waypoints.set_visible(false); /* There is no such item in tree anymore. */
 
@@ -2886,6 +2957,15 @@ void LayerTRW::on_wp_properties_dialog_wp_coordinates_changed_cb(void)
 
 
 
+
+void LayerTRW::on_track_lod_ready_cb(void)
+{
+	qDebug() << SG_PREFIX_SIGNAL << "Will emit 'layer changed' after generating simplified track";
+	this->emit_tree_item_changed("TRW - simplified track generated");
+}
+
+
+
 void LayerTRW::tp_show_properties_dialog()
 {
 	LayerToolTRWEditTrackpoint * tool = (LayerToolTRWEditTrackpoint *) ThisApp::main_window()->toolbox()->get_tool(LayerToolTRWEditTrackpoint::tool_id());
@@ -2959,20 +3039,26 @@ ThumbnailCreator::ThumbnailCreator(LayerTRW * new_layer, const QStringList & new
 
 
 
+/**
+   Thumbnails are created in parallel: this job's thread is joined by
+   helper threads from the same (local) thread pool, as many as the
+   pool has available.
+*/
 void ThumbnailCreator::run(void)
 {
-	const int n = this->original_image_files_paths.size();
-	for (int i = 0; i < n; i++) {
-		Thumbnails::generate_thumbnail_if_missing(this->original_image_files_paths.at(i));
-		const bool end_job = this->set_progress_state((i + 1.0) / n);
-		if (end_job) {
-			return; /* Abort thread. */
-		}
+	const bool completed = ParallelItems::process(this->original_image_files_paths.size(), [this](int idx) {
+			const QString & file_path = this->original_image_files_paths.at(idx);
+			if (!Thumbnails::generate_thumbnail_if_missing(file_path)) {
+				qDebug() << SG_PREFIX_E << "Failed to create thumbnail of" << file_path;
+			}
+		}, this);
+	if (!completed) {
+		return; /* Abort thread. */
 	}
 
 	/* Redraw to show the thumbnails as they are now created. */
 	if (this->layer) {
-		this->layer->emit_tree_item_changed("TRW - thumbnail creator"); /* NB update from background thread. */
+		this->layer->emit_tree_item_changed_in_background("TRW - thumbnail creator"); /* NB update from background thread. */
 	}
 
 	return;
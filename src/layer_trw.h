@@ -29,6 +29,7 @@
 #include <list>
 #include <deque>
 #include <mutex>
+#include <vector>
 
 
 
@@ -180,6 +181,8 @@ namespace SlavGPS {
 
 		/* Draw all items of the layer, with highlight. */
 		void draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+		bool supports_parallel_drawing(void) const override;
+		void prepare_parallel_drawing(void) override;
 
 
 		void recalculate_bbox(void);
@@ -430,15 +433,33 @@ namespace SlavGPS {
 		void append_other_cb(void);
 		void routes_stats_cb();
 
-		void wp_image_cache_add(const CachedPixmap & cached_pixmap);
+		void wp_image_cache_add(const QString & image_full_path, const CachedPixmap & cached_pixmap);
 
 		void on_tp_properties_dialog_tp_coordinates_changed_cb(void);
 
 		void on_wp_properties_dialog_wp_coordinates_changed_cb(void);
 
+		void on_track_lod_ready_cb(void);
+
 	private:
 		void wp_image_cache_flush(void);
 
+		/* What should be drawn, as seen in tree view. */
+		class DrawSnapshot {
+		public:
+			bool valid = false;
+			bool visible = false; /* Visibility of layer, including visibility of its parents. */
+			bool tracks_visible = false;
+			bool routes_visible = false;
+			bool waypoints_visible = false;
+			std::vector<Track *> tracks; /* In order of rows in tree view. */
+			std::vector<Track *> routes; /* In order of rows in tree view. */
+		};
+		/* Must be called in main thread. */
+		void take_draw_snapshot(DrawSnapshot & snapshot) const;
+		/* Snapshot taken by prepare_parallel_drawing(), to be used by drawing in worker thread. */
+		DrawSnapshot parallel_draw_snapshot;
+
 		LayerTRWTracks m_tracks{false}; /* Sub-node, under which all layer's tracks are shown. */
 		LayerTRWTracks m_routes{true};  /* Sub-node, under which all layer's routes are shown. */
 		LayerTRWWaypoints m_waypoints;  /* Sub-node, under which all layer's waypoints are shown. */
@@ -21,11 +21,14 @@
 
 
 
+#include <algorithm>
 #include <cstdint>
 #include <cmath>
+#include <list>
 #include <time.h>
 #include <cstring>
 #include <cstdlib>
+#include <vector>
 
 
 
@@ -144,6 +147,193 @@ GeoTagDialog::~GeoTagDialog()
 
 
 
+/**
+   @brief Time-sorted index of timestamped trackpoints of tracks
+
+   The index is a list of spans of time: a single trackpoint
+   (span of zero length), or a pair of consecutive trackpoints
+   between which a position can be interpolated. Spans are
+   sorted by their beginning, so spans that may contain given
+   time are found with binary search.
+*/
+class GeotagTrackpointsIndex {
+public:
+	/* Index trackpoints of @param tracks. Trackpoints from different
+	   segments of a track are paired only if @param interpolate_segments is true. */
+	void build(const std::list<Track *> & tracks, bool interpolate_segments);
+
+	/* Find position at @param time. If more than one track
+	   matches the time, the first track from the list given
+	   to build() is used, as when tracks are searched one by one. */
+	bool find_position(const Time & time, Coord & coord, Altitude & altitude) const;
+
+	size_t size(void) const { return this->spans.size(); }
+
+private:
+	class Span {
+	public:
+		Time::LL begin_time;
+		Time::LL end_time;
+		Trackpoint * tp_begin;
+		Trackpoint * tp_end;  /* NULL for a span of single trackpoint. */
+		size_t track_idx;     /* Index of track on list of tracks. */
+		size_t seq;           /* Order of span within the track. */
+	};
+
+	std::vector<Span> spans;
+	/* max_end_times[i] is the largest end time of spans[0]..spans[i]. */
+	std::vector<Time::LL> max_end_times;
+};
+
+
+
+
+void GeotagTrackpointsIndex::build(const std::list<Track *> & tracks, bool interpolate_segments)
+{
+	this->spans.clear();
+	this->max_end_times.clear();
+
+	size_t track_idx = 0;
+	for (auto trk_iter = tracks.begin(); trk_iter != tracks.end(); trk_iter++, track_idx++) {
+		Track * trk = *trk_iter;
+		size_t seq = 0;
+
+		for (auto iter = trk->begin(); iter != trk->end(); iter++) {
+			Trackpoint * tp = *iter;
+			if (!tp->timestamp.is_valid()) {
+				continue;
+			}
+
+			/* Photo taken exactly at this point. */
+			const Time::LL tp_time = tp->timestamp.ll_value();
+			this->spans.push_back({ tp_time, tp_time, tp, NULL, track_idx, seq++ });
+
+			/* Now need two trackpoints, hence check if next tp is available. */
+			if (std::next(iter) == trk->end()) {
+				break;
+			}
+			Trackpoint * tp_next = *std::next(iter);
+			if (!tp_next->timestamp.is_valid()) {
+				continue;
+			}
+
+			/* Skip repeated and out-of-order timestamps. */
+			const Time::LL tp_next_time = tp_next->timestamp.ll_value();
+			if (tp_next_time <= tp_time) {
+				continue;
+			}
+
+			/* When interpolating between segments, no need for any special segment handling. */
+			if (!interpolate_segments && tp_next->newsegment) {
+				/* Don't interpolate between segments. */
+				continue;
+			}
+
+			this->spans.push_back({ tp_time, tp_next_time, tp, tp_next, track_idx, seq++ });
+		}
+	}
+
+	std::sort(this->spans.begin(), this->spans.end(), [](const Span & a, const Span & b) {
+			return a.begin_time < b.begin_time;
+		});
+
+	this->max_end_times.reserve(this->spans.size());
+	for (size_t i = 0; i < this->spans.size(); i++) {
+		const Time::LL end_time = this->spans[i].end_time;
+		this->max_end_times.push_back(i == 0 ? end_time : std::max(end_time, this->max_end_times[i - 1]));
+	}
+}
+
+
+
+
+bool GeotagTrackpointsIndex::find_position(const Time & time, Coord & coord, Altitude & altitude) const
+{
+	const Time::LL photo_time = time.ll_value();
+
+	/* First span beginning after the photo was taken. */
+	auto upper = std::upper_bound(this->spans.begin(), this->spans.end(), photo_time, [](Time::LL value, const Span & span) {
+			return value < span.begin_time;
+		});
+
+	/* Go back through spans beginning before (or at) the time,
+	   until no earlier span can reach the time. With tracks
+	   that don't overlap in time only one or two spans are
+	   visited. */
+	const Span * best = NULL;
+	for (long i = (upper - this->spans.begin()) - 1; i >= 0 && this->max_end_times[i] >= photo_time; i--) {
+		const Span & span = this->spans[i];
+
+		const bool matches = span.tp_end
+			? (span.begin_time < photo_time && photo_time < span.end_time)
+			: (span.begin_time == photo_time);
+		if (!matches) {
+			continue;
+		}
+
+		if (!best || span.track_idx < best->track_idx || (span.track_idx == best->track_idx && span.seq < best->seq)) {
+			best = &span;
+		}
+	}
+
+	if (!best) {
+		return false;
+	}
+
+	if (!best->tp_end) {
+		coord = best->tp_begin->coord;
+		altitude = best->tp_begin->altitude;
+		return true;
+	}
+
+	/*
+	  Interpolate coordinate and altitude using timestamps as a
+	  base for interpolation.
+
+	  Calculate the "scale": a value giving the relative distance
+	  in time from beginning of span to time of taking a photo.
+	  Beginning and end of span are never equal, so division is
+	  safe.
+	*/
+	const double scale = ((double) (photo_time - best->begin_time)) / (best->end_time - best->begin_time);
+
+	/* Interpolate coordinate. */
+	const LatLon interpolated = LatLon::get_interpolated(best->tp_begin->coord.get_lat_lon(), best->tp_end->coord.get_lat_lon(), scale);
+	coord = Coord(interpolated, CoordMode::LatLon);
+
+	/* Interpolate elevation. */
+	altitude = best->tp_begin->altitude + ((best->tp_end->altitude - best->tp_begin->altitude) * scale);
+
+	return true;
+}
+
+
+
+
+/* Result of geotagging of one image, to be applied to TRW layer. */
+class GeotagImageResult {
+public:
+	GeotagExifInfo exif_info; /* Read before EXIF of the image has been modified. */
+
+	/* Image already has GPS info that won't be changed,
+	   waypoint should be created from this info. */
+	bool use_exif_position = false;
+
+	/* Position of image found on tracks. */
+	bool found_match = false;
+	Coord coord;
+	Altitude altitude;
+
+	bool exif_write_failed = false;
+
+	/* Image has been processed (and its EXIF may have been
+	   modified) before the job has been aborted. */
+	bool processed = false;
+};
+
+
+
+
 class GeotagJob : public BackgroundJob {
 public:
 	GeotagJob(GeoTagDialog * dialog);
@@ -151,10 +341,9 @@ public:
 
 	void run(void);
 
-
-	void geotag_image(const QString & file_full_path);
-	sg_ret geotag_image_from_waypoint(const QString & file_full_path, const Coord & coord, const Altitude & altitude);
-	sg_ret geotag_image_from_track(Track * trk);
+	GeotagImageResult geotag_image(const QString & file_full_path) const;
+	sg_ret geotag_image_from_waypoint(const QString & file_full_path, const Coord & coord, const Altitude & altitude) const;
+	void apply_result(const QString & file_full_path, const GeotagImageResult & result);
 
 	QStringList selected_images;
 
@@ -165,13 +354,13 @@ public:
 	/* User options... */
 	GeoTagValues values;
 
-	Time photo_time;
-	/* Store answer from interpolation for an image. */
-	bool found_match = false;
-	Coord coord;
-	Altitude altitude;
+	GeotagTrackpointsIndex trackpoints_index;
+
 	/* If anything has changed. */
 	bool redraw = false;
+
+	/* Results of images processed in parallel. Each thread writes only results of its images. */
+	std::vector<GeotagImageResult> results;
 };
 
 
@@ -226,8 +415,6 @@ GeotagJob::GeotagJob(GeoTagDialog * dialog)
 	this->selected_images = dialog->files_selection->get_list();
 
 	this->n_items = this->selected_images.size();
-
-	this->photo_time = Time(0, TimeType::Unit::internal_unit()); /* This will set timestamp as valid. */
 }
 
 
@@ -307,108 +494,10 @@ static GeoTagValues get_default_values(void)
 
 
 
-/**
-   Correlate the image against the specified track.
-*/
-sg_ret GeotagJob::geotag_image_from_track(Track * trk2)
-{
-	/* If already found match then don't need to check this track. */
-	if (this->found_match) {
-		return sg_ret::ok;
-	}
-
-	const AltitudeType::Unit height_unit = AltitudeType::Unit::E::Metres;
-
-	for (auto iter = trk2->begin(); iter != trk2->end(); iter++) {
-
-		Trackpoint * tp = *iter;
-		if (!tp->timestamp.is_valid()) {
-			continue;
-		}
-
-		/* Is it exactly this point? */
-		if (this->photo_time == tp->timestamp) {
-			this->coord = tp->coord;
-			this->altitude = tp->altitude;
-			this->found_match = true;
-			break;
-		}
-
-		/* Now need two trackpoints, hence check if next tp is available. */
-		if (std::next(iter) == trk2->end()) {
-			break;
-		}
-
-		Trackpoint * tp_next = *std::next(iter);
-		if (!tp_next->timestamp.is_valid()) {
-			continue;
-		}
-
-		if (tp->timestamp == tp_next->timestamp) {
-			/* Skip this timestamp, we have already
-			   compared against this value. */
-			continue;
-		}
-		if (tp->timestamp > tp_next->timestamp) {
-			/* Skip this out-of-order timestamp. */
-			continue;
-		}
-
-		/* When interpolating between segments, no need for any special segment handling. */
-		if (!this->values.interpolate_segments) {
-			/* Don't check between segments. */
-			if (tp_next->newsegment) {
-				/* Simply move on to consider next point. */
-				continue;
-			}
-		}
-
-		/* Too far. */
-		if (tp->timestamp > this->photo_time) {
-			break;
-		}
-
-		/* Is is between this and the next point? */
-		if ((this->photo_time > tp->timestamp) && (this->photo_time < tp_next->timestamp)) {
-			this->found_match = true;
-			/*
-			  Interpolate coordinate and altitude using
-			  timestamps as a base for interpolation.
-
-			  Calculate the "scale": a value giving the
-			  relative distance in time from tp->timestamp
-			  to time of taking a photo.
-
-			  The condition in this 'if' ensures that
-			  tp_next->timestamp > tp->timestamp, so
-			  denominator is non-zero and positive,
-			  therefore division is safe.
-			*/
-			const Time numerator = this->photo_time - tp->timestamp;
-			const Time denominator = tp_next->timestamp - tp->timestamp;
-
-			const double scale = numerator / denominator;
-
-			/* Interpolate coordinate. */
-			const LatLon interpolated = LatLon::get_interpolated(tp->coord.get_lat_lon(), tp_next->coord.get_lat_lon(), scale);
-			this->coord = Coord(interpolated, CoordMode::LatLon);
-
-			/* Interpolate elevation. */
-			this->altitude = tp->altitude + ((tp_next->altitude - tp->altitude) * scale);
-			break;
-		}
-	}
-
-	return sg_ret::ok;
-}
-
-
-
-
 /**
    Simply align the images the waypoint position
 */
-sg_ret GeotagJob::geotag_image_from_waypoint(const QString & file_full_path, const Coord & wp_coord, const Altitude & wp_altitude)
+sg_ret GeotagJob::geotag_image_from_waypoint(const QString & file_full_path, const Coord & wp_coord, const Altitude & wp_altitude) const
 {
 	if (!this->values.write_exif) {
 		return sg_ret::ok;
@@ -417,15 +506,10 @@ sg_ret GeotagJob::geotag_image_from_waypoint(const QString & file_full_path, con
 	sg_ret retv = sg_ret::ok;
 
 	const bool has_gps_exif = GeotagExif::object_has_gps_info(file_full_path);
-	const QString datetime = GeotagExif::get_object_datetime(file_full_path);
 
 	/* If image already has gps info - don't attempt to change it unless forced. */
 	if (this->values.overwrite_gps_exif || !has_gps_exif) {
-		const sg_ret ans = GeotagExif::write_exif_gps(file_full_path, wp_coord, wp_altitude, this->values.no_change_mtime);
-		if (ans != sg_ret::ok) {
-			this->trw->get_window()->statusbar()->set_message(StatusBarField::Info, tr("Failed updating EXIF on %1").arg(file_full_path));
-		}
-		retv = ans;
+		retv = GeotagExif::write_exif_gps(file_full_path, wp_coord, wp_altitude, this->values.no_change_mtime);
 	}
 
 	return retv;
@@ -436,167 +520,169 @@ sg_ret GeotagJob::geotag_image_from_waypoint(const QString & file_full_path, con
 
 /**
    Correlate the image to any track within the TrackWaypoint layer
+
+   Only EXIF of the image is modified here. Changes to the layer
+   are made by apply_result(), so this method can be called
+   for many images in parallel.
 */
-void GeotagJob::geotag_image(const QString & file_full_path)
+GeotagImageResult GeotagJob::geotag_image(const QString & file_full_path) const
 {
-	if (!this->trw) {
-		return;
-	}
+	GeotagImageResult result;
 
 	if (file_full_path.isEmpty()) {
-		return;
+		return result;
 	}
 
 	if (this->wp) {
-		this->geotag_image_from_waypoint(file_full_path, this->wp->get_coord(), this->wp->altitude);
-		return;
+		if (sg_ret::ok != this->geotag_image_from_waypoint(file_full_path, this->wp->get_coord(), this->wp->altitude)) {
+			result.exif_write_failed = true;
+		}
+		return result;
 	}
 
-	const bool has_gps_exif = GeotagExif::object_has_gps_info(file_full_path);
-	const QString datetime = GeotagExif::get_object_datetime(file_full_path);
-	if (datetime.isEmpty()) {
-		return;
+	if (sg_ret::ok != GeotagExif::get_object_info(file_full_path, result.exif_info)) {
+		return result;
+	}
+	if (result.exif_info.datetime.isEmpty()) {
+		return result;
 	}
 
 	/* If image already has gps info - don't attempt to change it. */
-	if (!this->values.overwrite_gps_exif && has_gps_exif) {
-		if (this->values.create_waypoints) {
-			/* Create waypoint with file information. */
-			Waypoint * new_wp = GeotagExif::create_waypoint_from_file(file_full_path, this->trw->get_coord_mode());
-			if (!new_wp) {
-				/* Couldn't create Waypoint. */
-				return;
-			}
-			if (new_wp->get_name().isEmpty()) {
-				/* GeotagExif method doesn't guarantee setting waypoints name. */
-				new_wp->set_name(file_base_name(file_full_path));
-			}
+	if (!this->values.overwrite_gps_exif && result.exif_info.has_gps_info) {
+		result.use_exif_position = true;
+		return result;
+	}
 
-			QString new_wp_name = new_wp->get_name();
+	time_t time_value = ConvertToUnixTime(result.exif_info.datetime.toUtf8().data(), (char *) EXIF_DATE_FORMAT, this->values.TimeZoneHours, this->values.TimeZoneMins);
 
-			bool updated_existing_waypoint = false;
+	/* Apply any offset. */
+	time_value += this->values.time_offset;
 
-			if (this->values.overwrite_waypoints) {
-				Waypoint * current_wp = this->trw->waypoints_node().find_waypoint_by_name(new_wp_name);
-				if (current_wp) {
-					/* Existing wp found, so set new position, comment and image. */
+	const Time photo_time(time_value, TimeType::Unit::internal_unit());
+	result.found_match = this->trackpoints_index.find_position(photo_time, result.coord, result.altitude);
 
-					/* TODO_LATER: we may be
-					   tagging massive amount of
-					   Waypoints, so maybe we want
-					   to skip recalculating bbox
-					   and sending signals. */
-					const bool recalculate_bbox = true;
-					const bool only_set_value = false;
-					current_wp->set_coord(new_wp->get_coord(), recalculate_bbox, only_set_value);
+	/* Write EXIF if specified. */
+	if (result.found_match && this->values.write_exif) {
+		if (sg_ret::ok != GeotagExif::write_exif_gps(file_full_path, result.coord, result.altitude, this->values.no_change_mtime)) {
+			result.exif_write_failed = true;
+		}
+	}
 
-					current_wp->altitude = new_wp->altitude;
-					current_wp->set_image_full_path(file_full_path);
-					current_wp->comment = GeotagExif::get_object_comment(file_full_path);
+	return result;
+}
 
-					new_wp_name = GeotagExif::get_object_name(file_full_path);
-					updated_existing_waypoint = true;
-				}
-			}
 
-			if (!updated_existing_waypoint) {
-				new_wp->set_name(new_wp_name);
-				this->trw->add_waypoint(new_wp);
-				/* TODO_LATER: do we delete the new_wp if we don't add it to layer? How was it done in Viking? */
-			}
 
-			/* Mark for redraw. */
-			this->redraw = true;
-		}
+
+/**
+   Create or update waypoint of the image
+*/
+void GeotagJob::apply_result(const QString & file_full_path, const GeotagImageResult & result)
+{
+	if (result.exif_write_failed) {
+		this->trw->get_window()->statusbar()->set_message(StatusBarField::Info, tr("Failed updating EXIF on %1").arg(file_full_path));
+	}
+
+	if (!this->values.create_waypoints) {
 		return;
 	}
 
-	time_t time_value = ConvertToUnixTime(datetime.toUtf8().data(), (char *) EXIF_DATE_FORMAT, this->values.TimeZoneHours, this->values.TimeZoneMins);
+	if (result.use_exif_position) {
+		if (!result.exif_info.lat_lon.is_valid()) {
+			/* Couldn't create Waypoint. */
+			return;
+		}
 
-	/* Apply any offset. */
-	time_value += this->values.time_offset;
+		/* GeotagExif doesn't guarantee setting waypoints name. */
+		const QString wp_name = result.exif_info.name.isEmpty() ? file_base_name(file_full_path) : result.exif_info.name;
+		const Coord wp_coord(result.exif_info.lat_lon, this->trw->get_coord_mode());
 
-	this->photo_time.set_ll_value(time_value);
+		Waypoint * current_wp = NULL;
+		if (this->values.overwrite_waypoints) {
+			current_wp = this->trw->waypoints_node().find_waypoint_by_name(wp_name);
+		}
 
+		if (current_wp) {
+			/* Existing wp found, so set new position, comment and image. */
 
-	this->found_match = false;
+			/* TODO_LATER: we may be tagging massive
+			   amount of Waypoints, so maybe we want to
+			   skip recalculating bbox and sending
+			   signals. */
+			const bool recalculate_bbox = true;
+			const bool only_set_value = false;
+			current_wp->set_coord(wp_coord, recalculate_bbox, only_set_value);
 
-	if (this->trk) {
-		/* Single specified track. */
-		this->geotag_image_from_track(this->trk);
-	} else {
-		/* Try all tracks. */
-		const std::list<Track *> tracks = this->trw->tracks_node().children_list();
-		for (auto iter = tracks.begin(); iter != tracks.end(); iter++) {
-			this->geotag_image_from_track(*iter);
+			current_wp->altitude = result.exif_info.altitude;
+			current_wp->set_image_full_path(file_full_path);
+			current_wp->comment = result.exif_info.comment;
+		} else {
+			/* Create waypoint with file information. */
+			Waypoint * new_wp = new Waypoint(wp_coord);
+			new_wp->altitude = result.exif_info.altitude;
+			new_wp->set_name(wp_name);
+			new_wp->comment = result.exif_info.comment;
+			new_wp->set_image_full_path(file_full_path);
+			this->trw->add_waypoint(new_wp);
 		}
-	}
 
-	if (this->found_match) {
+		/* Mark for redraw. */
+		this->redraw = true;
+		return;
+	}
 
-		if (this->values.create_waypoints) {
+	if (!result.found_match) {
+		return;
+	}
 
-			bool updated_existing_waypoint = false;
+	bool updated_existing_waypoint = false;
 
-			if (this->values.overwrite_waypoints) {
+	if (this->values.overwrite_waypoints) {
 
-				/* Update existing WP. */
-				/* Find a WP with current name. */
-				QString wp_name = file_base_name(file_full_path);
-				Waypoint * wp2 = this->trw->waypoints_node().find_waypoint_by_name(wp_name);
-				if (wp2) {
-					/* Found, so set new position, image and (below) a comment. */
+		/* Update existing WP. */
+		/* Find a WP with current name. */
+		Waypoint * wp2 = this->trw->waypoints_node().find_waypoint_by_name(file_base_name(file_full_path));
+		if (wp2) {
+			/* Found, so set new position, image and a comment. */
 
-					/* TODO_LATER: we may be
-					   tagging massive amount of
-					   Waypoints, so maybe we want
-					   to skip recalculating bbox
-					   and sending signals. */
-					const bool recalculate_bbox = true;
-					const bool only_set_value = false;
-					wp2->set_coord(this->coord, recalculate_bbox, only_set_value);
+			/* TODO_LATER: we may be tagging massive
+			   amount of Waypoints, so maybe we want to
+			   skip recalculating bbox and sending
+			   signals. */
+			const bool recalculate_bbox = true;
+			const bool only_set_value = false;
+			wp2->set_coord(result.coord, recalculate_bbox, only_set_value);
 
-					wp2->altitude = this->altitude;
-					wp2->set_image_full_path(file_full_path);
-					wp2->comment = GeotagExif::get_object_comment(file_full_path);
+			wp2->altitude = result.altitude;
+			wp2->set_image_full_path(file_full_path);
+			wp2->comment = result.exif_info.comment;
 
-					/* We ignore the returned wp name because the existing wp
-					   already has a name. We only update waypoint's comment. */
-					wp_name = GeotagExif::get_object_name(file_full_path);
-					updated_existing_waypoint = true;
-				}
-			}
+			/* We ignore name from EXIF because the existing wp
+			   already has a name. We only update waypoint's comment. */
+			updated_existing_waypoint = true;
+		}
+	}
 
-			if (!updated_existing_waypoint) {
-				/* Create waypoint with found position. */
-
-				Waypoint * wp2 = new Waypoint(this->coord);
-				wp2->altitude = this->altitude;
-				wp2->set_image_full_path(file_full_path);
-				wp2->comment = GeotagExif::get_object_name(file_full_path);
-
-				/* Brand new wp, so we don't ignore wp name returned by this function.
-				   If the name is not empty, we will use it for the wp. */
-				QString wp_name = GeotagExif::get_object_name(file_full_path);
-				if (wp_name.isEmpty()) {
-					wp_name = file_base_name(file_full_path);
-				}
-				wp2->set_name(wp_name);
-				this->trw->add_waypoint(wp2);
-			}
+	if (!updated_existing_waypoint) {
+		/* Create waypoint with found position. */
 
-			/* Mark for redraw. */
-			this->redraw = true;
-		}
+		Waypoint * wp2 = new Waypoint(result.coord);
+		wp2->altitude = result.altitude;
+		wp2->set_image_full_path(file_full_path);
+		wp2->comment = result.exif_info.name;
 
-		/* Write EXIF if specified. */
-		if (this->values.write_exif) {
-			const sg_ret ans = GeotagExif::write_exif_gps(file_full_path, this->coord, this->altitude, this->values.no_change_mtime);
-			if (ans != sg_ret::ok) {
-				this->trw->get_window()->statusbar()->set_message(StatusBarField::Info, tr("Failed updating EXIF on %1").arg(file_full_path));
-			}
+		/* Brand new wp, so we don't ignore wp name from EXIF.
+		   If the name is not empty, we will use it for the wp. */
+		QString wp_name = result.exif_info.name;
+		if (wp_name.isEmpty()) {
+			wp_name = file_base_name(file_full_path);
 		}
+		wp2->set_name(wp_name);
+		this->trw->add_waypoint(wp2);
 	}
+
+	/* Mark for redraw. */
+	this->redraw = true;
 }
 
 
@@ -612,33 +698,54 @@ GeotagJob::~GeotagJob()
 
 /**
    Run geotagging process in a separate thread.
+
+   Images are processed (EXIF is read, position is found and
+   EXIF is written) in parallel: this job's thread is joined by
+   helper threads from the same (local) thread pool, as many as
+   the pool has available. Waypoints are then created or updated
+   in this thread only, in order of images on the list.
 */
 void GeotagJob::run(void)
 {
-	const int n_files = this->selected_images.size();
-	int done = 0;
+	if (!this->trw) {
+		return;
+	}
 
 	/* TODO_LATER decide how to report any issues to the user... */
 
-	for (auto iter = this->selected_images.begin(); iter != this->selected_images.end(); iter++) {
-		/* For each file attempt to geotag it. */
-		this->geotag_image(*iter);
+	if (!this->wp) {
+		/* Search a single specified track or all tracks. */
+		const std::list<Track *> tracks = this->trk ? std::list<Track *>{ this->trk } : this->trw->tracks_node().children_list();
+		this->trackpoints_index.build(tracks, this->values.interpolate_segments);
+		qDebug() << SG_PREFIX_I << "Indexed" << this->trackpoints_index.size() << "trackpoints and spans between them, from" << tracks.size() << "tracks";
+	}
 
-		/* Update thread progress and detect stop requests. */
-		const bool end_job = this->set_progress_state(((double) ++done) / n_files);
-		if (end_job) {
-			return; /* Abort thread */
+	this->results.clear();
+	this->results.resize(this->selected_images.size());
+
+	const bool completed = ParallelItems::process(this->selected_images.size(), [this](int idx) {
+			/* For each file attempt to geotag it. */
+			this->results[idx] = this->geotag_image(this->selected_images.at(idx));
+			this->results[idx].processed = true;
+		}, this);
+
+	/* Even if the job has been aborted, EXIF of some images
+	   may have been already modified, so their waypoints have
+	   to be created or updated too. */
+	for (int i = 0; i < this->selected_images.size(); i++) {
+		if (this->results[i].processed) {
+			this->apply_result(this->selected_images.at(i), this->results[i]);
 		}
 	}
 
 	if (this->redraw) {
-		if (this->trw) {
-			this->trw->waypoints_node().recalculate_bbox();
+		this->trw->waypoints_node().recalculate_bbox();
+		if (completed) {
 			/* Ensure any new images get show. */
 			this->trw->generate_missing_thumbnails();
-			/* Force redraw as verify only redraws if there are new thumbnails (they may already exist). */
-			this->trw->emit_tree_item_changed("TRW Geotag - run"); /* Update from background. */
 		}
+		/* Force redraw as verify only redraws if there are new thumbnails (they may already exist). */
+		this->trw->emit_tree_item_changed_in_background("TRW Geotag - run"); /* Update from background. */
 	}
 
 	return;
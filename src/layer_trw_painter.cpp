@@ -54,6 +54,7 @@
 #include "layer_trw_waypoint.h"
 #include "layer_trw_painter.h"
 #include "layer_trw_track_internal.h"
+#include "layer_trw_track_lod.h"
 #include "layer_trw.h"
 #include "window.h"
 #include "preferences.h"
@@ -216,6 +217,86 @@ LayerTRWTrackGraphics SpeedColoring::get(const Trackpoint * tp1, const Trackpoin
 
 
 
+/*
+  Consecutive lines of a track that are drawn with the same pen,
+  collected so that they can be drawn with one call.
+*/
+class SlavGPS::TrackPolyline {
+public:
+	TrackPolyline(GisViewport * new_gisview) : gisview(new_gisview) {};
+
+	/* Lines that don't continue current polyline, or are drawn with different pen, start a new polyline. */
+	void add_line(const QPen & line_pen, const ScreenPos & begin, const ScreenPos & end);
+	void flush(void);
+
+private:
+	GisViewport * gisview = nullptr;
+	QPen pen;
+	QPolygonF points;
+};
+
+
+
+
+void TrackPolyline::add_line(const QPen & line_pen, const ScreenPos & begin, const ScreenPos & end)
+{
+	if (this->points.isEmpty() || this->points.last() != begin || this->pen != line_pen) {
+		this->flush();
+		this->pen = line_pen;
+		this->points.append(begin);
+	}
+	this->points.append(end);
+}
+
+
+
+
+void TrackPolyline::flush(void)
+{
+	if (!this->points.isEmpty()) {
+		this->gisview->draw_polyline(this->pen, this->points);
+		this->points.clear();
+	}
+}
+
+
+
+
+/*
+  Trackpoint's marker (square, circle), drawn after lines of track
+  so that lines don't cover markers.
+*/
+class TrackpointMarker {
+public:
+	TrackpointMarker(const QColor & new_color, const ScreenPos & new_pos, fpixel new_size, bool new_is_circle) :
+		color(new_color), pos(new_pos), size(new_size), is_circle(new_is_circle) {};
+
+	QColor color;
+	ScreenPos pos;
+	fpixel size = 0; /* Radius of circle, or half of side of square. */
+	bool is_circle = false;
+};
+
+
+
+
+/*
+  Arrow showing direction of track in the middle of a line, drawn
+  after lines of track so that lines don't cover arrows.
+*/
+class TrackDirectionArrow {
+public:
+	TrackDirectionArrow(const QPen & new_pen, const ScreenPos & new_begin, const ScreenPos & new_end) :
+		pen(new_pen), begin(new_begin), end(new_end) {};
+
+	QPen pen;
+	ScreenPos begin;
+	ScreenPos end;
+};
+
+
+
+
 static void draw_utm_skip_insignia(GisViewport * gisview, QPen & pen, int x, int y)
 {
 	/* First draw '+'. */
@@ -230,18 +311,19 @@ static void draw_utm_skip_insignia(GisViewport * gisview, QPen & pen, int x, int
 
 
 
-void LayerTRWPainter::draw_track_label(const QString & text, const QColor & fg_color, __attribute__((unused)) const QColor & bg_color, const Coord & coord)
+void LayerTRWPainter::draw_track_label(const QString & text, const QColor & fg_color, __attribute__((unused)) const QColor & bg_color, const Coord & coord, LabelPriority priority)
 {
 	ScreenPos label_pos;
 	this->gisview->coord_to_screen_pos(coord, label_pos);
 
 	QPen pen;
 	pen.setColor(fg_color);
-	this->gisview->draw_text(QFont("Helvetica", pango_font_size_to_point_font_size(this->track_label_font_size)),
-				 pen,
-				 label_pos.x(),
-				 label_pos.y(),
-				 text);
+
+	this->track_label_layouts.set_font("Helvetica", pango_font_size_to_point_font_size(this->track_label_font_size));
+
+	/* Label's baseline is at label_pos. */
+	const QPointF top_left(label_pos.x(), label_pos.y() - this->track_label_layouts.get_ascent());
+	this->labels.add(this->gisview->get_painter(), this->track_label_layouts, text, top_left, pen, QColor(), priority);
 }
 
 
@@ -298,7 +380,7 @@ void LayerTRWPainter::draw_track_dist_labels(Track * trk, bool do_highlight)
 			const QColor fg_color = this->get_fg_color(trk);
 			const QColor bg_color = this->get_bg_color(do_highlight);
 
-			this->draw_track_label(axis_mark_uu.to_nice_string(), fg_color, bg_color, coord_middle);
+			this->draw_track_label(axis_mark_uu.to_nice_string(), fg_color, bg_color, coord_middle, LabelPriority::Low);
 		}
 	}
 }
@@ -331,6 +413,7 @@ void LayerTRWPainter::draw_track_name_labels(Track * trk, bool do_highlight)
 {
 	const QColor fg_color = this->get_fg_color(trk);
 	const QColor bg_color = this->get_bg_color(do_highlight);
+	const LabelPriority priority = do_highlight ? LabelPriority::Always : LabelPriority::High;
 
 	char *ename = g_markup_escape_text(trk->get_name().toUtf8().constData(), -1);
 
@@ -338,7 +421,7 @@ void LayerTRWPainter::draw_track_name_labels(Track * trk, bool do_highlight)
 	    trk->draw_name_mode == TrackDrawNameMode::Centre) {
 
 		const Coord coord(trk->get_bbox().get_center_lat_lon(), this->trw->coord_mode);
-		this->draw_track_label(ename, fg_color, bg_color, coord);
+		this->draw_track_label(ename, fg_color, bg_color, coord, priority);
 	}
 
 	if (trk->draw_name_mode == TrackDrawNameMode::Centre) {
@@ -381,7 +464,7 @@ void LayerTRWPainter::draw_track_name_labels(Track * trk, bool do_highlight)
 				qDebug() << SG_PREFIX_E << "Failed to get valid coordinate";
 			} else {
 				QString name = QObject::tr("%1: start/end").arg(ename);
-				this->draw_track_label(name, fg_color, bg_color, av_coord);
+				this->draw_track_label(name, fg_color, bg_color, av_coord, priority);
 			}
 
 			done_start_end = true;
@@ -394,7 +477,7 @@ void LayerTRWPainter::draw_track_name_labels(Track * trk, bool do_highlight)
 		    || trk->draw_name_mode == TrackDrawNameMode::StartCentreEnd) {
 
 			const QString name_start = QObject::tr("%1: start").arg(ename);
-			this->draw_track_label(name_start, fg_color, bg_color, begin_coord);
+			this->draw_track_label(name_start, fg_color, bg_color, begin_coord, priority);
 		}
 		/* Don't draw end label if this is the one being created. */
 		if (trk != this->trw->selected_track_get()) {
@@ -403,7 +486,7 @@ void LayerTRWPainter::draw_track_name_labels(Track * trk, bool do_highlight)
 			    || trk->draw_name_mode == TrackDrawNameMode::StartCentreEnd) {
 
 				const QString name_end = QObject::tr("%1: end").arg(ename);
-				this->draw_track_label(name_end, fg_color, bg_color, end_coord);
+				this->draw_track_label(name_end, fg_color, bg_color, end_coord, priority);
 			}
 		}
 	}
@@ -429,7 +512,7 @@ void LayerTRWPainter::draw_track_point_names(Track * trk, bool do_highlight)
 
 	for (auto iter = trk->trackpoints.begin(); iter != trk->trackpoints.end(); iter++) {
 		if (!(*iter)->name.isEmpty()) {
-			this->draw_track_label((*iter)->name, fg_color, bg_color, (*iter)->coord);
+			this->draw_track_label((*iter)->name, fg_color, bg_color, (*iter)->coord, LabelPriority::Normal);
 		}
 	}
 }
@@ -460,33 +543,21 @@ void LayerTRWPainter::draw_track_draw_midarrow(const ScreenPos & begin, const Sc
 
 
 void LayerTRWPainter::draw_track_draw_something(const ScreenPos & begin, const ScreenPos & end, QPen & pen, Trackpoint * tp, Trackpoint * tp_next, const
-						Altitude & min_alt, const Altitude & alt_diff)
+						Altitude & min_alt, const Altitude & alt_diff, std::vector<ScreenPos> & elevation_polygons, TrackPolyline & elevation_polyline)
 {
 #define FIXALTITUDE(m_tp) \
 	((m_tp->altitude - min_alt) / alt_diff * DRAW_ELEVATION_FACTOR * this->track_elevation_factor / this->vp_xmpp)
 
 
-	ScreenPos points[4];
-
-	points[0] = begin;
-	points[1] = ScreenPos(begin.x(), begin.y() - FIXALTITUDE (tp));
-	points[2] = ScreenPos(end.x(), end.y() - FIXALTITUDE (tp_next));
-	points[3] = end;
+	const ScreenPos top_begin(begin.x(), begin.y() - FIXALTITUDE (tp));
+	const ScreenPos top_end(end.x(), end.y() - FIXALTITUDE (tp_next));
 
-	QPen tmp_pen;
-#ifdef K_FIXME_RESTORE
-	if (((begin.x() - x) > 0 && (begin.y() - y) > 0) || ((begin.x() - x) < 0 && (begin.y() - y) < 0)) {
-		tmp_pen = gtk_widget_get_style(this->viewport)->light_gc[3];
-	} else {
-		tmp_pen = gtk_widget_get_style(this->viewport)->dark_gc[0];
-	}
-#else
-	tmp_pen.setColor("green");
-	tmp_pen.setWidth(1);
-#endif
-	this->gisview->draw_polygon(tmp_pen, points, 4, true);
+	elevation_polygons.push_back(begin);
+	elevation_polygons.push_back(top_begin);
+	elevation_polygons.push_back(top_end);
+	elevation_polygons.push_back(end);
 
-	this->gisview->draw_line(pen, begin.x(), begin.y() - FIXALTITUDE (tp), end.x(), end.y() - FIXALTITUDE (tp_next));
+	elevation_polyline.add_line(pen, top_begin, top_end);
 }
 
 
@@ -524,7 +595,38 @@ QPen LayerTRWPainter::get_track_fg_pen(Track * trk, bool do_highlight)
 
 
 
-void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
+template <typename Points>
+void LayerTRWPainter::project_track_points(const Points & points, const std::vector<uint8_t> & crosses, std::vector<ScreenPos> & positions)
+{
+	const size_t count = crosses.size();
+	positions.resize(count);
+
+	/* Position of point is used when the point is an end of
+	   line crossing viewport, or when the point is first point
+	   after such line (or first line of track), where the line
+	   going out of viewport is finished. */
+	this->projected_coords.clear();
+	this->projected_indices.clear();
+	size_t i = 0;
+	for (auto iter = points.begin(); iter != points.end(); iter++, i++) {
+		if (i <= 1 || crosses[i] || crosses[i - 1] || (i + 1 < count && crosses[i + 1])) {
+			this->projected_coords.push_back(&(*iter)->coord);
+			this->projected_indices.push_back(i);
+		}
+	}
+
+	this->gisview->coords_to_screen_pos(this->projected_coords, this->projected_positions);
+
+	for (size_t j = 0; j < this->projected_indices.size(); j++) {
+		positions[this->projected_indices[j]] = this->projected_positions[j];
+	}
+}
+
+
+
+
+template <typename Points>
+void LayerTRWPainter::draw_track_fg_sub(Track * trk, const Points & points, int lod_level, bool do_highlight)
 {
 	Altitude min_alt;
 	Altitude max_alt;
@@ -540,8 +642,8 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 	const bool do_draw_track_stops = do_highlight ? false : this->draw_track_stops;
 
 
-#if 1   /* Temporary test code. */
-	this->draw_track_label("test track label", QColor("green"), QColor("black"), this->gisview->get_center_coord());
+#if 0   /* Temporary test code. */
+	this->draw_track_label("test track label", QColor("green"), QColor("black"), this->gisview->get_center_coord(), LabelPriority::Always);
 #endif
 
 
@@ -553,14 +655,36 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 	const int tp_size_reg = this->trackpoint_size;
 	const int tp_size_cur = this->trackpoint_size * 2;
 
-	auto iter = trk->trackpoints.begin();
+	/* Check some stuff -- but only if we're in UTM and there's only ONE ZONE; or lat lon. */
+
+	/* TODO_LATER: compare this condition with condition in LayerTRWPainter::draw_waypoint_sub(). */
+	const bool first_condition = (this->vp_coord_mode == CoordMode::UTM && !this->vp_is_one_utm_zone); /* UTM coord mode & more than one UTM zone - do everything. */
+
+	/* Lines that are drawn, found before calculating screen positions of their ends. */
+	std::vector<uint8_t> & crosses = this->track_crosses;
+	crosses.assign(points.size(), 0);
+	{
+		size_t i = 1;
+		for (auto iter = std::next(points.begin()); iter != points.end(); iter++, i++) {
+			const Trackpoint * tp = *iter;
+			const Trackpoint * prev_tp = *std::prev(iter);
+
+			const bool second_condition_A = ((!this->vp_is_one_utm_zone) || UTM::is_the_same_zone(tp->coord.utm, this->vp_center_coord.utm));  /* Only check zones if UTM & one_utm_zone. */
+			crosses[i] = first_condition || (second_condition_A && this->line_crosses_viewport(prev_tp->coord, tp->coord));
+		}
+	}
+
+	std::vector<ScreenPos> & positions = this->track_positions;
+	this->project_track_points(points, crosses, positions);
+	size_t pos_idx = 0; /* Index of position of trackpoint pointed to by iter. */
+
+	auto iter = points.begin();
 	Trackpoint * tp = *iter;
 
 	const bool trk_is_selected = trk->is_selected();
 	int tp_size = (trk_is_selected && trk->get_selected_children().is_member(tp)) ? tp_size_cur : tp_size_reg;
 
-	ScreenPos curr_pos;
-	this->gisview->coord_to_screen_pos((*iter)->coord, curr_pos);
+	ScreenPos curr_pos = positions[pos_idx];
 
 	/* Draw the first point as something a bit different from the normal points.
 	   ATM it's slightly bigger and a triangle. */
@@ -573,9 +697,13 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 	}
 
 
-	SpeedColoring speed_coloring;
-	/* If necessary calculate these values - which is done only once per track redraw. */
-	if (this->track_drawing_mode == LayerTRWTrackDrawingMode::BySpeed) {
+	/* Colours of lines in BySpeed mode, cached by track. */
+	std::shared_ptr<const std::vector<uint8_t>> speed_colors;
+	if (!do_highlight && this->track_drawing_mode == LayerTRWTrackDrawingMode::BySpeed) {
+		SpeedColoring speed_coloring;
+		/* Colours depend on these parameters, so they are also key of cached colours. */
+		std::vector<double> parameters;
+
 		/* The percentage factor away from the average speed
 		   determines transistions between the levels. */
 		Speed average_speed = trk->get_average_speed_moving(this->track_min_stop_duration);
@@ -583,15 +711,32 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 			const Speed low_speed = average_speed - (average_speed * (this->track_draw_speed_factor / 100.0));
 			const Speed high_speed = average_speed + (average_speed * (this->track_draw_speed_factor / 100.0));
 			speed_coloring.set(low_speed, average_speed, high_speed);
+
+			parameters.push_back(average_speed.convert_to_unit(SpeedType::Unit::internal_unit()).ll_value());
+			parameters.push_back(this->track_draw_speed_factor);
 		}
+
+		speed_colors = trk->get_color_indices(lod_level, points.size(), parameters, [&points, &speed_coloring](std::vector<uint8_t> & indices) {
+				size_t i = 0;
+				for (auto iter = points.begin(); iter != points.end(); iter++, i++) {
+					indices[i] = (uint8_t) (0 == i ? LayerTRWTrackGraphics::NeutralPen : speed_coloring.get(*iter, *std::prev(iter)));
+				}
+			});
 	}
 
 	ScreenPos prev_pos = curr_pos;
 	bool use_prev_pos = true; /* prev_pos contains valid coordinates of previous point. */
 
+	TrackPolyline polyline(this->gisview);
+	TrackPolyline elevation_polyline(this->gisview);
+	std::vector<ScreenPos> elevation_polygons;
+	std::vector<TrackDirectionArrow> arrows;
+	std::vector<TrackpointMarker> markers;
+
 	iter++; /* Because first Trackpoint has been drawn above. */
+	pos_idx++;
 
-	for (; iter != trk->trackpoints.end(); iter++) {
+	for (; iter != points.end(); iter++, pos_idx++) {
 		tp = *iter;
 		Trackpoint * prev_tp = (Trackpoint *) *std::prev(iter);
 
@@ -609,17 +754,6 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 			continue;
 		}
 
-		/* Check some stuff -- but only if we're in UTM and there's only ONE ZONE; or lat lon. */
-
-		/* TODO_LATER: compare this condition with condition in LayerTRWPainter::draw_waypoint_sub(). */
-		bool first_condition = (this->vp_coord_mode == CoordMode::UTM && !this->vp_is_one_utm_zone); /* UTM coord mode & more than one UTM zone - do everything. */
-
-		bool second_condition_A = ((!this->vp_is_one_utm_zone) || UTM::is_the_same_zone(tp->coord.utm, this->vp_center_coord.utm));  /* Only check zones if UTM & one_utm_zone. */
-
-		const bool line_crosses_vp = this->line_crosses_viewport(prev_tp->coord, tp->coord);
-		//const bool fits_into_viewport = this->point_inside_viewport(tp->coord);
-
-		bool second_condition = (second_condition_A && line_crosses_vp);
 #ifdef K_OLD_IMPLEMENTATION
 		if ((!this->vp_is_one_utm_zone && !this->lat_lon) /* UTM & zones; do everything. */
 		    || (((!this->vp_is_one_utm_zone) || tp->coord.utm_zone == this->center->utm_zone) /* Only check zones if UTM & one_utm_zone. */
@@ -629,11 +763,11 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 
 		//fprintf(stderr, "%d || (%d && %d && %d)\n", first_condition, second_condition_A, fits_horizontally, fits_vertically);
 
-		if (first_condition || second_condition) {
+		if (crosses[pos_idx]) {
 
 			//fprintf(stderr, "first branch ----\n");
 
-			this->gisview->coord_to_screen_pos(tp->coord, curr_pos);
+			curr_pos = positions[pos_idx];
 
 			/* The concept of drawing stops is that if the next trackpoint has a
 			   timestamp far into the future, we draw a circle of 6x trackpoint
@@ -642,14 +776,12 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 			if (do_draw_track_stops
 			    && do_draw_trackpoints
 			    && !do_highlight
-			    && std::next(iter) != trk->trackpoints.end()) {
+			    && std::next(iter) != points.end()) {
 
 				const Duration timestamp_diff = Duration::get_abs_duration((*std::next(iter))->timestamp, (*iter)->timestamp);
 				if (timestamp_diff > this->track_min_stop_duration) {
 					const int stop_radius = (6 * tp_size) / 2;
-					this->gisview->fill_ellipse(this->track_pens[(int) LayerTRWTrackGraphics::StopPen].color(),
-								    curr_pos,
-								    stop_radius, stop_radius);
+					markers.push_back(TrackpointMarker(this->track_pens[(int) LayerTRWTrackGraphics::StopPen].color(), curr_pos, stop_radius, true));
 				}
 			}
 
@@ -663,18 +795,18 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 			if (do_draw_trackpoints || this->draw_track_lines) {
 				/* Setup main_pen for both point and line drawing. */
 				if (!do_highlight && (this->track_drawing_mode == LayerTRWTrackDrawingMode::BySpeed)) {
-					main_pen = this->track_pens[(int) speed_coloring.get(tp, prev_tp)];
+					main_pen = this->track_pens[(*speed_colors)[pos_idx]];
 				}
 			}
 
 			if (do_draw_trackpoints) {
-				if (std::next(iter) != trk->trackpoints.end()) {
+				if (std::next(iter) != points.end()) {
 					/* Regular point - draw 2x square. */
-					this->gisview->fill_rectangle(main_pen.color(), curr_pos.x() - tp_size, curr_pos.y() - tp_size, 2*tp_size, 2*tp_size);
+					markers.push_back(TrackpointMarker(main_pen.color(), curr_pos, tp_size, false));
 				} else {
 					/* Final point - draw 4x circle. */
 					const int tp_radius = (4 * tp_size) / 2;
-					this->gisview->fill_ellipse(main_pen.color(), curr_pos, tp_radius, tp_radius);
+					markers.push_back(TrackpointMarker(main_pen.color(), curr_pos, tp_radius, true));
 				}
 			}
 
@@ -682,28 +814,30 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 
 				/* UTM only: zone check. */
 				if (do_draw_trackpoints && this->trw->coord_mode == CoordMode::UTM && !UTM::is_the_same_zone(tp->coord.utm, this->vp_center_coord.utm)) {
+					/* Lines collected so far go under the insignia. */
+					polyline.flush();
 					draw_utm_skip_insignia(this->gisview, main_pen, curr_pos.x(), curr_pos.y());
 				}
 
 				if (!use_prev_pos) {
-					this->gisview->coord_to_screen_pos(prev_tp->coord, prev_pos);
+					prev_pos = positions[pos_idx - 1];
 				}
 
-				this->gisview->draw_line(main_pen, prev_pos, curr_pos);
+				polyline.add_line(main_pen, prev_pos, curr_pos);
 
 				if (this->draw_track_elevation
-				    && std::next(iter) != trk->trackpoints.end()
+				    && std::next(iter) != points.end()
 				    && (*std::next(iter))->altitude.is_valid()
 				    && alt_diff.is_valid()) {
 
-					this->draw_track_draw_something(prev_pos, curr_pos, main_pen, *iter, *std::next(iter), min_alt, alt_diff);
+					this->draw_track_draw_something(prev_pos, curr_pos, main_pen, *iter, *std::next(iter), min_alt, alt_diff, elevation_polygons, elevation_polyline);
 				}
 			}
 
 			if (!tp->newsegment && this->draw_track_directions) {
 				/* Draw an arrow at the mid point to show the direction of the track.
 				   Code is a rework from vikwindow::draw_ruler(). */
-				this->draw_track_draw_midarrow(prev_pos, curr_pos, main_pen);
+				arrows.push_back(TrackDirectionArrow(main_pen, prev_pos, curr_pos));
 			}
 
 		skip:
@@ -714,20 +848,21 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 
 			if (use_prev_pos && this->draw_track_lines && (!tp->newsegment)) {
 				if (this->trw->coord_mode != CoordMode::UTM || UTM::is_the_same_zone(tp->coord.utm, this->vp_center_coord.utm)) {
-					this->gisview->coord_to_screen_pos(tp->coord, curr_pos);
+					curr_pos = positions[pos_idx];
 
 					if (!do_highlight && (this->track_drawing_mode == LayerTRWTrackDrawingMode::BySpeed)) {
-						main_pen = this->track_pens[(int) speed_coloring.get(tp, prev_tp)];
+						main_pen = this->track_pens[(*speed_colors)[pos_idx]];
 					}
 
 					/* Draw only if current point has different coordinates than the previous one. */
 					if (curr_pos.x() != prev_pos.x() || curr_pos.y() != prev_pos.y()) {
-						this->gisview->draw_line(main_pen, prev_pos, curr_pos);
+						polyline.add_line(main_pen, prev_pos, curr_pos);
 					}
 				} else {
 					/* Draw only if current point has different coordinates than the previous one. */
 					if (curr_pos.x() != prev_pos.x() || curr_pos.y() != prev_pos.y()) {
-						this->gisview->coord_to_screen_pos(prev_tp->coord, curr_pos);
+						curr_pos = positions[pos_idx - 1];
+						polyline.flush();
 						draw_utm_skip_insignia(this->gisview, main_pen, curr_pos.x(), curr_pos.y());
 					}
 				}
@@ -735,13 +870,43 @@ void LayerTRWPainter::draw_track_fg_sub(Track * trk, bool do_highlight)
 			use_prev_pos = false;
 		}
 	}
+
+	/* All lines of track are drawn at the bottom, then
+	   elevations, arrows and markers of the whole track on top
+	   of them. So unlike in drawing line by line, an arrow or
+	   elevation is never covered by a later line of the same
+	   track. */
+	polyline.flush();
+
+	if (!elevation_polygons.empty()) {
+		QPen elevation_pen;
+		elevation_pen.setColor("green");
+		elevation_pen.setWidth(1);
+		for (size_t i = 0; i + 4 <= elevation_polygons.size(); i += 4) {
+			this->gisview->draw_polygon(elevation_pen, &elevation_polygons[i], 4, true);
+		}
+	}
+	elevation_polyline.flush();
+
+	for (TrackDirectionArrow & arrow : arrows) {
+		this->draw_track_draw_midarrow(arrow.begin, arrow.end, arrow.pen);
+	}
+
+	for (const TrackpointMarker & marker : markers) {
+		if (marker.is_circle) {
+			this->gisview->fill_ellipse(marker.color, marker.pos, marker.size, marker.size);
+		} else {
+			this->gisview->fill_rectangle(marker.color, marker.pos.x() - marker.size, marker.pos.y() - marker.size, 2 * marker.size, 2 * marker.size);
+		}
+	}
 }
 
 
 
 
 
-void LayerTRWPainter::draw_track_bg_sub(Track * trk, bool do_highlight)
+template <typename Points>
+void LayerTRWPainter::draw_track_bg_sub(Track * trk, const Points & points, bool do_highlight)
 {
 	QPen main_pen = this->track_bg_pen;
 
@@ -759,17 +924,33 @@ void LayerTRWPainter::draw_track_bg_sub(Track * trk, bool do_highlight)
 		}
 	}
 
-	auto iter = trk->trackpoints.begin();
+	/* Lines that are drawn, found before calculating screen positions of their ends. */
+	std::vector<uint8_t> & crosses = this->track_crosses;
+	crosses.assign(points.size(), 0);
+	{
+		size_t i = 1;
+		for (auto iter = std::next(points.begin()); iter != points.end(); iter++, i++) {
+			crosses[i] = this->line_crosses_viewport((*std::prev(iter))->coord, (*iter)->coord);
+		}
+	}
 
-	ScreenPos curr_pos;
-	this->gisview->coord_to_screen_pos((*iter)->coord, curr_pos);
+	std::vector<ScreenPos> & positions = this->track_positions;
+	this->project_track_points(points, crosses, positions);
+	size_t pos_idx = 0; /* Index of position of trackpoint pointed to by iter. */
+
+	auto iter = points.begin();
+
+	ScreenPos curr_pos = positions[pos_idx];
 
 	ScreenPos prev_pos = curr_pos;
 	bool use_prev_pos = true; /* prev_pos contains valid coordinates of previous point. */
 
+	TrackPolyline polyline(this->gisview);
+
 	iter++; /* Because first Trackpoint has been drawn above. */
+	pos_idx++;
 
-	for (; iter != trk->trackpoints.end(); iter++) {
+	for (; iter != points.end(); iter++, pos_idx++) {
 		Trackpoint * tp = *iter;
 		Trackpoint * prev_tp = (Trackpoint *) *std::prev(iter);
 
@@ -795,10 +976,8 @@ void LayerTRWPainter::draw_track_bg_sub(Track * trk, bool do_highlight)
 #endif
 
 
-		const bool line_crosses_vp = this->line_crosses_viewport(prev_tp->coord, tp->coord);
-		//const bool fits_into_viewport = this->point_inside_viewport(tp->coord);
-		if (line_crosses_vp) {
-			this->gisview->coord_to_screen_pos(tp->coord, curr_pos);
+		if (crosses[pos_idx]) {
+			curr_pos = positions[pos_idx];
 
 			if (use_prev_pos && curr_pos == prev_pos) {
 				/* Points are the same in display coordinates, don't
@@ -809,9 +988,9 @@ void LayerTRWPainter::draw_track_bg_sub(Track * trk, bool do_highlight)
 
 			if (!tp->newsegment && this->draw_track_lines) {
 				if (!use_prev_pos) {
-					this->gisview->coord_to_screen_pos(prev_tp->coord, prev_pos);
+					prev_pos = positions[pos_idx - 1];
 				}
-				this->gisview->draw_line(this->track_bg_pen, prev_pos, curr_pos);
+				polyline.add_line(this->track_bg_pen, prev_pos, curr_pos);
 			}
 		skip:
 			prev_pos = curr_pos;
@@ -820,16 +999,17 @@ void LayerTRWPainter::draw_track_bg_sub(Track * trk, bool do_highlight)
 		} else {
 			if (use_prev_pos && this->draw_track_lines && !tp->newsegment) {
 				if (this->trw->coord_mode != CoordMode::UTM || UTM::is_the_same_zone(tp->coord.utm, this->vp_center_coord.utm)) {
-					this->gisview->coord_to_screen_pos(tp->coord, curr_pos);
+					curr_pos = positions[pos_idx];
 
 					/* Draw only if current point has different coordinates than the previous one. */
 					if (curr_pos.x() != prev_pos.x() || curr_pos.y() != prev_pos.y()) {
-						this->gisview->draw_line(main_pen, prev_pos, curr_pos);
+						polyline.add_line(main_pen, prev_pos, curr_pos);
 					}
 				} else {
 					/* Draw only if current point has different coordinates than the previous one. */
 					if (curr_pos.x() != prev_pos.x() || curr_pos.y() != prev_pos.y()) {
-						this->gisview->coord_to_screen_pos(prev_tp->coord, curr_pos);
+						curr_pos = positions[pos_idx - 1];
+						polyline.flush();
 						draw_utm_skip_insignia(this->gisview, main_pen, curr_pos.x(), curr_pos.y());
 					}
 				}
@@ -837,6 +1017,8 @@ void LayerTRWPainter::draw_track_bg_sub(Track * trk, bool do_highlight)
 			use_prev_pos = false;
 		}
 	}
+
+	polyline.flush();
 }
 
 
@@ -860,10 +1042,31 @@ void LayerTRWPainter::draw_track(Track * trk, GisViewport * a_gisview, bool do_h
 		return;
 	}
 
-	if (trk != this->trw->selected_track_get()) { /* Don't draw background of a track that is currently being created. */
-		this->draw_track_bg_sub(trk, do_highlight);
+	/* Zoomed-out track is drawn with one of its simplified
+	   versions. Selected track and track that is being
+	   created or edited are drawn with all trackpoints, and so
+	   are tracks with stops (stops are detected between
+	   consecutive trackpoints). */
+	const bool is_edited = trk == this->trw->selected_track_get();
+	int lod_level = TrackLOD::no_level;
+	std::shared_ptr<const TrackLOD> lod;
+	if (!is_edited && !trk->is_selected() && !(this->draw_track_stops && this->draw_trackpoints)) {
+		lod = trk->get_lod();
+		if (lod) {
+			lod_level = lod->get_level(this->vp_xmpp);
+		}
+	}
+
+	if (TrackLOD::no_level != lod_level) {
+		const std::vector<Trackpoint *> & lod_points = lod->levels[lod_level];
+		this->draw_track_bg_sub(trk, lod_points, do_highlight);
+		this->draw_track_fg_sub(trk, lod_points, lod_level, do_highlight);
+	} else {
+		if (!is_edited) { /* Don't draw background of a track that is currently being created. */
+			this->draw_track_bg_sub(trk, trk->trackpoints, do_highlight);
+		}
+		this->draw_track_fg_sub(trk, trk->trackpoints, lod_level, do_highlight);
 	}
-	this->draw_track_fg_sub(trk, do_highlight);
 
 	/* Labels drawn at the end, so the labels are on top. */
 	if (this->draw_track_labels) {
@@ -966,10 +1169,10 @@ bool LayerTRWPainter::draw_waypoint_image(Waypoint * wp, const ScreenPos & wp_po
 
 	QPixmap pixmap;
 
-	auto iter = std::find_if(this->trw->wp_image_cache.begin(), this->trw->wp_image_cache.end(), CachedPixmapCompareByPath(wp->image_full_path));
-	if (iter != this->trw->wp_image_cache.end()) {
+	const CachedPixmap * cached_pixmap = this->trw->wp_image_cache.get(wp->image_full_path);
+	if (cached_pixmap) {
 		/* Found a matching pixmap in cache. */
-		pixmap = (*iter).pixmap;
+		pixmap = cached_pixmap->pixmap;
 	} else {
 		/* WP Image Cache miss. */
 		qDebug() << SG_PREFIX_I << "Waypoint image" << wp->image_full_path << "not found in cache, generating new cached image";
@@ -979,7 +1182,10 @@ bool LayerTRWPainter::draw_waypoint_image(Waypoint * wp, const ScreenPos & wp_po
 		if (!cache_object.pixmap.isNull()) {
 			/* Apply alpha setting to the image before the pixmap gets stored in the cache. */
 			ui_pixmap_set_alpha(cache_object.pixmap, this->wp_image_alpha);
-			this->trw->wp_image_cache_add(cache_object);
+			/* Cache the pixmap under waypoint's path also
+			   when the default thumbnail is used, so that
+			   unreadable image isn't loaded again on each redraw. */
+			this->trw->wp_image_cache_add(wp->image_full_path, cache_object);
 
 			pixmap = cache_object.pixmap;
 		}
@@ -1082,32 +1288,28 @@ void LayerTRWPainter::draw_waypoint_symbol(Waypoint * wp, const ScreenPos & wp_p
 */
 void LayerTRWPainter::draw_waypoint_label(Waypoint * wp, const ScreenPos & wp_pos, bool do_highlight)
 {
-	/* Could this be stored in the waypoint rather than recreating each pass? */
-
 	const fpixel label_x = wp_pos.x();
 	const fpixel label_y = wp_pos.y();
-	__attribute__((unused)) int label_width = 100;
-	__attribute__((unused)) int label_height = 50;
+
+	/* Layout of the label is taken from cache, so it isn't recreated on each pass. */
+	this->wp_label_layouts.set_font("Arial", pango_font_size_to_point_font_size(this->wp_label_font_size));
 
 	if (do_highlight) {
 
-		/* Draw waypoint's label with highlight background color. */
+		/* Draw waypoint's label with highlight background color.
+		   Label of highlighted waypoint is never culled. */
 
 		/* +3/-3: we don't want the background of text overlap too much with symbol of waypoint. */
-		QRectF bounding_rect(label_x + 3, label_y - 3, 300, -30);
-		this->gisview->draw_text(QFont("Arial", pango_font_size_to_point_font_size(this->wp_label_font_size)),
-					 this->wp_label_fg_pen,
-					 this->gisview->get_highlight_pen().color(),
-					 bounding_rect,
-					 Qt::AlignBottom | Qt::AlignLeft,
-					 wp->get_name());
+		const QSizeF size = this->wp_label_layouts.get_text(wp->get_name()).size();
+		const QPointF top_left(label_x + 3, label_y - 3 - size.height());
+		this->labels.add(this->gisview->get_painter(), this->wp_label_layouts, wp->get_name(), top_left,
+				 this->wp_label_fg_pen, this->gisview->get_highlight_pen().color(), LabelPriority::Always);
 	} else {
-		/* Draw waypoint's label with regular background color. */
-		this->gisview->draw_text(QFont("Arial", pango_font_size_to_point_font_size(this->wp_label_font_size)),
-					 this->wp_label_fg_pen,
-					 label_x,
-					 label_y,
-					 wp->get_name());
+		/* Draw waypoint's label with regular background
+		   color. Label's baseline is at waypoint's position. */
+		const QPointF top_left(label_x, label_y - this->wp_label_layouts.get_ascent());
+		this->labels.add(this->gisview->get_painter(), this->wp_label_layouts, wp->get_name(), top_left,
+				 this->wp_label_fg_pen, QColor(), LabelPriority::Normal);
 	}
 
 	return;
@@ -1132,6 +1334,25 @@ void LayerTRWPainter::draw_waypoint(Waypoint * wp, GisViewport * a_gisview, bool
 
 
 
+void LayerTRWPainter::begin_labels(void)
+{
+	this->labels.begin(this->gisview->total_get_width(), this->gisview->total_get_height());
+}
+
+
+
+
+void LayerTRWPainter::end_labels(void)
+{
+	this->labels.end(this->gisview->get_painter());
+
+	qDebug() << SG_PREFIX_D << "Label layouts: tracks: hits =" << this->track_label_layouts.get_counters().n_hits << ", misses =" << this->track_label_layouts.get_counters().n_misses
+		 << "; waypoints: hits =" << this->wp_label_layouts.get_counters().n_hits << ", misses =" << this->wp_label_layouts.get_counters().n_misses;
+}
+
+
+
+
 CachedPixmap::~CachedPixmap()
 {
 
@@ -28,6 +28,7 @@
 
 
 
+#include <cstdint>
 #include <vector>
 
 
@@ -42,6 +43,7 @@
 #include "coord.h"
 #include "layer_trw_definitions.h"
 #include "mem_cache.h"
+#include "viewport_labels.h"
 
 
 
@@ -64,6 +66,7 @@ namespace SlavGPS {
 	class GisViewport;
 	class Waypoint;
 	class Window;
+	class TrackPolyline;
 
 
 
@@ -82,6 +85,12 @@ namespace SlavGPS {
 		void draw_waypoint(Waypoint * wp, GisViewport * gisview, bool do_highlight);
 		void draw_track(Track * trk, GisViewport * gisview, bool do_highlight);
 
+		/* Labels of tracks and waypoints drawn between these
+		   two calls are drawn at end_labels(), with labels
+		   overlapping other labels culled. */
+		void begin_labels(void);
+		void end_labels(void);
+
 	private:
 		QColor get_fg_color(const Track * trk) const;
 		QColor get_bg_color(bool do_highlight) const;
@@ -118,13 +127,23 @@ namespace SlavGPS {
 		bool draw_waypoint_image(Waypoint * wp, const ScreenPos & wp_pos, bool do_highlight);
 		void draw_waypoint_label(Waypoint * wp, const ScreenPos & wp_pos, bool do_highlight);
 
-		void draw_track_fg_sub(Track * trk, bool do_highlight);
-		void draw_track_bg_sub(Track * trk, bool do_highlight);
-		void draw_track_label(const QString & text, const QColor & fg_color, const QColor & bg_color, const Coord & coord);
+		/* @param points are either all trackpoints of track, or
+		   trackpoints of one of levels of track's LOD.
+
+		   @param crosses[i] tells if line from point i-1 to
+		   point i crosses viewport. Only positions of ends of
+		   such lines, and of their neighbours, are calculated
+		   and put into @param positions. */
+		template <typename Points> void project_track_points(const Points & points, const std::vector<uint8_t> & crosses, std::vector<ScreenPos> & positions);
+		/* @param lod_level - level of track's LOD with @param points, or TrackLOD::no_level. */
+		template <typename Points> void draw_track_fg_sub(Track * trk, const Points & points, int lod_level, bool do_highlight);
+		template <typename Points> void draw_track_bg_sub(Track * trk, const Points & points, bool do_highlight);
+		void draw_track_label(const QString & text, const QColor & fg_color, const QColor & bg_color, const Coord & coord, LabelPriority priority);
 		void draw_track_dist_labels(Track * trk, bool do_highlight);
 		void draw_track_point_names(Track * trk, bool do_highlight);
 		void draw_track_name_labels(Track * trk, bool do_highlight);
-		void draw_track_draw_something(const ScreenPos & begin, const ScreenPos & end, QPen & pen, Trackpoint * tp, Trackpoint * tp_next, const Altitude & min_alt, const Altitude & alt_diff);
+		/* Polygon (four points) is added to @param elevation_polygons, to be drawn after lines of track. */
+		void draw_track_draw_something(const ScreenPos & begin, const ScreenPos & end, QPen & pen, Trackpoint * tp, Trackpoint * tp_next, const Altitude & min_alt, const Altitude & alt_diff, std::vector<ScreenPos> & elevation_polygons, TrackPolyline & elevation_polyline);
 		void draw_track_draw_midarrow(const ScreenPos & begin, const ScreenPos & end, QPen & pen);
 
 		QPen get_track_fg_pen(Track * trk, bool do_highlight);
@@ -153,6 +172,17 @@ namespace SlavGPS {
 
 		std::vector<QPen> track_pens;
 
+		/* Buffers reused by drawing of consecutive tracks. */
+		std::vector<uint8_t> track_crosses;
+		std::vector<ScreenPos> track_positions;
+		std::vector<const Coord *> projected_coords;
+		std::vector<size_t> projected_indices;
+		std::vector<ScreenPos> projected_positions;
+
+		ViewportLabels labels;
+		LabelLayoutCache track_label_layouts;
+		LabelLayoutCache wp_label_layouts;
+
 
 	public:
 
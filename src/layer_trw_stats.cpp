@@ -21,6 +21,7 @@
 
 
 
+#include <algorithm>
 #include <cassert>
 #include <vector>
 #include <time.h>
@@ -30,6 +31,8 @@
 
 #include <QDateTime>
 #include <QDebug>
+#include <QThreadPool>
+#include <QTime>
 
 
 
@@ -43,6 +46,7 @@
 #include "vikutils.h"
 #include "util.h"
 #include "preferences.h"
+#include "background.h"
 
 
 
@@ -55,6 +59,9 @@ using namespace SlavGPS;
 #define SG_MODULE "Layer TRW Stats"
 #define NONE_TEXT "--"
 
+/* Don't divide collection of statistics into chunks smaller than this. */
+#define STATS_MIN_TRACKS_PER_CHUNK 256
+
 /* We have here a two-column table. First column is with names of parameters,
    the second column is with values of parameter. */
 #define NAME_COLUMN   0
@@ -141,15 +148,16 @@ void TRWStatsDialog::display_stats(TrackStatistics & stats)
 	/* Check for potential date range. */
 	/* Test if the same day by comparing the date string of the timestamp. */
 	/* Viking's C code used strftime()'s %x specifier: "The preferred date representation for current locale without the time". */
-	const QString time_start = stats.start_time.get_time_string(Qt::SystemLocaleLongDate);
-	const QString time_end = stats.end_time.get_time_string(Qt::SystemLocaleLongDate);
-
-	if (stats.start_time == stats.end_time) {
+	if (!stats.start_time.is_valid() || !stats.end_time.is_valid() || stats.start_time == stats.end_time) {
 		tmp_string = tr("No Data");
-	} else if (time_start != time_end) {
-		tmp_string = tr("%1 --> %2").arg(time_start).arg(time_end);
 	} else {
-		tmp_string = time_start;
+		const QString time_start = stats.start_time.get_time_string(Qt::SystemLocaleLongDate);
+		const QString time_end = stats.end_time.get_time_string(Qt::SystemLocaleLongDate);
+		if (time_start != time_end) {
+			tmp_string = tr("%1 --> %2").arg(time_start).arg(time_end);
+		} else {
+			tmp_string = time_start;
+		}
 	}
 	this->stats_table->get_value_label(TRWStatsRow::DateChange)->setText(tmp_string);
 
@@ -229,26 +237,96 @@ void TRWStatsDialog::display_stats(TrackStatistics & stats)
 
 
 
+namespace SlavGPS {
+	/* Contiguous range of tracks, and statistics collected from them. */
+	class StatsChunk {
+	public:
+		void collect(void);
+
+		/* Tracks, and whether they are visible. */
+		const std::vector<std::pair<Track *, bool>> * tracks = nullptr;
+		size_t first = 0;
+		size_t last = 0; /* One past last track in the chunk. */
+
+		TrackStatistics visible_stats;
+		TrackStatistics invisible_stats;
+	};
+}
+
+
+
+
+void StatsChunk::collect(void)
+{
+	for (size_t i = this->first; i < this->last; i++) {
+		const std::pair<Track *, bool> & track = (*this->tracks)[i];
+		if (track.second) {
+			this->visible_stats.add_track(track.first);
+		} else {
+			this->invisible_stats.add_track(track.first);
+		}
+	}
+}
+
+
+
+
 /**
    @brief Collect statistics for each item in this->tree_items list
 
-   @stats: statistics object to be filled
-   @include_invisible: whether to include invisible layers and tracks
+   Statistics of visible and of invisible items are collected
+   separately, so that toggling of "include invisible" doesn't
+   require collecting them again.
 */
-void TRWStatsDialog::collect_stats(TrackStatistics & stats, bool include_invisible)
+void TRWStatsDialog::collect_stats(void)
 {
+	QTime collection_time;
+	collection_time.start();
+
+	/* Visibility of items is checked here, in main thread. */
+	std::vector<std::pair<Track *, bool>> tracks;
+	tracks.reserve(this->tree_items.size());
 	for (auto iter = this->tree_items.begin(); iter != this->tree_items.end(); iter++) {
 		Track * trk = (Track *) *iter;
 		const LayerTRW * trw = trk->owner_trw_layer();
-		qDebug() << SG_PREFIX_I << "Collecting stats with layer/tracks/routes/include visibility:"
-			 << trw->is_visible()
-			 << trw->get_tracks_visibility()
-			 << trw->get_routes_visibility()
-			 << include_invisible;
-		stats.add_track_maybe(trk, trw->is_visible(), trw->get_tracks_visibility(), trw->get_routes_visibility(), include_invisible);
+		const bool visible = TrackStatistics::track_is_visible(trk, trw->is_visible(), trw->get_tracks_visibility(), trw->get_routes_visibility());
+		tracks.push_back(std::make_pair(trk, visible));
 	}
 
-	return;
+	/* Partial statistics of chunks are merged in order of
+	   chunks, so the result doesn't depend on which chunks
+	   have been collected by worker threads. */
+	const int max_n_chunks = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+	const int n_chunks = std::max(1, std::min(max_n_chunks, (int) (tracks.size() / STATS_MIN_TRACKS_PER_CHUNK)));
+	std::vector<StatsChunk> chunks(n_chunks);
+	for (int i = 0; i < n_chunks; i++) {
+		chunks[i].tracks = &tracks;
+		chunks[i].first = tracks.size() * i / n_chunks;
+		chunks[i].last = tracks.size() * (i + 1) / n_chunks;
+	}
+
+	ParallelItems::process(n_chunks, [&chunks](int idx) { chunks[idx].collect(); });
+
+	this->visible_stats = TrackStatistics();
+	this->invisible_stats = TrackStatistics();
+	for (const StatsChunk & chunk : chunks) {
+		this->visible_stats.merge(chunk.visible_stats);
+		this->invisible_stats.merge(chunk.invisible_stats);
+	}
+
+	qDebug() << SG_PREFIX_I << "Collected statistics of" << tracks.size() << "items in" << n_chunks << "chunks in" << collection_time.elapsed() << "ms";
+}
+
+
+
+
+TrackStatistics TRWStatsDialog::get_stats(bool include_invisible) const
+{
+	TrackStatistics stats = this->visible_stats;
+	if (include_invisible) {
+		stats.merge(this->invisible_stats);
+	}
+	return stats;
 }
 
 
@@ -259,13 +337,12 @@ void TRWStatsDialog::include_invisible_toggled_cb(int state)
 	const bool include_invisible = (bool) state;
 	qDebug() << SG_PREFIX_D << "Include invisible items:" << include_invisible;
 
-	/* Re-use existing this->tree_items. No need to re-get them from
-	   layers. this->tree_items contains both visible and invisible
-	   tracks, so it's a matter of checking in collect_stats()
-	   which ones to include in stats. */
+	/* this->tree_items contains both visible and invisible
+	   tracks, and statistics of both groups have been
+	   collected when the dialog has been opened, so it's only
+	   a matter of merging them. */
 
-	TrackStatistics stats;
-	this->collect_stats(stats, include_invisible);
+	TrackStatistics stats = this->get_stats(include_invisible);
 	this->display_stats(stats);
 }
 
@@ -320,11 +397,12 @@ void SlavGPS::layer_trw_show_stats(const QString & name, Layer * layer, const st
 	dialog->stats_table = new StatsTable(dialog);
 	vbox->addLayout(dialog->stats_table);
 
-	/* Analysis seems reasonably quick
-	   unless you have really large numbers of tracks (i.e. many many thousands or a really slow computer).
-	   One day might store stats in the track itself... */
-	TrackStatistics stats;
-	dialog->collect_stats(stats, include_invisible);
+	/* Values of each track are taken from track's summary
+	   (recalculated only for modified tracks), and tracks are
+	   analyzed in parallel, so this is quick even for layers
+	   with many thousands of tracks. */
+	dialog->collect_stats();
+	TrackStatistics stats = dialog->get_stats(include_invisible);
 	dialog->display_stats(stats);
 
 	dialog->checkbox = new QCheckBox(QObject::tr("Include Invisible Items"), dialog);
@@ -105,12 +105,22 @@ namespace SlavGPS {
 		std::list<TreeItem *> tree_items;
 		Layer * layer = NULL; /* Just a reference. */
 
-		void collect_stats(TrackStatistics & stats, bool include_invisible);
+		/* Collect statistics of visible and of invisible
+		   items from this->tree_items, in parallel. */
+		void collect_stats(void);
+
+		/* Get statistics of visible items, optionally merged
+		   with statistics of invisible items. */
+		TrackStatistics get_stats(bool include_invisible) const;
+
 		void display_stats(TrackStatistics & stats);
 
 	public slots:
 		void include_invisible_toggled_cb(int state);
 
+	private:
+		TrackStatistics visible_stats;
+		TrackStatistics invisible_stats;
 	};
 
 
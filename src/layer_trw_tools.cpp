@@ -929,7 +929,7 @@ static int draw_sync(LayerTRW * trw, GisViewport * gisview, const QPixmap & pixm
 	if (1 /* trw->draw_sync_do*/ ) {
 		gisview->draw_pixmap(pixmap, 0, 0);
 		qDebug() << SG_PREFIX_SIGNAL << "Will emit 'tree_item_changed()' signal for" << trw->get_name();
-		emit trw->tree_item_changed(trw->get_name());
+		emit trw->tree_item_changed(trw->get_name(), false);
 #ifdef K_OLD_IMPLEMENTATION
 		/* Sometimes don't want to draw normally because another
 		   update has taken precedent such as panning the display
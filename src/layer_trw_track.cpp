@@ -35,6 +35,8 @@
 
 #include <QDebug>
 #include <QFileDialog>
+#include <QThread>
+#include <QCoreApplication>
 
 
 
@@ -54,6 +56,7 @@
 #include "layer_trw_painter.h"
 #include "layer_trw_tools.h"
 #include "layer_trw_track_internal.h"
+#include "layer_trw_track_data.h"
 #include "layer_trw_track_profile_dialog.h"
 #include "layer_trw_track_properties_dialog.h"
 #include "layer_trw_trackpoint_properties.h"
@@ -503,83 +506,437 @@ void Track::add_trackpoint(Trackpoint * tp, bool recalculate)
 
 
 
-double Track::get_length_value_to_trackpoint(const Trackpoint * tp) const
+void TrackDistanceIndex::build(const TrackPoints & trackpoints)
 {
+	const size_t size = trackpoints.size();
+
+	this->points.assign(trackpoints.begin(), trackpoints.end());
+	this->distances.resize(size);
+	this->distances_including_gaps.resize(size);
+	this->positions.resize(size);
+
 	double len = 0.0;
-	if (this->trackpoints.empty()) {
-		return len;
+	double len_including_gaps = 0.0;
+	for (size_t i = 0; i < size; i++) {
+		if (i > 0) {
+			const double delta = Coord::distance(this->points[i]->coord, this->points[i - 1]->coord);
+			if (!this->points[i]->newsegment) {
+				len += delta;
+			}
+			len_including_gaps += delta;
+		}
+		this->distances[i] = len;
+		this->distances_including_gaps[i] = len_including_gaps;
+		this->positions[i] = std::make_pair(this->points[i], i);
 	}
 
-	auto iter = this->trackpoints.begin();
-	/* Is it the very first track point? */
-	if (*iter == tp) {
-		return len;
+	std::sort(this->positions.begin(), this->positions.end());
+
+	this->valid = true;
+}
+
+
+
+
+long TrackDistanceIndex::position_of(const Trackpoint * tp) const
+{
+	auto iter = std::lower_bound(this->positions.begin(), this->positions.end(), std::make_pair(tp, (size_t) 0));
+	if (iter == this->positions.end() || iter->first != tp) {
+		return -1;
 	}
-	iter++;
+	return (long) iter->second;
+}
 
-	for (; iter != this->trackpoints.end(); iter++) {
-		Trackpoint * tp1 = *iter;
-		if (!tp1->newsegment) {
-			len += Coord::distance(tp1->coord, (*std::prev(iter))->coord);
+
+
+
+void Track::update_distance_index(void) const
+{
+	const uint64_t counter = this->get_modification_counter();
+	if (this->distance_index.valid && this->distance_index.modification_counter == counter) {
+		return;
+	}
+
+	this->distance_index.build(this->trackpoints);
+	this->distance_index.modification_counter = counter;
+}
+
+
+
+
+void Track::mark_as_modified(void)
+{
+	this->modification_counter++;
+}
+
+
+
+
+uint64_t Track::get_modification_counter(void) const
+{
+	/* Both counters only grow, so their sum changes whenever any of them changes. */
+	return this->modification_counter + this->trackpoints.modification_counter();
+}
+
+
+
+
+void TrackSummary::calculate(const TrackDistanceIndex & index)
+{
+	*this = TrackSummary();
+
+	const std::vector<Trackpoint *> & trackpoints = index.points;
+
+	this->tp_count = trackpoints.size();
+	this->length = Distance(0, DistanceType::Unit::internal_unit());
+	this->length_including_gaps = Distance(0, DistanceType::Unit::internal_unit());
+	this->duration = Duration(0, DurationType::Unit::internal_unit());
+	this->duration_in_segments = Duration(0, DurationType::Unit::internal_unit());
+	this->max_speed = Speed(NAN, SpeedType::Unit::E::MetresPerSecond); /* Invalid for empty track. */
+	this->average_speed = Speed(NAN, SpeedType::Unit::E::MetresPerSecond);
+
+	if (trackpoints.empty()) {
+		this->valid = true;
+		return;
+	}
+
+	this->length = Distance(index.distances.back(), DistanceType::Unit::E::Meters);
+	this->length_including_gaps = Distance(index.distances_including_gaps.back(), DistanceType::Unit::E::Meters);
+
+	this->max_speed = Speed(0.0, SpeedType::Unit::E::MetresPerSecond); /* Valid, but zero. */
+	this->elev_gain = Altitude(0, AltitudeType::Unit::internal_unit());
+	this->elev_loss = Altitude(0, AltitudeType::Unit::internal_unit());
+
+	/* Distance and duration of parts of track with valid timestamps, for average speed. */
+	double timed_distance = 0.0;
+
+	for (size_t i = 0; i < trackpoints.size(); i++) {
+		const Trackpoint * tp = trackpoints[i];
+
+		if (tp->newsegment) {
+			this->segment_count++;
 		}
 
-		/* Exit when we reach the desired point. */
-		if (tp1 == tp) {
-			break;
+		this->bbox.expand_with_lat_lon(tp->coord.get_lat_lon());
+
+		if (tp->altitude.is_valid()) {
+			if (!this->has_altitudes) {
+				this->min_alt = tp->altitude;
+				this->max_alt = tp->altitude;
+				this->has_altitudes = true;
+			} else {
+				if (tp->altitude > this->max_alt) {
+					this->max_alt = tp->altitude;
+				}
+				if (tp->altitude < this->min_alt) {
+					this->min_alt = tp->altitude;
+				}
+			}
+		}
+
+		if (0 == i) {
+			continue;
+		}
+		const Trackpoint * prev_tp = trackpoints[i - 1];
+
+		if (tp->altitude.is_valid() && prev_tp->altitude.is_valid()) {
+			const Altitude diff = tp->altitude - prev_tp->altitude;
+			if (diff.is_positive()) {
+				this->elev_gain += diff;
+			} else {
+				this->elev_loss += diff;
+			}
+			this->has_elevation_gain = true;
+		}
+
+		if (tp->timestamp.is_valid() && prev_tp->timestamp.is_valid() && !tp->newsegment) {
+			const double distance = index.distances[i] - index.distances[i - 1];
+			const Duration diff = Duration::get_abs_duration(tp->timestamp, prev_tp->timestamp);
+			this->duration_in_segments += diff;
+			timed_distance += distance;
+
+			Speed speed;
+			speed.make_speed(Distance(distance, DistanceType::Unit::E::Meters), diff);
+			if (speed.is_valid() && speed > this->max_speed) {
+				this->max_speed = speed;
+			}
 		}
 	}
-	return len;
+
+	this->bbox.validate();
+
+	const Trackpoint * first_tp = trackpoints.front();
+	const Trackpoint * last_tp = trackpoints.back();
+	if (first_tp->timestamp.is_valid() && last_tp->timestamp.is_valid()) {
+		this->duration = Duration::get_abs_duration(last_tp->timestamp, first_tp->timestamp);
+	}
+
+	if (this->duration_in_segments.is_valid() && this->duration_in_segments.is_positive()) {
+		this->average_speed.make_speed(Distance(timed_distance, DistanceType::Unit::E::Meters), this->duration_in_segments);
+	}
+
+	this->valid = true;
 }
 
 
 
 
-Distance Track::get_length_to_trackpoint(const Trackpoint * tp) const
+void TrackSummary::calculate_average_speed_moving(const TrackDistanceIndex & index, const Duration & track_min_stop_duration)
 {
-	return Distance(this->get_length_value_to_trackpoint(tp), DistanceType::Unit::E::Meters);
+	this->average_speed_moving = Speed(); /* Invalid by default. */
+	this->average_speed_moving_min_stop_duration = track_min_stop_duration.convert_to_unit(DurationType::Unit::internal_unit());
+
+	const std::vector<Trackpoint *> & trackpoints = index.points;
+	if (trackpoints.empty()) {
+		return;
+	}
+
+	double distance = 0.0;
+	Duration duration(0, DurationType::Unit::internal_unit());
+
+	for (size_t i = 1; i < trackpoints.size(); i++) {
+		const Trackpoint * tp = trackpoints[i];
+		const Trackpoint * prev_tp = trackpoints[i - 1];
+		if (tp->timestamp.is_valid()
+		    && prev_tp->timestamp.is_valid()
+		    && !tp->newsegment) {
+
+			const Duration timestamp_diff = Duration::get_abs_duration(tp->timestamp, prev_tp->timestamp);
+			if (timestamp_diff < track_min_stop_duration) {
+				distance += index.distances[i] - index.distances[i - 1];
+				duration += timestamp_diff;
+			}
+		}
+	}
+
+	if (duration.is_valid() && duration.is_positive()) {
+		this->average_speed_moving.make_speed(Distance(distance, DistanceType::Unit::E::Meters), duration);
+	}
 }
 
 
 
 
-double Track::get_length_value(void) const
+void Track::update_summary(void) const
 {
-	double len = 0.0;
-	if (this->trackpoints.empty()) {
-		return len;
+	const uint64_t counter = this->get_modification_counter();
+	if (this->summary.valid && this->summary.modification_counter == counter) {
+		return;
 	}
 
-	for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-		Trackpoint * tp1 = *iter;
-		if (!tp1->newsegment) {
-			len += Coord::distance(tp1->coord, (*std::prev(iter))->coord);
+	/* Distances between trackpoints are calculated only by index of distances. */
+	std::lock_guard<std::mutex> lock(this->distance_index_mutex);
+	this->update_distance_index();
+
+	this->summary.calculate(this->distance_index);
+	this->summary.modification_counter = counter;
+}
+
+
+
+
+TrackSummary Track::get_summary(void) const
+{
+	std::lock_guard<std::mutex> lock(this->summary_mutex);
+	this->update_summary();
+	return this->summary;
+}
+
+
+
+
+std::shared_ptr<const TrackSeries> Track::get_series(void) const
+{
+	const uint64_t counter = this->get_modification_counter();
+
+	std::lock_guard<std::mutex> lock(this->series_mutex);
+	std::shared_ptr<const TrackSeries> cached_series = this->series.lock();
+	if (cached_series && cached_series->modification_counter == counter) {
+		return cached_series;
+	}
+
+	/* Users of old series may still hold it, so it is replaced, not modified. */
+	std::shared_ptr<TrackSeries> new_series(new TrackSeries());
+	new_series->calculate(*this);
+	new_series->modification_counter = counter;
+	this->series = new_series;
+
+	return new_series;
+}
+
+
+
+
+std::shared_ptr<const std::vector<uint8_t>> Track::get_color_indices(int lod_level, size_t n_points, const std::vector<double> & parameters, const std::function<void(std::vector<uint8_t> &)> & calculate) const
+{
+	const uint64_t counter = this->get_modification_counter();
+
+	std::lock_guard<std::mutex> lock(this->color_indices_mutex);
+
+	for (auto iter = this->color_indices.begin(); iter != this->color_indices.end(); iter++) {
+		if (iter->lod_level == lod_level
+		    && iter->modification_counter == counter
+		    && iter->parameters == parameters
+		    && iter->indices->size() == n_points) {
+
+			this->color_indices.splice(this->color_indices.begin(), this->color_indices, iter);
+			return this->color_indices.front().indices;
 		}
 	}
-	return len;
+
+	std::shared_ptr<std::vector<uint8_t>> indices(new std::vector<uint8_t>(n_points, 0));
+	calculate(*indices);
+
+	TrackColorIndices entry;
+	entry.lod_level = lod_level;
+	entry.parameters = parameters;
+	entry.modification_counter = counter;
+	entry.indices = indices;
+	this->color_indices.push_front(entry);
+
+	/* Track is drawn either with all trackpoints or with one
+	   of LOD levels, so there is no need to keep more entries. */
+	while (this->color_indices.size() > TrackLOD::n_levels + 1) {
+		this->color_indices.pop_back();
+	}
+
+	return indices;
 }
 
 
 
 
-Distance Track::get_length(void) const
+std::shared_ptr<const TrackLOD> Track::get_lod(void)
 {
-	return Distance(this->get_length_value(), DistanceType::Unit::E::Meters);
+	if (this->trackpoints.size() < TrackLOD::min_tp_count) {
+		return nullptr;
+	}
+
+	const uint64_t counter = this->get_modification_counter();
+
+	std::lock_guard<std::mutex> lock(this->lod_state->mutex);
+
+	if (this->lod_state->has_result) {
+		/* Result of background job is converted here: positions
+		   of trackpoints are valid only if the track hasn't been
+		   modified since the job has been started. */
+		if (this->lod_state->result_modification_counter == counter) {
+			const std::vector<Trackpoint *> all_points(this->trackpoints.begin(), this->trackpoints.end());
+
+			std::shared_ptr<TrackLOD> lod(new TrackLOD());
+			for (int level = 0; level < TrackLOD::n_levels; level++) {
+				const std::vector<size_t> & positions = this->lod_state->result_positions[level];
+				lod->levels[level].reserve(positions.size());
+				for (size_t i = 0; i < positions.size(); i++) {
+					lod->levels[level].push_back(all_points[positions[i]]);
+				}
+			}
+			lod->modification_counter = counter;
+			this->lod_state->lod = lod;
+		}
+
+		for (int level = 0; level < TrackLOD::n_levels; level++) {
+			std::vector<size_t>().swap(this->lod_state->result_positions[level]);
+		}
+		this->lod_state->has_result = false;
+	}
+
+	if (this->lod_state->lod && this->lod_state->lod->modification_counter == counter) {
+		return this->lod_state->lod;
+	}
+
+	if (!this->lod_state->job_running) {
+		this->lod_state->job_running = true;
+
+		if (QThread::currentThread() == QCoreApplication::instance()->thread()) {
+			this->start_lod_job(counter);
+		} else {
+			/* Track is drawn by parallel rendering. Jobs
+			   are shown in window of background jobs, so
+			   they are started in main thread. */
+			QMetaObject::invokeMethod(this, "start_lod_job_cb", Qt::QueuedConnection);
+		}
+	}
+
+	return nullptr;
 }
 
 
 
 
-double Track::get_length_value_including_gaps(void) const
+void Track::start_lod_job(uint64_t counter)
 {
-	double len = 0.0;
-	if (this->trackpoints.empty()) {
-		return len;
+	TrackLODJob * job = new TrackLODJob(this->trackpoints, counter, this->lod_state);
+	job->set_description(QObject::tr("Simplifying track %1").arg(this->get_name()));
+	LayerTRW * trw = this->owner_trw_layer();
+	if (trw) {
+		QObject::connect(job, SIGNAL (lod_ready(void)), trw, SLOT (on_track_lod_ready_cb(void)));
 	}
+	job->run_in_background(ThreadPoolType::Local);
+}
 
-	for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-		len += Coord::distance((*iter)->coord, (*std::prev(iter))->coord);
+
+
+
+void Track::start_lod_job_cb(void) /* Slot. */
+{
+	const uint64_t counter = this->get_modification_counter();
+
+	std::lock_guard<std::mutex> lock(this->lod_state->mutex);
+	this->start_lod_job(counter);
+}
+
+
+
+
+double Track::get_length_value_to_trackpoint(const Trackpoint * tp) const
+{
+	std::lock_guard<std::mutex> lock(this->distance_index_mutex);
+	this->update_distance_index();
+
+	const TrackDistanceIndex & index = this->distance_index;
+	if (index.points.empty()) {
+		return 0.0;
+	}
+
+	const long pos = index.position_of(tp);
+	if (pos < 0) {
+		/* Trackpoint not found: length of whole track. */
+		return index.distances.back();
 	}
-	return len;
+	return index.distances[pos];
+}
+
+
+
+
+Distance Track::get_length_to_trackpoint(const Trackpoint * tp) const
+{
+	return Distance(this->get_length_value_to_trackpoint(tp), DistanceType::Unit::E::Meters);
+}
+
+
+
+
+double Track::get_length_value(void) const
+{
+	return this->get_length().convert_to_unit(DistanceType::Unit::E::Meters).ll_value();
+}
+
+
+
+
+Distance Track::get_length(void) const
+{
+	return this->get_summary().length;
+}
+
+
+
+
+double Track::get_length_value_including_gaps(void) const
+{
+	return this->get_length_including_gaps().convert_to_unit(DistanceType::Unit::E::Meters).ll_value();
 }
 
 
@@ -587,7 +944,7 @@ double Track::get_length_value_including_gaps(void) const
 
 Distance Track::get_length_including_gaps(void) const
 {
-	return Distance(this->get_length_value_including_gaps(), DistanceType::Unit::E::Meters);
+	return this->get_summary().length_including_gaps;
 }
 
 
@@ -741,19 +1098,7 @@ void Track::to_routepoints(void)
 
 unsigned int Track::get_segment_count() const
 {
-	unsigned int num = 0;
-
-	if (this->trackpoints.empty()) {
-		return num;
-	}
-
-	for (auto iter = this->trackpoints.begin(); iter != this->trackpoints.end(); iter++) {
-		if ((*iter)->newsegment) {
-			num++;
-		}
-	}
-
-	return num;
+	return this->get_summary().segment_count;
 }
 
 
@@ -780,6 +1125,10 @@ unsigned int Track::merge_segments(void)
 		}
 	}
 
+	if (num) {
+		this->mark_as_modified();
+	}
+
 	return num;
 }
 
@@ -813,6 +1162,8 @@ void Track::reverse(void)
 	/* First segment by convention has newsegment flag set. */
 	(*iter)->newsegment = true;
 
+	this->mark_as_modified();
+
 	return;
 }
 
@@ -827,35 +1178,8 @@ void Track::reverse(void)
  */
 Duration Track::get_duration(bool segment_gaps) const
 {
-	Duration duration(0, DurationType::Unit::internal_unit());
-
-	if (this->trackpoints.empty()) {
-		return duration;
-	}
-
-	/* Ensure times are available. */
-	if (this->get_tp_first()->timestamp.is_valid()) {
-		/* Get trkpt only once - as using vik_track_get_tp_last() iterates whole track each time. */
-		if (segment_gaps) {
-			// Simple duration
-			Trackpoint * tp_last = this->get_tp_last();
-			if (tp_last->timestamp.is_valid()) {
-				duration = Duration::get_abs_duration(tp_last->timestamp, this->get_tp_first()->timestamp);
-			}
-		} else {
-			/* Total within segments. */
-			for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-				if ((*iter)->timestamp.is_valid()
-				    && (*std::prev(iter))->timestamp.is_valid()
-				    && !(*iter)->newsegment) {
-
-					duration += Duration::get_abs_duration((*iter)->timestamp, (*std::prev(iter))->timestamp);
-				}
-			}
-		}
-	}
-
-	return duration;
+	const TrackSummary track_summary = this->get_summary();
+	return segment_gaps ? track_summary.duration : track_summary.duration_in_segments;
 }
 
 
@@ -893,31 +1217,7 @@ Duration Track::get_duration(void) const
 
 Speed Track::get_average_speed(void) const
 {
-	Speed result(NAN, SpeedType::Unit::E::MetresPerSecond); /* Invalid by default. */
-
-	if (this->trackpoints.empty()) {
-		return result;
-	}
-
-	Distance distance(0, DistanceType::Unit::internal_unit());
-	Duration duration(0, DurationType::Unit::internal_unit());
-
-	for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-
-		if ((*iter)->timestamp.is_valid()
-		    && (*std::prev(iter))->timestamp.is_valid()
-		    && !(*iter)->newsegment) {
-
-			distance += Coord::distance_2((*iter)->coord, (*std::prev(iter))->coord);
-			duration += Duration::get_abs_duration((*iter)->timestamp, (*std::prev(iter))->timestamp);
-		}
-	}
-
-	if (duration.is_valid() && duration.is_positive()) {
-		result.make_speed(distance, duration);
-	}
-
-	return result;
+	return this->get_summary().average_speed;
 }
 
 
@@ -935,75 +1235,29 @@ Speed Track::get_average_speed(void) const
  */
 Speed Track::get_average_speed_moving(const Duration & track_min_stop_duration) const
 {
-	Speed result; /* Invalid by default. */
-
-	if (this->trackpoints.empty()) {
-		return result;
-	}
-
-	Distance distance(0, DistanceType::Unit::internal_unit());
-	Duration duration(0, DurationType::Unit::internal_unit());
-
-	for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-		if ((*iter)->timestamp.is_valid()
-		    && (*std::prev(iter))->timestamp.is_valid()
-		    && !(*iter)->newsegment) {
-
-			const Duration timestamp_diff = Duration::get_abs_duration((*iter)->timestamp, (*std::prev(iter))->timestamp);
-			if (timestamp_diff < track_min_stop_duration) {
-				distance += Coord::distance_2((*iter)->coord, (*std::prev(iter))->coord);
-				duration += Duration::get_abs_duration((*iter)->timestamp, (*std::prev(iter))->timestamp);
-			}
-		}
-	}
+	std::lock_guard<std::mutex> lock(this->summary_mutex);
+	this->update_summary();
 
-	if (duration.is_valid() && duration.is_positive()) {
-		result.make_speed(distance, duration);
+	/* Track can be drawn with one value of the parameter and
+	   shown in dialog with another one, so compare the values
+	   in common unit. */
+	const Duration & cached = this->summary.average_speed_moving_min_stop_duration;
+	const Duration requested = track_min_stop_duration.convert_to_unit(DurationType::Unit::internal_unit());
+	if (!cached.is_valid() || !requested.is_valid() || cached.ll_value() != requested.ll_value()) {
+		std::lock_guard<std::mutex> distance_lock(this->distance_index_mutex);
+		this->update_distance_index();
+		this->summary.calculate_average_speed_moving(this->distance_index, track_min_stop_duration);
 	}
 
-	return result;
+	return this->summary.average_speed_moving;
 }
 
 
 
 
-sg_ret Track::calculate_max_speed(void)
+Speed Track::get_max_speed(void) const
 {
-	this->max_speed = Speed(NAN, SpeedType::Unit::E::MetresPerSecond); /* Invalidate. */
-
-	if (this->trackpoints.empty()) {
-		return sg_ret::ok;
-	}
-
-	Speed maxspeed(0.0, SpeedType::Unit::E::MetresPerSecond); /* Initialized as valid, but zero. */
-
-	for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-		if ((*iter)->timestamp.is_valid()
-		    && (*std::prev(iter))->timestamp.is_valid()
-		    && !(*iter)->newsegment) {
-
-			const Distance distance = Coord::distance_2((*iter)->coord, (*std::prev(iter))->coord);
-			const Duration duration = Duration::get_abs_duration((*iter)->timestamp, (*std::prev(iter))->timestamp);
-			Speed speed;
-			speed.make_speed(distance, duration);
-
-			if (speed.is_valid() && speed > maxspeed) {
-				maxspeed = speed;
-			}
-		}
-	}
-
-	this->max_speed = maxspeed; /* Set the value even if detected max speed is zero. */
-
-	return sg_ret::ok;
-}
-
-
-
-
-const Speed & Track::get_max_speed(void) const
-{
-	return this->max_speed;
+	return this->get_summary().max_speed;
 }
 
 
@@ -1014,6 +1268,7 @@ void Track::change_coord_mode(CoordMode dest_mode)
 	for (auto iter = this->trackpoints.begin(); iter != this->trackpoints.end(); iter++) {
 		(*iter)->coord.recalculate_to_mode(dest_mode);
 	}
+	this->mark_as_modified();
 }
 
 
@@ -1021,42 +1276,22 @@ void Track::change_coord_mode(CoordMode dest_mode)
 
 bool Track::get_total_elevation_gain(Altitude & delta_up, Altitude & delta_down) const
 {
-	auto size = this->trackpoints.size();
-	if (size <= 1) {
-		/* Checking for more existence of more than one
-		   trackpoint, because the loop below will start from
-		   a second element of ::trackpoints. */
-		qDebug() << SG_PREFIX_N << "Can't get elevation gain for track of size" << size;
+	const TrackSummary track_summary = this->get_summary();
+	if (track_summary.tp_count <= 1) {
+		qDebug() << SG_PREFIX_N << "Can't get elevation gain for track of size" << track_summary.tp_count;
 		return false;
 	}
 
-	delta_up = Altitude(0, AltitudeType::Unit::internal_unit());
-	delta_down = Altitude(0, AltitudeType::Unit::internal_unit());
-
-	size_t n = 0;
-	for (auto iter = std::next(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
-
-		if (!(*iter)->altitude.is_valid() || !(*std::prev(iter))->altitude.is_valid()) {
-			continue;
-		}
-
-		const Altitude diff = (*iter)->altitude - (*std::prev(iter))->altitude;
-		if (diff.is_positive()) {
-			delta_up += diff;
-		} else {
-			delta_down += diff;
-		}
-		n++;
-	}
-
-	if (0 == n) {
+	if (!track_summary.has_elevation_gain) {
 		qDebug() << SG_PREFIX_N << "Zero valid elevation gains";
 		delta_up.invalidate();
 		delta_down.invalidate();
 		return false;
-	} else {
-		return true;
 	}
+
+	delta_up = track_summary.elev_gain;
+	delta_down = track_summary.elev_loss;
+	return true;
 }
 
 
@@ -1074,44 +1309,36 @@ bool Track::get_total_elevation_gain(Altitude & delta_up, Altitude & delta_down)
  */
 Trackpoint * Track::get_tp_by_dist(double meters_from_start, bool get_next_point, double *tp_metres_from_start)
 {
-	if (this->trackpoints.empty()) {
-		return NULL;
-	}
-
-	double current_dist = 0.0;
-	double current_inc = 0.0;
 	if (tp_metres_from_start) {
 		*tp_metres_from_start = 0.0;
 	}
 
-	auto iter = std::next(this->trackpoints.begin());
-	while (iter != this->trackpoints.end()) {
-		current_inc = Coord::distance((*iter)->coord, (*std::prev(iter))->coord);
-		current_dist += current_inc;
-		if (current_dist >= meters_from_start) {
-			break;
-		}
-		iter++;
+	std::lock_guard<std::mutex> lock(this->distance_index_mutex);
+	this->update_distance_index();
+
+	const TrackDistanceIndex & index = this->distance_index;
+	if (index.points.empty()) {
+		return NULL;
 	}
+
+	/* First trackpoint (other than the very first one) at or past given distance. */
+	auto dist_iter = std::lower_bound(std::next(index.distances_including_gaps.begin()), index.distances_including_gaps.end(), meters_from_start);
 	/* Passed the end of the track? */
-	if (iter == this->trackpoints.end()) {
+	if (dist_iter == index.distances_including_gaps.end()) {
 		return NULL;
 	}
 
-	if (tp_metres_from_start) {
-		*tp_metres_from_start = current_dist;
-	}
+	size_t pos = std::distance(index.distances_including_gaps.begin(), dist_iter);
 
 	/* We've gone past the distance already, is the previous trackpoint wanted? */
 	if (!get_next_point) {
-		if (iter != this->trackpoints.begin()) {
-			if (tp_metres_from_start) {
-				*tp_metres_from_start = current_dist - current_inc;
-			}
-			return *std::prev(iter);
-		}
+		pos--;
+	}
+
+	if (tp_metres_from_start) {
+		*tp_metres_from_start = index.distances_including_gaps[pos];
 	}
-	return *iter;
+	return index.points[pos];
 }
 
 
@@ -1131,8 +1358,7 @@ sg_ret Track::select_tp(const Trackpoint * tp)
 	auto iter = std::next(this->trackpoints.begin());
 	for (; iter != this->trackpoints.end(); iter++) {
 		if (tp == *iter) {
-			this->selected_children.references.front().m_iter_valid = true;
-			this->selected_children.references.front().m_iter = iter;
+			this->selected_children.references.front() = TrackpointReference(iter, true);
 			return sg_ret::ok;
 		}
 	}
@@ -1282,14 +1508,15 @@ Trackpoint * Track::get_tp_prev(Trackpoint * tp) const
 
 	Trackpoint * tp_prev = NULL;
 
-	for (auto iter = std::prev(this->trackpoints.begin()); iter != this->trackpoints.end(); iter++) {
+	for (auto iter = this->trackpoints.begin(); iter != this->trackpoints.end(); iter++) {
 		if (*iter == tp) {
-			tp_prev = *std::prev(iter);
-			break;
+			/* NULL for first trackpoint. */
+			return tp_prev;
 		}
+		tp_prev = *iter;
 	}
 
-	return tp_prev;
+	return NULL;
 }
 
 
@@ -1301,32 +1528,13 @@ bool Track::get_minmax_alt(Altitude & min_alt, Altitude & max_alt) const
 		return false;
 	}
 
+	const TrackSummary track_summary = this->get_summary();
 
-	/* Initialize as invalid. */
-	min_alt = Altitude();
-	max_alt = Altitude();
-	bool initialized = false;
-
-	for (auto iter = this->trackpoints.begin(); iter != this->trackpoints.end(); iter++) {
-		if (!(*iter)->altitude.is_valid()) {
-			continue;
-		}
+	/* Invalid if track has no altitudes. */
+	min_alt = track_summary.min_alt;
+	max_alt = track_summary.max_alt;
 
-		if (!initialized) {
-			min_alt = (*iter)->altitude;
-			max_alt = (*iter)->altitude;
-			initialized = true;
-		} else {
-			const Altitude & tmp_alt = (*iter)->altitude;
-			if (tmp_alt > max_alt) {
-				max_alt = tmp_alt;
-			}
-			if (tmp_alt < min_alt) {
-				min_alt = tmp_alt;
-			}
-		}
-	}
-	return initialized;
+	return track_summary.has_altitudes;
 }
 
 
@@ -1432,12 +1640,11 @@ void Track::recalculate_bbox(void)
 		return;
 	}
 
-	this->bbox.invalidate();
-	for (auto iter = this->trackpoints.begin(); iter != this->trackpoints.end(); iter++) {
-		const LatLon lat_lon = (*iter)->coord.get_lat_lon();
-		this->bbox.expand_with_lat_lon(lat_lon);
-	}
-	this->bbox.validate();
+	/* Bounds are calculated together with other data of the
+	   summary, which will be then ready for tooltips and for
+	   painter. Summary is recalculated only if trackpoints have
+	   been modified (see get_modification_counter()). */
+	this->bbox = this->get_summary().bbox;
 
 	/* TODO_LATER: enable this debug and verify whether it appears only
 	   once for a given track during import ("acquire") of the
@@ -1484,6 +1691,7 @@ sg_ret Track::anonymize_times(void)
 			tp->timestamp.set_ll_value(tp->timestamp.ll_value() - offset);
 		}
 	}
+	this->mark_as_modified();
 
 	return sg_ret::ok;
 }
@@ -1535,6 +1743,7 @@ void Track::interpolate_times()
 
 				(*iter)->timestamp = first_timestamp + timestamp_diff * relative;
 			}
+			this->mark_as_modified();
 			/* Some points may now have the same time so remove them. */
 			this->remove_same_time_points();
 		}
@@ -1553,20 +1762,34 @@ unsigned long Track::apply_dem_data(bool skip_existing)
 {
 	unsigned long num = 0;
 
+	/* Look up elevations of all trackpoints in one batch. */
+	std::vector<Trackpoint *> tps;
+	std::vector<Coord> coords;
 	for (auto iter = this->trackpoints.begin(); iter != this->trackpoints.end(); iter++) {
 		/* Don't apply if the point already has a value and the overwrite is off. */
 		if (!(skip_existing && (*iter)->altitude.is_valid())) {
-			/* TODO_LATER: of the 4 possible choices we have for choosing an
-			   elevation (trackpoint in between samples), choose the one
-			   with the least elevation change as the last. */
-			const Altitude elev = DEMCache::get_elev_by_coord((*iter)->coord, DEMInterpolation::Best);
-			if (elev.is_valid()) {
-				(*iter)->altitude = elev;
-				num++;
-			}
+			tps.push_back(*iter);
+			coords.push_back((*iter)->coord);
+		}
+	}
+
+	/* TODO_LATER: of the 4 possible choices we have for choosing an
+	   elevation (trackpoint in between samples), choose the one
+	   with the least elevation change as the last. */
+	std::vector<Altitude> elevs;
+	DEMCache::get_elevs_by_coords(coords, DEMInterpolation::Best, elevs);
+
+	for (size_t i = 0; i < tps.size(); i++) {
+		if (elevs[i].is_valid()) {
+			tps[i]->altitude = elevs[i];
+			num++;
 		}
 	}
 
+	if (num) {
+		this->mark_as_modified();
+	}
+
 	return num;
 }
 
@@ -1587,6 +1810,7 @@ void Track::apply_dem_data_last_trackpoint()
 	const Altitude elev = DEMCache::get_elev_by_coord((*last)->coord, DEMInterpolation::Best);
 	if (elev.is_valid()) {
 		(*last)->altitude = elev;
+		this->mark_as_modified();
 	}
 }
 
@@ -1677,6 +1901,10 @@ unsigned long Track::smooth_missing_elevation_data(bool flat)
 		}
 	}
 
+	if (num) {
+		this->mark_as_modified();
+	}
+
 	return num;
 }
 
@@ -1811,25 +2039,16 @@ void Track::sort(compare_trackpoints_t compare_func)
 
 TrackPoints::iterator Track::delete_trackpoint(TrackPoints::iterator iter)
 {
-	TrackPoints::iterator new_iter;
-
-	if ((new_iter = std::next(iter)) != this->trackpoints.end()
-	    || (new_iter = std::next(iter)) != this->trackpoints.end()) {
+	if ((*iter)->newsegment
+	    && std::next(iter) != this->trackpoints.end()) {
 
-		if ((*iter)->newsegment
-		    && std::next(iter) != this->trackpoints.end()) {
-
-			(*std::next(iter))->newsegment = true; /* don't concat segments on del */
-		}
-
-		/* Delete current trackpoint. */
-		this->erase_trackpoint(iter);
-		return new_iter;
-	} else {
-		/* Delete current trackpoint. */
-		this->erase_trackpoint(iter);
-		return this->trackpoints.end();
+		(*std::next(iter))->newsegment = true; /* don't concat segments on del */
 	}
+
+	/* Delete current trackpoint. Erasing invalidates
+	   iterators following the erased trackpoint, so use
+	   iterator returned by erase. */
+	return this->erase_trackpoint(iter);
 }
 
 
@@ -1852,7 +2071,7 @@ void Track::insert(Trackpoint * tp_at, Trackpoint * tp_new, bool before)
 		return;
 	}
 
-	/* std::list::insert() inserts element before position indicated by iter.
+	/* TrackPoints::insert() inserts element before position indicated by iter.
 	   Iterator can be end() - then element is inserted before end(). */
 
 	if (before) {
@@ -2724,6 +2943,7 @@ QString Track::sublayer_rename_request(const QString & new_name)
 	parent_trw->tree_view->apply_tree_item_name(this);
 	parent_trw->tree_view->sort_children(tracks, parent_trw->track_sort_order);
 
+	this->increment_content_versions();
 	ThisApp::layers_panel()->emit_items_tree_updated_cb("Redrawing items after renaming track");
 
 	return new_name;
@@ -2741,7 +2961,7 @@ bool Track::handle_selection_in_tree(void)
 	parent_trw->set_statusbar_msg_info_trk(this);
 #endif
 	parent_trw->reset_internal_selections(); /* No other tree item (that is a sublayer of this layer) is selected... */
-	parent_trw->selected_track_set(this, this->selected_children.references.front()); /* But this tree item is selected (and maybe its trackpoint too). */
+	parent_trw->selected_track_set(this, this->selected_children.front_ref()); /* But this tree item is selected (and maybe its trackpoint too). */
 
 	qDebug() << SG_PREFIX_I << "Tree item" << this->get_name() << "becomes selected tree item";
 	g_selected.add_to_set(this);
@@ -3084,7 +3304,7 @@ void Track::refine_route_cb(void)
 
 sg_ret Track::create_tp_next_to_selected_tp(bool before)
 {
-	return this->create_tp_next_to_specified_tp(this->selected_children.references.front(), before);
+	return this->create_tp_next_to_specified_tp(this->selected_children.front_ref(), before);
 }
 
 
@@ -3109,7 +3329,7 @@ sg_ret Track::create_tp_next_to_specified_tp(const TrackpointReference & other_t
 	}
 
 #if 1   /* Debug code. */
-	auto iter = std::find(this->trackpoints.begin(), this->trackpoints.end(), *(other_tp_ref.m_iter));
+	auto iter = std::find(this->trackpoints.begin(), this->trackpoints.end(), other_tp_ref.m_tp);
 	qDebug() << "Will check assertion for track" << this->get_name();
 	assert (iter != this->trackpoints.end());
 #endif
@@ -3419,7 +3639,7 @@ bool TrackSelectedChildren::is_member(const Trackpoint * tp) const
 
 	for (auto iter = this->references.begin(); iter != this->references.end(); iter++) {
 		const TrackpointReference & tp_ref = *iter;
-		if (tp_ref.m_iter_valid && tp == *tp_ref.m_iter) {
+		if (tp_ref.m_iter_valid && tp == tp_ref.m_tp) {
 			return true;
 		}
 	}
@@ -3434,12 +3654,52 @@ TrackpointReference TrackSelectedChildren::front(void) const
 	/* Since we add one reference to the container in constructor,
 	   then here we will always return *some* reference (which may
 	   be not valid). */
+	this->references.front().revalidate();
+	return this->references.front();
+}
+
+
+
+
+TrackpointReference & TrackSelectedChildren::front_ref(void)
+{
+	this->references.front().revalidate();
 	return this->references.front();
 }
 
 
 
 
+void TrackpointReference::revalidate(void)
+{
+	if (!this->m_iter_valid) {
+		return;
+	}
+
+	/* Iterator is stored together with the container that it belongs to. */
+	TrackPoints * container = const_cast<TrackPoints *>(this->m_iter.container());
+	if (container->layout_version() == this->m_layout_version) {
+		return;
+	}
+
+	this->m_iter = std::find(container->begin(), container->end(), this->m_tp);
+	this->m_iter_valid = this->m_iter != container->end();
+	this->m_layout_version = container->layout_version();
+}
+
+
+
+
+void TrackpointReference::set_iter(const TrackPoints::iterator & iter)
+{
+	this->m_iter = iter;
+	this->m_tp = *iter;
+	this->m_layout_version = iter.container()->layout_version();
+}
+
+
+
+
 const TrackSelectedChildren & Track::get_selected_children(void) const
 {
 	return this->selected_children;
@@ -3487,7 +3747,7 @@ sg_ret Track::get_timestamps(Time & ts_first, Time & ts_last) const
 */
 void Track::insert_point_after_cb(void)
 {
-	if (sg_ret::ok != this->create_tp_next_to_specified_tp(this->selected_children.references.front(), false)) {
+	if (sg_ret::ok != this->create_tp_next_to_specified_tp(this->selected_children.front_ref(), false)) {
 		qDebug() << SG_PREFIX_E << "Failed to insert trackpoint after selected trackpoint";
 	} else {
 		this->emit_tree_item_changed("Track changed after inserting trackpoint 'after'");
@@ -3502,7 +3762,7 @@ void Track::insert_point_after_cb(void)
 */
 void Track::insert_point_before_cb(void)
 {
-	if (sg_ret::ok != this->create_tp_next_to_specified_tp(this->selected_children.references.front(), true)) {
+	if (sg_ret::ok != this->create_tp_next_to_specified_tp(this->selected_children.front_ref(), true)) {
 		qDebug() << SG_PREFIX_E << "Failed to insert trackpoint before selected trackpoint";
 	} else {
 		this->emit_tree_item_changed("Track changed after inserting trackpoint 'before'");
@@ -3517,7 +3777,7 @@ void Track::insert_point_before_cb(void)
 */
 sg_ret Track::split_at_selected_trackpoint_cb(void)
 {
-	sg_ret ret = this->split_at_trackpoint(this->selected_children.references.front());
+	sg_ret ret = this->split_at_trackpoint(this->selected_children.front_ref());
 	if (sg_ret::ok != ret) {
 		qDebug() << SG_PREFIX_W << "Failed to split track" << this->get_name() << "at selected trackpoint";
 		return ret;
@@ -3533,7 +3793,7 @@ sg_ret Track::split_at_selected_trackpoint_cb(void)
 
 sg_ret Track::delete_all_selected_tp(void)
 {
-	TrackPoints::iterator new_tp_iter = this->delete_trackpoint(this->selected_children.references.front().m_iter);
+	TrackPoints::iterator new_tp_iter = this->delete_trackpoint(this->selected_children.front_ref().m_iter);
 
 	if (new_tp_iter != this->end()) {
 		/* Set to current to the available adjacent trackpoint. */
@@ -3676,12 +3936,13 @@ sg_ret Track::move_selection_to_next_tp(void)
 	if (1 != this->selected_children.get_count()) {
 		return sg_ret::err_cond;
 	}
-	if (std::next(this->selected_children.references.front().m_iter) == this->end()) {
+	if (std::next(this->selected_children.front_ref().m_iter) == this->end()) {
 		/* Can't go forward if we are already at the end. */
 		return sg_ret::err_cond;
 	}
 
-	this->selected_children.references.front().m_iter++;
+	TrackpointReference & tp_ref = this->selected_children.front_ref();
+	tp_ref.set_iter(std::next(tp_ref.m_iter));
 
 	return sg_ret::ok;
 }
@@ -3694,12 +3955,13 @@ sg_ret Track::move_selection_to_previous_tp(void)
 	if (1 != this->selected_children.get_count()) {
 		return sg_ret::err_cond;
 	}
-	if (this->selected_children.references.front().m_iter == this->begin()) {
+	if (this->selected_children.front_ref().m_iter == this->begin()) {
 		/* Can't go back if we are already at the beginning. */
 		return sg_ret::err_cond;
 	}
 
-	this->selected_children.references.front().m_iter--;
+	TrackpointReference & tp_ref = this->selected_children.front_ref();
+	tp_ref.set_iter(std::prev(tp_ref.m_iter));
 
 	return sg_ret::ok;
 }
@@ -3710,6 +3972,7 @@ sg_ret Track::move_selection_to_previous_tp(void)
 size_t TrackSelectedChildren::get_count(void) const
 {
 	/* For now we can select at most one trackpoint. */
+	this->references.front().revalidate();
 	return this->references.front().m_iter_valid ? 1 : 0;
 }
 
@@ -3736,11 +3999,11 @@ void Track::selected_tp_set(const TrackpointReference & tp_ref)
 
 bool Track::selected_tp_reset(void)
 {
-	const bool was_set = this->selected_children.references.front().m_iter_valid;
+	const bool was_set = this->selected_children.front_ref().m_iter_valid;
 
 	if (was_set) {
 		qDebug() << SG_PREFIX_E << "zzzzz - reset";
-		this->selected_children.references.front().m_iter_valid = false;
+		this->selected_children.front_ref().m_iter_valid = false;
 	}
 	/* Do this regardless of value of 'was_set' - just in case. */
 	Track::tp_properties_dialog_reset();
@@ -3802,7 +4065,7 @@ sg_ret Track::selected_tp_set_coord(const Coord & new_coord, bool do_recalculate
 		Track::tp_properties_dialog_reset();
 		return sg_ret::err;
 	}
-	if (false == this->selected_children.references.front().m_iter_valid) {
+	if (false == this->selected_children.front_ref().m_iter_valid) {
 		/* That's a double error: function was called for
 		   invalid tp, and the tp is invalid while
 		   selected_children.get_count() returned 1. */
@@ -3812,7 +4075,8 @@ sg_ret Track::selected_tp_set_coord(const Coord & new_coord, bool do_recalculate
 	}
 
 
-	(*this->selected_children.references.front().m_iter)->coord = new_coord;
+	(*this->selected_children.front_ref().m_iter)->coord = new_coord;
+	this->mark_as_modified();
 
 
 	/* Update properties dialog with the most recent coordinates
@@ -3985,7 +4249,7 @@ sg_ret Track::get_item_position(const TrackpointReference & tp_ref, bool & is_fi
 		return sg_ret::ok;
 	}
 
-	auto iter = std::find(this->trackpoints.begin(), this->trackpoints.end(), *tp_ref.m_iter);
+	auto iter = std::find(this->trackpoints.begin(), this->trackpoints.end(), tp_ref.m_tp);
 	if (iter != tp_ref.m_iter) {
 		qDebug() << SG_PREFIX_E << "Invalid trackpoint reference";
 		is_first = false;
@@ -25,6 +25,12 @@
 
 
 #include <list>
+#include <cstdint>
+
+
+
+
+#include "layer_trw_trackpoints.h"
 
 
 
@@ -67,7 +73,6 @@ namespace SlavGPS {
 
 
 
-	typedef std::list<Trackpoint *> TrackPoints;
 	typedef bool (* compare_trackpoints_t)(const Trackpoint * a, const Trackpoint * b);
 
 
@@ -80,17 +85,27 @@ namespace SlavGPS {
 		{
 			this->m_iter = iter;
 			this->m_iter_valid = iter_valid;
+			if (iter_valid) {
+				this->m_tp = *iter;
+				this->m_layout_version = iter.container()->layout_version();
+			}
 		}
 
-		/*
-		  TODO: semi-persistent storage of iterator will lead
-		  to problems for tracks that can be edited.
+		/* Look up the iterator again if trackpoints
+		   container has been modified since the iterator
+		   was stored. Reference becomes invalid if the
+		   trackpoint is no longer in the container. */
+		void revalidate(void);
+
+		/* Set the iterator to other trackpoint of the same container. */
+		void set_iter(const TrackPoints::iterator & iter);
 
-		  Come up with different way to reference specific
-		  trackpoints.
-		*/
 		TrackPoints::iterator m_iter;
 		bool m_iter_valid = false;
+
+		/* Stable handle of referenced trackpoint, used to find m_iter again after changes in container. */
+		Trackpoint * m_tp = NULL;
+		uint64_t m_layout_version = 0;
 	};
 
 
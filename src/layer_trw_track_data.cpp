@@ -89,92 +89,83 @@ using namespace SlavGPS;
 /**
    @reviewed-on tbd
 */
-template <typename Tx, typename Ty>
-sg_ret TrackData<Tx, Ty>::compress_into(TrackData & target, int compressed_n_points) const
+TrackDataBase::TrackDataBase()
 {
-	target.invalidate();
-	if (sg_ret::ok != target.allocate(compressed_n_points)) {
-		qDebug() << SG_PREFIX_E << "Failed to allocate vector for compressed track data";
-		return sg_ret::err;
-	}
-
-
-	const double tps_per_data_point = 1.0 * this->n_points / target.n_points;
-	const int floor_ = floor(tps_per_data_point);
-	const int ceil_ = ceil(tps_per_data_point);
-	int n_tps_compressed = 0;
 
-	//qDebug() << "-----------------------" << floor_ << tps_per_data_point << ceil_ << this->n_points << target.n_points;
+}
 
-	/* In the following computation, we iterate through periods of time of duration delta_t.
-	   The first period begins at the beginning of the track.  The last period ends at the end of the track. */
-	int tp_index = 0; /* index of the current trackpoint. */
-	int i = 0;
-	for (i = 0; i < target.n_points; i++) {
 
-		int sampling_size;
-		if ((i + 1) * tps_per_data_point > n_tps_compressed + floor_) {
-		        sampling_size = ceil_;
-		} else {
-			sampling_size = floor_;
-		}
 
-		/* This may happen at the very end of loop, when
-		   attempting to calculate last output data point. */
-		if (n_tps_compressed + sampling_size > this->n_points) {
-			const int fix = (n_tps_compressed + sampling_size) - this->n_points;
-			qDebug() << "oooooooooooo truncating from" << n_tps_compressed + sampling_size
-				 << "to" << n_tps_compressed + sampling_size - fix
-				 << "(sampling_size = " << sampling_size << " -> " << sampling_size - fix << ")";
-			sampling_size -= fix;
-		}
 
-		double acc_x = 0.0;
-		double acc_y = 0.0;
-		for (int j = n_tps_compressed; j < n_tps_compressed + sampling_size; j++) {
-			acc_x += this->x[j];
-			acc_y += this->m_y_ll[j];
-			tp_index++;
-		}
+/**
+   @reviewed-on tbd
+*/
+TrackDataBase::~TrackDataBase()
+{
 
-		//qDebug() << "------- i =" << i << "/" << target.n_points << "sampling_size =" << sampling_size << "n_tps_compressed =" << n_tps_compressed << "n_tps_compressed + sampling_size =" << n_tps_compressed + sampling_size << acc_y << acc_y / sampling_size;
+}
 
-		target.m_x_ll[i] = acc_x / sampling_size;
-		target.m_y_ll[i] = acc_y / sampling_size;
-		target->m_tps[i] = this->tps[n_tps_compressed];
 
-		n_tps_compressed += sampling_size;
-	}
 
-	assert(i == target.n_points);
 
-	target.valid = true;
-	target.calculate_min_max(); /* TODO_LATER: rethink how we calculate min/max of compressed. */
-	snprintf(target.debug, sizeof (target.debug), "Compressed %s", this->debug);
-
-	return sg_ret::ok;
-}
+void TrackSeries::calculate(const Track & trk)
+{
+	*this = TrackSeries();
 
+	this->tps.assign(trk.trackpoints.begin(), trk.trackpoints.end());
 
+	const int tp_count = this->size();
+	this->time_ll.resize(tp_count);
+	this->distance_ll.resize(tp_count);
+	this->altitude_ll.resize(tp_count);
+	this->speed_ll.resize(tp_count);
+	this->gradient_ll.resize(tp_count);
 
+	int n_glitches = 0;
+	for (int i = 0; i < tp_count; i++) {
+		const Trackpoint * tp = this->tps[i];
 
-/**
-   @reviewed-on tbd
-*/
-TrackDataBase::TrackDataBase()
-{
+		this->time_ll[i] = tp->timestamp.ll_value();
+		this->altitude_ll[i] = tp->altitude.is_valid() ? tp->altitude.ll_value() : NAN;
 
-}
+		if (0 == i) {
+			this->distance_ll[i] = 0;
+			this->speed_ll[i] = 0;
+			continue;
+		}
 
+		this->distance_ll[i] = this->distance_ll[i - 1] + Coord::distance(this->tps[i - 1]->coord, tp->coord);
 
+		if (this->time_ll[i] <= this->time_ll[i - 1]) {
+			/* TODO_LATER: this doesn't solve problem in any way if glitch is at the beginning of dataset. */
+			this->time_ll[i] = this->time_ll[i - 1];
+			this->speed_ll[i] = 0;
+			n_glitches++;
+		} else {
+			this->speed_ll[i] = (this->distance_ll[i] - this->distance_ll[i - 1]) / (this->time_ll[i] - this->time_ll[i - 1]);
+		}
+	}
 
+	for (int i = 0; i < tp_count - 1; i++) {
+		const DistanceType::LL delta_distance = this->distance_ll[i + 1] - this->distance_ll[i];
+		if (delta_distance <= 0.0) { /* e.g. two trackpoints in the same location. */
+			this->gradient_ll[i] = 0;
+		} else {
+			this->gradient_ll[i] = 100.0 * (this->altitude_ll[i + 1] - this->altitude_ll[i]) / delta_distance;
+		}
+	}
+	if (tp_count > 1) {
+		this->gradient_ll[tp_count - 1] = this->gradient_ll[tp_count - 2];
+	} else if (tp_count > 0) {
+		this->gradient_ll[tp_count - 1] = 0;
+	}
 
-/**
-   @reviewed-on tbd
-*/
-TrackDataBase::~TrackDataBase()
-{
+	if (n_glitches) {
+		qDebug() << SG_PREFIX_W << "Found" << n_glitches << "glitches in timestamps of track" << trk.get_name();
+	}
+	qDebug() << SG_PREFIX_D << "Collected" << tp_count << "values of track series";
 
+	this->valid = true;
 }
 
 
@@ -187,7 +178,6 @@ namespace SlavGPS { /* Template specializations need to be put inside a namespac
 
 /**
    Simple method for copying "distance over time" information from Track to TrackData.
-   Make a distance/time map, heavily based on the Track::make_track_data_speed_over_time() method.
 
    @reviewed-on tbd
 */
@@ -209,7 +199,8 @@ sg_ret TrackData<Time, Distance>::make_track_data_x_over_y(const Track & trk)
 	}
 
 
-	const int tp_count = trk.get_tp_count();
+	const std::shared_ptr<const TrackSeries> series = trk.get_series();
+	const int tp_count = series->size();
 	if (tp_count < 1) {
 		qDebug() << SG_PREFIX_W << "Trying to calculate track data from empty track";
 		return sg_ret::err;
@@ -217,52 +208,13 @@ sg_ret TrackData<Time, Distance>::make_track_data_x_over_y(const Track & trk)
 	this->allocate(tp_count);
 
 
-	int i = 0;
-	auto iter = trk.trackpoints.begin();
-	this->m_x_ll[i] = (*iter)->timestamp.ll_value();
-	this->m_y_ll[i] = 0;
-	this->m_tps[i] = (*iter);
-	TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
-	i++;
-	iter++;
-
-	while (iter != trk.trackpoints.end()) {
-
-		this->m_x_ll[i] = (*iter)->timestamp.ll_value();
-		if (i > 0 && this->m_x_ll[i] <= this->m_x_ll[i - 1]) {
-			/* TODO_LATER: this doesn't solve problem in any way if glitch is at the beginning of dataset. */
-			qDebug() << SG_PREFIX_W << "Glitch in timestamps" << i << this->m_x_ll[i] << this->m_x_ll[i - 1];
-			this->m_x_ll[i] = this->m_x_ll[i - 1];
-		}
-
-		this->m_y_ll[i] = this->m_y_ll[i - 1] + Coord::distance((*std::prev(iter))->coord, (*iter)->coord);
-
-		this->m_tps[i] = (*iter);
-
+	for (int i = 0; i < tp_count; i++) {
+		this->m_x_ll[i] = series->time_ll[i];
+		this->m_y_ll[i] = series->distance_ll[i];
+		this->m_tps[i] = series->tps[i];
 		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
-
-		i++;
-		iter++;
-
-#if 0
-		if (data_dt.m_x_ll[i] <= data_dt.m_x_ll[i - 1]) {
-			/* Handle glitch in values of consecutive time stamps.
-			   TODO_LATER: improve code that calculates pseudo-values of result when a glitch has been found. */
-			qDebug() << SG_PREFIX_W << "Glitch in timestamps" << i << data_dt.m_x_ll[i] << data_dt.m_x_ll[i - 1];
-			this->m_x_ll[i] = data_dt.m_x_ll[i - 1];
-			this->m_y_ll[i] = NAN;
-			TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, false);
-		} else {
-			this->m_x_ll[i] = data_dt.m_x_ll[i];
-			this->m_y_ll[i] = data_dt.m_y_ll[i - 1];
-			TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, true);
-		}
-#endif
 	}
 
-	assert (i == tp_count);
-	qDebug() << SG_PREFIX_D << "Collected" << i << "track data values";
-
 #if 0 /* Debug. */
 	for (int j = 0; j < tp_count; j++) {
 		qDebug() << SG_PREFIX_I << "Distance over time: t[" << j << "] = " << this->m_x_ll[j] << ", d[" << j << "] =" << this->m_y_ll[j];
@@ -294,8 +246,6 @@ sg_ret TrackData<Time, Distance>::make_track_data_x_over_y(const Track & trk)
 template <> /* Template specialisation for specific type. */
 sg_ret TrackData<Distance, Altitude>::make_track_data_x_over_y(const Track & trk)
 {
-	TrackData result;
-
 	bool extremes_initialized = false;
 	DistanceType::LL x_min_ll = 0;
 	DistanceType::LL x_max_ll = 0;
@@ -307,49 +257,18 @@ sg_ret TrackData<Distance, Altitude>::make_track_data_x_over_y(const Track & trk
 		return sg_ret::err;
 	}
 
-	const int tp_count = trk.get_tp_count();
+	const std::shared_ptr<const TrackSeries> series = trk.get_series();
+	const int tp_count = series->size();
 	this->allocate(tp_count);
 
 
-	int i = 0;
-	bool y_valid = false;
-
-	auto iter = trk.trackpoints.begin();
-	/* Initial step. */
-	{
-		this->m_x_ll[i] = 0; /* Distance at the beginning is zero. */
-
-		y_valid = (*iter)->altitude.is_valid();
-		this->m_y_ll[i] = y_valid ? (*iter)->altitude.ll_value() : NAN;
-		this->m_y_ll[i] = (*iter)->altitude.ll_value();
-
-		this->m_tps[i] = (*iter);
+	for (int i = 0; i < tp_count; i++) {
+		this->m_x_ll[i] = series->distance_ll[i];
+		this->m_y_ll[i] = series->altitude_ll[i];
+		this->m_tps[i] = series->tps[i];
 		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
-		i++;
-		iter++;
-	}
-
-
-	while (iter != trk.trackpoints.end()) {
-
-		/* Iterative step. */
-		{
-			/* Accumulate distance. */
-			this->m_x_ll[i] = this->m_x_ll[i - 1] + Coord::distance((*std::prev(iter))->coord, (*iter)->coord);
-
-			y_valid = (*iter)->altitude.is_valid();
-			this->m_y_ll[i] = y_valid ? (*iter)->altitude.ll_value() : NAN;
-			this->m_y_ll[i] = (*iter)->altitude.ll_value();
-
-			this->m_tps[i] = (*iter);
-			TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
-			i++;
-			iter++;
-		}
 	}
 
-	assert(i == tp_count);
-
 	this->m_valid = true;
 	this->x_domain = GisViewportDomain::DistanceDomain;
 	this->y_domain = GisViewportDomain::ElevationDomain;
@@ -378,56 +297,28 @@ sg_ret TrackData<Distance, Altitude>::make_track_data_x_over_y(const Track & trk
 template <> /* Template specialisation for specific type. */
 sg_ret TrackData<Distance, Gradient>::make_track_data_x_over_y(const Track & trk)
 {
-	TrackData result;
-
 	bool extremes_initialized = false;
 	DistanceType::LL x_min_ll = 0;
 	DistanceType::LL x_max_ll = 0;
 	GradientType::LL y_min_ll = 0;
 	GradientType::LL y_max_ll = 0;
 
-	const int tp_count = trk.get_tp_count();
+	const std::shared_ptr<const TrackSeries> series = trk.get_series();
+	const int tp_count = series->size();
 	if (tp_count < 2) {
 		qDebug() << SG_PREFIX_W << "Trying to calculate track data from track with size" << tp_count;
 		return sg_ret::err;
 	}
 
-
-	TrackData<Distance, Altitude> data_ad;
-	data_ad.make_track_data_x_over_y(trk);
-	if (!data_ad.is_valid()) {
-		qDebug() << SG_PREFIX_I << "Failed to collect 'altitude over distance' track data";
-		return sg_ret::err;
-	}
-
 	this->allocate(tp_count);
 
-	int i = 0;
-	GradientType::LL gradient;
-	for (i = 0; i < (tp_count - 1); i++) {
-
-		this->m_x_ll[i] = data_ad.x_ll(i);
-
-		const DistanceType::LL delta_distance = data_ad.x_ll(i + 1) - data_ad.x_ll(i);
-
-		if (delta_distance <= 0.0) { /* e.g. two trackpoints in the same location. */
-			this->m_y_ll[i] = 0;
-		} else {
-			const AltitudeType::LL delta_altitude = data_ad.y_ll(i + 1) - data_ad.y_ll(i);
-			gradient = 100.0 * delta_altitude / delta_distance;
-			this->m_y_ll[i] = gradient;
-		}
-		this->m_tps[i] = data_ad.tp(i);
-
-		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, true);
 
+	for (int i = 0; i < tp_count; i++) {
+		this->m_x_ll[i] = series->distance_ll[i];
+		this->m_y_ll[i] = series->gradient_ll[i];
+		this->m_tps[i] = series->tps[i];
+		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
 	}
-	this->m_x_ll[i] = data_ad.x_ll(i);
-	this->m_y_ll[i] = gradient;
-	this->m_tps[i] = data_ad.tp(i);
-	TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, true);
-
-	assert (i + 1 == tp_count);
 
 	this->m_valid = true;
 	this->x_domain = GisViewportDomain::DistanceDomain;
@@ -459,8 +350,6 @@ sg_ret TrackData<Distance, Gradient>::make_track_data_x_over_y(const Track & trk
 template <> /* Template specialisation for specific type. */
 sg_ret TrackData<Time, Speed>::make_track_data_x_over_y(const Track & trk)
 {
-	TrackData result;
-
 	bool extremes_initialized = false;
 	TimeType::LL x_min_ll = 0;
 	TimeType::LL x_max_ll = 0;
@@ -474,53 +363,21 @@ sg_ret TrackData<Time, Speed>::make_track_data_x_over_y(const Track & trk)
 	}
 
 
-	const int tp_count = trk.get_tp_count();
+	const std::shared_ptr<const TrackSeries> series = trk.get_series();
+	const int tp_count = series->size();
 	if (tp_count < 1) {
 		qDebug() << SG_PREFIX_W << "Trying to calculate track data from empty track";
 		return sg_ret::err;
 	}
-	TrackData<Time, Distance> data_dt;
-	data_dt.make_track_data_x_over_y(trk);
-
-
-	if (data_dt.size() != tp_count) {
-		qDebug() << SG_PREFIX_E << "Mismatch of data: data points in 'distance over time' =" << data_dt.size() << ", trackpoints count =" << tp_count;
-	}
-	assert (data_dt.size() == tp_count);
-
-
 	this->allocate(tp_count);
 
 
-	int i = 0;
-	this->m_x_ll[i] = data_dt.x_ll(i);
-	this->m_y_ll[i] = 0.0;
-	this->m_tps[i] = data_dt.tp(i);
-	TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
-	i++;
-
-	for (; i < tp_count; i++) {
-		/* TODO_LATER: handle invalid distance values in data_dt. */
-
-		if (data_dt.x_ll(i) <= data_dt.x_ll(i - 1)) {
-			/* Handle glitch in values of consecutive time stamps.
-			   TODO_LATER: improve code that calculates pseudo-values of result when a glitch has been found. */
-			qDebug() << SG_PREFIX_W << "Glitch in timestamps:" << i << data_dt.x_ll(i) << data_dt.x_ll(i - 1);
-			this->m_x_ll[i] = data_dt.x_ll(i - 1);
-			this->m_y_ll[i] = 0;
-
-			TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, false);
-
-		} else {
-			const double delta_t = (data_dt.x_ll(i) - data_dt.x_ll(i - 1));
-			const double delta_d = (data_dt.y_ll(i) - data_dt.y_ll(i - 1));
-
-			this->m_x_ll[i] = data_dt.x_ll(i);
-			this->m_y_ll[i] = delta_d / delta_t;
-
-			TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, true);
-		}
-		this->m_tps[i] = data_dt.tp(i);
+	for (int i = 0; i < tp_count; i++) {
+		/* TODO_LATER: improve pseudo-values of speed for glitches in timestamps. */
+		this->m_x_ll[i] = series->time_ll[i];
+		this->m_y_ll[i] = series->speed_ll[i];
+		this->m_tps[i] = series->tps[i];
+		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
 	}
 
 	this->m_valid = true;
@@ -558,8 +415,6 @@ sg_ret TrackData<Time, Speed>::make_track_data_x_over_y(const Track & trk)
 template <> /* Template specialisation for specific type. */
 sg_ret TrackData<Time, Altitude>::make_track_data_x_over_y(const Track & trk)
 {
-	TrackData result;
-
 	bool extremes_initialized = false;
 	TimeType::LL x_min_ll = 0;
 	TimeType::LL x_max_ll = 0;
@@ -573,7 +428,8 @@ sg_ret TrackData<Time, Altitude>::make_track_data_x_over_y(const Track & trk)
 	}
 
 
-	const int tp_count = trk.get_tp_count();
+	const std::shared_ptr<const TrackSeries> series = trk.get_series();
+	const int tp_count = series->size();
 	if (tp_count < 1) {
 		qDebug() << SG_PREFIX_W << "Trying to calculate track data from empty track";
 		return sg_ret::err;
@@ -581,29 +437,12 @@ sg_ret TrackData<Time, Altitude>::make_track_data_x_over_y(const Track & trk)
 	this->allocate(tp_count);
 
 
-	int i = 0;
-	auto iter = trk.trackpoints.begin();
-	do {
-		this->m_x_ll[i] = (*iter)->timestamp.ll_value();
-		if (i > 0 && this->m_x_ll[i] <= this->m_x_ll[i - 1]) {
-			/* TODO_LATER: this doesn't solve problem in any way if glitch is at the beginning of dataset. */
-			qDebug() << SG_PREFIX_W << "Glitch in timestamps" << i << this->m_x_ll[i] << this->m_x_ll[i - 1];
-			this->m_x_ll[i] = this->m_x_ll[i - 1];
-		}
-
-		const bool y_valid = (*iter)->altitude.is_valid();
-		this->m_y_ll[i] = y_valid ? (*iter)->altitude.ll_value() : NAN;
-		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, y_valid);
-
-		this->m_tps[i] = (*iter);
-
-		i++;
-		iter++;
-	} while (iter != trk.trackpoints.end());
-
-
-	assert (i == tp_count);
-	qDebug() << SG_PREFIX_D << "Collected" << i << "track data values";
+	for (int i = 0; i < tp_count; i++) {
+		this->m_x_ll[i] = series->time_ll[i];
+		this->m_y_ll[i] = series->altitude_ll[i];
+		this->m_tps[i] = series->tps[i];
+		TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
+	}
 
 
 	this->m_valid = true;
@@ -636,8 +475,6 @@ sg_ret TrackData<Time, Altitude>::make_track_data_x_over_y(const Track & trk)
 template <> /* Template specialisation for specific type. */
 sg_ret TrackData<Distance, Speed>::make_track_data_x_over_y(const Track & trk)
 {
-	TrackData result;
-
 	bool extremes_initialized = false;
 	DistanceType::LL x_min_ll = 0;
 	DistanceType::LL x_max_ll = 0;
@@ -649,10 +486,8 @@ sg_ret TrackData<Distance, Speed>::make_track_data_x_over_y(const Track & trk)
 		return sg_ret::err;
 	}
 
-	const int tp_count = trk.get_tp_count();
-	TrackData<Time, Distance> data_dt;
-	data_dt.make_track_data_x_over_y(trk);
-
+	const std::shared_ptr<const TrackSeries> series = trk.get_series();
+	const int tp_count = series->size();
 	this->allocate(tp_count);
 
 	const int side = (this->m_window_size - 1) / 2;
@@ -660,15 +495,14 @@ sg_ret TrackData<Distance, Speed>::make_track_data_x_over_y(const Track & trk)
 	int i = 0;
 	this->m_x_ll[i] = 0;
 	this->m_y_ll[i] = 0;
-	this->m_tps[i] = data_dt.tp(i);
+	this->m_tps[i] = series->tps[i];
 	TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, (!std::isnan(this->m_y_ll[i])));
 	i++;
 
 	for (; i < tp_count; i++) {
-		if (data_dt.x_ll(i) <= data_dt.x_ll(i - 1)) {
+		if (series->time_ll[i] <= series->time_ll[i - 1]) {
 			/* Handle glitch in values of consecutive time stamps.
 			   TODO_LATER: improve code that calculates pseudo-values of result when a glitch has been found. */
-			qDebug() << SG_PREFIX_W << "Glitch in timestamps" << i << data_dt.x_ll(i) << data_dt.x_ll(i - 1);
 			this->m_x_ll[i] = this->m_x_ll[i - 1]; /* TODO_LATER: This won't work for a two or more invalid timestamps in a row. */
 			this->m_y_ll[i] = 0;
 		} else {
@@ -676,8 +510,8 @@ sg_ret TrackData<Distance, Speed>::make_track_data_x_over_y(const Track & trk)
 			double delta_t = 0.0;
 			for (int j = i - side; j <= i + side; j++) {
 				if (j - 1 >= 0 && j < tp_count) {
-					delta_d += (data_dt.y_ll(j) - data_dt.y_ll(j - 1));
-					delta_t += (data_dt.x_ll(j) - data_dt.x_ll(j - 1));
+					delta_d += (series->distance_ll[j] - series->distance_ll[j - 1]);
+					delta_t += (series->time_ll[j] - series->time_ll[j - 1]);
 				}
 			}
 
@@ -685,7 +519,7 @@ sg_ret TrackData<Distance, Speed>::make_track_data_x_over_y(const Track & trk)
 			this->m_x_ll[i] = this->m_x_ll[i - 1] + (delta_d / (side + 1 + side)); /* Accumulate the distance. */
 			TRW_TRACK_DATA_UPDATE_MIN_MAX(this, i, true);
 		}
-		this->m_tps[i] = data_dt.tp(i);
+		this->m_tps[i] = series->tps[i];
 	}
 
 	assert(i == tp_count);
@@ -26,6 +26,14 @@
 
 
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+
+
 #include <QDebug>
 
 
@@ -48,6 +56,54 @@ namespace SlavGPS {
 
 
 
+	/**
+	   @brief Values of track's parameters at each of its trackpoints
+
+	   Calculated in one pass over trackpoints of a track and
+	   shared through the track (see Track::get_series()), so
+	   that all TrackData objects made for one revision of the
+	   track (e.g. all graphs in Track Profile Dialog) don't
+	   have to walk the trackpoints and calculate distances
+	   between them again.
+	*/
+	class TrackSeries {
+	public:
+		void calculate(const Track & trk);
+
+		int size(void) const { return (int) this->tps.size(); }
+
+		std::vector<Trackpoint *> tps;
+
+		/* Timestamps of trackpoints. A glitch in timestamps
+		   (timestamp not larger than previous one) is
+		   replaced with previous timestamp, so the values
+		   never decrease. */
+		std::vector<TimeType::LL> time_ll;
+
+		/* Distance from first trackpoint, including gaps
+		   between segments. */
+		std::vector<DistanceType::LL> distance_ll;
+
+		/* NAN for trackpoints without altitude. */
+		std::vector<AltitudeType::LL> altitude_ll;
+
+		/* Speed between previous and current trackpoint.
+		   Zero for first trackpoint and for glitches in
+		   timestamps. */
+		std::vector<SpeedType::LL> speed_ll;
+
+		/* Gradient between current and next trackpoint (in
+		   percents). Last trackpoint has gradient of
+		   previous one. */
+		std::vector<GradientType::LL> gradient_ll;
+
+		uint64_t modification_counter = 0;
+		bool valid = false;
+	};
+
+
+
+
 	/*
 	  Convenience class for pair of vectors representing track's
 	  <Y param> over <X param>, where <X param> is Time or
@@ -89,11 +145,24 @@ namespace SlavGPS {
 		TrackData & operator=(const TrackData & other);
 
 
-		void calculate_min_max(void);
-
-
-		sg_ret compress_into(TrackData & target, int compressed_n_points) const;
+		/**
+		   @brief Make a copy of track data reduced for drawing in graph of given width
+
+		   Range of 'x' values is divided into @param
+		   n_columns columns of equal width, and in each
+		   column only first, last, lowest and highest point
+		   is kept. A line drawn through the kept points
+		   covers the same pixels as a line drawn through all
+		   points, so peaks are not flattened as they would be
+		   by averaging of points.
+
+		   Minimal and maximal values of @param target are
+		   the same as of this object. If @param n_columns is
+		   not positive, @param target is a full copy.
+		*/
+		sg_ret downsample_into(TrackData & target, int n_columns) const;
 
+		/* Values are taken from track's cached TrackSeries. */
 		sg_ret make_track_data_x_over_y(const Track & trk);
 
 		/**
@@ -170,53 +239,6 @@ namespace SlavGPS {
 
 
 
-	/**
-	   @reviewed-on tbd
-	*/
-	template <typename Tx, typename Ty>
-	void TrackData<Tx, Ty>::calculate_min_max(void)
-	{
-		this->x_min_ll = this->x[0];
-		this->x_max_ll = this->x[0];
-		for (int i = 1; i < this->size(); i++) {
-			if (this->x[i] >= this->x[i - 1]) { /* Non-decreasing x. */
-				if (this->x[i] > this->x_max_ll) {
-					this->x_max_ll = this->x[i];
-				}
-
-				if (this->x[i] < this->x_min_ll) {
-					this->x_min_ll = this->x[i];
-				}
-				qDebug() << this->debug << " x[" << i << "] =" << qSetRealNumberPrecision(10)
-					 << this->x[i] << ", x_min =" << this->x_min_ll << ", x_max =" << this->x_max_ll;
-			}
-		}
-
-
-		this->y_min_ll = this->y[0];
-		this->y_max_ll = this->y[0];
-		for (int i = 1; i < this->size(); i++) {
-			if (!std::isnan(this->y[i])) {
-				if (this->y[i] > this->y_max_ll) {
-					this->y_max_ll = this->y[i];
-				}
-
-				if (this->y[i] < this->y_min_ll) {
-					this->y_min_ll = this->y[i];
-				}
-				qDebug() << this->debug << "y[" << i << "] =" << qSetRealNumberPrecision(10)
-					 << this->y[i] << ", y_min =" << this->y_min_ll << ", y_max =" << this->y_max_ll;
-			}
-		}
-
-		this->x_min = Tx(this->x_min_ll, Tx::get_internal_unit());
-		this->x_max = Tx(this->x_max_ll, Tx::get_internal_unit());
-		this->y_min = Ty(this->y_min_ll, Ty::get_internal_unit());
-		this->y_max = Ty(this->y_max_ll, Ty::get_internal_unit());
-	}
-
-
-
 	/**
 	   @reviewed-on tbd
 	*/
@@ -280,6 +302,100 @@ namespace SlavGPS {
 
 
 
+	template <typename Tx, typename Ty>
+	sg_ret TrackData<Tx, Ty>::downsample_into(TrackData<Tx, Ty> & target, int n_columns) const
+	{
+		target.clear();
+
+		if (!this->is_valid()) {
+			qDebug() << "EE   TrackData" << __func__ << __LINE__ << "Can't downsample invalid track data" << this->m_debug;
+			return sg_ret::err;
+		}
+
+		/* 'x' values never decrease, so first and last values are the extremes. */
+		const int n = this->size();
+		const double x_first = this->m_x_ll[0];
+		const double x_span = this->m_x_ll[n - 1] - x_first;
+		if (n_columns < 1 || n <= 5 * n_columns || x_span <= 0) {
+			/* Width of graph is not known yet, or there is nothing to gain. */
+			target = *this;
+			return sg_ret::ok;
+		}
+
+		std::vector<int> kept;
+		kept.reserve(5 * n_columns);
+
+		int i = 0;
+		while (i < n) {
+			const int column = std::min(n_columns - 1, (int) ((this->m_x_ll[i] - x_first) * n_columns / x_span));
+
+			const int first = i;
+			int last = i;
+			int lowest = -1;
+			int highest = -1;
+			int missing = -1; /* Point without value, e.g. without altitude. */
+			for (; i < n; i++) {
+				if (column != std::min(n_columns - 1, (int) ((this->m_x_ll[i] - x_first) * n_columns / x_span))) {
+					break;
+				}
+				last = i;
+				if (std::isnan(this->m_y_ll[i])) {
+					if (-1 == missing) {
+						missing = i;
+					}
+					continue;
+				}
+				if (-1 == lowest || this->m_y_ll[i] < this->m_y_ll[lowest]) {
+					lowest = i;
+				}
+				if (-1 == highest || this->m_y_ll[i] > this->m_y_ll[highest]) {
+					highest = i;
+				}
+			}
+
+			/* Keep the points in their original order. Point
+			   without value is kept so that the graph still
+			   has a gap in this column. */
+			int column_points[5] = { first, lowest, highest, missing, last };
+			std::sort(column_points, column_points + 5);
+			for (int j = 0; j < 5; j++) {
+				if (-1 != column_points[j] && (kept.empty() || kept.back() != column_points[j])) {
+					kept.push_back(column_points[j]);
+				}
+			}
+		}
+
+		if (sg_ret::ok != target.allocate(kept.size())) {
+			qDebug() << "EE   TrackData" << __func__ << __LINE__ << "Failed to allocate downsampled track data";
+			return sg_ret::err;
+		}
+		for (size_t k = 0; k < kept.size(); k++) {
+			target.m_x_ll[k] = this->m_x_ll[kept[k]];
+			target.m_y_ll[k] = this->m_y_ll[kept[k]];
+			target.m_tps[k] = this->m_tps[kept[k]];
+		}
+
+		target.m_x_min = this->m_x_min;
+		target.m_x_max = this->m_x_max;
+		target.m_y_min = this->m_y_min;
+		target.m_y_max = this->m_y_max;
+
+		target.x_domain = this->x_domain;
+		target.y_domain = this->y_domain;
+		target.x_unit = this->x_unit;
+		target.y_unit = this->y_unit;
+
+		snprintf(target.m_debug, sizeof (target.m_debug), "Downsampled %s", this->m_debug);
+		target.m_valid = true;
+
+		qDebug() << "II   TrackData" << __func__ << __LINE__ << "Downsampled" << this->m_debug << "from" << n << "to" << target.size() << "points for" << n_columns << "columns";
+
+		return sg_ret::ok;
+	}
+
+
+
+
 	/**
 	   @reviewed-on tbd
 	*/
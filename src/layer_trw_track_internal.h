@@ -25,6 +25,10 @@
 
 
 #include <list>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <functional>
 #include <cstdint>
 #include <cmath>
 #include <time.h>
@@ -42,6 +46,7 @@
 #include "bbox.h"
 #include "tree_view.h"
 #include "layer_trw_track.h"
+#include "layer_trw_track_lod.h"
 #include "dialog.h"
 #include "measurements.h"
 
@@ -61,6 +66,7 @@ namespace SlavGPS {
 
 	class TrackPropertiesDialog;
 	class TrackProfileDialog;
+	class TrackSeries;
 	class Graph2D;
 
 	enum class SGFileType;
@@ -128,10 +134,16 @@ namespace SlavGPS {
 		TrackpointReference front(void) const;
 
 	private:
+		/* Get first reference, revalidated after possible changes in track's trackpoints. */
+		TrackpointReference & front_ref(void);
+
 		/* For now it's only single-item container. There will
 		   always be one item, but the item may be invalid if
-		   no selections are made. */
-		std::list<TrackpointReference> references;
+		   no selections are made.
+
+		   Mutable because references are revalidated on
+		   access (see TrackpointReference::revalidate()). */
+		mutable std::list<TrackpointReference> references;
 	};
 
 
@@ -152,6 +164,122 @@ namespace SlavGPS {
 	  they are shown.
 	*/
 
+	/**
+	   @brief Cumulative distances from start of track to each of its trackpoints
+
+	   Built on first query and rebuilt on first query after the
+	   track has been modified (see Track::get_modification_counter()),
+	   so that repeated distance queries (e.g. from profile
+	   dialog or from distance labels) don't walk whole track.
+	*/
+	class TrackDistanceIndex {
+	public:
+		void build(const TrackPoints & trackpoints);
+
+		/* @return position of @param tp in track, or -1 if @param tp is not in track. */
+		long position_of(const Trackpoint * tp) const;
+
+		std::vector<Trackpoint *> points;
+
+		/* Distances to i-th trackpoint, without and with
+		   gaps between track's segments. */
+		std::vector<double> distances;
+		std::vector<double> distances_including_gaps;
+
+		/* Pairs of (trackpoint, position of trackpoint in
+		   track), sorted by trackpoint, for finding position
+		   of a trackpoint with binary search. */
+		std::vector<std::pair<const Trackpoint *, size_t>> positions;
+
+		uint64_t modification_counter = 0;
+		bool valid = false;
+	};
+
+
+
+
+	/**
+	   @brief Summary of track's data, calculated in one pass over its trackpoints
+
+	   Cached by track and recalculated on first query after
+	   the track has been modified, so that painter, tree view
+	   and dialogs don't scan whole track every time they need
+	   length, duration or altitude range of a track.
+	*/
+	class TrackSummary {
+	public:
+		/* Distances between trackpoints are taken from
+		   @param index, so that they are calculated only in
+		   one place. */
+		void calculate(const TrackDistanceIndex & index);
+
+		/* Average speed while moving depends on a parameter,
+		   so it is calculated separately, on demand. */
+		void calculate_average_speed_moving(const TrackDistanceIndex & index, const Duration & track_min_stop_duration);
+
+		unsigned long tp_count = 0;
+		unsigned int segment_count = 0;
+
+		Distance length; /* Without gaps between segments. */
+		Distance length_including_gaps;
+
+		Duration duration; /* Between first and last trackpoint, including gaps between segments. */
+		Duration duration_in_segments;
+
+		Speed max_speed;
+		Speed average_speed;
+
+		Speed average_speed_moving;
+		Duration average_speed_moving_min_stop_duration; /* Parameter for which average_speed_moving has been calculated. */
+
+		/* Valid only if has_altitudes is true. */
+		bool has_altitudes = false;
+		Altitude min_alt;
+		Altitude max_alt;
+
+		/* Valid only if has_elevation_gain is true. */
+		bool has_elevation_gain = false;
+		Altitude elev_gain;
+		Altitude elev_loss;
+
+		LatLonBBox bbox;
+
+		uint64_t modification_counter = 0;
+		bool valid = false;
+	};
+
+
+
+
+	/**
+	   @brief Colours of lines of track, calculated for some drawing mode of track
+
+	   Cached by track, so that colour of each line (e.g. in
+	   "colour by speed" mode) isn't recalculated on every
+	   redraw of the track.
+	*/
+	class TrackColorIndices {
+	public:
+		/* Points for which the indices have been calculated:
+		   level of track's LOD, or TrackLOD::no_level for all
+		   trackpoints of track. Levels of LOD built for given
+		   version of track always contain the same points, so
+		   level and modification counter identify the points. */
+		int lod_level = TrackLOD::no_level;
+
+		/* Parameters of drawing mode for which the indices have been calculated. */
+		std::vector<double> parameters;
+
+		uint64_t modification_counter = 0;
+
+		/* indices->at(i) is colour of line between (i-1)-th
+		   and i-th point. First element is unused. */
+		std::shared_ptr<const std::vector<uint8_t>> indices;
+	};
+
+
+
+
 	class Track : public TreeItem {
 		Q_OBJECT
 	public:
@@ -227,6 +355,58 @@ namespace SlavGPS {
 		unsigned int get_segment_count() const;
 
 
+		/* Call this after changing coordinates, timestamps,
+		   altitudes or other data of track's trackpoints
+		   directly (not through methods of the track or its
+		   trackpoints container), so that data cached for the
+		   track is recalculated. */
+		void mark_as_modified(void);
+
+		/* Value that changes every time when the track's
+		   trackpoints are added, removed, reordered or
+		   modified. */
+		uint64_t get_modification_counter(void) const;
+
+		/* Get summary of track's data. The summary is
+		   recalculated only if the track has been modified
+		   since last call. */
+		TrackSummary get_summary(void) const;
+
+		/* Get values of track's parameters at each of its
+		   trackpoints. The track doesn't own the values: they
+		   are reused (until the track is modified) only as
+		   long as somebody (e.g. Track Profile Dialog) holds
+		   the returned pointer. */
+		std::shared_ptr<const TrackSeries> get_series(void) const;
+
+		/**
+		   @brief Get colours of lines between given points of the track
+
+		   Colours are calculated with @param calculate, and
+		   are recalculated only if the track has been
+		   modified, or if colours for given @param lod_level or
+		   @param parameters are not cached yet.
+
+		   @param lod_level - level of track's LOD, or TrackLOD::no_level for all trackpoints of the track
+		   @param n_points - number of points on @param lod_level
+		   @param parameters - parameters of drawing mode that affect colours
+		*/
+		std::shared_ptr<const std::vector<uint8_t>> get_color_indices(int lod_level, size_t n_points, const std::vector<double> & parameters, const std::function<void(std::vector<uint8_t> &)> & calculate) const;
+
+		/**
+		   @brief Get simplified versions of the track, for drawing
+
+		   Generation of the simplified versions is started
+		   in background when they are missing or out of
+		   date.
+
+		   @return nullptr if the track is too small to be
+		   simplified or if simplified versions are not
+		   ready yet
+		*/
+		std::shared_ptr<const TrackLOD> get_lod(void);
+
+
 		SGObjectTypeID get_type_id(void) const override;
 		static SGObjectTypeID type_id(void);
 
@@ -280,8 +460,7 @@ namespace SlavGPS {
 
 		void to_routepoints();
 
-		sg_ret calculate_max_speed(void);
-		const Speed & get_max_speed(void) const;
+		Speed get_max_speed(void) const;
 
 		Speed get_average_speed(void) const;
 		Speed get_average_speed_moving(const Duration & track_min_stop_duration) const;
@@ -515,10 +694,34 @@ namespace SlavGPS {
 		   trackpoints::end()) iterators. */
 		sg_ret split_at_iterators(std::list<TrackPoints::iterator> & iterators, LayerTRW * parent_layer);
 
-		Speed max_speed;
-
 		TrackSelectedChildren selected_children;
 
+		/* Must be called with this->summary_mutex locked. Locks
+		   this->distance_index_mutex, so the two mutexes must
+		   always be locked in this order. */
+		void update_summary(void) const;
+		mutable TrackSummary summary;
+		mutable std::mutex summary_mutex;
+
+		std::shared_ptr<TrackLODState> lod_state{new TrackLODState()};
+		/* Must be called in main thread, with this->lod_state->mutex locked. */
+		void start_lod_job(uint64_t counter);
+
+		/* Most recently used colours are at the beginning of the list. */
+		mutable std::list<TrackColorIndices> color_indices;
+		mutable std::mutex color_indices_mutex;
+
+		/* Must be called with this->distance_index_mutex locked. */
+		void update_distance_index(void) const;
+		mutable TrackDistanceIndex distance_index;
+		mutable std::mutex distance_index_mutex;
+
+		/* Freed when last user of series releases it. */
+		mutable std::weak_ptr<const TrackSeries> series;
+		mutable std::mutex series_mutex;
+
+		uint64_t modification_counter = 0;
+
 	public slots:
 		void goto_startpoint_cb(void);
 		void goto_center_cb(void);
@@ -585,6 +788,9 @@ namespace SlavGPS {
 
 		void extend_track_end_cb(void);
 		void extend_track_end_route_finder_cb(void);
+
+	private slots:
+		void start_lod_job_cb(void);
 	};
 
 
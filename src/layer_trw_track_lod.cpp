@@ -0,0 +1,229 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <cmath>
+
+
+
+
+#include <QDebug>
+
+
+
+
+#include "layer_trw_track_lod.h"
+#include "layer_trw_track_internal.h"
+#include "measurements.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "TRW Track LOD"
+
+
+
+
+/* Tolerance of first level. Each next level has 4 times larger tolerance. */
+#define LOD_BASE_TOLERANCE 1.0 /* [meters] */
+#define LOD_EARTH_RADIUS 6378137.0 /* [meters] */
+
+
+
+
+double TrackLOD::level_tolerance(int level)
+{
+	return LOD_BASE_TOLERANCE * (1 << (2 * level));
+}
+
+
+
+
+int TrackLOD::get_level(double meters_per_pixel) const
+{
+	/* Points skipped on a level are not further than half of
+	   pixel from line drawn through points of the level. */
+	int result = TrackLOD::no_level;
+	for (int i = 0; i < TrackLOD::n_levels; i++) {
+		if (TrackLOD::level_tolerance(i) > meters_per_pixel / 2) {
+			break;
+		}
+		result = i;
+	}
+
+	return result;
+}
+
+
+
+
+TrackLODJob::TrackLODJob(const TrackPoints & trackpoints, uint64_t new_modification_counter, const std::shared_ptr<TrackLODState> & new_state)
+{
+	this->modification_counter = new_modification_counter;
+	this->state = new_state;
+
+	/* Work on a copy of coordinates: trackpoints may be
+	   modified or deleted while the job is running. Positions
+	   are projected to a plane tangent to Earth at mean
+	   latitude of track, which is good enough for deciding
+	   which trackpoints are visible at given scale. */
+	double lat_sum = 0.0;
+	for (auto iter = trackpoints.begin(); iter != trackpoints.end(); iter++) {
+		lat_sum += (*iter)->coord.get_lat_lon().lat.value();
+	}
+	const double cos_lat = cos(DEG2RAD(lat_sum / std::max((size_t) 1, trackpoints.size())));
+
+	this->points.reserve(trackpoints.size());
+	for (auto iter = trackpoints.begin(); iter != trackpoints.end(); iter++) {
+		const LatLon lat_lon = (*iter)->coord.get_lat_lon();
+		Point point;
+		point.x = LOD_EARTH_RADIUS * DEG2RAD(lat_lon.lon.unbound_value()) * cos_lat;
+		point.y = LOD_EARTH_RADIUS * DEG2RAD(lat_lon.lat.value());
+		point.newsegment = (*iter)->newsegment;
+		this->points.push_back(point);
+	}
+
+	this->n_items = TrackLOD::n_levels;
+}
+
+
+
+
+void TrackLODJob::simplify_segment(const std::vector<size_t> & input, size_t first, size_t last, double tolerance, std::vector<size_t> & output) const
+{
+	const double tolerance_2 = tolerance * tolerance;
+
+	std::vector<bool> keep(last - first + 1, false);
+	keep.front() = true;
+	keep.back() = true;
+
+	/* Iterative Douglas-Peucker: ranges of positions in @input. */
+	std::vector<std::pair<size_t, size_t>> ranges;
+	ranges.push_back(std::make_pair(first, last));
+
+	while (!ranges.empty()) {
+		const size_t a = ranges.back().first;
+		const size_t b = ranges.back().second;
+		ranges.pop_back();
+		if (b <= a + 1) {
+			continue;
+		}
+
+		const Point & pa = this->points[input[a]];
+		const Point & pb = this->points[input[b]];
+		const double dx = pb.x - pa.x;
+		const double dy = pb.y - pa.y;
+		const double len_2 = dx * dx + dy * dy;
+
+		double max_dist_2 = -1.0;
+		size_t max_pos = a;
+		for (size_t i = a + 1; i < b; i++) {
+			const Point & p = this->points[input[i]];
+			double dist_2;
+			if (len_2 == 0.0) {
+				dist_2 = (p.x - pa.x) * (p.x - pa.x) + (p.y - pa.y) * (p.y - pa.y);
+			} else {
+				const double cross = dx * (p.y - pa.y) - dy * (p.x - pa.x);
+				dist_2 = cross * cross / len_2;
+			}
+			if (dist_2 > max_dist_2) {
+				max_dist_2 = dist_2;
+				max_pos = i;
+			}
+		}
+
+		if (max_dist_2 > tolerance_2) {
+			keep[max_pos - first] = true;
+			ranges.push_back(std::make_pair(a, max_pos));
+			ranges.push_back(std::make_pair(max_pos, b));
+		}
+	}
+
+	for (size_t i = first; i < last; i++) {
+		if (keep[i - first]) {
+			output.push_back(input[i]);
+		}
+	}
+}
+
+
+
+
+void TrackLODJob::run(void)
+{
+	std::vector<size_t> levels[TrackLOD::n_levels];
+
+	/* Level i is built from level i - 1, which is much less
+	   work for coarse levels than working on all trackpoints.
+	   Errors of consecutive levels add up: a trackpoint is
+	   within tolerance of level i - 1 from a line of level
+	   i - 1, and that line is within tolerance used for level i
+	   from a line of level i. So level i is built with its
+	   tolerance reduced by tolerance of level i - 1, and then
+	   all trackpoints are within tolerance of level i from
+	   lines of level i. */
+	std::vector<size_t> input(this->points.size());
+	for (size_t i = 0; i < input.size(); i++) {
+		input[i] = i;
+	}
+
+	for (int level = 0; level < TrackLOD::n_levels; level++) {
+		const double tolerance = TrackLOD::level_tolerance(level) - (level > 0 ? TrackLOD::level_tolerance(level - 1) : 0.0);
+		std::vector<size_t> & output = levels[level];
+
+		size_t segment_begin = 0;
+		for (size_t i = 1; i <= input.size(); i++) {
+			if (i < input.size() && !this->points[input[i]].newsegment) {
+				continue;
+			}
+			/* Segment consists of positions <segment_begin, i - 1>. */
+			this->simplify_segment(input, segment_begin, i - 1, tolerance, output);
+			output.push_back(input[i - 1]);
+			segment_begin = i;
+		}
+
+		input = output;
+
+		const bool end_job = this->set_progress_state(100 * (level + 1) / TrackLOD::n_levels);
+		if (end_job) {
+			qDebug() << SG_PREFIX_I << "Generating of track LOD was cancelled";
+			std::lock_guard<std::mutex> lock(this->state->mutex);
+			this->state->job_running = false;
+			return;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->state->mutex);
+		for (int level = 0; level < TrackLOD::n_levels; level++) {
+			this->state->result_positions[level].swap(levels[level]);
+		}
+		this->state->result_modification_counter = this->modification_counter;
+		this->state->has_result = true;
+		this->state->job_running = false;
+	}
+
+	emit this->lod_ready();
+}
@@ -0,0 +1,158 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_LAYER_TRW_TRACK_LOD_H_
+#define _SG_LAYER_TRW_TRACK_LOD_H_
+
+
+
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+
+
+#include "background.h"
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class Trackpoint;
+	class TrackPoints;
+
+
+
+
+	/**
+	   @brief Simplified versions of a track, used for drawing zoomed-out track
+
+	   Each level contains a subset of track's trackpoints,
+	   selected with Douglas-Peucker algorithm with given
+	   tolerance (in meters). Simplification is done separately
+	   for each segment of track, so first and last trackpoint
+	   of each segment are present on every level.
+
+	   Levels are used only for drawing. Hit-testing and
+	   editing of track always use all trackpoints.
+	*/
+	class TrackLOD {
+	public:
+		static const int n_levels = 7;
+
+		/* Tolerance of i-th level, in meters. */
+		static double level_tolerance(int level);
+
+		/* Tracks with fewer trackpoints are always drawn with all trackpoints. */
+		static const size_t min_tp_count = 1000;
+
+		/* Value returned by get_level() when track should be drawn with all trackpoints. */
+		static const int no_level = -1;
+
+		/**
+		   @brief Get level that can be used to draw track at given scale
+
+		   @param meters_per_pixel - scale of viewport
+
+		   @return index of selected level in this->levels
+		   @return TrackLOD::no_level if track should be drawn with all trackpoints
+		*/
+		int get_level(double meters_per_pixel) const;
+
+		std::vector<Trackpoint *> levels[n_levels];
+
+		/* Value of track's modification counter for which the levels have been built. */
+		uint64_t modification_counter = 0;
+	};
+
+
+
+
+	/**
+	   @brief State of generation of track's LOD, shared between track and job generating the LOD
+
+	   A job may outlive the track (e.g. when the track is
+	   deleted while the job is running), so the job doesn't
+	   access the track directly.
+	*/
+	class TrackLODState {
+	public:
+		std::mutex mutex;
+
+		/* LOD that is ready to be used. */
+		std::shared_ptr<const TrackLOD> lod;
+
+		/* Result of last job: positions of trackpoints (in
+		   track) for each level, not yet converted into
+		   TrackLOD. */
+		bool has_result = false;
+		std::vector<size_t> result_positions[TrackLOD::n_levels];
+		uint64_t result_modification_counter = 0;
+
+		bool job_running = false;
+	};
+
+
+
+
+	class TrackLODJob : public BackgroundJob {
+		Q_OBJECT
+	public:
+		TrackLODJob(const TrackPoints & trackpoints, uint64_t modification_counter, const std::shared_ptr<TrackLODState> & state);
+
+		void run(void);
+
+	signals:
+		void lod_ready(void);
+
+	private:
+		/* Position of trackpoint projected to plane, in meters. */
+		class Point {
+		public:
+			double x = 0.0;
+			double y = 0.0;
+			bool newsegment = false;
+		};
+
+		/* Simplify part of @param input between positions
+		   @param first and @param last (inclusive), append
+		   selected positions to @param output (without
+		   @param last). */
+		void simplify_segment(const std::vector<size_t> & input, size_t first, size_t last, double tolerance, std::vector<size_t> & output) const;
+
+		std::vector<Point> points;
+		uint64_t modification_counter = 0;
+		std::shared_ptr<TrackLODState> state;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_LAYER_TRW_TRACK_LOD_H_ */
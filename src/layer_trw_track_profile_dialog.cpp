@@ -36,6 +36,7 @@
 
 #include <QDebug>
 #include <QPushButton>
+#include <QTime>
 
 
 
@@ -55,6 +56,7 @@
 #include "measurements.h"
 #include "graph_intervals.h"
 #include "tree_view_internal.h"
+#include "background.h"
 
 
 
@@ -517,11 +519,6 @@ void ProfileViewGD::save_settings(void)
 sg_ret ProfileViewGD::draw_additional_indicators(Track & trk)
 {
 	if (this->show_gps_speed_cb && this->show_gps_speed_cb->checkState()) {
-		/* Ensure some kind of max speed when not set. */
-		if (!trk.get_max_speed().is_valid() || trk.get_max_speed().is_zero()) {
-			trk.calculate_max_speed();
-		}
-
 		return this->draw_gps_speeds_relative(trk);
 	} else {
 		qDebug() << SG_PREFIX_E << "Can't draw relative GPS speeds - no widgets";
@@ -561,10 +558,6 @@ void ProfileViewDT::save_settings(void)
 sg_ret ProfileViewDT::draw_additional_indicators(Track & trk)
 {
 	if (this->show_gps_speed_cb && this->show_gps_speed_cb->checkState()) {
-		/* Ensure some kind of max speed when not set. */
-		if (!trk.get_max_speed().is_valid() || trk.get_max_speed().is_zero()) {
-			trk.calculate_max_speed();
-		}
 		return this->draw_gps_speeds_relative(trk);
 	} else {
 		qDebug() << SG_PREFIX_E << "Can't draw relative GPS speeds - no widgets";
@@ -896,16 +889,34 @@ TrackProfileDialog::TrackProfileDialog(Track * new_trk, GisViewport * new_main_g
 	vbox->addWidget(this->tabs);
 	vbox->addWidget(this->button_box);
 
-	int i = 0;
-	for (auto iter = this->views.begin(); iter != this->views.end(); iter++) {
-		i++;
-		ProfileViewBase * view = *iter;
-		if (!view) {
-			qDebug() << SG_PREFIX_E << "Can't find profile" << i << "in loop";
-			continue;
-		}
-		view->generate_initial_track_data_wrapper(*this->trk);
-	}
+	this->generate_initial_track_data();
+}
+
+
+
+
+void TrackProfileDialog::generate_initial_track_data(void)
+{
+	QTime generation_time;
+	generation_time.start();
+
+	/* All views take their values from track's series, so
+	   calculate the series once, before the views are
+	   generated in parallel. */
+	this->track_series = this->trk->get_series();
+
+	/* Data of each view is accessed only by one thread, and
+	   the track is only read. */
+	ParallelItems::process(this->views.size(), [this](int idx) {
+			ProfileViewBase * view = this->views[idx];
+			if (!view) {
+				qDebug() << SG_PREFIX_E << "Can't find profile" << idx << "in loop";
+				return;
+			}
+			view->generate_initial_track_data_wrapper(*this->trk);
+		});
+
+	qDebug() << SG_PREFIX_I << "Generated initial track data of" << this->views.size() << "views in" << generation_time.elapsed() << "ms";
 }
 
 
@@ -27,6 +27,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <memory>
 #include <cassert>
 
 
@@ -154,6 +155,14 @@ namespace SlavGPS {
 	private:
 		sg_ret set_center_at_selected_tp(const ProfileViewBase * view, QMouseEvent * ev);
 
+		/* Generate initial track data of all views, in parallel. */
+		void generate_initial_track_data(void);
+
+		/* Values of track's parameters, shared by all views.
+		   Held only while the dialog exists (the track
+		   doesn't keep them). */
+		std::shared_ptr<const TrackSeries> track_series;
+
 
 		QTabWidget * tabs = NULL;
 
@@ -396,9 +405,11 @@ namespace SlavGPS {
 		/*
 		  Data structure with data from initial_track_data,
 		  but processed and prepared for painting
-		  (e.g. compressed).
+		  (downsampled to width of graph).
 		*/
 		TrackData<Tx, Ty> track_data_to_draw;
+		/* Width of graph for which ::track_data_to_draw has been made. */
+		int track_data_to_draw_n_columns = 0;
 
 	private:
 		/*
@@ -424,21 +435,20 @@ namespace SlavGPS {
 	template <typename Tx, typename Ty>
 	sg_ret ProfileView<Tx, Ty>::regenerate_track_data_to_draw(__attribute__((unused)) Track & trk)
 	{
-		this->track_data_to_draw.clear();
-
-
-
-		const bool precise_drawing = true;
-		if (precise_drawing) {
-			this->track_data_to_draw = this->initial_track_data;
-		} else {
-			/*
-			  ::initial_track_data has been generated
-			  once, when the dialog has been opened. Now
-			  compress it to limit number of drawn points.
-			*/
-			const int compressed_n_points = this->get_central_n_columns();
-			this->initial_track_data.compress_into(track_data_to_draw, compressed_n_points);
+		/*
+		  ::initial_track_data has been generated once, when
+		  the dialog has been opened. Reduce it to number of
+		  points that can be drawn in current width of graph,
+		  but only when the width has changed.
+		*/
+		const int n_columns = this->get_central_n_columns();
+		if (!this->track_data_to_draw.is_valid() || n_columns != this->track_data_to_draw_n_columns) {
+			this->track_data_to_draw_n_columns = 0;
+			if (sg_ret::ok != this->initial_track_data.downsample_into(this->track_data_to_draw, n_columns)) {
+				qDebug() << "EE   ProfileView" << __func__ << __LINE__ << "Failed to downsample track data for" << this->get_title();
+				return sg_ret::err;
+			}
+			this->track_data_to_draw_n_columns = n_columns;
 		}
 		if (!this->track_data_to_draw.is_valid()) {
 			qDebug() << "EE   ProfileView" << __func__ << __LINE__ << "Failed to regenerate valid compressed track data for" << this->get_title();
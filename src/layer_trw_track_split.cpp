@@ -138,31 +138,36 @@ sg_ret Track::split_at_iterators(std::list<TrackPoints::iterator> & split_iters,
 	}
 
 
-	auto iter = split_iters.begin();
-	/* Skip first range of trackpoints. These trackpoints will be
-	   kept in original track. The rest of trackpoints (those from
-	   second, third etc. range) will go to newly created
-	   tracks. */
-	iter++;
-
-	for (; iter != std::prev(split_iters.end()); iter++) {
+	/* Ranges are moved out of this track starting from the
+	   last one. Moving a range out of container invalidates
+	   iterators that follow it, but iterators preceding it
+	   stay valid, so the iterators collected in
+	   @split_iters can be used for the remaining ranges.
+
+	   First range of trackpoints is skipped. These
+	   trackpoints will be kept in original track. The rest
+	   of trackpoints (those from second, third etc. range)
+	   will go to newly created tracks. */
+	std::list<Track *> new_tracks;
+	for (auto iter = std::prev(split_iters.end(), 2); iter != split_iters.begin(); iter--) {
 
 		TrackPoints::iterator tp_iter_begin = *iter;
-		TrackPoints::iterator tp_iter_end = *std::next(iter);
+		/* Trackpoints after this range have already been moved out, so the range ends at end(). */
+		TrackPoints::iterator tp_iter_end = this->trackpoints.end();
 
 		if (1) { /* Debug. */
-			if (tp_iter_end != this->trackpoints.end()) {
-				Trackpoint * tp1 = *tp_iter_begin;
-				Trackpoint * tp2 = *tp_iter_end;
-				qDebug() << SG_PREFIX_I << "Trackpoint" << tp1->timestamp << "(range from" << tp1->timestamp << "to" << tp2->timestamp << ")";
-			} else {
-				Trackpoint * tp1 = *tp_iter_begin;
-				qDebug() << SG_PREFIX_I << "Trackpoint" << tp1->timestamp << "(range from" << tp1->timestamp << "to end)";
-			}
+			Trackpoint * tp1 = *tp_iter_begin;
+			qDebug() << SG_PREFIX_I << "Trackpoint" << tp1->timestamp << "(range from" << tp1->timestamp << "to" << (*std::prev(tp_iter_end))->timestamp << ")";
 		}
 
 		Track * new_trk = new Track(*this); /* Just copy track properties. */
 		__attribute__((unused)) const sg_ret mv = new_trk->move_trackpoints_from(*this, tp_iter_begin, tp_iter_end); /* Now move a range of trackpoints. */
+		new_tracks.push_front(new_trk);
+	}
+
+	/* Add new tracks in order of their trackpoints. */
+	for (auto iter = new_tracks.begin(); iter != new_tracks.end(); iter++) {
+		Track * new_trk = *iter;
 
 		const QString new_trk_name = parent_layer->new_unique_element_name(this->m_type_id, this->get_name());
 		new_trk->set_name(new_trk_name);
@@ -45,10 +45,10 @@ using namespace SlavGPS;
 
 TrackStatistics::TrackStatistics()
 {
-	 /* Set some valid initial value. */
-
-	this->min_alt = Altitude(0, AltitudeType::Unit::internal_unit());
-	this->max_alt = Altitude(0, AltitudeType::Unit::internal_unit());
+	 /* Set some valid initial value. Extremes of altitudes and
+	    timestamps stay invalid until a track that has them is
+	    added, otherwise initial value would be one of the
+	    extremes. */
 
 	this->elev_gain = Altitude(0, AltitudeType::Unit::internal_unit());;
 	this->elev_loss = Altitude(0, AltitudeType::Unit::internal_unit());
@@ -59,8 +59,6 @@ TrackStatistics::TrackStatistics()
 	this->max_speed = Speed(0, SpeedType::Unit::internal_unit());
 
 	this->sum_of_durations = Duration(0, DurationType::Unit::internal_unit());
-	this->start_time = Time(0, TimeType::Unit::internal_unit());
-	this->end_time = Time(0, TimeType::Unit::internal_unit());
 }
 
 
@@ -69,59 +67,99 @@ TrackStatistics::TrackStatistics()
 /**
    Accumulate statistics from given track.
 
+   Values of the track are taken from its summary, which is
+   recalculated only when the track has been modified.
+
    @trk: The track, which parameters should be added to statistics.
 */
 void TrackStatistics::add_track(Track * trk)
 {
-	qDebug() << SG_PREFIX_I << "Adding track" << trk->get_name();
+	const TrackSummary summary = trk->get_summary();
 
-	this->count++;
+	TrackStatistics track_stats;
+	track_stats.count = 1;
 
-	this->trackpoints += trk->get_tp_count();;
-	this->segments    += trk->get_segment_count();
-	this->length      += trk->get_length();
-	this->length_with_gaps += trk->get_length_including_gaps();
+	track_stats.trackpoints = summary.tp_count;
+	track_stats.segments = summary.segment_count;
+	track_stats.length = summary.length;
+	track_stats.length_with_gaps = summary.length_including_gaps;
 
-	trk->calculate_max_speed(); /* First calculate the speed, then get it. */
-	const Speed incoming_track_max_speed = trk->get_max_speed();
-	if (incoming_track_max_speed.is_valid() && incoming_track_max_speed > this->max_speed) {
-		this->max_speed = incoming_track_max_speed;
+	if (summary.max_speed.is_valid()) {
+		track_stats.max_speed = summary.max_speed;
 	}
 
-	Altitude min_altitude;
-	Altitude max_altitude;
-	if (trk->get_minmax_alt(min_altitude, max_altitude)) {
-		if (min_altitude < this->min_alt) {
-			this->min_alt = min_altitude;
-		}
-		if (max_altitude > this->max_alt) {
-			this->max_alt = max_altitude;
-		}
+	if (summary.has_altitudes) {
+		track_stats.min_alt = summary.min_alt;
+		track_stats.max_alt = summary.max_alt;
 	}
 
-	Altitude delta_up;
-	Altitude delta_down;
-	if (trk->get_total_elevation_gain(delta_up, delta_down)) {
-		this->elev_gain += delta_up;
-		this->elev_loss += delta_down;
+	if (summary.has_elevation_gain) {
+		track_stats.elev_gain = summary.elev_gain;
+		track_stats.elev_loss = summary.elev_loss;
 	}
 
-
 	Time ts_first;
 	Time ts_last;
 	if (sg_ret::ok == trk->get_timestamps(ts_first, ts_last)) {
+		track_stats.start_time = ts_first;
+		track_stats.end_time = ts_last;
+		track_stats.sum_of_durations = Duration::get_abs_duration(ts_last, ts_first);
+	}
+
+	this->merge(track_stats);
+}
+
+
+
+
+void TrackStatistics::merge(const TrackStatistics & other)
+{
+	this->count       += other.count;
+	this->trackpoints += other.trackpoints;
+	this->segments    += other.segments;
+	this->length      += other.length;
+	this->length_with_gaps += other.length_with_gaps;
+
+	if (other.max_speed.is_valid() && other.max_speed > this->max_speed) {
+		this->max_speed = other.max_speed;
+	}
+
+	if (other.min_alt.is_valid() && (!this->min_alt.is_valid() || other.min_alt < this->min_alt)) {
+		this->min_alt = other.min_alt;
+	}
+	if (other.max_alt.is_valid() && (!this->max_alt.is_valid() || other.max_alt > this->max_alt)) {
+		this->max_alt = other.max_alt;
+	}
 
-		/* Update the earliest / the latest timestamps
-		   (initialize if necessary). */
-		if ((!this->start_time.is_valid()) || ts_first < this->start_time) {
-			this->start_time = ts_first;
-		}
-		if ((!this->end_time.is_valid()) || ts_last > this->end_time) {
-			this->end_time = ts_last;
-		}
+	this->elev_gain += other.elev_gain;
+	this->elev_loss += other.elev_loss;
 
-		this->sum_of_durations += Duration::get_abs_duration(ts_last, ts_first);
+	/* Update the earliest / the latest timestamps
+	   (initialize if necessary). */
+	if (other.start_time.is_valid() && (!this->start_time.is_valid() || other.start_time < this->start_time)) {
+		this->start_time = other.start_time;
 	}
+	if (other.end_time.is_valid() && (!this->end_time.is_valid() || other.end_time > this->end_time)) {
+		this->end_time = other.end_time;
+	}
+
+	this->sum_of_durations += other.sum_of_durations;
+}
+
+
+
+
+bool TrackStatistics::track_is_visible(const Track * trk, bool layer_is_visible, bool tracks_are_visible, bool routes_are_visible)
+{
+	/* Invisible layers or sublayers. */
+	if (!layer_is_visible
+	    || (trk->is_track() && !tracks_are_visible)
+	    || (trk->is_route() && !routes_are_visible)) {
+
+		return false;
+	}
+
+	return trk->is_visible();
 }
 
 
@@ -143,19 +181,8 @@ void TrackStatistics::add_track_maybe(Track * trk, bool layer_is_visible, bool t
 		return;
 	}
 
-	if (!include_invisible) {
-		/* Skip invisible layers or sublayers. */
-		if (!layer_is_visible
-		    || (trk->is_track() && !tracks_are_visible)
-		    || (trk->is_route() && !routes_are_visible)) {
-
-			return;
-		}
-
-		/* Skip invisible tracks. */
-		if (!trk->is_visible()) {
-			return;
-		}
+	if (!include_invisible && !TrackStatistics::track_is_visible(trk, layer_is_visible, tracks_are_visible, routes_are_visible)) {
+		return;
 	}
 
 	this->add_track(trk);
@@ -47,6 +47,16 @@ namespace SlavGPS {
 		void add_track_maybe(Track * trk, bool layer_is_visible, bool tracks_are_visible, bool routes_are_visible, bool include_invisible);
 		void add_track(Track * trk);
 
+		/* Add statistics collected by other object (e.g. in
+		   other thread, for other subset of tracks). Result
+		   doesn't depend on how tracks have been divided
+		   into subsets. */
+		void merge(const TrackStatistics & other);
+
+		/* Whether given track is visible in its layer. */
+		static bool track_is_visible(const Track * trk, bool layer_is_visible, bool tracks_are_visible, bool routes_are_visible);
+
+		/* Invalid if no track has altitudes. */
 		Altitude min_alt;
 		Altitude max_alt;
 
@@ -64,6 +74,7 @@ namespace SlavGPS {
 		   duration1 + duration2. */
 		Duration sum_of_durations;
 
+		/* Invalid if no track has timestamps. */
 		Time start_time;
 		Time end_time;
 		int count = 0;
@@ -84,6 +84,9 @@ void TpPropertiesDialog::sync_coord_widget_to_current_point_cb(void) /* Slot. */
 
 	this->current_point->coord = new_coord;
 	this->timestamp_widget->set_coord(new_coord);
+	if (this->current_track) {
+		this->current_track->mark_as_modified();
+	}
 
 
 	/* Don't redraw unless we really have to. */
@@ -112,6 +115,9 @@ void TpPropertiesDialog::sync_altitude_widget_to_current_point_cb(void) /* Slot.
 
 	/* Always store internally in metres. */
 	this->current_point->altitude = this->altitude_widget->get_value_iu();
+	if (this->current_track) {
+		this->current_track->mark_as_modified();
+	}
 }
 
 
@@ -134,6 +140,9 @@ bool TpPropertiesDialog::sync_timestamp_widget_to_current_point_cb(const Time &
 	   consecutive values.  Should we now warn user about unsorted
 	   timestamps in consecutive trackpoints? */
 	this->current_point->set_timestamp(timestamp);
+	if (this->current_track) {
+		this->current_track->mark_as_modified();
+	}
 
 	return true;
 }
@@ -158,6 +167,9 @@ bool TpPropertiesDialog::sync_empty_timestamp_widget_to_current_point_cb(void)
 	   consecutive values.  Should we now warn user about unsorted
 	   timestamps in consecutive trackpoints? */
 	this->current_point->set_timestamp(Time()); /* Invalid value - this should indicate that timestamp is cleared from the tp. */
+	if (this->current_track) {
+		this->current_track->mark_as_modified();
+	}
 
 	return true;
 }
@@ -0,0 +1,289 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include "layer_trw_trackpoints.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "TRW Trackpoints"
+
+
+
+
+TrackPoints::~TrackPoints()
+{
+	this->clear();
+}
+
+
+
+
+TrackPoints::Chunk * TrackPoints::insert_chunk_after(Chunk * chunk)
+{
+	Chunk * new_chunk = new Chunk();
+
+	if (chunk) {
+		new_chunk->prev = chunk;
+		new_chunk->next = chunk->next;
+		if (chunk->next) {
+			chunk->next->prev = new_chunk;
+		} else {
+			this->tail = new_chunk;
+		}
+		chunk->next = new_chunk;
+	} else {
+		new_chunk->next = this->head;
+		if (this->head) {
+			this->head->prev = new_chunk;
+		} else {
+			this->tail = new_chunk;
+		}
+		this->head = new_chunk;
+	}
+
+	return new_chunk;
+}
+
+
+
+
+void TrackPoints::remove_chunk(Chunk * chunk)
+{
+	if (chunk->prev) {
+		chunk->prev->next = chunk->next;
+	} else {
+		this->head = chunk->next;
+	}
+	if (chunk->next) {
+		chunk->next->prev = chunk->prev;
+	} else {
+		this->tail = chunk->prev;
+	}
+	delete chunk;
+}
+
+
+
+
+void TrackPoints::push_back(Trackpoint * tp)
+{
+	if (NULL == this->tail || this->tail->count == chunk_capacity) {
+		this->insert_chunk_after(this->tail);
+	}
+	this->tail->points[this->tail->count++] = tp;
+	this->m_size++;
+	this->m_modification_counter++;
+}
+
+
+
+
+void TrackPoints::push_front(Trackpoint * tp)
+{
+	this->insert(this->begin(), tp);
+}
+
+
+
+
+TrackPoints::iterator TrackPoints::insert(iterator pos, Trackpoint * tp)
+{
+	if (NULL == pos.m_chunk) {
+		this->push_back(tp);
+		return iterator(this->tail, this->tail->count - 1, this);
+	}
+
+	this->m_layout_version++;
+	this->m_modification_counter++;
+
+	Chunk * chunk = pos.m_chunk;
+	int idx = pos.m_idx;
+
+	if (chunk->count == chunk_capacity) {
+		/* Split full chunk into two halves. */
+		const int half = chunk_capacity / 2;
+		Chunk * new_chunk = this->insert_chunk_after(chunk);
+		std::copy(chunk->points + half, chunk->points + chunk_capacity, new_chunk->points);
+		new_chunk->count = chunk_capacity - half;
+		chunk->count = half;
+
+		if (idx > half) {
+			chunk = new_chunk;
+			idx -= half;
+		}
+	}
+
+	std::copy_backward(chunk->points + idx, chunk->points + chunk->count, chunk->points + chunk->count + 1);
+	chunk->points[idx] = tp;
+	chunk->count++;
+	this->m_size++;
+
+	return iterator(chunk, idx, this);
+}
+
+
+
+
+TrackPoints::iterator TrackPoints::erase(iterator pos)
+{
+	this->m_layout_version++;
+	this->m_modification_counter++;
+
+	Chunk * chunk = pos.m_chunk;
+	const int idx = pos.m_idx;
+
+	std::copy(chunk->points + idx + 1, chunk->points + chunk->count, chunk->points + idx);
+	chunk->count--;
+	this->m_size--;
+
+	if (0 == chunk->count) {
+		Chunk * next = chunk->next;
+		this->remove_chunk(chunk);
+		return iterator(next, 0, this);
+	}
+	if (idx == chunk->count) {
+		return iterator(chunk->next, 0, this);
+	}
+	return iterator(chunk, idx, this);
+}
+
+
+
+
+TrackPoints::iterator TrackPoints::erase(iterator first, iterator last)
+{
+	if (first == last) {
+		return last;
+	}
+
+	if (last == this->end()) {
+		/* Truncation: drop tail of first chunk and all chunks after it. */
+		this->m_layout_version++;
+		this->m_modification_counter++;
+
+		Chunk * chunk = first.m_chunk;
+		this->m_size -= chunk->count - first.m_idx;
+		chunk->count = first.m_idx;
+
+		while (chunk->next) {
+			this->m_size -= chunk->next->count;
+			this->remove_chunk(chunk->next);
+		}
+		if (0 == chunk->count) {
+			this->remove_chunk(chunk);
+		}
+		return this->end();
+	}
+
+	/* Erasing invalidates 'last', so count the trackpoints first. */
+	size_t n = std::distance(first, last);
+	while (n--) {
+		first = this->erase(first);
+	}
+	return first;
+}
+
+
+
+
+void TrackPoints::splice(iterator pos, TrackPoints & other, iterator first, iterator last)
+{
+	if (&other != this && pos == this->end() && first == other.begin() && last == other.end()) {
+		/* All trackpoints of other container are appended
+		   (e.g. when merging tracks): just relink chunks. */
+		if (other.head) {
+			if (this->tail) {
+				this->tail->next = other.head;
+				other.head->prev = this->tail;
+			} else {
+				this->head = other.head;
+			}
+			this->tail = other.tail;
+			this->m_size += other.m_size;
+			this->m_modification_counter++;
+
+			other.head = NULL;
+			other.tail = NULL;
+			other.m_size = 0;
+			other.m_layout_version++;
+			other.m_modification_counter++;
+		}
+		return;
+	}
+
+	const std::vector<Trackpoint *> moved(first, last);
+	other.erase(first, last);
+
+	for (auto iter = moved.begin(); iter != moved.end(); iter++) {
+		pos = this->insert(pos, *iter);
+		++pos;
+	}
+}
+
+
+
+
+void TrackPoints::clear(void)
+{
+	Chunk * chunk = this->head;
+	while (chunk) {
+		Chunk * next = chunk->next;
+		delete chunk;
+		chunk = next;
+	}
+
+	this->head = NULL;
+	this->tail = NULL;
+	this->m_size = 0;
+	this->m_layout_version++;
+	this->m_modification_counter++;
+}
+
+
+
+
+void TrackPoints::reverse(void)
+{
+	std::vector<Trackpoint *> points(this->begin(), this->end());
+	std::reverse(points.begin(), points.end());
+	this->assign(points);
+}
+
+
+
+
+void TrackPoints::assign(const std::vector<Trackpoint *> & points)
+{
+	this->m_layout_version++;
+	this->m_modification_counter++;
+
+	auto src = points.begin();
+	for (Chunk * chunk = this->head; chunk; chunk = chunk->next) {
+		std::copy(src, src + chunk->count, chunk->points);
+		src += chunk->count;
+	}
+}
@@ -0,0 +1,231 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_LAYER_TRW_TRACKPOINTS_H_
+#define _SG_LAYER_TRW_TRACKPOINTS_H_
+
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class Trackpoint;
+
+
+
+
+	/**
+	   @brief Sequence of trackpoints of a track
+
+	   Trackpoints are stored in chunks: arrays of up to
+	   TrackPoints::chunk_capacity trackpoints, linked into a
+	   list. Iterating over a track walks contiguous memory,
+	   and appending a trackpoint doesn't need a separate
+	   allocation of list node.
+
+	   Interface of the container is a subset of interface
+	   of std::list, but iterators are less stable than
+	   iterators of std::list: inserting or erasing a
+	   trackpoint invalidates iterators to trackpoints that
+	   follow it in the same chunk. Iterators to trackpoints
+	   before the modified position remain valid. Appending
+	   at the end doesn't invalidate any iterators.
+
+	   Like in std::list, end() is between last and first
+	   trackpoint: std::prev(begin()) == end() and
+	   std::next(end()) == begin().
+
+	   Trackpoint pointers are stable handles. Code that
+	   keeps an iterator for a long time should keep the
+	   pointer too, and look the iterator up again when
+	   layout_version() has changed (see TrackpointReference).
+
+	   Fields of trackpoints are not stored in separate
+	   arrays (columns). Trackpoint objects are used through
+	   pointers in most of the code, so the container stores
+	   pointers. Code that needs one field of all trackpoints
+	   in contiguous memory takes it from caches of Track
+	   (TrackLOD for drawing, TrackSeries for graphs).
+	*/
+	class TrackPoints {
+	public:
+		static const int chunk_capacity = 256;
+
+	private:
+		class Chunk {
+		public:
+			Trackpoint * points[chunk_capacity];
+			int count = 0;
+			Chunk * prev = NULL;
+			Chunk * next = NULL;
+		};
+
+	public:
+		template <typename Ref>
+		class base_iterator {
+		public:
+			typedef std::bidirectional_iterator_tag iterator_category;
+			typedef Trackpoint * value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef Ref * pointer;
+			typedef Ref & reference;
+
+			base_iterator() {}
+			base_iterator(Chunk * chunk, int idx, const TrackPoints * container) : m_chunk(chunk), m_idx(idx), m_container(container) {}
+
+			/* Conversion from iterator to const_iterator. */
+			template <typename OtherRef>
+			base_iterator(const base_iterator<OtherRef> & other) : m_chunk(other.m_chunk), m_idx(other.m_idx), m_container(other.m_container) {}
+
+			reference operator*() const { return this->m_chunk->points[this->m_idx]; }
+			pointer operator->() const { return &this->m_chunk->points[this->m_idx]; }
+
+			base_iterator & operator++()
+			{
+				if (NULL == this->m_chunk) {
+					/* Going forward from end(). */
+					this->m_chunk = this->m_container->head;
+					this->m_idx = 0;
+				} else if (++this->m_idx == this->m_chunk->count) {
+					this->m_chunk = this->m_chunk->next;
+					this->m_idx = 0;
+				}
+				return *this;
+			}
+			base_iterator operator++(int) { base_iterator result = *this; ++(*this); return result; }
+
+			base_iterator & operator--()
+			{
+				if (NULL == this->m_chunk) {
+					/* Going back from end(). */
+					this->m_chunk = this->m_container->tail;
+					this->m_idx = this->m_chunk ? this->m_chunk->count - 1 : 0;
+				} else if (0 == this->m_idx) {
+					/* Going back from begin() gives end(). */
+					this->m_chunk = this->m_chunk->prev;
+					this->m_idx = this->m_chunk ? this->m_chunk->count - 1 : 0;
+				} else {
+					this->m_idx--;
+				}
+				return *this;
+			}
+			base_iterator operator--(int) { base_iterator result = *this; --(*this); return result; }
+
+			template <typename OtherRef>
+			bool operator==(const base_iterator<OtherRef> & other) const { return this->m_chunk == other.m_chunk && this->m_idx == other.m_idx; }
+			template <typename OtherRef>
+			bool operator!=(const base_iterator<OtherRef> & other) const { return !(*this == other); }
+
+			const TrackPoints * container(void) const { return this->m_container; }
+
+			Chunk * m_chunk = NULL; /* NULL for end(). */
+			int m_idx = 0;
+			const TrackPoints * m_container = NULL;
+		};
+
+		typedef base_iterator<Trackpoint *> iterator;
+		typedef base_iterator<Trackpoint * const> const_iterator;
+
+
+		TrackPoints() {};
+		~TrackPoints();
+
+		/* Chunks are owned by the container. Trackpoints are not. */
+		TrackPoints(const TrackPoints & other) = delete;
+		TrackPoints & operator=(const TrackPoints & other) = delete;
+
+		iterator begin(void) { return iterator(this->head, 0, this); }
+		iterator end(void) { return iterator(NULL, 0, this); }
+		const_iterator begin(void) const { return const_iterator(this->head, 0, this); }
+		const_iterator end(void) const { return const_iterator(NULL, 0, this); }
+
+		size_t size(void) const { return this->m_size; }
+		bool empty(void) const { return 0 == this->m_size; }
+
+		Trackpoint * front(void) const { return this->head->points[0]; }
+		Trackpoint * back(void) const { return this->tail->points[this->tail->count - 1]; }
+
+		void push_back(Trackpoint * tp);
+		void push_front(Trackpoint * tp);
+
+		/* Insert @param tp before @param pos. Return iterator to inserted trackpoint. */
+		iterator insert(iterator pos, Trackpoint * tp);
+
+		/* Return iterator to trackpoint that followed the erased trackpoint(s). */
+		iterator erase(iterator pos);
+		iterator erase(iterator first, iterator last);
+
+		/* Remove range of trackpoints from @param other container and insert them before @param pos. */
+		void splice(iterator pos, TrackPoints & other, iterator first, iterator last);
+
+		/* Remove all trackpoints (without deleting them). */
+		void clear(void);
+
+		void reverse(void);
+
+		/* Stable sort, like std::list::sort(). */
+		template <typename Compare>
+		void sort(Compare compare)
+		{
+			std::vector<Trackpoint *> points(this->begin(), this->end());
+			std::stable_sort(points.begin(), points.end(), compare);
+			this->assign(points);
+		}
+
+		/* Incremented on every operation that may move trackpoints between positions in chunks. */
+		uint64_t layout_version(void) const { return this->m_layout_version; }
+
+		/* Incremented on every operation that adds, removes or reorders trackpoints (including appending). */
+		uint64_t modification_counter(void) const { return this->m_modification_counter; }
+
+	private:
+		/* Overwrite trackpoints in existing chunks with @param points, in order. Sizes must match. */
+		void assign(const std::vector<Trackpoint *> & points);
+
+		/* Insert new empty chunk after @param chunk, or at the beginning if @param chunk is NULL. */
+		Chunk * insert_chunk_after(Chunk * chunk);
+		void remove_chunk(Chunk * chunk);
+
+		Chunk * head = NULL;
+		Chunk * tail = NULL;
+		size_t m_size = 0;
+		uint64_t m_layout_version = 0;
+		uint64_t m_modification_counter = 0;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_LAYER_TRW_TRACKPOINTS_H_ */
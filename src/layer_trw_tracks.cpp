@@ -30,8 +30,10 @@
 
 
 #include <unordered_map>
+#include <unordered_set>
 #include <cstring>
 #include <cassert>
+#include <cmath>
 
 
 
@@ -73,6 +75,10 @@ extern SelectedTreeItems g_selected;
 /* This is how it knows when you click if you are clicking close to a trackpoint. */
 #define TRACKPOINT_SIZE_APPROX 5
 
+/* Trackpoints slightly outside of viewport may still have their
+   markers or thick lines visible. */
+#define TRACK_DRAW_MARGIN 16 /* [pixels] */
+
 #define LAYER_TRW_TRACK_COLORS_MAX 10
 
 
@@ -398,40 +404,82 @@ Track * LayerTRWTracks::find_track_with_duplicate_name(void) const
 
 void LayerTRWTracks::track_search_closest_tp(TrackpointSearch & search) const
 {
-	const int rows = this->child_rows_count();
-	for (int row = 0; row < rows; row++) {
-		TreeItem * tree_item = nullptr;
-		if (sg_ret::ok != this->child_from_row(row, &tree_item)) {
-			qDebug() << SG_PREFIX_E << "Failed to get child from row" << row << "/" << rows;
-			continue;
+	std::vector<Track *> tracks;
+	this->get_tracks_in_draw_order(tracks);
+	this->spatial_index.update(tracks);
+
+	/* Area around event position, in which trackpoints are
+	   looked for. The area is twice as big as necessary to
+	   cover inaccuracy of conversion from screen to Lat/Lon. */
+	const int margin = 2 * TRACKPOINT_SIZE_APPROX;
+	const ScreenPos corners[4] = { ScreenPos(search.m_event_pos.x() - margin, search.m_event_pos.y() - margin),
+				       ScreenPos(search.m_event_pos.x() + margin, search.m_event_pos.y() - margin),
+				       ScreenPos(search.m_event_pos.x() - margin, search.m_event_pos.y() + margin),
+				       ScreenPos(search.m_event_pos.x() + margin, search.m_event_pos.y() + margin) };
+	TracksIndexRect search_rect;
+	bool search_rect_valid = true;
+	for (int i = 0; i < 4; i++) {
+		const Coord coord = search.m_gisview->screen_pos_to_coord(corners[i]);
+		if (!coord.is_valid()) {
+			search_rect_valid = false;
+			break;
 		}
-		Track * trk = (Track *) tree_item;
+		const LatLon lat_lon = coord.get_lat_lon();
+		TracksIndexRect corner_rect;
+		corner_rect.north = corner_rect.south = lat_lon.lat.value();
+		corner_rect.east = corner_rect.west = lat_lon.lon.unbound_value();
+		search_rect.expand(corner_rect);
+	}
+
+	std::vector<const TracksIndexChunk *> chunks;
+	if (search_rect_valid) {
+		this->spatial_index.find_chunks(search_rect, chunks);
+	} else {
+		qDebug() << SG_PREFIX_W << "Can't calculate search area, will check all trackpoints";
+		TracksIndexRect whole_world;
+		whole_world.north = 1000.0;
+		whole_world.south = -1000.0;
+		whole_world.east = 1000.0;
+		whole_world.west = -1000.0;
+		this->spatial_index.find_chunks(whole_world, chunks);
+	}
+
+	std::vector<const Coord *> coords;
+	std::vector<ScreenPos> positions;
+	for (auto chunk_iter = chunks.begin(); chunk_iter != chunks.end(); chunk_iter++) {
+		const TracksIndexChunk * chunk = *chunk_iter;
+		Track * trk = chunk->trk;
 
 		if (!trk->is_visible()) {
 			continue;
 		}
 
-		if (!trk->bbox.intersects_with(search.bbox)) {
-			continue;
+		coords.clear();
+		auto iter = chunk->begin;
+		for (size_t i = 0; i < chunk->count; i++, iter++) {
+			coords.push_back(&(*iter)->coord);
 		}
+		search.m_gisview->coords_to_screen_pos(coords, positions);
 
+		iter = chunk->begin;
+		for (size_t i = 0; i < chunk->count; i++, iter++) {
 
-		for (auto iter = trk->trackpoints.begin(); iter != trk->trackpoints.end(); iter++) {
+			if (NULL != search.skip_tp && search.skip_tp == *iter) {
+				continue;
+			}
 
-			ScreenPos tp_pos;
-			search.m_gisview->coord_to_screen_pos((*iter)->coord, tp_pos);
+			const ScreenPos & tp_pos = positions[i];
+			if (std::isnan(tp_pos.x())) {
+				continue;
+			}
 
 			const int dist_x = std::fabs(tp_pos.x() - search.m_event_pos.x());
 			const int dist_y = std::fabs(tp_pos.y() - search.m_event_pos.y());
 
-			if (NULL != search.skip_tp && search.skip_tp == *iter) {
-				continue;
-			}
-
 			if (dist_x <= TRACKPOINT_SIZE_APPROX && dist_y <= TRACKPOINT_SIZE_APPROX
 			    && ((!search.closest_tp)
 				/* Was the old trackpoint we already found closer than this one? */
-				|| dist_x + dist_y < std::fabs(tp_pos.x() - search.closest_pos.x()) + std::fabs(tp_pos.y() - search.closest_pos.y()))) {
+				|| dist_x + dist_y < std::fabs(search.closest_pos.x() - search.m_event_pos.x()) + std::fabs(search.closest_pos.y() - search.m_event_pos.y()))) {
 
 				search.closest_track = trk;
 				search.closest_tp = *iter;
@@ -925,41 +973,118 @@ bool LayerTRWTracks::handle_selection_in_tree(void)
  * It assumes they belong to the TRW Layer (it doesn't check this is the case)
  */
 void LayerTRWTracks::draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	if (!this->is_drawable()) {
+		return;
+	}
+
+	std::vector<Track *> tracks;
+	this->get_tracks_in_draw_order(tracks);
+	this->draw_tracks(gisview, tracks, highlight_selected, parent_is_selected);
+}
+
+
+
+
+bool LayerTRWTracks::is_drawable(void) const
 {
 	if (!this->is_in_tree()) {
 		/* This subnode hasn't been added to tree yet. */
-		return;
+		return false;
 	}
 
 	/* Check the layer for visibility (including all the parents visibilities). */
 	if (!this->tree_view->get_tree_item_visibility_with_parents(this)) {
-		return;
+		return false;
 	}
 
 	if (this->attached_empty()) {
-		return;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+void LayerTRWTracks::get_tracks_in_draw_order(std::vector<Track *> & tracks) const
+{
+	const int rows = this->child_rows_count();
+	tracks.reserve(rows);
+	for (int row = 0; row < rows; row++) {
+		TreeItem * tree_item = nullptr;
+		if (sg_ret::ok != this->child_from_row(row, &tree_item)) {
+			qDebug() << SG_PREFIX_E << "Failed to get child from row" << row << "/" << rows;
+			continue;
+		}
+
+		tracks.push_back((Track *) tree_item);
 	}
+}
+
+
 
+
+void LayerTRWTracks::draw_tracks(GisViewport * gisview, const std::vector<Track *> & tracks, bool highlight_selected, bool parent_is_selected)
+{
 	SelectedTreeItems::print_draw_mode(*this, parent_is_selected);
 
 	const bool item_is_selected = parent_is_selected || g_selected.is_in_set(this);
+	LayerTRWPainter * painter = this->owner_trw_layer()->painter;
 
-#ifdef TODO_MAYBE
-	if (this->bbox.intersects_with(viewport->get_bbox())) {
-#endif
-		const int rows = this->child_rows_count();
-		for (int row = 0; row < rows; row++) {
-			TreeItem * tree_item = nullptr;
-			if (sg_ret::ok != this->child_from_row(row, &tree_item)) {
-				qDebug() << SG_PREFIX_E << "Failed to get child from row" << row << "/" << rows;
+	std::unordered_set<const Track *> tracks_in_viewport;
+	const bool cull = this->find_tracks_in_viewport(gisview, tracks, tracks_in_viewport);
+
+	for (size_t i = 0; i < tracks.size(); i++) {
+		if (gisview->render_is_cancelled()) {
+			qDebug() << SG_PREFIX_I << "Drawing of tracks has been cancelled at track" << i << "/" << tracks.size();
+			return;
+		}
+
+		/* Visibility of parents has been checked by caller,
+		   so Track::draw_tree_item() that looks at tree view
+		   isn't needed. */
+		Track * trk = tracks[i];
+		if (cull && 0 == tracks_in_viewport.count(trk)) {
+			/* Name of track drawn at center of track's
+			   bbox may be visible even if no part of track
+			   is visible. */
+			if (trk->draw_name_mode != TrackDrawNameMode::Centre && trk->draw_name_mode != TrackDrawNameMode::StartCentreEnd) {
 				continue;
 			}
-
-			tree_item->draw_tree_item(gisview, highlight_selected, item_is_selected);
 		}
-#ifdef TODO_MAYBE
+
+		const bool trk_is_selected = item_is_selected || g_selected.is_in_set(trk);
+		painter->draw_track(trk, gisview, trk_is_selected && highlight_selected);
 	}
-#endif
+}
+
+
+
+
+bool LayerTRWTracks::find_tracks_in_viewport(const GisViewport * gisview, const std::vector<Track *> & tracks, std::unordered_set<const Track *> & result) const
+{
+	const LatLonBBox bbox = gisview->get_bbox(-TRACK_DRAW_MARGIN, -TRACK_DRAW_MARGIN, -TRACK_DRAW_MARGIN, -TRACK_DRAW_MARGIN);
+	if (!bbox.is_valid()) {
+		return false;
+	}
+
+	this->spatial_index.update(tracks);
+
+	TracksIndexRect rect;
+	rect.north = bbox.north.value();
+	rect.south = bbox.south.value();
+	rect.east = bbox.east.unbound_value();
+	rect.west = bbox.west.unbound_value();
+
+	std::vector<const TracksIndexChunk *> chunks;
+	this->spatial_index.find_chunks(rect, chunks);
+	for (const TracksIndexChunk * chunk : chunks) {
+		result.insert(chunk->trk);
+	}
+
+	return true;
 }
 
 
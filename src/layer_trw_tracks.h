@@ -27,7 +27,9 @@
 
 
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
+#include <vector>
 
 
 
@@ -40,6 +42,7 @@
 #include "measurements.h"
 #include "layer_trw_definitions.h"
 #include "layer_trw_track.h"
+#include "layer_trw_tracks_index.h"
 #include "tree_view.h"
 #include "bbox.h"
 #include "coord.h"
@@ -181,6 +184,18 @@ namespace SlavGPS {
 
 		void draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
 
+		/* Is the node in tree view, visible (including its
+		   parents) and non-empty? Must be called in main
+		   thread. */
+		bool is_drawable(void) const;
+		/* Get tracks in order of their rows in tree view,
+		   i.e. in order in which they are drawn. Must be
+		   called in main thread. */
+		void get_tracks_in_draw_order(std::vector<Track *> & tracks) const;
+		/* Draw given tracks without using tree view, so
+		   this can be called in worker thread. */
+		void draw_tracks(GisViewport * gisview, const std::vector<Track *> & tracks, bool highlight_selected, bool parent_is_selected);
+
 		sg_ret update_properties(void) override;
 
 		void recalculate_bbox(void);
@@ -213,7 +228,16 @@ namespace SlavGPS {
 		void sort_order_timestamp_descend_cb(void);
 
 	private:
+		/* Find those of @param tracks that are in or close to
+		   viewport. Returns false if the tracks can't be
+		   found (e.g. viewport's bbox can't be calculated). */
+		bool find_tracks_in_viewport(const GisViewport * gisview, const std::vector<Track *> & tracks, std::unordered_set<const Track *> & result) const;
+
 		LatLonBBox bbox;
+
+		/* Used for finding trackpoints close to given position
+		   and tracks that are in viewport. */
+		mutable TracksSpatialIndex spatial_index;
 	};
 
 
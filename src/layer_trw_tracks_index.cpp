@@ -0,0 +1,298 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+
+
+
+#include <QDebug>
+
+
+
+
+#include "layer_trw_tracks_index.h"
+#include "layer_trw_track_internal.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "TRW Tracks Index"
+
+/* Number of children of node of R-tree. */
+#define TRACKS_INDEX_NODE_SIZE 16
+
+/* The tree is repacked when count of chunks outside of tree and of
+   chunks removed from tree is larger than this fraction of count of
+   chunks in tree, or than the minimum count. */
+#define TRACKS_INDEX_REPACK_FRACTION 0.25
+#define TRACKS_INDEX_REPACK_MIN 256
+
+
+
+
+void TracksIndexRect::expand(const TracksIndexRect & other)
+{
+	this->north = std::max(this->north, other.north);
+	this->south = std::min(this->south, other.south);
+	this->east = std::max(this->east, other.east);
+	this->west = std::min(this->west, other.west);
+}
+
+
+
+
+void TracksSpatialIndex::build_chunks(Track * trk, std::vector<TracksIndexChunk> & chunks)
+{
+	chunks.clear();
+	chunks.reserve(trk->trackpoints.size() / TracksSpatialIndex::chunk_size + 1);
+
+	for (auto iter = trk->trackpoints.begin(); iter != trk->trackpoints.end(); iter++) {
+		const LatLon lat_lon = (*iter)->coord.get_lat_lon();
+		const double lat = lat_lon.lat.value();
+		const double lon = lat_lon.lon.unbound_value();
+
+		if (chunks.empty() || chunks.back().count == TracksSpatialIndex::chunk_size) {
+			if (!chunks.empty()) {
+				/* Rectangle of chunk covers also line
+				   to first trackpoint of next chunk. */
+				TracksIndexRect & rect = chunks.back().rect;
+				rect.north = std::max(rect.north, lat);
+				rect.south = std::min(rect.south, lat);
+				rect.east = std::max(rect.east, lon);
+				rect.west = std::min(rect.west, lon);
+			}
+
+			TracksIndexChunk chunk;
+			chunk.trk = trk;
+			chunk.begin = iter;
+			chunks.push_back(chunk);
+		}
+
+		TracksIndexChunk & chunk = chunks.back();
+		chunk.rect.north = std::max(chunk.rect.north, lat);
+		chunk.rect.south = std::min(chunk.rect.south, lat);
+		chunk.rect.east = std::max(chunk.rect.east, lon);
+		chunk.rect.west = std::min(chunk.rect.west, lon);
+		chunk.count++;
+	}
+}
+
+
+
+
+void TracksSpatialIndex::update(const std::vector<Track *> & tracks)
+{
+	bool changed = false;
+
+	for (auto iter = this->entries.begin(); iter != this->entries.end(); iter++) {
+		iter->second.seen = false;
+	}
+
+	for (auto iter = tracks.begin(); iter != tracks.end(); iter++) {
+		Track * trk = *iter;
+		const uint64_t counter = trk->get_modification_counter();
+
+		/* uid is compared too, in case a new track has been
+		   allocated at address of deleted one. */
+		TrackEntry & entry = this->entries[trk];
+		if (!entry.built || entry.uid != trk->get_uid() || entry.modification_counter != counter) {
+			this->remove_chunks(entry);
+			entry.built = true;
+			entry.uid = trk->get_uid();
+			entry.modification_counter = counter;
+			TracksSpatialIndex::build_chunks(trk, entry.chunks);
+			changed = true;
+		}
+		entry.seen = true;
+	}
+
+	for (auto iter = this->entries.begin(); iter != this->entries.end();) {
+		if (!iter->second.seen) {
+			this->remove_chunks(iter->second);
+			iter = this->entries.erase(iter);
+			changed = true;
+		} else {
+			iter++;
+		}
+	}
+
+	if (!changed) {
+		return;
+	}
+
+	this->unpacked.clear();
+	for (auto iter = this->entries.begin(); iter != this->entries.end(); iter++) {
+		if (!iter->second.packed) {
+			for (const TracksIndexChunk & chunk : iter->second.chunks) {
+				this->unpacked.push_back(&chunk);
+			}
+		}
+	}
+
+	const size_t n_outdated = this->unpacked.size() + this->n_removed;
+	if (n_outdated > std::max((size_t) TRACKS_INDEX_REPACK_MIN, (size_t) (this->leaves.size() * TRACKS_INDEX_REPACK_FRACTION))) {
+		qDebug() << SG_PREFIX_D << "Repacking tree with" << n_outdated << "outdated chunks";
+		this->build_tree();
+	}
+}
+
+
+
+
+void TracksSpatialIndex::remove_chunks(TrackEntry & entry)
+{
+	if (!entry.packed) {
+		/* Chunks are not in tree, this->unpacked will be
+		   made again. */
+		entry.chunks.clear();
+		return;
+	}
+
+	/* Moved vector keeps its items in place, so leaves of
+	   tree still point to them. */
+	for (TracksIndexChunk & chunk : entry.chunks) {
+		chunk.removed = true;
+	}
+	this->n_removed += entry.chunks.size();
+	this->removed_chunks.push_back(std::move(entry.chunks));
+	entry.chunks = std::vector<TracksIndexChunk>();
+	entry.packed = false;
+}
+
+
+
+
+void TracksSpatialIndex::build_tree(void)
+{
+	this->leaves.clear();
+	this->levels.clear();
+	this->unpacked.clear();
+	this->removed_chunks.clear();
+	this->n_removed = 0;
+
+	for (auto iter = this->entries.begin(); iter != this->entries.end(); iter++) {
+		for (const TracksIndexChunk & chunk : iter->second.chunks) {
+			this->leaves.push_back(&chunk);
+		}
+		iter->second.packed = true;
+	}
+	if (this->leaves.empty()) {
+		return;
+	}
+
+	/* Sort-Tile-Recursive: sort chunks by longitude, cut them
+	   into vertical slices, sort each slice by latitude, and
+	   group consecutive chunks into nodes. */
+	const size_t n_leaves = this->leaves.size();
+	const size_t n_nodes = (n_leaves + TRACKS_INDEX_NODE_SIZE - 1) / TRACKS_INDEX_NODE_SIZE;
+	const size_t n_slices = (size_t) ceil(sqrt((double) n_nodes));
+	const size_t slice_size = n_slices * TRACKS_INDEX_NODE_SIZE;
+
+	std::sort(this->leaves.begin(), this->leaves.end(), [](const TracksIndexChunk * a, const TracksIndexChunk * b) {
+			return a->rect.west + a->rect.east < b->rect.west + b->rect.east;
+		});
+	for (size_t begin = 0; begin < n_leaves; begin += slice_size) {
+		const size_t end = std::min(n_leaves, begin + slice_size);
+		std::sort(this->leaves.begin() + begin, this->leaves.begin() + end, [](const TracksIndexChunk * a, const TracksIndexChunk * b) {
+				return a->rect.south + a->rect.north < b->rect.south + b->rect.north;
+			});
+	}
+
+	std::vector<Node> level;
+	for (size_t first = 0; first < n_leaves; first += TRACKS_INDEX_NODE_SIZE) {
+		Node node;
+		node.first = first;
+		node.count = std::min((size_t) TRACKS_INDEX_NODE_SIZE, n_leaves - first);
+		for (size_t i = first; i < first + node.count; i++) {
+			node.rect.expand(this->leaves[i]->rect);
+		}
+		level.push_back(node);
+	}
+	this->levels.push_back(level);
+
+	/* Nodes of lowest level are already ordered in space, so
+	   upper levels are made by grouping consecutive nodes. */
+	while (this->levels.back().size() > TRACKS_INDEX_NODE_SIZE) {
+		const std::vector<Node> & lower = this->levels.back();
+		std::vector<Node> upper;
+		for (size_t first = 0; first < lower.size(); first += TRACKS_INDEX_NODE_SIZE) {
+			Node node;
+			node.first = first;
+			node.count = std::min((size_t) TRACKS_INDEX_NODE_SIZE, lower.size() - first);
+			for (size_t i = first; i < first + node.count; i++) {
+				node.rect.expand(lower[i].rect);
+			}
+			upper.push_back(node);
+		}
+		this->levels.push_back(upper);
+	}
+}
+
+
+
+
+void TracksSpatialIndex::find_chunks(const TracksIndexRect & rect, std::vector<const TracksIndexChunk *> & result) const
+{
+	for (const TracksIndexChunk * chunk : this->unpacked) {
+		if (chunk->rect.intersects_with(rect)) {
+			result.push_back(chunk);
+		}
+	}
+
+	if (this->levels.empty()) {
+		return;
+	}
+
+	/* Pairs of (level, position of node in level). */
+	std::vector<std::pair<size_t, size_t>> stack;
+	const size_t top = this->levels.size() - 1;
+	for (size_t i = 0; i < this->levels[top].size(); i++) {
+		stack.push_back(std::make_pair(top, i));
+	}
+
+	while (!stack.empty()) {
+		const size_t level = stack.back().first;
+		const Node & node = this->levels[level][stack.back().second];
+		stack.pop_back();
+
+		if (!node.rect.intersects_with(rect)) {
+			continue;
+		}
+
+		for (size_t i = node.first; i < node.first + node.count; i++) {
+			if (0 == level) {
+				if (!this->leaves[i]->removed && this->leaves[i]->rect.intersects_with(rect)) {
+					result.push_back(this->leaves[i]);
+				}
+			} else {
+				stack.push_back(std::make_pair(level - 1, i));
+			}
+		}
+	}
+}
@@ -0,0 +1,164 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_LAYER_TRW_TRACKS_INDEX_H_
+#define _SG_LAYER_TRW_TRACKS_INDEX_H_
+
+
+
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+
+
+#include "layer_trw_trackpoints.h"
+#include "tree_item.h"
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class Track;
+
+
+
+
+	/* Rectangle in Lat/Lon domain, in degrees. */
+	class TracksIndexRect {
+	public:
+		bool intersects_with(const TracksIndexRect & other) const
+		{
+			return this->west <= other.east && other.west <= this->east
+				&& this->south <= other.north && other.south <= this->north;
+		}
+		void expand(const TracksIndexRect & other);
+
+		double north = -1000.0;
+		double south = 1000.0;
+		double east = -1000.0;
+		double west = 1000.0;
+	};
+
+
+
+
+	/* Range of consecutive trackpoints of a track. Rectangle of
+	   chunk covers also line to first trackpoint of next chunk. */
+	class TracksIndexChunk {
+	public:
+		Track * trk = nullptr;
+		TrackPoints::iterator begin;
+		size_t count = 0;
+		TracksIndexRect rect;
+
+		/* Chunk of old version of track, waiting in packed
+		   tree for next repacking of the tree. */
+		bool removed = false;
+	};
+
+
+
+
+	/**
+	   @brief Spatial index of trackpoints of tracks (or routes) of a TRW layer
+
+	   Tracks are divided into chunks of consecutive trackpoints,
+	   and the chunks are kept in a packed R-tree (built with
+	   Sort-Tile-Recursive method), so that looking for
+	   trackpoints close to given position visits only
+	   trackpoints of nearby chunks, and tracks that are
+	   entirely outside of viewport are skipped without
+	   looking at them during drawing.
+
+	   The index is updated before each query: chunks are
+	   recalculated only for tracks that have been added or
+	   modified since last query (see
+	   Track::get_modification_counter()). Chunks of old
+	   versions of modified and deleted tracks are only marked
+	   as removed in the packed tree, and chunks of new versions
+	   are kept in a short list outside of the tree. The tree is
+	   repacked from all chunks once there are too many of
+	   such chunks.
+	*/
+	class TracksSpatialIndex {
+	public:
+		static const size_t chunk_size = 64;
+
+		void update(const std::vector<Track *> & tracks);
+
+		/* Find chunks which rectangles intersect with given rectangle. */
+		void find_chunks(const TracksIndexRect & rect, std::vector<const TracksIndexChunk *> & result) const;
+
+	private:
+		class TrackEntry {
+		public:
+			sg_uid_t uid = SG_UID_INITIAL;
+			uint64_t modification_counter = 0;
+			std::vector<TracksIndexChunk> chunks;
+			bool built = false;
+			bool seen = false;
+			/* Are chunks in packed tree, or in this->unpacked? */
+			bool packed = false;
+		};
+
+		class Node {
+		public:
+			TracksIndexRect rect;
+			/* Range of children: chunks in this->leaves for
+			   nodes of lowest level, nodes of lower level for
+			   other nodes. */
+			size_t first = 0;
+			size_t count = 0;
+		};
+
+		static void build_chunks(Track * trk, std::vector<TracksIndexChunk> & chunks);
+		void build_tree(void);
+		/* Remove chunks of entry from index, without changing the tree. */
+		void remove_chunks(TrackEntry & entry);
+
+		std::unordered_map<const Track *, TrackEntry> entries;
+
+		/* Chunks of tracks changed since the tree has been packed. */
+		std::vector<const TracksIndexChunk *> unpacked;
+
+		/* Chunks that are marked as removed, but are still
+		   pointed to by this->leaves. */
+		std::vector<std::vector<TracksIndexChunk>> removed_chunks;
+		size_t n_removed = 0;
+
+		std::vector<const TracksIndexChunk *> leaves;
+		/* levels[0] is the lowest level. */
+		std::vector<std::vector<Node>> levels;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_LAYER_TRW_TRACKS_INDEX_H_ */
@@ -219,9 +219,14 @@ void Waypoint::set_symbol_name(const QString & new_symbol_name)
 sg_ret Waypoint::set_coord(const Coord & new_coord, bool do_recalculate_bbox, bool only_set_value)
 {
 	this->m_coord = new_coord;
+	LayerTRW * trw = this->owner_trw_layer();
 	if (do_recalculate_bbox) {
-		LayerTRW * trw = this->owner_trw_layer();
 		trw->waypoints_node().recalculate_bbox();
+	} else if (trw) {
+		/* Bbox is recalculated (and spatial index rebuilt)
+		   only when waypoint is released, but waypoint being
+		   moved must be found by the index all the time. */
+		trw->waypoints_node().update_index_for_waypoint(this);
 	}
 
 	if (only_set_value) {
@@ -711,6 +716,7 @@ QString Waypoint::sublayer_rename_request(const QString & new_name)
 	parent_trw->tree_view->apply_tree_item_name(this);
 	parent_trw->tree_view->sort_children(&parent_trw->waypoints_node(), parent_trw->wp_sort_order);
 
+	this->increment_content_versions();
 	ThisApp::layers_panel()->emit_items_tree_updated_cb("Redrawing items after renaming waypoint");
 
 	return new_name;
@@ -27,7 +27,10 @@
 
 
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <vector>
 
 
 
@@ -70,6 +73,9 @@ extern SelectedTreeItems g_selected;
 /* This is how it knows when you click if you are clicking close to a waypoint. */
 #define WAYPOINT_SIZE_APPROX 5
 
+/* Margin around viewport in which waypoints are drawn, in pixels. */
+#define WAYPOINT_DRAW_MARGIN 100
+
 
 
 
@@ -243,15 +249,44 @@ Waypoint * LayerTRWWaypoints::find_waypoint_with_duplicate_name(void) const
 
 void LayerTRWWaypoints::search_closest_wp(WaypointSearch & search)
 {
-	const int rows = this->child_rows_count();
-	for (int row = 0; row < rows; row++) {
-		TreeItem * tree_item = nullptr;
-		if (sg_ret::ok != this->child_from_row(row, &tree_item)) {
-			qDebug() << SG_PREFIX_E << "Failed to find valid tree item in row" << row << "/" << rows;
-			continue;
+	this->update_index();
+
+	/* Area around event position, in which waypoints are looked
+	   for. The area is twice as big as necessary to cover
+	   inaccuracy of conversion from screen to Lat/Lon. */
+	const int margin = 2 * std::max(WAYPOINT_SIZE_APPROX, this->max_drawn_image_size / 2 + 1);
+	const ScreenPos corners[4] = { ScreenPos(search.m_event_pos.x() - margin, search.m_event_pos.y() - margin),
+				       ScreenPos(search.m_event_pos.x() + margin, search.m_event_pos.y() - margin),
+				       ScreenPos(search.m_event_pos.x() - margin, search.m_event_pos.y() + margin),
+				       ScreenPos(search.m_event_pos.x() + margin, search.m_event_pos.y() + margin) };
+	LatLonBBox search_bbox;
+	for (int i = 0; i < 4; i++) {
+		const Coord coord = search.m_gisview->screen_pos_to_coord(corners[i]);
+		if (!coord.is_valid()) {
+			search_bbox.invalidate();
+			break;
 		}
+		search_bbox.expand_with_lat_lon(coord.get_lat_lon());
+	}
 
-		Waypoint * wp = (Waypoint *) tree_item;
+	std::vector<Waypoint *> waypoints;
+	if (search_bbox.validate()) {
+		this->spatial_index.find_waypoints(search_bbox, waypoints);
+	} else {
+		qDebug() << SG_PREFIX_W << "Can't calculate search area, will check all waypoints";
+		this->spatial_index.get_all_waypoints(waypoints);
+	}
+
+	std::vector<const Coord *> coords;
+	coords.reserve(waypoints.size());
+	for (auto iter = waypoints.begin(); iter != waypoints.end(); iter++) {
+		coords.push_back(&(*iter)->get_coord());
+	}
+	std::vector<ScreenPos> positions;
+	search.m_gisview->coords_to_screen_pos(coords, positions);
+
+	for (size_t i = 0; i < waypoints.size(); i++) {
+		Waypoint * wp = waypoints[i];
 		if (!wp->is_visible()) {
 			continue;
 		}
@@ -260,38 +295,27 @@ void LayerTRWWaypoints::search_closest_wp(WaypointSearch & search)
 			continue;
 		}
 
-		ScreenPos wp_pos;
-		search.m_gisview->coord_to_screen_pos(wp->get_coord(), wp_pos);
-
-		bool found = false;
+		const ScreenPos & wp_pos = positions[i];
+		if (std::isnan(wp_pos.x())) {
+			continue;
+		}
 
 		/* If waypoint has non-empty image then use the image size to select. */
+		int slackx = WAYPOINT_SIZE_APPROX;
+		int slacky = WAYPOINT_SIZE_APPROX;
 		if (!wp->drawn_image_rect.isNull()) {
+			slackx = wp->drawn_image_rect.width() / 2;
+			slacky = wp->drawn_image_rect.height() / 2;
+		}
 
-			int slackx = wp->drawn_image_rect.width() / 2;
-			int slacky = wp->drawn_image_rect.height() / 2;
-
-			if (wp_pos.x() <= search.m_event_pos.x() + slackx
-			    && wp_pos.x() >= search.m_event_pos.x() - slackx
-			    && wp_pos.y() <= search.m_event_pos.y() + slacky
-			    && wp_pos.y() >= search.m_event_pos.y() - slacky) {
-
-				found = true;
-			}
-		} else {
-			const int dist_x = std::fabs(wp_pos.x() - search.m_event_pos.x());
-			const int dist_y = std::fabs(wp_pos.y() - search.m_event_pos.y());
-
-			if (dist_x <= WAYPOINT_SIZE_APPROX && dist_y <= WAYPOINT_SIZE_APPROX
-			    && ((!search.closest_wp)
-				/* Was the old waypoint we already found closer than this one? */
-				|| dist_x + dist_y < std::fabs(wp_pos.x() - search.closest_pos.x()) + std::fabs(wp_pos.y() - search.closest_pos.y()))) {
+		const int dist_x = std::fabs(wp_pos.x() - search.m_event_pos.x());
+		const int dist_y = std::fabs(wp_pos.y() - search.m_event_pos.y());
 
-				found = true;
-			}
-		}
+		if (dist_x <= slackx && dist_y <= slacky
+		    && ((!search.closest_wp)
+			/* Was the old waypoint we already found closer than this one? */
+			|| dist_x + dist_y < std::fabs(search.closest_pos.x() - search.m_event_pos.x()) + std::fabs(search.closest_pos.y() - search.m_event_pos.y()))) {
 
-		if (found) {
 			search.closest_wp = wp;
 			search.closest_pos = wp_pos;
 		}
@@ -363,6 +387,9 @@ QStringList LayerTRWWaypoints::get_list_of_missing_thumbnails(void) const
 		}
 	}
 
+	/* Many waypoints may show the same image. Create its thumbnail only once. */
+	paths.removeDuplicates();
+
 	return paths;
 }
 
@@ -456,6 +483,7 @@ QString LayerTRWWaypoints::new_unique_element_name(const QString & existing_name
 void LayerTRWWaypoints::recalculate_bbox(void)
 {
 	this->bbox.invalidate();
+	this->invalidate_index();
 
 	const int rows = this->child_rows_count();
 
@@ -485,6 +513,50 @@ void LayerTRWWaypoints::recalculate_bbox(void)
 
 
 
+void LayerTRWWaypoints::update_index_for_waypoint(Waypoint * wp)
+{
+	this->spatial_index.update_waypoint(wp);
+}
+
+
+
+
+void LayerTRWWaypoints::invalidate_index(void)
+{
+	this->spatial_index.invalidate();
+}
+
+
+
+
+/**
+   Build spatial index of waypoints if it has been invalidated,
+   or if number of waypoints has changed since it was built.
+*/
+void LayerTRWWaypoints::update_index(void)
+{
+	const int rows = this->child_rows_count();
+	if (this->spatial_index.is_valid() && this->spatial_index.size() == (size_t) std::max(rows, 0)) {
+		return;
+	}
+
+	std::vector<Waypoint *> waypoints;
+	waypoints.reserve(std::max(rows, 0));
+	for (int row = 0; row < rows; row++) {
+		TreeItem * tree_item = nullptr;
+		if (sg_ret::ok != this->child_from_row(row, &tree_item)) {
+			qDebug() << SG_PREFIX_E << "Failed to find valid tree item in row" << row << "/" << rows;
+			continue;
+		}
+		waypoints.push_back((Waypoint *) tree_item);
+	}
+
+	this->spatial_index.build(waypoints);
+}
+
+
+
+
 /*
   Can accept an empty symbol name, and may return null value
 */
@@ -820,24 +892,44 @@ bool LayerTRWWaypoints::handle_selection_in_tree(void)
  * It assumes they belong to the TRW Layer (it doesn't check this is the case)
  */
 void LayerTRWWaypoints::draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	if (!this->is_drawable()) {
+		return;
+	}
+
+	this->draw_waypoints(gisview, highlight_selected, parent_is_selected);
+}
+
+
+
+
+bool LayerTRWWaypoints::is_drawable(void) const
 {
 	if (this->attached_empty()) {
 		qDebug() << SG_PREFIX_I << "Not drawing Waypoints - no waypoints";
-		return;
+		return false;
 	}
 
 	if (!this->is_in_tree()) {
 		/* This subnode hasn't been added to tree yet. */
 		qDebug() << SG_PREFIX_I << "Not drawing Waypoints - node not in tree";
-		return;
+		return false;
 	}
 
 	/* Check the layer for visibility (including all the parents visibilities). */
 	if (!this->tree_view->get_tree_item_visibility_with_parents(this)) {
 		qDebug() << SG_PREFIX_I << "Not drawing Waypoints - not visible";
-		return;
+		return false;
 	}
 
+	return true;
+}
+
+
+
+
+void LayerTRWWaypoints::draw_waypoints(GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
 	SelectedTreeItems::print_draw_mode(*this, parent_is_selected);
 
 	const bool item_is_selected = parent_is_selected || g_selected.is_in_set(this);
@@ -848,17 +940,39 @@ void LayerTRWWaypoints::draw_tree_item(GisViewport * gisview, bool highlight_sel
 		return;
 	}
 
-	const int rows = this->child_rows_count();
-	for (int row = 0; row < rows; row++) {
+	this->update_index();
 
-		TreeItem * tree_item = nullptr;
-		if (sg_ret::ok != this->child_from_row(row, &tree_item)) {
-			qDebug() << SG_PREFIX_E << "Failed to find valid tree item in row" << row << "/" << rows;
-			continue;
+	/* Waypoints slightly outside of viewport may still have
+	   their image, symbol or label visible. */
+	const int margin = std::max(WAYPOINT_DRAW_MARGIN, this->max_drawn_image_size);
+	const LatLonBBox draw_bbox = gisview->get_bbox(-margin, -margin, -margin, -margin);
+
+	std::vector<Waypoint *> waypoints;
+	if (draw_bbox.is_valid()) {
+		this->spatial_index.find_waypoints(draw_bbox, waypoints);
+	} else {
+		this->spatial_index.get_all_waypoints(waypoints);
+	}
+
+	LayerTRWPainter * painter = this->owner_trw_layer()->painter;
+
+	this->max_drawn_image_size = 0;
+	for (auto iter = waypoints.begin(); iter != waypoints.end(); iter++) {
+		if (gisview->render_is_cancelled()) {
+			qDebug() << SG_PREFIX_I << "Drawing of waypoints has been cancelled";
+			return;
 		}
 
-		qDebug() << SG_PREFIX_I << "Will now draw tree item" << tree_item->m_type_id << tree_item->get_name();
-		tree_item->draw_tree_item(gisview, highlight_selected, item_is_selected);
+		/* Visibility of parents has been checked by caller,
+		   so Waypoint::draw_tree_item() that looks at tree
+		   view isn't needed. */
+		Waypoint * wp = *iter;
+		const bool wp_is_selected = item_is_selected || g_selected.is_in_set(wp);
+		painter->draw_waypoint(wp, gisview, wp_is_selected && highlight_selected);
+
+		if (!wp->drawn_image_rect.isNull()) {
+			this->max_drawn_image_size = std::max(this->max_drawn_image_size, std::max(wp->drawn_image_rect.width(), wp->drawn_image_rect.height()));
+		}
 	}
 }
 
@@ -880,6 +994,7 @@ void LayerTRWWaypoints::sort_order_a2z_cb(void)
 {
 	this->owner_trw_layer()->wp_sort_order = TreeViewSortOrder::AlphabeticalAscending;
 	this->tree_view->sort_children(this, TreeViewSortOrder::AlphabeticalAscending);
+	this->invalidate_index(); /* Order of drawing follows order of rows. */
 }
 
 
@@ -889,6 +1004,7 @@ void LayerTRWWaypoints::sort_order_z2a_cb(void)
 {
 	this->owner_trw_layer()->wp_sort_order = TreeViewSortOrder::AlphabeticalDescending;
 	this->tree_view->sort_children(this, TreeViewSortOrder::AlphabeticalDescending);
+	this->invalidate_index(); /* Order of drawing follows order of rows. */
 }
 
 
@@ -898,6 +1014,7 @@ void LayerTRWWaypoints::sort_order_timestamp_ascend_cb(void)
 {
 	this->owner_trw_layer()->wp_sort_order = TreeViewSortOrder::DateAscending;
 	this->tree_view->sort_children(this, TreeViewSortOrder::DateAscending);
+	this->invalidate_index(); /* Order of drawing follows order of rows. */
 }
 
 
@@ -907,6 +1024,7 @@ void LayerTRWWaypoints::sort_order_timestamp_descend_cb(void)
 {
 	this->owner_trw_layer()->wp_sort_order = TreeViewSortOrder::DateDescending;
 	this->tree_view->sort_children(this, TreeViewSortOrder::DateDescending);
+	this->invalidate_index(); /* Order of drawing follows order of rows. */
 }
 
 
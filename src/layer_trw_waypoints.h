@@ -43,6 +43,7 @@
 #include "bbox.h"
 #include "coord.h"
 #include "viewport.h"
+#include "layer_trw_waypoints_index.h"
 
 
 
@@ -181,9 +182,22 @@ namespace SlavGPS {
 
 		void draw_tree_item(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
 
+		/* Is the node in tree view, visible (including its
+		   parents) and non-empty? Must be called in main
+		   thread. */
+		bool is_drawable(void) const;
+		/* Draw waypoints without using tree view, so this
+		   can be called in worker thread. */
+		void draw_waypoints(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+
 		void recalculate_bbox(void);
 		LatLonBBox get_bbox(void) const { return this->bbox; };
 
+		/* Update spatial index after coordinate of given waypoint has been changed. */
+		void update_index_for_waypoint(Waypoint * wp);
+		/* Spatial index will be rebuilt before next use. */
+		void invalidate_index(void);
+
 		SGObjectTypeID get_type_id(void) const override;
 		static SGObjectTypeID type_id(void);
 
@@ -230,7 +244,15 @@ namespace SlavGPS {
 		void sort_order_timestamp_descend_cb(void);
 
 	private:
+		void update_index(void);
+
 		LatLonBBox bbox;
+
+		WaypointsSpatialIndex spatial_index;
+
+		/* Largest width or height of waypoints' images drawn
+		   during last drawing of waypoints, in pixels. */
+		int max_drawn_image_size = 0;
 	};
 
 
@@ -0,0 +1,234 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <algorithm>
+#include <cmath>
+
+
+
+
+#include <QDebug>
+
+
+
+
+#include "layer_trw_waypoints_index.h"
+#include "layer_trw_waypoint.h"
+#include "bbox.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "TRW Waypoints Index"
+
+/* Offset making indices of cells non-negative, so that they can be packed into a key. */
+#define CELL_INDEX_OFFSET ((int64_t) 1 << 31)
+
+
+
+
+int64_t WaypointsSpatialIndex::cell_lat(double lat)
+{
+	return (int64_t) floor(lat / WaypointsSpatialIndex::cell_size);
+}
+
+
+
+
+int64_t WaypointsSpatialIndex::cell_lon(double lon)
+{
+	return (int64_t) floor(lon / WaypointsSpatialIndex::cell_size);
+}
+
+
+
+
+uint64_t WaypointsSpatialIndex::cell_key(int64_t lat_idx, int64_t lon_idx)
+{
+	return ((uint64_t) (lat_idx + CELL_INDEX_OFFSET) << 32) | (uint32_t) (lon_idx + CELL_INDEX_OFFSET);
+}
+
+
+
+
+uint64_t WaypointsSpatialIndex::cell_key(const LatLon & lat_lon)
+{
+	return WaypointsSpatialIndex::cell_key(WaypointsSpatialIndex::cell_lat(lat_lon.lat.value()),
+					       WaypointsSpatialIndex::cell_lon(lat_lon.lon.unbound_value()));
+}
+
+
+
+
+void WaypointsSpatialIndex::build(const std::vector<Waypoint *> & waypoints)
+{
+	this->cells.clear();
+	this->cell_of_waypoint.clear();
+
+	for (size_t row = 0; row < waypoints.size(); row++) {
+		Entry entry;
+		entry.wp = waypoints[row];
+		entry.row = (int) row;
+
+		const uint64_t key = WaypointsSpatialIndex::cell_key(entry.wp->get_coord().get_lat_lon());
+		this->cells[key].push_back(entry);
+		this->cell_of_waypoint[entry.wp] = key;
+	}
+
+	this->valid = true;
+	qDebug() << SG_PREFIX_D << "Built index of" << waypoints.size() << "waypoints in" << this->cells.size() << "cells";
+}
+
+
+
+
+void WaypointsSpatialIndex::invalidate(void)
+{
+	this->cells.clear();
+	this->cell_of_waypoint.clear();
+	this->valid = false;
+}
+
+
+
+
+void WaypointsSpatialIndex::update_waypoint(Waypoint * wp)
+{
+	if (!this->valid) {
+		return;
+	}
+
+	auto iter = this->cell_of_waypoint.find(wp);
+	if (iter == this->cell_of_waypoint.end()) {
+		/* Waypoint added after the index has been built. */
+		this->invalidate();
+		return;
+	}
+
+	const uint64_t new_key = WaypointsSpatialIndex::cell_key(wp->get_coord().get_lat_lon());
+	const uint64_t old_key = iter->second;
+	if (new_key == old_key) {
+		return;
+	}
+
+	std::vector<Entry> & old_cell = this->cells[old_key];
+	auto entry_iter = std::find_if(old_cell.begin(), old_cell.end(), [wp](const Entry & entry) { return entry.wp == wp; });
+	if (entry_iter == old_cell.end()) {
+		qDebug() << SG_PREFIX_E << "Waypoint not found in its cell";
+		this->invalidate();
+		return;
+	}
+
+	const Entry entry = *entry_iter;
+	old_cell.erase(entry_iter);
+	if (old_cell.empty()) {
+		this->cells.erase(old_key);
+	}
+
+	this->cells[new_key].push_back(entry);
+	iter->second = new_key;
+}
+
+
+
+
+void WaypointsSpatialIndex::find_waypoints(const LatLonBBox & bbox, std::vector<Waypoint *> & result) const
+{
+	const double north = bbox.north.value();
+	const double south = bbox.south.value();
+	const double east = bbox.east.unbound_value();
+	const double west = bbox.west.unbound_value();
+
+	const int64_t lat_begin = WaypointsSpatialIndex::cell_lat(south);
+	const int64_t lat_end = WaypointsSpatialIndex::cell_lat(north);
+	const int64_t lon_begin = WaypointsSpatialIndex::cell_lon(west);
+	const int64_t lon_end = WaypointsSpatialIndex::cell_lon(east);
+
+	std::vector<const Entry *> found;
+	auto add_from_cell = [&found, north, south, east, west](const std::vector<Entry> & cell) {
+		for (const Entry & entry : cell) {
+			const LatLon lat_lon = entry.wp->get_coord().get_lat_lon();
+			const double lat = lat_lon.lat.value();
+			const double lon = lat_lon.lon.unbound_value();
+			if (lat <= north && lat >= south && lon <= east && lon >= west) {
+				found.push_back(&entry);
+			}
+		}
+	};
+
+	/* For large areas (e.g. zoomed-out viewport) it's cheaper
+	   to visit all non-empty cells than all cells of area. */
+	const double n_area_cells = (double) (lat_end - lat_begin + 1) * (double) (lon_end - lon_begin + 1);
+	if (n_area_cells > this->cells.size()) {
+		for (auto iter = this->cells.begin(); iter != this->cells.end(); iter++) {
+			const int64_t lat_idx = (int64_t) (iter->first >> 32) - CELL_INDEX_OFFSET;
+			const int64_t lon_idx = (int64_t) (iter->first & 0xffffffff) - CELL_INDEX_OFFSET;
+			if (lat_idx >= lat_begin && lat_idx <= lat_end && lon_idx >= lon_begin && lon_idx <= lon_end) {
+				add_from_cell(iter->second);
+			}
+		}
+	} else {
+		for (int64_t lat_idx = lat_begin; lat_idx <= lat_end; lat_idx++) {
+			for (int64_t lon_idx = lon_begin; lon_idx <= lon_end; lon_idx++) {
+				auto iter = this->cells.find(WaypointsSpatialIndex::cell_key(lat_idx, lon_idx));
+				if (iter != this->cells.end()) {
+					add_from_cell(iter->second);
+				}
+			}
+		}
+	}
+
+	WaypointsSpatialIndex::append_sorted_by_row(found, result);
+}
+
+
+
+
+void WaypointsSpatialIndex::get_all_waypoints(std::vector<Waypoint *> & result) const
+{
+	std::vector<const Entry *> all;
+	all.reserve(this->cell_of_waypoint.size());
+	for (auto iter = this->cells.begin(); iter != this->cells.end(); iter++) {
+		for (const Entry & entry : iter->second) {
+			all.push_back(&entry);
+		}
+	}
+
+	WaypointsSpatialIndex::append_sorted_by_row(all, result);
+}
+
+
+
+
+void WaypointsSpatialIndex::append_sorted_by_row(std::vector<const Entry *> & entries, std::vector<Waypoint *> & result)
+{
+	std::sort(entries.begin(), entries.end(), [](const Entry * a, const Entry * b) { return a->row < b->row; });
+
+	result.reserve(result.size() + entries.size());
+	for (const Entry * entry : entries) {
+		result.push_back(entry->wp);
+	}
+}
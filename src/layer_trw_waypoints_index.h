@@ -0,0 +1,101 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_LAYER_TRW_WAYPOINTS_INDEX_H_
+#define _SG_LAYER_TRW_WAYPOINTS_INDEX_H_
+
+
+
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class Waypoint;
+	class LatLon;
+	class LatLonBBox;
+
+
+
+
+	/**
+	   @brief Spatial index of waypoints of a TRW layer
+
+	   Waypoints are put into cells of a uniform Lat/Lon grid.
+	   Only non-empty cells are stored, so the index stays small
+	   for waypoints scattered over whole world.
+
+	   The index also remembers position (row) of each waypoint
+	   in Waypoints node at the moment of building the index, so
+	   that waypoints found in an area can be returned in the
+	   same order in which they are drawn without the index.
+	*/
+	class WaypointsSpatialIndex {
+	public:
+		/* Size of cell of grid, in degrees. */
+		static constexpr double cell_size = 0.05;
+
+		void build(const std::vector<Waypoint *> & waypoints);
+		void invalidate(void);
+		bool is_valid(void) const { return this->valid; };
+		size_t size(void) const { return this->cell_of_waypoint.size(); };
+
+		/* Move waypoint to cell corresponding to its current coordinate. */
+		void update_waypoint(Waypoint * wp);
+
+		/* Find waypoints located inside of given bbox, in order of their rows. */
+		void find_waypoints(const LatLonBBox & bbox, std::vector<Waypoint *> & result) const;
+
+		/* Get all waypoints, in order of their rows. */
+		void get_all_waypoints(std::vector<Waypoint *> & result) const;
+
+	private:
+		class Entry {
+		public:
+			Waypoint * wp = nullptr;
+			int row = 0;
+		};
+
+		static int64_t cell_lat(double lat);
+		static int64_t cell_lon(double lon);
+		static uint64_t cell_key(int64_t lat_idx, int64_t lon_idx);
+		static uint64_t cell_key(const LatLon & lat_lon);
+		static void append_sorted_by_row(std::vector<const Entry *> & entries, std::vector<Waypoint *> & result);
+
+		std::unordered_map<uint64_t, std::vector<Entry>> cells;
+		std::unordered_map<const Waypoint *, uint64_t> cell_of_waypoint;
+		bool valid = false;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_LAYER_TRW_WAYPOINTS_INDEX_H_ */
@@ -131,7 +131,7 @@ LayersPanel::LayersPanel(QWidget * parent_, Window * window_) : QWidget(parent_)
 
 
 	connect(this->m_tree_view, SIGNAL(tree_item_needs_redraw(sg_uid_t)), this->m_window, SLOT(draw_layer_cb(sg_uid_t)));
-	connect(this->m_toplayer, SIGNAL(tree_item_changed(const QString &)), this, SLOT(emit_items_tree_updated_cb(const QString &)));
+	connect(this->m_toplayer, SIGNAL(tree_item_changed(const QString &, bool)), this, SLOT(toplayer_changed_cb(const QString &, bool)));
 	connect(this->m_tree_view, SIGNAL (tree_item_selected(void)), this, SLOT (activate_buttons_cb(void)));
 
 
@@ -158,7 +158,18 @@ void LayersPanel::emit_items_tree_updated_cb(const QString & trigger_name)
 {
 	qDebug() << "SLOT?: Layers Panel received 'changed' signal from top level layer?" << trigger_name;
 	qDebug() << SG_PREFIX_SIGNAL << "Will emit 'items_tree_updated' signal";
-	emit this->items_tree_updated();
+	/* We don't know which item has changed. */
+	emit this->items_tree_updated(false, false);
+}
+
+
+
+
+void LayersPanel::toplayer_changed_cb(const QString & trigger_name, bool in_background)
+{
+	qDebug() << SG_PREFIX_SLOT << "Layers Panel received 'changed' signal from top level layer" << trigger_name;
+	qDebug() << SG_PREFIX_SIGNAL << "Will emit 'items_tree_updated' signal";
+	emit this->items_tree_updated(true, in_background);
 }
 
 
@@ -361,6 +372,14 @@ void LayersPanel::move_item(bool up)
 
 
 void LayersPanel::draw_tree_items(GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	this->draw_tree_items(gisview, highlight_selected, parent_is_selected, LayersDrawStage::All, RenderCancellationToken());
+}
+
+
+
+
+void LayersPanel::draw_tree_items(GisViewport * gisview, bool highlight_selected, bool parent_is_selected, LayersDrawStage stage, const RenderCancellationToken & token)
 {
 	if (!gisview || !this->m_toplayer->is_visible()) {
 		return;
@@ -375,7 +394,9 @@ void LayersPanel::draw_tree_items(GisViewport * gisview, bool highlight_selected
 
 	qDebug() << "";
 	qDebug() << SG_PREFIX_I << "vvvvvvvvvvvvv drawing tree - start vvvvvvvvvvvvv";
-	this->m_toplayer->draw_tree_item(gisview, highlight_selected, parent_is_selected);
+	gisview->set_render_token(token);
+	this->m_toplayer->draw_stage(gisview, highlight_selected, parent_is_selected, stage);
+	gisview->set_render_token(RenderCancellationToken());
 	qDebug() << SG_PREFIX_I << "^^^^^^^^^^^^^ drawing tree - end   ^^^^^^^^^^^^^";
 	qDebug() << "";
 
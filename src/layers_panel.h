@@ -48,6 +48,8 @@ namespace SlavGPS {
 	class TreeItem;
 	class Layer;
 	class StandardMenuOperations;
+	class RenderCancellationToken;
+	enum class LayersDrawStage;
 	enum class LayerKind;
 	enum class CoordMode;
 
@@ -63,6 +65,9 @@ namespace SlavGPS {
 
 		void add_layer(Layer * layer, const CoordMode & viewport_coord_mode);
 		void draw_tree_items(GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+		/* Draw given stage of progressive drawing of layers.
+		   Drawing is abandoned when @param token gets cancelled. */
+		void draw_tree_items(GisViewport * gisview, bool highlight_selected, bool parent_is_selected, LayersDrawStage stage, const RenderCancellationToken & token);
 
 		/* If a layer is selected, get the layer.
 		   If a sublayer is selected, get the sublayer's owning/parent layer. */
@@ -131,6 +136,7 @@ namespace SlavGPS {
 		bool paste_selected_cb(void);
 		void delete_selected_cb(void);
 		void emit_items_tree_updated_cb(const QString & trigger_name);
+		void toplayer_changed_cb(const QString & trigger_name, bool in_background);
 
 		void move_item_up_cb(void);
 		void move_item_down_cb(void);
@@ -138,7 +144,12 @@ namespace SlavGPS {
 		void activate_buttons_cb(void);
 
 	signals:
-		void items_tree_updated(void);
+		/* @param reuse_layers_cache is true when the change
+		   has been reported by a tree item (which has already
+		   marked itself as changed in layers cache).
+		   @param in_background is true when the change has
+		   been made by a download or a job. */
+		void items_tree_updated(bool reuse_layers_cache, bool in_background);
 	};
 
 
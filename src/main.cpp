@@ -58,6 +58,7 @@
 #include "external_tools.h"
 #include "clipboard.h"
 #include "file.h"
+#include "geotag_exif.h"
 #include "measurements.h"
 
 
@@ -220,6 +221,8 @@ int main(int argc, char ** argv)
 	layer_georef_init();
 	LayerMap::init();
 	MapCache::init();
+	DEMCache::init();
+	SGExif::init();
 	Background::init();
 	Routing::init();
 
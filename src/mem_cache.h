@@ -25,11 +25,15 @@
 
 
 
-#include <deque>
+#include <cstdint>
+#include <list>
+#include <utility>
 
 
 
 
+#include <QDebug>
+#include <QHash>
 #include <QPixmap>
 #include <QString>
 
@@ -51,84 +55,146 @@ namespace SlavGPS {
 
 
 
-	template <class T>
+	class MemCacheCounters {
+	public:
+		uint64_t n_hits = 0;
+		uint64_t n_misses = 0;
+		/* Items removed to keep size of cache under capacity. */
+		uint64_t n_evictions = 0;
+	};
+
+
+
+
+	/**
+	   @brief In-memory cache of items, with removal of least recently used items
+
+	   Items are looked up by key through hash table, and a
+	   lookup moves the item to front of list of items, so both
+	   operations take constant time. When total size of items
+	   exceeds capacity of the cache, items from back of the
+	   list (least recently used) are removed.
+
+	   Type T must have "size_t get_size_bytes(void) const"
+	   method. Type Key must be usable as key of QHash.
+	*/
+	template <class T, class Key = QString>
 	class MemCache {
 
 	public:
-		void add(const T & item);
-		void remove_oldest(void);
-		void clear(void) { this->items.clear(); this->current_size_bytes = 0; };
+		/* Get item from cache and mark it as most recently used.
+		   Returns nullptr if there is no item with @param key in cache.
+		   The pointer is valid until next call to add(), remove() or clear(). */
+		T * get(const Key & key);
+		bool contains(const Key & key) const { return this->index.contains(key); };
+
+		/* Item with the same key, if present, is replaced. */
+		void add(const Key & key, const T & item);
+		void remove(const Key & key);
+		void clear(void) { this->items.clear(); this->index.clear(); this->current_size_bytes = 0; };
 
 		void set_capacity_megabytes(int capacity_megabytes);
-		int get_capacity_megabytes(void) const { return this->capacity_bytes / (1024.0 * 1024.0); };
+		int get_capacity_megabytes(void) const { return this->capacity_bytes / (1024 * 1024); };
+
+		size_t get_size_bytes(void) const { return this->current_size_bytes; };
+		int size(void) const { return this->index.size(); };
 
-		class std::deque<T>::iterator begin() { return this->items.begin(); };
-		class std::deque<T>::iterator end()   { return this->items.end(); };
+		const MemCacheCounters & get_counters(void) const { return this->counters; };
 
 	private:
-		/* Deque is used to easily find the oldest elements in cache. */
-		std::deque<T> items;
+		void remove_least_recently_used(void);
+
+		typedef std::list<std::pair<Key, T>> ItemsList;
+
+		/* Most recently used items are at front of the list. */
+		ItemsList items;
+		QHash<Key, typename ItemsList::iterator> index;
 
-	        int current_size_bytes = 0;
-		int capacity_bytes = 0;
+		size_t current_size_bytes = 0;
+		size_t capacity_bytes = 0;
+
+		MemCacheCounters counters;
 	};
 
-	template <class T>
-	void MemCache<T>::add(const T & item)
+	template <class T, class Key>
+	T * MemCache<T, Key>::get(const Key & key)
+	{
+		auto index_iter = this->index.find(key);
+		if (index_iter == this->index.end()) {
+			this->counters.n_misses++;
+			return nullptr;
+		}
+		this->counters.n_hits++;
+
+		/* Splicing doesn't invalidate iterators stored in index. */
+		const typename ItemsList::iterator iter = index_iter.value();
+		if (iter != this->items.begin()) {
+			this->items.splice(this->items.begin(), this->items, iter);
+		}
+
+		return &iter->second;
+	}
+
+	template <class T, class Key>
+	void MemCache<T, Key>::add(const Key & key, const T & item)
 	{
-		this->items.push_back(item);
+		this->remove(key);
+
+		this->items.push_front(std::make_pair(key, item));
+		this->index.insert(key, this->items.begin());
 		this->current_size_bytes += item.get_size_bytes();
 
-		/* Keep size of queue under a limit. */
+		/* Keep size of cache under a limit. */
 		if (this->current_size_bytes > this->capacity_bytes) {
-			if (this->items.size()) {
-				qDebug() << "II   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Removing oldest items from cache to fit into a limit";
-				qDebug() << "II   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Current size (before removal) =" << this->current_size_bytes / (1024.0 * 1024.0) << "megabytes, capacity =" << this->capacity_bytes / (1024.0 * 1024.0) << "megabytes";
-				this->remove_oldest();
-				qDebug() << "II   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Current size (after removal) =" << this->current_size_bytes / (1024.0 * 1024.0) << "megabytes, capacity =" << this->capacity_bytes / (1024.0 * 1024.0) << "megabytes";
-			} else {
-				/* A bit paranoid because we have just added an object. */
-				qDebug() << "EE   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Limit of cache reached, but cache data structure is empty";
-			}
+			qDebug() << "II   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Current size (before removal) =" << this->current_size_bytes / (1024.0 * 1024.0) << "megabytes, capacity =" << this->capacity_bytes / (1024.0 * 1024.0) << "megabytes";
+			this->remove_least_recently_used();
+			qDebug() << "II   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Current size (after removal) =" << this->current_size_bytes / (1024.0 * 1024.0) << "megabytes, capacity =" << this->capacity_bytes / (1024.0 * 1024.0) << "megabytes"
+				 << ", hits =" << this->counters.n_hits << ", misses =" << this->counters.n_misses << ", evictions =" << this->counters.n_evictions;
 		}
 	}
 
-	template <class T>
-	void MemCache<T>::remove_oldest(void)
+	template <class T, class Key>
+	void MemCache<T, Key>::remove(const Key & key)
 	{
-		while (this->current_size_bytes > this->capacity_bytes) {
-			if (this->items.size()) {
-				qDebug() << "II   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Removing oldest item from cache, item size =" << this->items.front().get_size_bytes();
+		auto index_iter = this->index.find(key);
+		if (index_iter == this->index.end()) {
+			return;
+		}
 
-				this->current_size_bytes -= ((int) this->items.front().get_size_bytes());
-				this->items.pop_front(); /* Calling .pop_front() removes oldest element and calls its destructor. */
+		const typename ItemsList::iterator iter = index_iter.value();
+		this->current_size_bytes -= iter->second.get_size_bytes();
+		this->items.erase(iter);
+		this->index.erase(index_iter);
+	}
 
-				if (this->current_size_bytes < 0) {
-					qDebug() << "EE   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Reached negative cache size:" << this->current_size_bytes;
-				}
-			} else {
-				qDebug() << "EE   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Cache size still over limit, but cache data structure is empty";
+	template <class T, class Key>
+	void MemCache<T, Key>::remove_least_recently_used(void)
+	{
+		while (this->current_size_bytes > this->capacity_bytes && !this->items.empty()) {
+			const std::pair<Key, T> & oldest = this->items.back();
 
-				/* If we get into this branch of
-				   if/else, we may have infinite
-				   while() loop. Break it. */
+			this->current_size_bytes -= oldest.second.get_size_bytes();
+			this->index.remove(oldest.first);
+			this->items.pop_back(); /* Calling .pop_back() calls destructor of the item. */
 
-				/* TODO_MAYBE: perhaps we should call MemCache::clear() in case of such error? */
+			this->counters.n_evictions++;
+		}
 
-				break;
-			}
+		if (this->items.empty() && this->current_size_bytes != 0) {
+			qDebug() << "EE   " << SG_MODULE_MEM_CACHE << __FUNCTION__ << __LINE__ << "Cache is empty, but its size is" << this->current_size_bytes;
+			this->current_size_bytes = 0;
 		}
 	}
 
-	template <class T>
-	void MemCache<T>::set_capacity_megabytes(int new_capacity_megabytes)
+	template <class T, class Key>
+	void MemCache<T, Key>::set_capacity_megabytes(int new_capacity_megabytes)
 	{
-		this->capacity_bytes = new_capacity_megabytes * 1024 * 1024;
+		this->capacity_bytes = ((size_t) new_capacity_megabytes) * 1024 * 1024;
 
 		/* Size of memory already used by cached objects may
 		   be larger than new capacity. */
-		if (this->current_size_bytes < this->capacity_bytes) {
-			this->remove_oldest();
+		if (this->current_size_bytes > this->capacity_bytes) {
+			this->remove_least_recently_used();
 		}
 	}
 
@@ -170,17 +236,6 @@ namespace SlavGPS {
 
 
 
-	/* Binary predicate for searching a pixmap (CachedPixmap) in pixmap cache container. */
-	struct CachedPixmapCompareByPath {
-	CachedPixmapCompareByPath(const QString & new_searched_full_path) : searched_full_path(new_searched_full_path) { }
-		bool operator()(CachedPixmap & item) const { return item.image_file_full_path == this->searched_full_path; }
-	private:
-		const QString searched_full_path;
-	};
-
-
-
-
 }
 
 
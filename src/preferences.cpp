@@ -192,7 +192,9 @@ static ParameterSpecification prefs_advanced[] = {
 	{ 1, PREFERENCES_NAMESPACE_ADVANCED "ask_for_create_track_name", SGVariantType::Boolean,       PARAMETER_GROUP_GENERIC, QObject::tr("Ask for Name before Track Creation:"), WidgetType::CheckButton,  NULL,                 NULL, "" },
 	{ 2, PREFERENCES_NAMESPACE_ADVANCED "create_track_tooltip",      SGVariantType::Boolean,       PARAMETER_GROUP_GENERIC, QObject::tr("Show Tooltip during Track Creation:"), WidgetType::CheckButton,  NULL,                 NULL, "" },
 	{ 3, PREFERENCES_NAMESPACE_ADVANCED "number_recent_files",       SGVariantType::Int,           PARAMETER_GROUP_GENERIC, QObject::tr("The number of recent files:"),         WidgetType::SpinBoxInt,   &scale_recent_files,  NULL, QObject::tr("Only applies to new windows or on application restart. -1 means all available files.") },
-	{ 4,                                "",                          SGVariantType::Empty,         PARAMETER_GROUP_GENERIC, "",                                                 WidgetType::None,         NULL,                 NULL, "" },  /* Guard. */
+	{ 4, PREFERENCES_NAMESPACE_ADVANCED "progressive_rendering",     SGVariantType::Boolean,       PARAMETER_GROUP_GENERIC, QObject::tr("Progressive Rendering:"),              WidgetType::CheckButton,  NULL,                 NULL, QObject::tr("Show base layers (e.g. maps) in main viewport before other layers are drawn.") },
+	{ 5, PREFERENCES_NAMESPACE_ADVANCED "parallel_rendering",        SGVariantType::Boolean,       PARAMETER_GROUP_GENERIC, QObject::tr("Parallel Rendering:"),                 WidgetType::CheckButton,  NULL,                 NULL, QObject::tr("Draw layers of main viewport in many threads. Only some kinds of layers can be drawn this way.") },
+	{ 6,                                "",                          SGVariantType::Empty,         PARAMETER_GROUP_GENERIC, "",                                                 WidgetType::None,         NULL,                 NULL, "" },  /* Guard. */
 };
 
 static WidgetIntEnumerationData startup_method_enum = {
@@ -607,6 +609,10 @@ void Preferences::register_default_values()
 	i++;
 	Preferences::register_parameter_instance(prefs_advanced[i], scale_recent_files.initial);
 	i++;
+	Preferences::register_parameter_instance(prefs_advanced[i], SGVariant(true, prefs_advanced[i].type_id));
+	i++;
+	Preferences::register_parameter_instance(prefs_advanced[i], SGVariant(false, prefs_advanced[i].type_id));
+	i++;
 }
 
 
@@ -758,6 +764,22 @@ int Preferences::get_recent_number_files()
 
 
 
+bool Preferences::get_progressive_rendering()
+{
+	return Preferences::get_param_value(PREFERENCES_NAMESPACE_ADVANCED "progressive_rendering").u.val_bool;
+}
+
+
+
+
+bool Preferences::get_parallel_rendering()
+{
+	return Preferences::get_param_value(PREFERENCES_NAMESPACE_ADVANCED "parallel_rendering").u.val_bool;
+}
+
+
+
+
 bool Preferences::get_add_default_map_layer()
 {
 	return Preferences::get_param_value(PREFERENCES_NAMESPACE_STARTUP "add_default_map_layer").u.val_bool;
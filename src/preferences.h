@@ -202,6 +202,8 @@ namespace SlavGPS {
 		static bool get_ask_for_create_track_name();
 		static bool get_create_track_tooltip();
 		static int get_recent_number_files();
+		static bool get_progressive_rendering();
+		static bool get_parallel_rendering();
 		static bool get_add_default_map_layer();
 		static StartupMethod get_startup_method();
 		static QString get_startup_file(void);
@@ -12,6 +12,9 @@ SOURCES += main.cpp \
     viewport_decorations.cpp \
     viewport_zoom.cpp \
     viewport_pixmap.cpp \
+    viewport_layers_cache.cpp \
+    viewport_labels.cpp \
+    frame_scheduler.cpp \
     layer_trw_track_profile_dialog.cpp \
     babel.cpp \
     mem_cache.cpp \
@@ -111,10 +114,14 @@ SOURCES += main.cpp \
     layer_trw_tools.cpp \
     layer_trw_menu.cpp \
     layer_trw_tracks.cpp \
+    layer_trw_tracks_index.cpp \
+    layer_trw_waypoints_index.cpp \
     layer_trw_waypoints.cpp \
     layers_panel.cpp \
     toolbox.cpp \
     layer_trw_track.cpp \
+    layer_trw_track_lod.cpp \
+    layer_trw_trackpoints.cpp \
     layer_trw_track_data.cpp \
     layer_trw_track_split.cpp \
     layer_trw_track_properties_dialog.cpp \
@@ -143,6 +150,7 @@ SOURCES += main.cpp \
     layer_dem_dem_srtm.cpp \
     layer_dem_dem_24k.cpp \
     layer_dem_dem_cache.cpp \
+    layer_dem_contours.cpp \
     srtm_continent.cpp \
     compression.cpp \
     file_utils.cpp \
@@ -249,6 +257,9 @@ HEADERS += window.h \
     viewport_decorations.h \
     viewport_zoom.h \
     viewport_pixmap.h \
+    viewport_layers_cache.h \
+    viewport_labels.h \
+    frame_scheduler.h \
     coord.h \
     coords.h \
     globals.h \
@@ -266,10 +277,14 @@ HEADERS += window.h \
     layer_trw_menu.h \
     layer_trw_dialogs.h \
     layer_trw_tracks.h \
+    layer_trw_tracks_index.h \
+    layer_trw_waypoints_index.h \
     layer_trw_waypoints.h \
     layers_panel.h \
     toolbox.h \
     layer_trw_track.h \
+    layer_trw_track_lod.h \
+    layer_trw_trackpoints.h \
     layer_trw_track_data.h \
     layer_trw_track_internal.h \
     layer_trw_track_properties_dialog.h \
@@ -301,6 +316,7 @@ HEADERS += window.h \
     layer_dem_dem_srtm.h \
     layer_dem_dem_24k.h \
     layer_dem_dem_cache.h \
+    layer_dem_contours.h \
     compression.h \
     file_utils.h \
     util.h \
@@ -469,6 +485,9 @@ DEFINES += "HAVE_UNISTD_H=1"
 # Size of the map cache
 DEFINES += "VIK_CONFIG_MAPCACHE_SIZE=128"
 
+# Memory budget of the DEM cache (in megabytes)
+DEFINES += "VIK_CONFIG_DEMCACHE_SIZE=1024"
+
 # Age of tiles before checking it (in seconds)
 DEFINES += "VIK_CONFIG_DEFAULT_TILE_AGE=604800"
 
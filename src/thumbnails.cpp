@@ -27,6 +27,8 @@
 
 
 
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <cstdlib>
@@ -49,6 +51,11 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QFile>
+#include <QImageReader>
+#include <QStandardPaths>
+#include <QTransform>
+#include <QUrl>
 
 
 
@@ -80,26 +87,37 @@ using namespace SlavGPS;
 #endif
 
 
-#ifdef WINDOWS
-#define THUMB_DIR "\\THUMBNAILS\\" /* viking maps default viking\maps */
-#define THUMB_SUB_DIR "normal\\"
-#else
-#define THUMB_DIR "/.thumbnails/"
-#define THUMB_SUB_DIR "normal/"
-#endif
+/* Location of "normal" (128x128) thumbnails in thumbnail cache,
+   relative to user's cache directory (e.g. ~/.cache). */
+#define THUMB_SUB_DIR "thumbnails/normal/"
+
+/* Thumbnail embedded in EXIF data is used only if its aspect
+   ratio differs from aspect ratio of image by less than this
+   (thumbnails with black bars added by camera are rejected). */
+#define EMBEDDED_THUMB_ASPECT_TOLERANCE 0.02
+
+/* Image is decoded at up to this many times the size of thumbnail,
+   and then scaled down smoothly. */
+#define DECODING_SCALE_FACTOR 2
 
 
 
 
 static QString md5_hash(const char * message);
+static QString get_file_uri(const QString & file_full_path);
+static bool thumbnail_is_up_to_date(const QImageReader & thumbnail_reader, const QString & original_file_full_path);
 
 
 
 
 bool Thumbnails::thumbnail_exists(const QString & original_file_full_path)
 {
-	const QPixmap pixmap = Thumbnails::get_thumbnail(original_file_full_path);
-	return !pixmap.isNull();
+	QImageReader reader(Thumbnails::get_thumbnail_full_path(original_file_full_path));
+	if (!reader.canRead()) {
+		return false;
+	}
+
+	return thumbnail_is_up_to_date(reader, original_file_full_path);
 }
 
 
@@ -113,11 +131,13 @@ QPixmap Thumbnails::get_default_thumbnail(void)
 
 
 
-void Thumbnails::generate_thumbnail_if_missing(const QString & original_file_full_path)
+bool Thumbnails::generate_thumbnail_if_missing(const QString & original_file_full_path)
 {
-	if (!Thumbnails::thumbnail_exists(original_file_full_path)) {
-		Thumbnails::generate_thumbnail(original_file_full_path);
+	if (Thumbnails::thumbnail_exists(original_file_full_path)) {
+		return true;
 	}
+
+	return Thumbnails::generate_thumbnail(original_file_full_path);
 }
 
 
@@ -144,91 +164,146 @@ QPixmap Thumbnails::scale_pixmap(const QPixmap & src, int max_w, int max_h)
 
 
 
-bool Thumbnails::generate_thumbnail(const QString & original_file_full_path)
+QImage Thumbnails::scale_image(const QImage & src, int max_w, int max_h)
 {
-	QPixmap original_image;
-	if (!original_image.load(original_file_full_path)) {
-		qDebug() << SG_PREFIX_E << "Failed to load image" << original_file_full_path;
-		return false;
+	if (src.width() <= max_w && src.height() <= max_h) {
+		return src;
+	}
+
+	return src.scaled(max_w, max_h, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+
+
+
+QImage Thumbnails::get_embedded_thumbnail(const QByteArray & embedded_data, const QSize & original_size)
+{
+	if (embedded_data.isEmpty() || !original_size.isValid()) {
+		return QImage();
+	}
+
+	const QImage embedded = QImage::fromData(embedded_data);
+	if (embedded.isNull()) {
+		return QImage();
+	}
+
+	if (embedded.width() < PIXMAP_THUMB_SIZE && embedded.height() < PIXMAP_THUMB_SIZE) {
+		/* Too small, would have to be scaled up. */
+		return QImage();
+	}
+
+	const double original_aspect = ((double) original_size.width()) / original_size.height();
+	const double embedded_aspect = ((double) embedded.width()) / embedded.height();
+	if (std::fabs(embedded_aspect - original_aspect) > EMBEDDED_THUMB_ASPECT_TOLERANCE * original_aspect) {
+		return QImage();
+	}
+
+	return embedded;
+}
+
+
+
+
+QImage Thumbnails::read_scaled_image(const QString & original_file_full_path, const QSize & original_size)
+{
+	QImageReader reader(original_file_full_path);
+	/* Orientation from EXIF is applied by us, also to embedded thumbnail. */
+	reader.setAutoTransform(false);
+
+	const int decoded_size = DECODING_SCALE_FACTOR * PIXMAP_THUMB_SIZE;
+	if (original_size.isValid() && (original_size.width() > decoded_size || original_size.height() > decoded_size)) {
+		/* Decoder of JPEG files uses this size to skip decoding of unnecessary details. */
+		reader.setScaledSize(original_size.scaled(decoded_size, decoded_size, Qt::KeepAspectRatio));
 	}
 
-	sg_exif_image_orientation image_orientation;
-	if (true == SGExif::get_image_orientation(image_orientation, original_file_full_path)) {
-		Thumbnails::apply_image_orientation(original_image, image_orientation);
+	const QImage image = reader.read();
+	if (image.isNull()) {
+		qDebug() << SG_PREFIX_E << "Failed to read image" << original_file_full_path << ":" << reader.errorString();
 	}
 
+	return image;
+}
+
+
+
+
+/**
+   Thread-safe: thumbnails may be generated in parallel.
+*/
+bool Thumbnails::generate_thumbnail(const QString & original_file_full_path)
+{
 	struct stat info;
 	if (stat(original_file_full_path.toUtf8().constData(), &info) != 0) {
 		qDebug() << SG_PREFIX_E << "Failed to stat image" << original_file_full_path;
 		return false;
 	}
 
-	QPixmap thumb = Thumbnails::scale_pixmap(original_image, PIXMAP_THUMB_SIZE, PIXMAP_THUMB_SIZE);
+	/* Only header of image is read here. */
+	const QSize original_size = QImageReader(original_file_full_path).size();
 
-	const QString canonical_path = SGUtils::get_canonical_path(original_file_full_path);
-	const QString original_uri = QString("file://%1").arg(canonical_path);
-	const QString md5 = md5_hash(original_uri.toUtf8().constData());
+	sg_exif_image_orientation image_orientation = 0;
+	QByteArray embedded_data;
+	SGExif::get_thumbnail_info(original_file_full_path, image_orientation, embedded_data);
 
+	/* Fast path: use thumbnail embedded by camera, without decoding the image. */
+	QImage thumb = Thumbnails::get_embedded_thumbnail(embedded_data, original_size);
+	if (thumb.isNull()) {
+		thumb = Thumbnails::read_scaled_image(original_file_full_path, original_size);
+		if (thumb.isNull()) {
+			return false;
+		}
+	}
 
-	QString target_full_path = QString("%1%2%3").arg(SlavGPSLocations::get_home_dir()).arg(THUMB_DIR).arg(THUMB_SUB_DIR);
-	const QDir thumbs_dir(target_full_path); /* Here we are still using path to a directory, not a final-final path. */
-	/* Create thumbnails directory (with all parent dirs if necessary).
-	   TODO_LATER: viking used 0700 permissions for the directory. What should we do? Use umask? */
-	if (!thumbs_dir.mkpath(".")) {
-		qDebug() << SG_PREFIX_E << "Failed to create thumbnails directory" << target_full_path;
+	thumb = Thumbnails::scale_image(thumb, PIXMAP_THUMB_SIZE, PIXMAP_THUMB_SIZE);
+	if (image_orientation) {
+		Thumbnails::apply_image_orientation(thumb, image_orientation);
 	}
 
-	target_full_path += QString("%1.png").arg(md5);
 
-	/* Truncate final path to this length when renaming.
-	   We create the file ###.png.Viking-PID and rename it to avoid
-	   a race condition if two programs create the same thumb at
-	   once. */
-	const int final_path_len = target_full_path.length();
+	/* Attributes required by thumbnail managing standard. */
+	thumb.setText("Thumb::URI", get_file_uri(original_file_full_path));
+	thumb.setText("Thumb::MTime", QString("%1").arg((long long) info.st_mtime));
+	thumb.setText("Thumb::Size", QString("%1").arg((long long) info.st_size));
+	if (original_size.isValid()) {
+		thumb.setText("Thumb::Image::Width", QString("%1").arg(original_size.width()));
+		thumb.setText("Thumb::Image::Height", QString("%1").arg(original_size.height()));
+	}
+	thumb.setText("Software", PROJECT);
+
+
+	const QString thumbs_dir_path = Thumbnails::get_thumbnails_dir();
+	const QDir thumbs_dir(thumbs_dir_path);
+	if (!thumbs_dir.exists()) {
+		/* Create thumbnails directory (with all parent dirs if necessary). */
+		if (!thumbs_dir.mkpath(".")) {
+			qDebug() << SG_PREFIX_E << "Failed to create thumbnails directory" << thumbs_dir_path;
+		}
+		QFile::setPermissions(thumbs_dir_path, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+	}
+
+	/* We create the file ###.png.Viking-PID-N and rename it to
+	   avoid a race condition if two programs (or two threads)
+	   create the same thumb at once. */
+	static std::atomic<unsigned int> tmp_file_counter{0};
+	const QString final_full_path = Thumbnails::get_thumbnail_full_path(original_file_full_path);
 #ifdef WINDOWS
-	target_full_path += ".Viking";
+	const QString target_full_path = QString("%1.Viking-%2").arg(final_full_path).arg(tmp_file_counter++);
 #else
-	target_full_path += QString(".Viking-%1").arg((long) getpid());
+	const QString target_full_path = QString("%1.Viking-%2-%3").arg(final_full_path).arg((long) getpid()).arg(tmp_file_counter++);
 #endif
 
-
-	mode_t old_mask = umask(0077);
-	const bool success = thumb.save(target_full_path, "png");
-	umask(old_mask);
-	if (!success) {
+	if (!thumb.save(target_full_path, "png")) {
 		qDebug() << SG_PREFIX_E << "Failed to save thumbnail as" << target_full_path;
 		return false;
 	}
+	/* Thumbnails must be readable only by owner. Not using
+	   umask() because it is shared by all threads. */
+	QFile::setPermissions(target_full_path, QFile::ReadOwner | QFile::WriteOwner);
 
-
-	const QString swidth = QString("%1").arg((int) original_image.width());
-	const QString sheight = QString("%1").arg((int) original_image.height());
-	const QString ssize = QString("%1").arg((long long) info.st_size);
-	const QString smtime = QString("%1").arg((long) info.st_mtime);
-#ifdef K_FIXME_RESTORE
-	const char * orientation = gdk_pixbuf_get_option(original_image, "orientation");
-
-	/*
-	  Thumb::URI must be in ISO-8859-1 encoding otherwise gdk_pixbuf_save() will fail
-	  - e.g. if characters such as 'ě' are encountered.
-	  Also see http://en.wikipedia.org/wiki/ISO/IEC_8859-1.
-	*/
-
-	gdk_pixbuf_save(thumb, target_full_path, "png", &error,
-			"tEXt::Thumb::Image::Width", swidth,
-			"tEXt::Thumb::Image::Height", sheight,
-			"tEXt::Thumb::Size", ssize,
-			"tEXt::Thumb::MTime", smtime,
-			"tEXt::Thumb::URI", original_uri.toLatin1().constData(),
-			"tEXt::Software", PROJECT,
-			"tEXt::Software::Orientation", orientation ? orientation : "0",
-			NULL);
-#endif
-
-	const QString final_full_path = target_full_path.left(final_path_len);
 	if (rename(target_full_path.toUtf8().constData(), final_full_path.toUtf8().constData())) {
 		int e = errno;
 		qDebug() << SG_PREFIX_E << "Failed to rename" << target_full_path << "to" << final_full_path << ":" << strerror(e);
+		QFile::remove(target_full_path);
 		return false;
 	}
 
@@ -240,48 +315,72 @@ bool Thumbnails::generate_thumbnail(const QString & original_file_full_path)
 
 QPixmap Thumbnails::get_thumbnail(const QString & original_file_full_path)
 {
-	const QString canonical_path = SGUtils::get_canonical_path(original_file_full_path);
-	const QString original_uri = QString("file://%1").arg(canonical_path);
-	const QString md5 = md5_hash(original_uri.toUtf8().constData());
+	QImageReader reader(Thumbnails::get_thumbnail_full_path(original_file_full_path));
+	if (!reader.canRead()) {
+		return QPixmap();
+	}
 
-	const QString thumb_path = QString("%1%2%3%4.png").arg(SlavGPSLocations::get_home_dir()).arg(THUMB_DIR).arg(THUMB_SUB_DIR).arg(md5);
+	if (!thumbnail_is_up_to_date(reader, original_file_full_path)) {
+		return QPixmap();
+	}
+
+	return QPixmap::fromImage(reader.read());
+}
+
+
+
+
+QString Thumbnails::get_thumbnails_dir(void)
+{
+	return QString("%1/%2").arg(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)).arg(THUMB_SUB_DIR);
+}
+
+
+
+
+QString Thumbnails::get_thumbnail_full_path(const QString & original_file_full_path)
+{
+	const QString md5 = md5_hash(get_file_uri(original_file_full_path).toUtf8().constData());
+	return QString("%1%2.png").arg(Thumbnails::get_thumbnails_dir()).arg(md5);
+}
 
 
-	QPixmap thumbnail;
-	if (!thumbnail.load(thumb_path)) {
-		goto err;
-	}
 
-#ifdef K_FIXME_RESTORE
-	/* Note that these don't need freeing... */
-	const char * ssize = gdk_pixbuf_get_option(thumbnail, "tEXt::Thumb::Size");
-	if (!ssize) {
-		goto err;
-	}
 
-	const char * smtime = gdk_pixbuf_get_option(thumbnail, "tEXt::Thumb::MTime");
-	if (!smtime) {
-		goto err;
+/* URI of file, in form used by thumbnail managing standard to calculate name of thumbnail. */
+static QString get_file_uri(const QString & file_full_path)
+{
+	const QString canonical_path = SGUtils::get_canonical_path(file_full_path);
+	return QUrl::fromLocalFile(canonical_path).toString(QUrl::FullyEncoded);
+}
+
+
+
+
+/* Thumbnail is out of date if file with original image has been modified after the thumbnail was created. */
+static bool thumbnail_is_up_to_date(const QImageReader & thumbnail_reader, const QString & original_file_full_path)
+{
+	const QString smtime = thumbnail_reader.text("Thumb::MTime");
+	if (smtime.isEmpty()) {
+		return false;
 	}
 
 	struct stat info;
-	if (stat(canonical_path.toUtf8().constData(), &info) != 0) {
-		goto err;
+	if (stat(original_file_full_path.toUtf8().constData(), &info) != 0) {
+		return false;
 	}
 
-	if (info.st_mtime != atol(smtime) || info.st_size != atol(ssize)) {
-		goto err;
+	if ((long long) info.st_mtime != smtime.toLongLong()) {
+		return false;
 	}
-#endif
 
-	goto out;
-err:
-	if (!thumbnail.isNull()) {
-		thumbnail = QPixmap(); /* Resetting because we are handling error here. */
+	/* Size is optional. */
+	const QString ssize = thumbnail_reader.text("Thumb::Size");
+	if (!ssize.isEmpty() && (long long) info.st_size != ssize.toLongLong()) {
+		return false;
 	}
 
-out:
-	return thumbnail;
+	return true;
 }
 
 
@@ -567,35 +666,47 @@ static QString md5_hash(const char * message)
 
 
 
-bool Thumbnails::apply_image_orientation(QPixmap & image, sg_exif_image_orientation orientation)
+bool Thumbnails::apply_image_orientation(QImage & image, sg_exif_image_orientation orientation)
 {
-	/* TODO_LATER: handle all orientations, apply them to image. */
+	/* See CIPA's "Exchangeable image file format for digital still cameras: Exif Version 2.3" reference document. */
 
 	QTransform transform;
-	bool result = true;
-
-	/* See CIPA's "Exchangeable image file format for digital still cameras: Exif Version 2.3" reference document. */
 
 	switch (orientation) {
 	case 1:
+		/* Nothing to do. */
+		return true;
 	case 2:
+		image = image.mirrored(true, false);
+		return true;
 	case 3:
+		transform.rotate(180);
+		break;
 	case 4:
+		image = image.mirrored(false, true);
+		return true;
 	case 5:
-		break;
+		/* Transpose. */
+		transform.rotate(90);
+		image = image.transformed(transform).mirrored(true, false);
+		return true;
 	case 6:
 		/* Image needs to be rotated 90 degrees clockwise. */
 		transform.rotate(90);
-		image = image.transformed(transform);
-		qDebug() << SG_PREFIX_I << "Rotated image 90 degrees clockwise:" << !image.isNull();
 		break;
 	case 7:
+		/* Transverse. */
+		transform.rotate(270);
+		image = image.transformed(transform).mirrored(true, false);
+		return true;
 	case 8:
+		transform.rotate(270);
 		break;
 	default:
 		qDebug() << SG_PREFIX_E << "Unexpected orientation value" << orientation;
-		break;
+		return false;
 	}
 
-	return result;
+	image = image.transformed(transform);
+	return true;
 }
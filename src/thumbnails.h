@@ -24,7 +24,9 @@
 
 
 
+#include <QImage>
 #include <QPixmap>
+#include <QString>
 
 
 
@@ -44,25 +46,49 @@ namespace SlavGPS {
 
 
 
+	/**
+	   @brief Thumbnails of images, stored in shared thumbnail cache
+
+	   Thumbnails are stored in "normal" directory of
+	   thumbnail cache described by freedesktop.org's
+	   "Thumbnail Managing Standard", so thumbnails created by
+	   other programs can be used here, and vice versa.
+
+	   Methods returning or creating QImage (but not QPixmap)
+	   can be called from non-GUI threads.
+	*/
 	class Thumbnails {
 	public:
+		/* Check if an up-to-date thumbnail exists. Pixels
+		   of the thumbnail are not decoded. */
 		static bool thumbnail_exists(const QString & original_file_full_path);
 
 		/* Generate a thumbnail, but only if it doesn't exist yet. */
-		static void generate_thumbnail_if_missing(const QString & original_file_full_path);
+		static bool generate_thumbnail_if_missing(const QString & original_file_full_path);
 
-		/* Returns freshly allocated pixmap. Caller must delete the pointer. */
 		static QPixmap get_thumbnail(const QString & original_file_full_path);
 
 		static QPixmap get_default_thumbnail(void);
 
 		static QPixmap scale_pixmap(const QPixmap & src, int max_w, int max_h);
+		static QImage scale_image(const QImage & src, int max_w, int max_h);
 
-		static bool apply_image_orientation(QPixmap & image, sg_exif_image_orientation orientation);
+		static bool apply_image_orientation(QImage & image, sg_exif_image_orientation orientation);
 
 	private:
 		/* Unconditionally generate a thumbnail. */
 		static bool generate_thumbnail(const QString & original_file_full_path);
+
+		/* Get thumbnail embedded in EXIF data of image, if it
+		   is large enough to be used as our thumbnail. */
+		static QImage get_embedded_thumbnail(const QByteArray & embedded_data, const QSize & original_size);
+
+		/* Read image already scaled down during decoding (e.g.
+		   in DCT domain for JPEG files). */
+		static QImage read_scaled_image(const QString & original_file_full_path, const QSize & original_size);
+
+		static QString get_thumbnail_full_path(const QString & original_file_full_path);
+		static QString get_thumbnails_dir(void);
 	};
 
 
@@ -37,6 +37,7 @@
 #include "tree_item.h"
 #include "tree_view.h"
 #include "tree_view_internal.h"
+#include "layer.h"
 #include "layers_panel.h"
 #include "window.h"
 
@@ -490,10 +491,27 @@ bool TreeItem::move_child(TreeItem & child_tree_item, bool up)
 */
 void TreeItem::emit_tree_item_changed(const QString & where)
 {
+	this->increment_content_versions();
+
 	if (this->m_visible && this->tree_view) {
-		ThisApp::main_window()->set_redraw_trigger(this);
 		qDebug() << SG_PREFIX_SIGNAL << "Tree item" << this->m_name << "emits 'layer changed' signal @" << where;
-		emit this->tree_item_changed(this->m_name);
+		emit this->tree_item_changed(this->m_name, false);
+	}
+}
+
+
+
+
+/**
+   Indicate to receiver that specified tree item has been changed by a download or a job (if the item is visible)
+*/
+void TreeItem::emit_tree_item_changed_in_background(const QString & where)
+{
+	this->increment_content_versions();
+
+	if (this->m_visible && this->tree_view) {
+		qDebug() << SG_PREFIX_SIGNAL << "Tree item" << this->m_name << "emits 'layer changed' signal from background @" << where;
+		emit this->tree_item_changed(this->m_name, true);
 	}
 }
 
@@ -508,9 +526,28 @@ void TreeItem::emit_tree_item_changed(const QString & where)
 */
 void TreeItem::emit_tree_item_changed_although_invisible(const QString & where)
 {
-	ThisApp::main_window()->set_redraw_trigger(this);
+	this->increment_content_versions();
 	qDebug() << SG_PREFIX_SIGNAL << "TreeItem" << this->m_name << "emits 'changed' signal @" << where;
-	emit this->tree_item_changed(this->m_name);
+	emit this->tree_item_changed(this->m_name, false);
+}
+
+
+
+
+/**
+   Mark this item (if it is a layer) and all layers containing
+   this item as changed.
+
+   TreeItem::m_parent is used instead of ::parent_member() because
+   this may be called from background thread.
+*/
+void TreeItem::increment_content_versions(void)
+{
+	for (TreeItem * item = this; nullptr != item; item = item->m_parent) {
+		if (item->is_layer()) {
+			((Layer *) item)->increment_content_version();
+		}
+	}
 }
 
 
@@ -912,22 +949,20 @@ sg_ret TreeItem::attach_as_tree_item_child(TreeItem * child, int row)
 
 	this->tree_view->expand(this->index());
 
-	QObject::connect(child, SIGNAL (tree_item_changed(const QString &)), this->m_parent, SLOT (child_tree_item_changed_cb(const QString &)));
+	QObject::connect(child, SIGNAL (tree_item_changed(const QString &, bool)), this->m_parent, SLOT (child_tree_item_changed_cb(const QString &, bool)));
 	return sg_ret::ok;
 }
 
 
 
 
-/* Doesn't set the trigger. Should be done by aggregate layer when child emits 'changed' signal. */
-sg_ret TreeItem::child_tree_item_changed_cb(const QString & child_tree_item_name) /* Slot. */
+/* Pass the change (and the information whether it was made in background) up the tree. */
+sg_ret TreeItem::child_tree_item_changed_cb(const QString & child_tree_item_name, bool in_background) /* Slot. */
 {
 	qDebug() << SG_PREFIX_SLOT << "Parent" << this->get_name() << "received 'child tree item changed' signal from" << child_tree_item_name;
 	if (this->is_visible()) {
-		/* TODO_LATER: this can used from the background - e.g. in acquire
-		   so will need to flow background update status through too. */
 		qDebug() << SG_PREFIX_SIGNAL << "Layer" << this->get_name() << "emits 'changed' signal";
-		emit this->tree_item_changed(this->get_name());
+		emit this->tree_item_changed(this->get_name(), in_background);
 	}
 
 	return sg_ret::ok;
@@ -165,8 +165,18 @@ namespace SlavGPS {
 		static bool compare_name_descending(const TreeItem * a, const TreeItem * b);  /* Descending: ZZZ -> AAA */
 
 		void emit_tree_item_changed(const QString & where);
+		/* Like emit_tree_item_changed(), but for changes made
+		   by downloads and jobs, which don't need to be shown
+		   in the very next frame. */
+		void emit_tree_item_changed_in_background(const QString & where);
 		void emit_tree_item_changed_although_invisible(const QString & where);
 
+		/* Mark layers containing this item (and the item
+		   itself, if it is a layer) as changed, so that their
+		   cached images are not reused. Called by the two
+		   functions above. */
+		void increment_content_versions(void);
+
 		virtual Time get_timestamp(void) const;
 		virtual void set_timestamp(const Time & value);
 		virtual void set_timestamp(time_t value);
@@ -568,7 +578,12 @@ namespace SlavGPS {
 		bool m_visible = true;
 
 	signals:
-		void tree_item_changed(const QString & tree_item_name);
+		/* @param in_background tells whether the change has
+		   been made by a download or a job (and not by user),
+		   so its redrawing may wait. The flag travels with the
+		   signal because the signal may be emitted from a
+		   worker thread and delivered through a queue. */
+		void tree_item_changed(const QString & tree_item_name, bool in_background);
 
 		/**
 		   E.g. count of child items has changed or bbox has
@@ -584,7 +599,7 @@ namespace SlavGPS {
 	public slots:
 		/* Tree Item can contain other Tree Items and should
 		   be notified about changes in them. */
-		virtual sg_ret child_tree_item_changed_cb(const QString & child_tree_item_name);
+		virtual sg_ret child_tree_item_changed_cb(const QString & child_tree_item_name, bool in_background);
 
 		virtual sg_ret cut_tree_item_cb(void);
 		virtual sg_ret copy_tree_item_cb(void);
@@ -1184,6 +1184,32 @@ int SelectedTreeItems::size(void) const
 
 
 
+std::vector<sg_uid_t> SelectedTreeItems::get_related_uids(const TreeItem * tree_item) const
+{
+	std::vector<sg_uid_t> result;
+
+	for (auto iter = this->selected_tree_items.begin(); iter != this->selected_tree_items.end(); iter++) {
+		const TreeItem * selected_item = iter->second;
+
+		bool related = false;
+		for (const TreeItem * item = selected_item; nullptr != item && !related; item = item->parent_member()) {
+			related = TreeItem::the_same_object(item, tree_item);
+		}
+		for (const TreeItem * item = tree_item->parent_member(); nullptr != item && !related; item = item->parent_member()) {
+			related = TreeItem::the_same_object(item, selected_item);
+		}
+
+		if (related) {
+			result.push_back(iter->first);
+		}
+	}
+
+	return result;
+}
+
+
+
+
 int TreeView::property_id_to_column_idx(TreeItemPropertyID property_id) const
 {
 	int col = 0;
@@ -25,6 +25,7 @@
 
 
 #include <map>
+#include <vector>
 
 
 
@@ -80,6 +81,14 @@ namespace SlavGPS {
 		void clear(void);
 		int size(void) const;
 
+		/**
+		   Get uids of selected items that affect how given
+		   @param tree_item is drawn: the item itself, items
+		   below it (e.g. waypoints of TRW layer) and items
+		   above it (its parent layers).
+		*/
+		std::vector<sg_uid_t> get_related_uids(const TreeItem * tree_item) const;
+
 		/**
 		   Print to console information about how given @param
 		   tree_item will be drawn given its current selection
@@ -26,6 +26,9 @@
 
 #include <list>
 #include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <memory>
 
 
 
@@ -102,6 +105,79 @@ namespace SlavGPS {
 
 
 
+	/**
+	   @brief Token allowing to cancel drawing of a frame
+
+	   Copies of a token share its state, so a token can be
+	   cancelled by one owner (e.g. frame scheduler) and checked
+	   by another one (e.g. a layer drawing itself in
+	   viewport). Default-constructed token is never cancelled.
+
+	   Layers are drawn in GUI thread, so nothing can cancel
+	   the token while they are drawn, unless the token is also
+	   cancelled by user input that has been handled since a
+	   given moment (see cancel_on_user_input() and
+	   GisViewport::render_is_cancelled()).
+	*/
+	class RenderCancellationToken {
+	public:
+		static RenderCancellationToken create(void)
+		{
+			RenderCancellationToken token;
+			token.state = std::make_shared<State>();
+			return token;
+		}
+
+		void cancel(void) { if (this->state) { this->state->cancelled = true; } }
+		bool is_cancelled(void) const { return this->state && this->state->cancelled; }
+
+		/* Let user input cancel the token, but only after
+		   @param after_ms milliseconds from now. The token is
+		   cancelled if count of input events (see
+		   UserInputCounter) is different than @param
+		   input_count. */
+		void cancel_on_user_input(int after_ms, uint64_t input_count)
+		{
+			if (this->state) {
+				this->state->input_check_enabled = true;
+				this->state->input_check_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(after_ms);
+				this->state->input_count = input_count;
+			}
+		}
+
+		uint64_t get_input_count(void) const { return this->state ? this->state->input_count : 0; }
+
+		/* Is it time to check if there has been user input?
+		   Call this only from GUI thread. The next check will
+		   be due after @param interval_ms milliseconds. */
+		bool input_check_is_due(int interval_ms) const
+		{
+			if (!this->state || !this->state->input_check_enabled) {
+				return false;
+			}
+			const auto now = std::chrono::steady_clock::now();
+			if (now < this->state->input_check_time) {
+				return false;
+			}
+			this->state->input_check_time = now + std::chrono::milliseconds(interval_ms);
+			return true;
+		}
+
+	private:
+		class State {
+		public:
+			std::atomic<bool> cancelled{false};
+			/* Used only in GUI thread. */
+			bool input_check_enabled = false;
+			std::chrono::steady_clock::time_point input_check_time;
+			uint64_t input_count = 0;
+		};
+		std::shared_ptr<State> state;
+	};
+
+
+
+
 	/* Enum created to avoid using specific pixel values. */
 	enum class ScreenCorner {
 		UpperLeft,
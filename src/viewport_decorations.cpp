@@ -407,6 +407,24 @@ void GisViewportDecorations::clear(void)
 
 
 
+void GisViewportDecorations::get_attributions_and_logos(QStringList & new_attributions, std::list<GisViewportLogo> & new_logos) const
+{
+	new_attributions = this->attributions;
+	new_logos = this->logos;
+}
+
+
+
+
+void GisViewportDecorations::set_attributions_and_logos(const QStringList & new_attributions, const std::list<GisViewportLogo> & new_logos)
+{
+	this->attributions = new_attributions;
+	this->logos = new_logos;
+}
+
+
+
+
 /* Return length of scale bar, in pixels. */
 static int rescale_unit(double * base_distance, double * scale_unit, int maximum_width)
 {
@@ -61,6 +61,12 @@ namespace SlavGPS {
 		void draw(GisViewport & gisview);
 		void clear(void);
 
+		/* Attributions and logos are added by layers while
+		   the layers are drawn. These two functions allow
+		   finding out which of them belong to which layer. */
+		void get_attributions_and_logos(QStringList & attributions, std::list<GisViewportLogo> & logos) const;
+		void set_attributions_and_logos(const QStringList & attributions, const std::list<GisViewportLogo> & logos);
+
 	private:
 		void draw_attributions(GisViewport & gisview);
 
@@ -37,6 +37,8 @@
 #include <QDebug>
 #include <QPainter>
 #include <QMimeData>
+#include <QCoreApplication>
+#include <QThread>
 
 
 
@@ -46,6 +48,7 @@
 #include "viewport_internal.h"
 #include "viewport_zoom.h"
 #include "window.h"
+#include "frame_scheduler.h"
 #include "coords.h"
 #include "layer_dem_dem_cache.h"
 #include "layer_map_tile.h"
@@ -77,6 +80,9 @@ using namespace SlavGPS;
 /* TODO_LATER: Form of this expression should be optimized for usage in denominator. */
 #define REVERSE_MERCATOR_FACTOR(_mpp_) ((65536.0 / 180 / (_mpp_)) * 256.0)
 
+/* How often drawing of layers checks for user input. */
+#define RENDER_INPUT_CHECK_INTERVAL 5 /* [milliseconds] */
+
 #define VIK_SETTINGS_VIEW_LAST_LATITUDE     "viewport_last_latitude"
 #define VIK_SETTINGS_VIEW_LAST_LONGITUDE    "viewport_last_longitude"
 #define VIK_SETTINGS_VIEW_LAST_ZOOM_X       "viewport_last_zoom_xpp"
@@ -999,6 +1005,42 @@ sg_ret GisViewport::move_screen_pos_to_center(const ScreenPos & pos)
 
 
 
+sg_ret GisViewport::get_center_shift(const Coord & old_center, double & shift_x, double & shift_y) const
+{
+	switch (this->draw_mode) {
+	case GisViewportDrawMode::LatLon:
+	case GisViewportDrawMode::Mercator:
+		break;
+	case GisViewportDrawMode::UTM:
+		/* Contents of viewport are drawn differently in different zones. */
+		if (!UTM::is_the_same_zone(old_center.get_utm(), this->center_coord.get_utm())) {
+			return sg_ret::err;
+		}
+		break;
+	default:
+		/* Expedia: a move of center is not a simple move of contents. */
+		return sg_ret::err;
+	}
+
+	ScreenPos old_center_pos;
+	ScreenPos new_center_pos;
+	if (sg_ret::ok != this->coord_to_screen_pos(old_center, old_center_pos)
+	    || sg_ret::ok != this->coord_to_screen_pos(this->center_coord, new_center_pos)) {
+		return sg_ret::err;
+	}
+
+	shift_x = old_center_pos.x() - new_center_pos.x();
+	shift_y = old_center_pos.y() - new_center_pos.y();
+	if (std::isnan(shift_x) || std::isnan(shift_y)) {
+		return sg_ret::err;
+	}
+
+	return sg_ret::ok;
+}
+
+
+
+
 /**
    @reviewed-on tbd
 */
@@ -1415,6 +1457,143 @@ sg_ret GisViewport::coord_to_screen_pos(const Coord & coord_in, ScreenPos & resu
 
 
 
+sg_ret GisViewport::coords_to_screen_pos(const std::vector<const Coord *> & coords, std::vector<ScreenPos> & positions) const
+{
+	const size_t count = coords.size();
+	positions.resize(count);
+	if (0 == count) {
+		return sg_ret::ok;
+	}
+
+	const double xmpp = this->viking_scale.x;
+	const double ympp = this->viking_scale.y;
+	const fpixel x_center_pixel = this->central_get_x_center_pixel();
+	const fpixel y_center_pixel = this->central_get_y_center_pixel();
+
+	/* Components of coordinates (longitude/latitude or
+	   easting/northing) are copied to separate arrays, so that
+	   loops below work on contiguous arrays of numbers. */
+	std::vector<double> & in_x = this->projection_buffers.in_x;
+	std::vector<double> & in_y = this->projection_buffers.in_y;
+	std::vector<fpixel> & out_x = this->projection_buffers.out_x;
+	std::vector<fpixel> & out_y = this->projection_buffers.out_y;
+	in_x.resize(count);
+	in_y.resize(count);
+	out_x.resize(count);
+	out_y.resize(count);
+	/* Coordinates that can't be converted in the loops below. */
+	std::vector<size_t> & irregular = this->projection_buffers.irregular;
+	irregular.clear();
+
+	switch (this->coord_mode) {
+	case CoordMode::UTM:
+		{
+			std::vector<double> & zone_shift = this->projection_buffers.zone_shift;
+			zone_shift.assign(count, 0.0);
+			const double center_easting = this->center_coord.utm.get_easting();
+			const double center_northing = this->center_coord.utm.get_northing();
+
+			for (size_t i = 0; i < count; i++) {
+				const Coord * coord = coords[i];
+				if (!coord->is_valid() || coord->get_coord_mode() != CoordMode::UTM) {
+					irregular.push_back(i);
+					continue;
+				}
+				in_x[i] = coord->utm.get_easting();
+				in_y[i] = coord->utm.get_northing();
+
+				const int zone_diff = UTMZone::bound_zone_diff(this->center_coord.utm.zone(), coord->utm.zone());
+				if (0 != zone_diff) {
+					if (this->m_is_one_utm_zone) {
+						irregular.push_back(i);
+						continue;
+					}
+					zone_shift[i] = zone_diff * this->m_utm_zone_width;
+				}
+			}
+
+			for (size_t i = 0; i < count; i++) {
+				out_x[i] = x_center_pixel + (in_x[i] - center_easting - zone_shift[i]) / xmpp;
+				out_y[i] = y_center_pixel - (in_y[i] - center_northing) / ympp;
+			}
+		}
+		break;
+
+	case CoordMode::LatLon:
+		{
+			for (size_t i = 0; i < count; i++) {
+				const Coord * coord = coords[i];
+				if (!coord->is_valid() || coord->get_coord_mode() != CoordMode::LatLon) {
+					irregular.push_back(i);
+					continue;
+				}
+				in_x[i] = coord->lat_lon.lon.unbound_value();
+				in_y[i] = coord->lat_lon.lat.value();
+			}
+
+			const double center_lon = this->center_coord.lat_lon.lon.unbound_value();
+			const double center_lat = this->center_coord.lat_lon.lat.value();
+			const double x_factor = MERCATOR_FACTOR(xmpp);
+			const double y_factor = MERCATOR_FACTOR(ympp);
+
+			switch (this->draw_mode) {
+			case GisViewportDrawMode::LatLon:
+				for (size_t i = 0; i < count; i++) {
+					out_x[i] = x_center_pixel + x_factor * (in_x[i] - center_lon);
+					out_y[i] = y_center_pixel + y_factor * (center_lat - in_y[i]);
+				}
+				break;
+			case GisViewportDrawMode::Mercator:
+				{
+					const double center_merclat = MERCLAT(center_lat);
+					for (size_t i = 0; i < count; i++) {
+						out_x[i] = x_center_pixel + x_factor * (in_x[i] - center_lon);
+						out_y[i] = y_center_pixel + y_factor * (center_merclat - MERCLAT(in_y[i]));
+					}
+				}
+				break;
+			case GisViewportDrawMode::Expedia:
+				/* No shortcuts for this mode. */
+				for (size_t i = 0; i < count; i++) {
+					if (coords[i]->is_valid() && coords[i]->get_coord_mode() == CoordMode::LatLon) {
+						Expedia::lat_lon_to_screen_pos(&out_x[i], &out_y[i], this->center_coord.lat_lon, coords[i]->lat_lon, xmpp * ALTI_TO_MPP, ympp * ALTI_TO_MPP, x_center_pixel, y_center_pixel);
+					}
+				}
+				break;
+			default:
+				qDebug() << SG_PREFIX_E << "Unexpected viewport drawing mode" << this->draw_mode;
+				return sg_ret::err;
+			}
+		}
+		break;
+
+	default:
+		qDebug() << SG_PREFIX_E << "Unexpected viewport coord mode" << this->coord_mode;
+		return sg_ret::err;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		positions[i].rx() = out_x[i];
+		positions[i].ry() = out_y[i];
+	}
+
+	/* Coordinates in unexpected coord mode or outside of
+	   current UTM zone are handled by regular function. */
+	sg_ret result = sg_ret::ok;
+	for (size_t i : irregular) {
+		if (sg_ret::ok != this->coord_to_screen_pos(*coords[i], positions[i])) {
+			positions[i].rx() = NAN;
+			positions[i].ry() = NAN;
+			result = sg_ret::err;
+		}
+	}
+
+	return result;
+}
+
+
+
+
 /**
    @reviewed-on tbd
 */
@@ -1563,6 +1742,13 @@ LatLonBBox GisViewport::get_bbox(int margin_left, int margin_right, int margin_t
 	   bbox, and that get() methods used here return values in
 	   Qt's coordinate system where beginning of the coordinate
 	   system is in upper-left corner.  */
+	if (!this->bbox_area.isEmpty()) {
+		margin_left   += std::max(0, this->bbox_area.left() - this->central_get_leftmost_pixel());
+		margin_right  += std::max(0, this->central_get_rightmost_pixel() - this->bbox_area.right());
+		margin_top    += std::max(0, this->bbox_area.top() - this->central_get_topmost_pixel());
+		margin_bottom += std::max(0, this->central_get_bottommost_pixel() - this->bbox_area.bottom());
+	}
+
 	Coord coord_ul = this->screen_pos_to_coord(ScreenPos(this->central_get_leftmost_pixel() + margin_left,   this->central_get_topmost_pixel() + margin_top));
 	Coord coord_ur = this->screen_pos_to_coord(ScreenPos(this->central_get_rightmost_pixel() - margin_right, this->central_get_topmost_pixel() + margin_top));
 	Coord coord_bl = this->screen_pos_to_coord(ScreenPos(this->central_get_leftmost_pixel() + margin_left,   this->central_get_bottommost_pixel() - margin_bottom));
@@ -1599,6 +1785,25 @@ LatLonBBox GisViewport::get_bbox(int margin_left, int margin_right, int margin_t
 
 
 
+void GisViewport::set_bbox_area(const QRect & rect)
+{
+	if (rect.isEmpty()) {
+		this->bbox_area = QRect();
+		return;
+	}
+
+	/* Area must have at least one pixel in central part of
+	   viewport, so it is clamped to that part. */
+	const int left   = std::min(std::max(rect.left(),   this->central_get_leftmost_pixel()), this->central_get_rightmost_pixel());
+	const int right  = std::min(std::max(rect.right(),  this->central_get_leftmost_pixel()), this->central_get_rightmost_pixel());
+	const int top    = std::min(std::max(rect.top(),    this->central_get_topmost_pixel()), this->central_get_bottommost_pixel());
+	const int bottom = std::min(std::max(rect.bottom(), this->central_get_topmost_pixel()), this->central_get_bottommost_pixel());
+	this->bbox_area = QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+
+
+
 sg_ret GisViewport::get_valid_central_rect(int & topmost, int & bottommost, int & leftmost, int & rightmost)
 {
 	/*
@@ -2158,6 +2363,75 @@ void GisViewport::request_redraw(const QString & trigger_descr)
 
 
 
+void GisViewport::set_layers_cache_usage(bool new_state)
+{
+	this->layers_cache_usage = new_state;
+}
+
+
+
+
+GisViewportLayersCache * GisViewport::get_layers_cache(void)
+{
+	return this->layers_cache_usage ? &this->layers_cache : nullptr;
+}
+
+
+
+
+void GisViewport::invalidate_layers_cache(void)
+{
+	this->layers_cache.invalidate();
+}
+
+
+
+
+void GisViewport::set_render_token(const RenderCancellationToken & token)
+{
+	this->render_token = token;
+}
+
+
+
+
+const RenderCancellationToken & GisViewport::get_render_token(void) const
+{
+	return this->render_token;
+}
+
+
+
+
+bool GisViewport::render_is_cancelled(void) const
+{
+	if (this->render_token.is_cancelled()) {
+		return true;
+	}
+
+	/* If drawing takes too long and the user has done
+	   something since beginning of the frame, give up the
+	   frame. Copies of viewport used by worker threads see
+	   the cancellation through shared state of token. */
+	if (QThread::currentThread() != QCoreApplication::instance()->thread()) {
+		return false;
+	}
+	if (!this->render_token.input_check_is_due(RENDER_INPUT_CHECK_INTERVAL)) {
+		return false;
+	}
+	if (UserInputCounter::get_count() != this->render_token.get_input_count()) {
+		qDebug() << SG_PREFIX_I << "Cancelling drawing of frame because of user input";
+		RenderCancellationToken token = this->render_token;
+		token.cancel();
+		return true;
+	}
+
+	return false;
+}
+
+
+
+
 /**
    @reviewed-on tbd
 
@@ -25,12 +25,14 @@
 
 
 #include <list>
+#include <vector>
 #include <cstdint>
 
 
 
 
 #include <QPen>
+#include <QRect>
 #include <QWidget>
 #include <QWheelEvent>
 #include <QMouseEvent>
@@ -41,6 +43,7 @@
 
 #include "viewport.h"
 #include "viewport_decorations.h"
+#include "viewport_layers_cache.h"
 #include "viewport_zoom.h"
 #include "viewport_pixmap.h"
 #include "coord.h"
@@ -82,6 +85,7 @@ namespace SlavGPS {
 		Q_OBJECT
 
 		friend class GisViewportDecorations;
+		friend class GisViewportLayersCache;
 	public:
 
 		/* ******** Methods that definitely should be in this class. ******** */
@@ -119,6 +123,12 @@ namespace SlavGPS {
 		/* Positive value of a margin mean that we want to shrink bbox from specified side. */
 		LatLonBBox get_bbox(int margin_left = 0, int margin_right = 0, int margin_top = 0, int margin_bottom = 0) const;
 
+		/* Shrink bbox returned by get_bbox() to given
+		   rectangle (in pixels), so that layers drawn only
+		   in a part of viewport don't look at their items
+		   outside of it. Empty rectangle means whole viewport. */
+		void set_bbox_area(const QRect & rect);
+
 		/**
 		   Get rectangle, inside which all x/y points can be
 		   converted into valid LatLon or UTM coordinates
@@ -154,6 +164,20 @@ namespace SlavGPS {
 		sg_ret coord_to_screen_pos(const Coord & coord, fpixel * x, fpixel * y) const;
 		sg_ret coord_to_screen_pos(const Coord & coord, ScreenPos & pos) const;
 
+		/**
+		   @brief Convert many coordinates to screen positions in one call
+
+		   Gives the same results as calling
+		   coord_to_screen_pos() for each coordinate, but
+		   checks of viewport's coord mode and draw mode are
+		   done only once per call, and conversion itself is
+		   done in tight loops over arrays of numbers.
+
+		   Positions of coordinates that can't be converted are
+		   set to NaN, and sg_ret::err is returned.
+		*/
+		sg_ret coords_to_screen_pos(const std::vector<const Coord *> & coords, std::vector<ScreenPos> & positions) const;
+
 
 
 		sg_ret set_viking_scale(double new_value);
@@ -233,6 +257,18 @@ namespace SlavGPS {
 		*/
 		sg_ret move_screen_pos_to_center(const ScreenPos & pos);
 
+		/**
+		   @brief Calculate by how many pixels contents of
+		   viewport, drawn when center of viewport was at
+		   @param old_center, should be moved so that they
+		   match current center of viewport
+
+		   Fails if change of center can't be represented as a
+		   move of contents, e.g. in Expedia draw mode or when
+		   UTM zone of center has changed.
+		*/
+		sg_ret get_center_shift(const Coord & old_center, double & shift_x, double & shift_y) const;
+
 
 		/* These methods belong to GisViewport because only
 		   this class knows something about distances in
@@ -294,6 +330,25 @@ namespace SlavGPS {
 		void request_redraw(const QString & trigger_descr);
 
 
+		/* Cache of images of layers. Only main viewport of
+		   a window uses it, copies of viewports don't.
+		   Turning the cache off only bypasses it, images of
+		   layers are kept for the time the cache is used
+		   again. */
+		void set_layers_cache_usage(bool new_state);
+		GisViewportLayersCache * get_layers_cache(void);
+		void invalidate_layers_cache(void);
+
+
+		/* Token of frame that is being drawn in viewport.
+		   Layers that take long to draw should check
+		   render_is_cancelled() and stop drawing when a
+		   newer frame has been requested. */
+		void set_render_token(const RenderCancellationToken & token);
+		const RenderCancellationToken & get_render_token(void) const;
+		bool render_is_cancelled(void) const;
+
+
 		/* Trigger stuff. */
 		void set_trigger(Layer * trigger);
 		Layer * get_trigger(void) const;
@@ -384,6 +439,27 @@ namespace SlavGPS {
 
 		GisViewportDecorations decorations;
 
+		GisViewportLayersCache layers_cache;
+		bool layers_cache_usage = false;
+
+		QRect bbox_area;
+
+		RenderCancellationToken render_token;
+
+		/* Arrays used by coords_to_screen_pos(), kept between
+		   calls so that they aren't allocated for every track
+		   drawn in a frame. */
+		class ProjectionBuffers {
+		public:
+			std::vector<double> in_x;
+			std::vector<double> in_y;
+			std::vector<double> zone_shift;
+			std::vector<fpixel> out_x;
+			std::vector<fpixel> out_y;
+			std::vector<size_t> irregular;
+		};
+		mutable ProjectionBuffers projection_buffers;
+
 
 		/* ******** Other class variables. ******** */
 
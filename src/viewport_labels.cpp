@@ -0,0 +1,242 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <algorithm>
+#include <cmath>
+
+
+
+
+#include <QDebug>
+#include <QFontMetricsF>
+
+
+
+
+#include "viewport_labels.h"
+#include "globals.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "Viewport Labels"
+
+/* Size of side of a cell of collision grid. */
+#define LABEL_GRID_CELL_SIZE 64 /* [pixels] */
+
+/* Capacity of cache of laid out texts. */
+#define LABEL_CACHE_CAPACITY 2 /* [megabytes] */
+
+/* Estimate of memory used by laid out text, in addition to memory used by its characters. */
+#define LABEL_CACHE_ITEM_OVERHEAD 256 /* [bytes] */
+
+
+
+
+CachedStaticText::CachedStaticText(const QStaticText & new_static_text)
+{
+	this->static_text = new_static_text;
+	this->size_bytes = LABEL_CACHE_ITEM_OVERHEAD + new_static_text.text().size() * sizeof (QChar);
+}
+
+
+
+
+void LabelLayoutCache::set_font(const QString & new_family, int new_point_size)
+{
+	if (new_family == this->family && new_point_size == this->point_size) {
+		return;
+	}
+
+	this->family = new_family;
+	this->point_size = new_point_size;
+	this->font = QFont(new_family, new_point_size);
+	this->ascent = QFontMetricsF(this->font).ascent();
+	this->texts.clear();
+	this->texts.set_capacity_megabytes(LABEL_CACHE_CAPACITY);
+}
+
+
+
+
+QStaticText LabelLayoutCache::get_text(const QString & text)
+{
+	const CachedStaticText * cached_text = this->texts.get(text);
+	if (cached_text) {
+		return cached_text->static_text;
+	}
+
+	QStaticText static_text(text);
+	static_text.setTextFormat(Qt::PlainText);
+	static_text.setPerformanceHint(QStaticText::AggressiveCaching);
+	static_text.prepare(QTransform(), this->font);
+
+	this->texts.add(text, CachedStaticText(static_text));
+
+	return static_text;
+}
+
+
+
+
+void LabelCollisionGrid::reset(int width, int height)
+{
+	this->n_cols = std::max(1, (width + LABEL_GRID_CELL_SIZE - 1) / LABEL_GRID_CELL_SIZE);
+	this->n_rows = std::max(1, (height + LABEL_GRID_CELL_SIZE - 1) / LABEL_GRID_CELL_SIZE);
+
+	/* Keep memory allocated by cells for next frames. */
+	this->cells.resize(this->n_cols * this->n_rows);
+	for (auto iter = this->cells.begin(); iter != this->cells.end(); iter++) {
+		iter->clear();
+	}
+}
+
+
+
+
+bool LabelCollisionGrid::get_cells(const QRectF & rect, int & first_col, int & last_col, int & first_row, int & last_row) const
+{
+	first_col = std::max(0, (int) floor(rect.left() / LABEL_GRID_CELL_SIZE));
+	last_col = std::min(this->n_cols - 1, (int) floor(rect.right() / LABEL_GRID_CELL_SIZE));
+	first_row = std::max(0, (int) floor(rect.top() / LABEL_GRID_CELL_SIZE));
+	last_row = std::min(this->n_rows - 1, (int) floor(rect.bottom() / LABEL_GRID_CELL_SIZE));
+
+	return first_col <= last_col && first_row <= last_row;
+}
+
+
+
+
+bool LabelCollisionGrid::try_place(const QRectF & rect)
+{
+	int first_col, last_col, first_row, last_row;
+	if (!this->get_cells(rect, first_col, last_col, first_row, last_row)) {
+		/* Label would not be visible anyway. */
+		return false;
+	}
+
+	for (int row = first_row; row <= last_row; row++) {
+		for (int col = first_col; col <= last_col; col++) {
+			const std::vector<QRectF> & cell = this->cells[row * this->n_cols + col];
+			for (const QRectF & other : cell) {
+				if (other.intersects(rect)) {
+					return false;
+				}
+			}
+		}
+	}
+
+	this->place(rect);
+	return true;
+}
+
+
+
+
+void LabelCollisionGrid::place(const QRectF & rect)
+{
+	int first_col, last_col, first_row, last_row;
+	if (!this->get_cells(rect, first_col, last_col, first_row, last_row)) {
+		return;
+	}
+
+	for (int row = first_row; row <= last_row; row++) {
+		for (int col = first_col; col <= last_col; col++) {
+			this->cells[row * this->n_cols + col].push_back(rect);
+		}
+	}
+}
+
+
+
+
+void ViewportLabels::begin(int width, int height)
+{
+	this->labels.clear();
+	this->grid.reset(width, height);
+	this->collecting = true;
+}
+
+
+
+
+void ViewportLabels::end(QPainter & painter)
+{
+	this->collecting = false;
+
+	/* Stable sort: labels with the same priority are placed in order in which they were added. */
+	std::stable_sort(this->labels.begin(), this->labels.end(), [](const Label & a, const Label & b) { return a.priority > b.priority; });
+
+	int n_culled = 0;
+	for (const Label & label : this->labels) {
+		if (LabelPriority::Always == label.priority) {
+			this->grid.place(label.rect);
+		} else if (!this->grid.try_place(label.rect)) {
+			n_culled++;
+			continue;
+		}
+		ViewportLabels::draw_label(painter, label);
+	}
+
+	if (n_culled) {
+		qDebug() << SG_PREFIX_D << "Culled" << n_culled << "of" << this->labels.size() << "labels";
+	}
+	this->labels.clear();
+}
+
+
+
+
+void ViewportLabels::add(QPainter & painter, LabelLayoutCache & layout_cache, const QString & text, const QPointF & top_left, const QPen & pen, const QColor & bg_color, LabelPriority priority)
+{
+	Label label;
+	label.static_text = layout_cache.get_text(text);
+	label.font = layout_cache.get_font();
+	label.rect = QRectF(top_left, label.static_text.size());
+	label.pen = pen;
+	label.bg_color = bg_color;
+	label.priority = priority;
+
+	if (this->collecting) {
+		this->labels.push_back(label);
+	} else {
+		ViewportLabels::draw_label(painter, label);
+	}
+}
+
+
+
+
+void ViewportLabels::draw_label(QPainter & painter, const Label & label)
+{
+	if (label.bg_color.isValid()) {
+		painter.fillRect(label.rect, label.bg_color);
+	}
+
+	painter.setPen(label.pen);
+	painter.setFont(label.font);
+	painter.drawStaticText(label.rect.topLeft(), label.static_text);
+}
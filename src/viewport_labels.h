@@ -0,0 +1,180 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_VIEWPORT_LABELS_H_
+#define _SG_VIEWPORT_LABELS_H_
+
+
+
+
+#include <vector>
+
+
+
+
+#include <QFont>
+#include <QPainter>
+#include <QPen>
+#include <QRectF>
+#include <QStaticText>
+#include <QString>
+
+
+
+
+#include "mem_cache.h"
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	/* Text of label laid out with given font. */
+	class CachedStaticText {
+	public:
+		CachedStaticText(const QStaticText & static_text);
+		size_t get_size_bytes(void) const { return this->size_bytes; }
+
+		QStaticText static_text;
+	private:
+		size_t size_bytes = 0;
+	};
+
+
+
+
+	/**
+	   @brief Texts of labels laid out with one font
+
+	   Laying out of text is expensive, and the same texts
+	   (e.g. names of waypoints) are drawn again on each redraw
+	   of viewport. Color of text doesn't affect its layout, so
+	   it's not a part of key of the cache.
+	*/
+	class LabelLayoutCache {
+	public:
+		/* Cached texts are forgotten when the font changes. */
+		void set_font(const QString & family, int point_size);
+		const QFont & get_font(void) const { return this->font; }
+
+		/* Distance from top of text to its baseline. */
+		qreal get_ascent(void) const { return this->ascent; }
+
+		QStaticText get_text(const QString & text);
+
+		const MemCacheCounters & get_counters(void) const { return this->texts.get_counters(); }
+
+	private:
+		QString family;
+		int point_size = 0;
+		QFont font;
+		qreal ascent = 0.0;
+
+		MemCache<CachedStaticText> texts;
+	};
+
+
+
+
+	/**
+	   @brief Grid of rectangles of labels already placed in viewport
+
+	   Viewport is divided into square cells, and each
+	   rectangle is recorded in all cells that it overlaps, so
+	   a new rectangle is compared only with rectangles from
+	   nearby cells.
+	*/
+	class LabelCollisionGrid {
+	public:
+		void reset(int width, int height);
+
+		/* Place @param rect in grid, unless it overlaps a rectangle already placed.
+		   Returns false if the rectangle hasn't been placed. */
+		bool try_place(const QRectF & rect);
+		void place(const QRectF & rect);
+
+	private:
+		/* Get range of cells overlapped by @param rect. Returns false if the rect is outside of grid. */
+		bool get_cells(const QRectF & rect, int & first_col, int & last_col, int & first_row, int & last_row) const;
+
+		int n_cols = 0;
+		int n_rows = 0;
+		std::vector<std::vector<QRectF>> cells;
+	};
+
+
+
+
+	enum class LabelPriority {
+		Low = 0,   /* E.g. distance marks along track. */
+		Normal,    /* E.g. names of waypoints. */
+		High,      /* E.g. names of tracks. */
+		Always     /* Labels of highlighted items are never culled. */
+	};
+
+
+
+
+	/**
+	   @brief Labels drawn in viewport, with culling of overlapping labels
+
+	   Between begin() and end() labels are only collected. In
+	   end() they are placed in order of their priority: a label
+	   that overlaps a label with higher (or the same) priority
+	   is not drawn. Outside of begin()/end() labels are drawn
+	   immediately.
+	*/
+	class ViewportLabels {
+	public:
+		void begin(int width, int height);
+		void end(QPainter & painter);
+
+		/* Add label with top-left corner of its text at @param top_left.
+		   @param bg_color is used only if it is valid. */
+		void add(QPainter & painter, LabelLayoutCache & layout_cache, const QString & text, const QPointF & top_left, const QPen & pen, const QColor & bg_color, LabelPriority priority);
+
+	private:
+		class Label {
+		public:
+			QStaticText static_text;
+			QFont font;
+			QRectF rect;
+			QPen pen;
+			QColor bg_color;
+			LabelPriority priority;
+		};
+
+		static void draw_label(QPainter & painter, const Label & label);
+
+		bool collecting = false;
+		std::vector<Label> labels;
+		LabelCollisionGrid grid;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_VIEWPORT_LABELS_H_ */
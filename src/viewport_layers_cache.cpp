@@ -0,0 +1,509 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+
+
+
+#include <QDebug>
+#include <QPainter>
+#include <QRunnable>
+#include <QSemaphore>
+
+
+
+
+#include "viewport_layers_cache.h"
+#include "viewport_internal.h"
+#include "layer.h"
+#include "tree_view.h"
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+#define SG_MODULE "Viewport Layers Cache"
+
+/* Rounding of offsets of moved images accumulates, so after
+   some moves the image is drawn again from scratch. */
+#define LAYERS_CACHE_MAX_PAN_ERROR 1.0 /* [pixels] */
+
+
+
+
+extern SelectedTreeItems g_selected;
+
+
+
+
+namespace SlavGPS {
+	/* Draws one layer into its image in worker thread. */
+	class LayerDrawWorker : public QRunnable {
+	public:
+		LayerDrawWorker(Layer * new_layer, GisViewport * new_gisview, bool new_highlight_selected, bool new_parent_is_selected, QSemaphore & new_done)
+			: layer(new_layer), gisview(new_gisview), highlight_selected(new_highlight_selected), parent_is_selected(new_parent_is_selected), done(new_done) {};
+
+		void run(void) override;
+
+	private:
+		Layer * layer = nullptr;
+		GisViewport * gisview = nullptr;
+		bool highlight_selected = false;
+		bool parent_is_selected = false;
+		QSemaphore & done;
+	};
+}
+
+
+
+
+void LayerDrawWorker::run(void)
+{
+	this->layer->draw_tree_item(this->gisview, this->highlight_selected, this->parent_is_selected);
+	this->done.release();
+}
+
+
+
+
+GisViewportLayersCache::~GisViewportLayersCache()
+{
+	this->thread_pool.waitForDone();
+	for (auto iter = this->worker_gisviews.begin(); iter != this->worker_gisviews.end(); iter++) {
+		delete *iter;
+	}
+}
+
+
+
+
+void GisViewportLayersCache::begin_frame(void)
+{
+	for (auto iter = this->entries.begin(); iter != this->entries.end(); iter++) {
+		iter->second.used = false;
+	}
+}
+
+
+
+
+void GisViewportLayersCache::end_frame(void)
+{
+	/* Forget images of layers that have been deleted or hidden. */
+	for (auto iter = this->entries.begin(); iter != this->entries.end();) {
+		if (!iter->second.used) {
+			iter = this->entries.erase(iter);
+		} else {
+			iter++;
+		}
+	}
+}
+
+
+
+
+void GisViewportLayersCache::invalidate(void)
+{
+	qDebug() << SG_PREFIX_I << "Invalidating images of" << this->entries.size() << "layers";
+	this->entries.clear();
+}
+
+
+
+
+void GisViewportLayersCache::draw_layer(Layer * layer, GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	if (!layer->is_visible()) {
+		/* Don't keep a full-size image for nothing. */
+		layer->draw_tree_item(gisview, highlight_selected, parent_is_selected);
+		return;
+	}
+
+	DrawTask task;
+	task.layer = layer;
+	this->prepare_task(task, gisview, highlight_selected, parent_is_selected);
+	if (task.needs_drawing) {
+		this->draw_into_image(layer, gisview, highlight_selected, parent_is_selected, task.image, task.region, *task.entry);
+	}
+
+	if (!this->finish_task(task, gisview, highlight_selected, parent_is_selected)) {
+		return;
+	}
+	this->composite(*task.entry, gisview);
+}
+
+
+
+
+void GisViewportLayersCache::draw_layers(const std::vector<Layer *> & layers, GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	std::vector<DrawTask> tasks(layers.size());
+	for (size_t i = 0; i < layers.size(); i++) {
+		tasks[i].layer = layers[i];
+		if (layers[i]->is_visible()) {
+			this->prepare_task(tasks[i], gisview, highlight_selected, parent_is_selected);
+		}
+	}
+
+	/* Start workers. Each of them draws one layer into the
+	   layer's image, through a copy of viewport. */
+	QSemaphore workers_done;
+	int n_workers = 0;
+	for (DrawTask & task : tasks) {
+		if (!task.needs_drawing || !task.layer->supports_parallel_drawing()) {
+			continue;
+		}
+
+		GisViewport * worker_gisview = this->get_worker_gisview(gisview, n_workers);
+		if (nullptr == worker_gisview) {
+			continue;
+		}
+		task.worker_gisview = worker_gisview;
+
+		worker_gisview->set_render_token(gisview->get_render_token());
+		worker_gisview->decorations.set_attributions_and_logos(QStringList(), std::list<GisViewportLogo>());
+		worker_gisview->begin_redirect(task.image);
+		if (!task.region.isEmpty()) {
+			worker_gisview->get_painter().setClipRegion(task.region);
+		}
+
+		task.layer->prepare_parallel_drawing();
+		this->thread_pool.start(new LayerDrawWorker(task.layer, worker_gisview, highlight_selected, parent_is_selected, workers_done));
+		n_workers++;
+	}
+	qDebug() << SG_PREFIX_I << "Drawing" << n_workers << "of" << tasks.size() << "layers in worker threads";
+
+	/* Meanwhile draw remaining layers in main thread. */
+	for (DrawTask & task : tasks) {
+		if (task.needs_drawing && nullptr == task.worker_gisview) {
+			this->draw_into_image(task.layer, gisview, highlight_selected, parent_is_selected, task.image, task.region, *task.entry);
+		}
+	}
+
+	workers_done.acquire(n_workers);
+
+	for (DrawTask & task : tasks) {
+		if (nullptr == task.worker_gisview) {
+			continue;
+		}
+		task.worker_gisview->end_redirect();
+		task.worker_gisview->set_render_token(RenderCancellationToken());
+
+		QStringList attributions;
+		std::list<GisViewportLogo> logos;
+		task.worker_gisview->decorations.get_attributions_and_logos(attributions, logos);
+		this->store_decorations(*task.entry, attributions, logos, task.region.isEmpty());
+	}
+
+	/* Composite images in z-order. */
+	for (DrawTask & task : tasks) {
+		if (!task.layer->is_visible()) {
+			task.layer->draw_tree_item(gisview, highlight_selected, parent_is_selected);
+			continue;
+		}
+		if (!this->finish_task(task, gisview, highlight_selected, parent_is_selected)) {
+			continue;
+		}
+		this->composite(*task.entry, gisview);
+	}
+}
+
+
+
+
+void GisViewportLayersCache::prepare_task(DrawTask & task, GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	Layer * layer = task.layer;
+
+	Entry & entry = this->entries[layer->get_uid()];
+	entry.used = true;
+	task.entry = &entry;
+
+	task.content_version = layer->get_content_version();
+	task.selected_uids = g_selected.get_related_uids(layer);
+
+	const bool same_contents = !entry.image.isNull()
+		&& entry.content_version == task.content_version
+		&& entry.selected_uids == task.selected_uids
+		&& entry.highlight_selected == highlight_selected
+		&& entry.parent_is_selected == parent_is_selected;
+
+	int dx = 0;
+	int dy = 0;
+
+	if (same_contents && this->has_same_geometry(entry, gisview)) {
+		qDebug() << SG_PREFIX_D << "Reusing image of layer" << layer->get_name();
+		task.needs_drawing = false;
+
+	} else if (same_contents && this->get_pan_offset(entry, gisview, dx, dy, task.pan_error)) {
+		qDebug() << SG_PREFIX_D << "Moving image of layer" << layer->get_name() << "by" << dx << dy;
+
+		task.image = QImage(entry.image.size(), QImage::Format_ARGB32_Premultiplied);
+		task.image.fill(Qt::transparent);
+		{
+			QPainter painter(&task.image);
+			painter.setCompositionMode(QPainter::CompositionMode_Source);
+			painter.drawImage(dx, dy, entry.image);
+		}
+
+		task.region = QRegion(task.image.rect()).subtracted(QRegion(task.image.rect().translated(dx, dy)));
+		task.needs_drawing = true;
+
+	} else {
+		qDebug() << SG_PREFIX_D << "Drawing image of layer" << layer->get_name();
+
+		task.image = QImage(gisview->total_get_width(), gisview->total_get_height(), QImage::Format_ARGB32_Premultiplied);
+		task.image.fill(Qt::transparent);
+		task.region = QRegion();
+		task.pan_error = 0.0;
+		task.needs_drawing = true;
+	}
+}
+
+
+
+
+bool GisViewportLayersCache::finish_task(DrawTask & task, const GisViewport * gisview, bool highlight_selected, bool parent_is_selected)
+{
+	if (!task.needs_drawing) {
+		return true;
+	}
+
+	/* Don't check for user input here: image of layer that
+	   has been drawn to the end is complete. */
+	Entry & entry = *task.entry;
+	if (gisview->get_render_token().is_cancelled()) {
+		this->forget_incomplete_image(task.layer, entry);
+		return false;
+	}
+
+	entry.image = task.image;
+	entry.content_version = task.content_version;
+	entry.selected_uids = task.selected_uids;
+	entry.highlight_selected = highlight_selected;
+	entry.parent_is_selected = parent_is_selected;
+	entry.pan_error = task.pan_error;
+	this->save_geometry(entry, gisview);
+
+	return true;
+}
+
+
+
+
+void GisViewportLayersCache::composite(const Entry & entry, GisViewport * gisview) const
+{
+	gisview->get_painter().drawImage(0, 0, entry.image);
+
+	/* Viewport forgets attributions and logos before each redraw. */
+	for (auto iter = entry.attributions.rbegin(); iter != entry.attributions.rend(); iter++) {
+		gisview->add_attribution(*iter);
+	}
+	for (auto iter = entry.logos.begin(); iter != entry.logos.end(); iter++) {
+		gisview->add_logo(*iter);
+	}
+}
+
+
+
+
+void GisViewportLayersCache::draw_into_image(Layer * layer, GisViewport * gisview, bool highlight_selected, bool parent_is_selected, QImage & image, const QRegion & region, Entry & entry)
+{
+	/* Let the layer add its attributions and logos to empty lists. */
+	QStringList other_attributions;
+	std::list<GisViewportLogo> other_logos;
+	gisview->decorations.get_attributions_and_logos(other_attributions, other_logos);
+	gisview->decorations.set_attributions_and_logos(QStringList(), std::list<GisViewportLogo>());
+
+	this->drawing = true;
+	gisview->begin_redirect(image);
+	if (!region.isEmpty()) {
+		gisview->get_painter().setClipRegion(region);
+	}
+
+	layer->draw_tree_item(gisview, highlight_selected, parent_is_selected);
+
+	gisview->end_redirect();
+	this->drawing = false;
+
+	QStringList attributions;
+	std::list<GisViewportLogo> logos;
+	gisview->decorations.get_attributions_and_logos(attributions, logos);
+	gisview->decorations.set_attributions_and_logos(other_attributions, other_logos);
+
+	this->store_decorations(entry, attributions, logos, region.isEmpty());
+}
+
+
+
+
+void GisViewportLayersCache::store_decorations(Entry & entry, const QStringList & attributions, const std::list<GisViewportLogo> & logos, bool whole_image) const
+{
+	if (whole_image) {
+		entry.attributions = attributions;
+		entry.logos = logos;
+		return;
+	}
+
+	/* Part of image drawn before still shows old attributions and logos. */
+	for (auto iter = attributions.rbegin(); iter != attributions.rend(); iter++) {
+		if (!entry.attributions.contains(*iter)) {
+			entry.attributions.push_front(*iter);
+		}
+	}
+	for (auto iter = logos.begin(); iter != logos.end(); iter++) {
+		const QString & logo_id = iter->logo_id;
+		if (entry.logos.end() == std::find_if(entry.logos.begin(), entry.logos.end(), [&logo_id](const GisViewportLogo & logo) { return logo.logo_id == logo_id; })) {
+			entry.logos.push_back(*iter);
+		}
+	}
+}
+
+
+
+
+/**
+   Drawing of layer has been cancelled, so the layer's image
+   (and its attributions and logos) may be incomplete
+*/
+void GisViewportLayersCache::forget_incomplete_image(const Layer * layer, Entry & entry)
+{
+	qDebug() << SG_PREFIX_I << "Drawing of image of layer" << layer->get_name() << "has been cancelled";
+	entry.image = QImage();
+	entry.attributions.clear();
+	entry.logos.clear();
+}
+
+
+
+
+GisViewport * GisViewportLayersCache::get_worker_gisview(const GisViewport * gisview, size_t index)
+{
+	GisViewport * worker_gisview = index < this->worker_gisviews.size() ? this->worker_gisviews[index] : nullptr;
+
+	if (nullptr != worker_gisview
+	    && (worker_gisview->total_get_width() != gisview->total_get_width()
+		|| worker_gisview->total_get_height() != gisview->total_get_height())) {
+
+		delete worker_gisview;
+		worker_gisview = nullptr;
+		this->worker_gisviews[index] = nullptr;
+	}
+
+	if (nullptr == worker_gisview) {
+		/* Copies are widgets, so they are created here, in main thread. */
+		worker_gisview = gisview->copy(gisview->total_get_width(), gisview->total_get_height(), gisview->get_viking_scale());
+		if (nullptr == worker_gisview) {
+			qDebug() << SG_PREFIX_E << "Failed to create copy of viewport for worker thread";
+			return nullptr;
+		}
+		if (index < this->worker_gisviews.size()) {
+			this->worker_gisviews[index] = worker_gisview;
+		} else {
+			this->worker_gisviews.push_back(worker_gisview);
+		}
+	} else {
+		worker_gisview->set_draw_mode(gisview->get_draw_mode());
+		worker_gisview->set_coord_mode(gisview->get_coord_mode());
+		worker_gisview->set_center_coord(gisview->get_center_coord(), false);
+		worker_gisview->set_viking_scale(gisview->get_viking_scale());
+	}
+
+	worker_gisview->set_highlight_usage(gisview->get_highlight_usage());
+	worker_gisview->set_highlight_color(gisview->get_highlight_color());
+	worker_gisview->set_highlight_thickness(gisview->get_highlight_pen().width());
+
+	return worker_gisview;
+}
+
+
+
+
+bool GisViewportLayersCache::has_same_geometry(const Entry & entry, const GisViewport * gisview) const
+{
+	return entry.width == gisview->total_get_width()
+		&& entry.height == gisview->total_get_height()
+		&& entry.coord_mode == gisview->get_coord_mode()
+		&& entry.draw_mode == gisview->get_draw_mode()
+		&& entry.viking_scale == gisview->get_viking_scale()
+		&& entry.center == gisview->get_center_coord();
+}
+
+
+
+
+/**
+   Calculate by how many pixels an image of layer should be moved
+   so that it matches current center of viewport
+
+   Returns false if the image can't be reused by moving it.
+*/
+bool GisViewportLayersCache::get_pan_offset(const Entry & entry, const GisViewport * gisview, int & dx, int & dy, double & pan_error) const
+{
+	if (entry.width != gisview->total_get_width()
+	    || entry.height != gisview->total_get_height()
+	    || entry.coord_mode != gisview->get_coord_mode()
+	    || entry.draw_mode != gisview->get_draw_mode()
+	    || !(entry.viking_scale == gisview->get_viking_scale())) {
+		return false;
+	}
+
+	double offset_x = 0.0;
+	double offset_y = 0.0;
+	if (sg_ret::ok != gisview->get_center_shift(entry.center, offset_x, offset_y)) {
+		return false;
+	}
+
+	dx = (int) round(offset_x);
+	dy = (int) round(offset_y);
+
+	/* For large moves most of image would be drawn again anyway. */
+	if (std::abs(dx) > entry.width / 2 || std::abs(dy) > entry.height / 2) {
+		return false;
+	}
+
+	pan_error = entry.pan_error + sqrt((dx - offset_x) * (dx - offset_x) + (dy - offset_y) * (dy - offset_y));
+	if (pan_error > LAYERS_CACHE_MAX_PAN_ERROR) {
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+void GisViewportLayersCache::save_geometry(Entry & entry, const GisViewport * gisview) const
+{
+	entry.center = gisview->get_center_coord();
+	entry.viking_scale = gisview->get_viking_scale();
+	entry.width = gisview->total_get_width();
+	entry.height = gisview->total_get_height();
+	entry.coord_mode = gisview->get_coord_mode();
+	entry.draw_mode = gisview->get_draw_mode();
+}
@@ -0,0 +1,186 @@
+/*
+ * SlavGPS -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SG_VIEWPORT_LAYERS_CACHE_H_
+#define _SG_VIEWPORT_LAYERS_CACHE_H_
+
+
+
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+
+
+
+#include <QImage>
+#include <QRegion>
+#include <QStringList>
+#include <QThreadPool>
+
+
+
+
+#include "coord.h"
+#include "tree_item.h"
+#include "viewport.h"
+#include "viewport_zoom.h"
+
+
+
+
+namespace SlavGPS {
+
+
+
+
+	class GisViewport;
+	class Layer;
+
+
+
+
+	/**
+	   @brief Cache of images of layers drawn in viewport
+
+	   Each top-level layer is drawn into its own transparent
+	   image, and the images are composited into viewport's
+	   pixmap. An image is reused as long as geometry of
+	   viewport and contents of layer (see
+	   Layer::get_content_version()) don't change.
+
+	   If the only change of geometry is a small move of center
+	   of viewport, the image is moved by corresponding number
+	   of pixels, and the layer is drawn only in the exposed
+	   part of the image.
+
+	   Images of layers that support it (see
+	   Layer::supports_parallel_drawing()) can be drawn in
+	   worker threads. Each worker draws through its own copy
+	   of viewport, and images are composited in z-order in
+	   main thread.
+	*/
+	class GisViewportLayersCache {
+	public:
+		~GisViewportLayersCache();
+
+		/* Call these two before and after drawing all layers. */
+		void begin_frame(void);
+		void end_frame(void);
+
+		/* Draw the layer into viewport using the layer's cached
+		   image, updating the image first if necessary. */
+		void draw_layer(Layer * layer, GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+
+		/* Draw the layers (given in z-order) like
+		   draw_layer() does, but update images of some of
+		   them in worker threads, while images of other
+		   layers are updated in main thread. */
+		void draw_layers(const std::vector<Layer *> & layers, GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+
+		/* Forget all images, e.g. because something not tracked by the cache has changed. */
+		void invalidate(void);
+
+		/* Is cache in the middle of drawing a layer into an image? */
+		bool is_drawing(void) const { return this->drawing; }
+
+	private:
+		class Entry {
+		public:
+			QImage image;
+
+			/* Geometry of viewport. */
+			Coord center;
+			VikingScale viking_scale;
+			int width = 0;
+			int height = 0;
+			CoordMode coord_mode = CoordMode::Invalid;
+			GisViewportDrawMode draw_mode = GisViewportDrawMode::Invalid;
+
+			/* Things that affect contents of image. */
+			uint64_t content_version = 0;
+			std::vector<sg_uid_t> selected_uids;
+			bool highlight_selected = false;
+			bool parent_is_selected = false;
+
+			/* Attributions and logos added by the layer while it was drawn. */
+			QStringList attributions;
+			std::list<GisViewportLogo> logos;
+
+			/* Error introduced by rounding offsets of moves of image. */
+			double pan_error = 0.0;
+
+			bool used = false;
+		};
+
+		/* Work to be done to bring image of one layer up to date. */
+		class DrawTask {
+		public:
+			Layer * layer = nullptr;
+			Entry * entry = nullptr;
+
+			/* Image to draw into, and part of it that needs
+			   drawing (empty region means whole image). */
+			bool needs_drawing = false;
+			QImage image;
+			QRegion region;
+
+			double pan_error = 0.0;
+			uint64_t content_version = 0;
+			std::vector<sg_uid_t> selected_uids;
+
+			/* Copy of viewport used by worker thread. */
+			GisViewport * worker_gisview = nullptr;
+		};
+
+		void prepare_task(DrawTask & task, GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+		/* Returns false if drawing of image has been cancelled. */
+		bool finish_task(DrawTask & task, const GisViewport * gisview, bool highlight_selected, bool parent_is_selected);
+		void composite(const Entry & entry, GisViewport * gisview) const;
+
+		/* Get copy of @param gisview to be used by worker thread number @param index. */
+		GisViewport * get_worker_gisview(const GisViewport * gisview, size_t index);
+
+		bool has_same_geometry(const Entry & entry, const GisViewport * gisview) const;
+		bool get_pan_offset(const Entry & entry, const GisViewport * gisview, int & dx, int & dy, double & pan_error) const;
+		void save_geometry(Entry & entry, const GisViewport * gisview) const;
+
+		/* Draw layer into image. Non-empty @param region limits drawing to the region. */
+		void draw_into_image(Layer * layer, GisViewport * gisview, bool highlight_selected, bool parent_is_selected, QImage & image, const QRegion & region, Entry & entry);
+		void forget_incomplete_image(const Layer * layer, Entry & entry);
+		/* Remember attributions and logos added by layer drawn into whole image or into its part. */
+		void store_decorations(Entry & entry, const QStringList & attributions, const std::list<GisViewportLogo> & logos, bool whole_image) const;
+
+		std::unordered_map<sg_uid_t, Entry> entries;
+		bool drawing = false;
+
+		std::vector<GisViewport *> worker_gisviews;
+		QThreadPool thread_pool;
+	};
+
+
+
+
+} /* namespace SlavGPS */
+
+
+
+
+#endif /* #ifndef _SG_VIEWPORT_LAYERS_CACHE_H_ */
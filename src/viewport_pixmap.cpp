@@ -25,6 +25,12 @@
 
 
 
+#include <cmath>
+#include <cstdlib>
+
+
+
+
 #include "viewport_pixmap.h"
 #include "viewport_internal.h"
 #include "globals.h"
@@ -144,6 +150,44 @@ void ViewportPixmap::draw_line(const QPen & pen, fpixel begin_x, fpixel begin_y,
 
 
 
+void ViewportPixmap::draw_polyline(const QPen & pen, const QPolygonF & points)
+{
+	if (points.size() < 2) {
+		return;
+	}
+
+	const QRectF bounding_rect = points.boundingRect();
+	if (this->line_is_outside(bounding_rect.left(), bounding_rect.top(), bounding_rect.right(), bounding_rect.bottom())) {
+		return;
+	}
+
+	this->painter.setPen(pen);
+
+	if (bounding_rect.left() >= -32767 && bounding_rect.right() <= 32768
+	    && bounding_rect.top() >= -32767 && bounding_rect.bottom() <= 32768) {
+
+		this->painter.drawPolyline(points);
+		return;
+	}
+
+	/* Some points are too far from viewport to be passed to
+	   painter as they are. */
+	for (int i = 1; i < points.size(); i++) {
+		fpixel begin_x = points[i - 1].x();
+		fpixel begin_y = points[i - 1].y();
+		fpixel end_x = points[i].x();
+		fpixel end_y = points[i].y();
+		if (this->line_is_outside(begin_x, begin_y, end_x, end_y)) {
+			continue;
+		}
+		ViewportPixmap::clip_line(&begin_x, &begin_y, &end_x, &end_y);
+		this->painter.drawLine(begin_x, begin_y, end_x, end_y);
+	}
+}
+
+
+
+
 /**
    @reviewed-on 2019-07-19
 */
@@ -474,6 +518,7 @@ void ViewportPixmap::apply_total_sizes(int new_total_width, int new_total_height
 	qDebug() << SG_PREFIX_I << this->debug << "Will regenerate snapshot buffer with size" << this->total_width << this->total_height;
 	/* TODO_LATER trigger: only if this is enabled!!! */
 	this->vpixmap_snapshot = QPixmap(this->total_width, this->total_height); /* Reset snapshot buffer with new size */
+	this->vpixmap_layers = QPixmap();
 
 
 	qDebug() << SG_PREFIX_SIGNAL << this->debug << "Sending \"size changed\" signal";
@@ -1065,32 +1110,37 @@ void ViewportPixmap::set_pixmap(const QPixmap & new_pixmap)
 /**
    @reviewed-on tbd
 */
-void ViewportPixmap::pan_sync(__attribute__((unused)) int x_off, __attribute__((unused)) int y_off)
+sg_ret ViewportPixmap::pan_sync(int x_off, int y_off, QRegion & exposed)
 {
-	qDebug() << SG_PREFIX_I;
-#ifdef K_FIXME_RESTORE
-	int x, y, wid, hei;
+	if (this->vpixmap_layers.size() != this->vpixmap.size()) {
+		qDebug() << SG_PREFIX_I << "No layers snapshot for current size of pixmap";
+		return sg_ret::err;
+	}
+	if (std::abs(x_off) >= this->total_width || std::abs(y_off) >= this->total_height) {
+		/* Nothing of old contents would be visible. */
+		return sg_ret::err;
+	}
+
+	this->painter.end();
+	exposed = QRegion();
+	this->vpixmap_layers.scroll(x_off, y_off, this->vpixmap_layers.rect(), &exposed);
+	this->vpixmap = this->vpixmap_layers;
+	this->painter.begin(&this->vpixmap);
 
-	gdk_draw_drawable(gtk_widget_get_window(GTK_WIDGET(this)), gtk_widget_get_style(GTK_WIDGET(this))->bg_gc[0], GDK_DRAWABLE(this->pixmap), 0, 0, x_off, y_off, this->width, this->vpixmap.height);
+	this->painter.setClipRegion(exposed);
+	this->painter.eraseRect(0, 0, this->total_width, this->total_height);
+	this->painter.setClipping(false);
 
-	if (x_off >= 0) {
-		x = 0;
-		wid = x_off;
-	} else {
-		x = this->width + x_off;
-		wid = -x_off;
-	}
+	return sg_ret::ok;
+}
 
-	if (y_off >= 0) {
-		y = 0;
-		hei = y_off;
-	} else {
-		y = this->height + y_off;
-		hei = -y_off;
-	}
-	gtk_widget_queue_draw_area(GTK_WIDGET(this), x, 0, wid, this->height);
-	gtk_widget_queue_draw_area(GTK_WIDGET(this), 0, y, this->width, hei);
-#endif
+
+
+
+void ViewportPixmap::layers_snapshot_save(void)
+{
+	/* Painter is active on vpixmap, so this is a deep copy. */
+	this->vpixmap_layers = this->vpixmap;
 }
 
 
@@ -1195,6 +1245,24 @@ void ViewportPixmap::snapshot_restore(void)
 
 
 
+void ViewportPixmap::begin_redirect(QImage & image)
+{
+	this->painter.end();
+	this->painter.begin(&image);
+}
+
+
+
+
+void ViewportPixmap::end_redirect(void)
+{
+	this->painter.end();
+	this->painter.begin(&this->vpixmap);
+}
+
+
+
+
 /**
    @reviewed-on: 2019-07-21
 */
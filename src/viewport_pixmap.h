@@ -30,6 +30,9 @@
 #include <QWidget>
 #include <QPainter>
 #include <QPixmap>
+#include <QImage>
+#include <QPolygonF>
+#include <QRegion>
 #include <QDebug>
 
 
@@ -124,7 +127,21 @@ namespace SlavGPS {
 		/* ViewportPixmap buffer management/drawing to screen. */
 		const QPixmap & get_pixmap(void) const;   /* Get contents of drawing buffer. */
 		void set_pixmap(const QPixmap & pixmap);
-		void pan_sync(int x_off, int y_off);
+
+		/**
+		   @brief Move contents of pixmap by given offset, in
+		   reaction to pan
+
+		   Contents of pixmap saved with
+		   ::layers_snapshot_save() (i.e. without decorations)
+		   are moved. Part of pixmap exposed by the move is
+		   erased and returned in @param exposed, so that the
+		   caller can draw layers only in that part.
+		*/
+		sg_ret pan_sync(int x_off, int y_off, QRegion & exposed);
+
+		/* Remember contents of pixmap with all layers drawn, but before decorations are drawn. */
+		void layers_snapshot_save(void);
 
 		void snapshot_save(void);
 		void snapshot_restore(void);
@@ -197,6 +214,16 @@ namespace SlavGPS {
 		void fill_ellipse(const QColor & color, const ScreenPos & center, fpixel radius_x, fpixel radius_y);
 		void draw_polygon(const QPen & pen, const ScreenPos * points, int npoints, bool filled);
 
+		/**
+		   @brief Draw connected lines going through given points
+
+		   The whole polyline is checked against viewport and
+		   drawn with one call to QPainter. Only if some of its
+		   points are very far outside of viewport, each line
+		   is clipped and drawn separately.
+		*/
+		void draw_polyline(const QPen & pen, const QPolygonF & points);
+
 		/**
 		   @brief Draw pixmap (or its part) into viewport
 
@@ -244,6 +271,12 @@ namespace SlavGPS {
 
 		QPainter & get_painter(void) { return this->painter; }
 
+		/* Make painter draw into given image instead of
+		   viewport's pixmap, until end_redirect() is called.
+		   The image should have the same size as the pixmap. */
+		void begin_redirect(QImage & image);
+		void end_redirect(void);
+
 
 		void set_highlight_usage(bool new_state);
 		bool get_highlight_usage(void) const;
@@ -329,6 +362,7 @@ namespace SlavGPS {
 		QPainter painter;
 		QPixmap vpixmap;
 		QPixmap vpixmap_snapshot;
+		QPixmap vpixmap_layers; /* See ::layers_snapshot_save(). */
 
 	private:
 		void draw_text_debug(const QRectF & text_rect);
@@ -25,6 +25,7 @@
 
 #include <vector>
 #include <cassert>
+#include <cmath>
 
 
 
@@ -48,6 +49,7 @@
 
 #include "generic_tools.h"
 #include "window.h"
+#include "frame_scheduler.h"
 #include "viewport.h"
 #include "viewport_zoom.h"
 #include "viewport_internal.h"
@@ -106,6 +108,12 @@ static std::list<Window *> window_list;
 
 #define WIN_MAIN_DOCK_MIN_WIDTH 50  /* Minimal usable width/height of dock. */
 
+/* Maximal accumulated error of moving viewport's pixmap during pan. */
+#define PAN_MAX_ERROR 1.0 /* [pixels] */
+/* Items (e.g. waypoint symbols) just outside of part of
+   viewport exposed by pan may still overlap the part. */
+#define PAN_EXPOSED_AREA_PADDING 64 /* [pixels] */
+
 
 #define VIKING_ACCELERATOR_KEY_FILE "keys.rc"
 
@@ -236,7 +244,7 @@ Window::Window()
 	connect(this->m_main_gisview, SIGNAL (list_of_center_coords_changed(GisViewport *)), this, SLOT (center_changed_cb(GisViewport *)));
 	connect(this->m_main_gisview, SIGNAL (center_coord_or_zoom_changed(GisViewport *)), this, SLOT (draw_tree_items_cb(GisViewport *)));
 	connect(this->m_main_gisview, SIGNAL (size_changed(ViewportPixmap *)), this, SLOT (draw_tree_items_cb(ViewportPixmap *)));
-	connect(this->m_layers_panel, SIGNAL (items_tree_updated()), this, SLOT (draw_tree_items_cb()));
+	connect(this->m_layers_panel, SIGNAL (items_tree_updated(bool, bool)), this, SLOT (draw_tree_items_cb(bool, bool)));
 
 
 	this->pan_pos = ScreenPos(-1, -1);  /* -1: off */
@@ -390,6 +398,8 @@ void Window::create_layout()
 	this->m_main_gisview = new GisViewport(0, 0, 0, 0, this);
 	//this->m_main_gisview = new GisViewport(90, 60, 30, 120, this);
 	qDebug() << SG_PREFIX_I << "Created Viewport with center's size:" << this->m_main_gisview->central_get_height() << this->m_main_gisview->central_get_width();
+	this->m_main_gisview->set_layers_cache_usage(true);
+	this->m_frame_scheduler = new FrameScheduler(this, this->m_main_gisview);
 	this->setCentralWidget(this->m_main_gisview);
 
 
@@ -934,10 +944,13 @@ void Window::create_actions(void)
 
 
 
-void Window::draw_tree_items_cb(void)
+void Window::draw_tree_items_cb(bool reuse_layers_cache, bool in_background)
 {
 	qDebug() << SG_PREFIX_SLOT;
-	this->draw_tree_items(this->m_main_gisview);
+	/* Edits made by user are shown in next frame, changes made
+	   by downloads and jobs can wait. */
+	const FramePriority priority = in_background ? FramePriority::Background : FramePriority::UserInput;
+	this->m_frame_scheduler->request_frame(priority, reuse_layers_cache, "items tree updated");
 }
 
 
@@ -946,7 +959,11 @@ void Window::draw_tree_items_cb(void)
 void Window::draw_tree_items_cb(GisViewport * gisview)
 {
 	qDebug() << SG_PREFIX_SLOT;
-	this->draw_tree_items(gisview);
+	if (gisview == this->m_main_gisview) {
+		this->m_frame_scheduler->request_frame(FramePriority::UserInput, true, "center or zoom changed");
+	} else {
+		this->draw_tree_items(gisview, true);
+	}
 }
 
 
@@ -956,7 +973,11 @@ void Window::draw_tree_items_cb(ViewportPixmap * vpixmap)
 {
 	qDebug() << SG_PREFIX_SLOT;
 	GisViewport * gisview = (GisViewport *) vpixmap;
-	this->draw_tree_items(gisview);
+	if (gisview == this->m_main_gisview) {
+		this->m_frame_scheduler->request_frame(FramePriority::UserInput, true, "size changed");
+	} else {
+		this->draw_tree_items(gisview, true);
+	}
 }
 
 
@@ -1031,7 +1052,7 @@ void Window::menu_layer_new_cb(void) /* Slot. */
 
 
 
-void Window::draw_tree_items(GisViewport * gisview)
+void Window::draw_tree_items(GisViewport * gisview, bool reuse_layers_cache)
 {
 	qDebug() << "\n";
 	qDebug() << SG_PREFIX_I;
@@ -1055,12 +1076,43 @@ void Window::draw_tree_items(GisViewport * gisview)
 #endif
 
 
-	gisview->clear();
+	this->begin_drawing_tree_items(gisview, reuse_layers_cache);
 
 	/* Main layer drawing.  This is a standard drawing of items in
 	   main viewport, so allow highlight. */
 	this->m_layers_panel->draw_tree_items(gisview, true, false);
 
+	this->finish_drawing_tree_items(gisview);
+}
+
+
+
+
+void Window::begin_drawing_tree_items(GisViewport * gisview, bool reuse_layers_cache)
+{
+	if (gisview == this->m_main_gisview) {
+		/* This frame serves all requests recorded so far. */
+		this->m_frame_scheduler->discard_pending_requests();
+	}
+
+	/* Cache may be bypassed at the moment, but its images
+	   would be out of date once it is used again. */
+	if (!reuse_layers_cache) {
+		gisview->invalidate_layers_cache();
+	}
+	this->pan_error = 0.0;
+
+
+	gisview->clear();
+}
+
+
+
+
+void Window::finish_drawing_tree_items(GisViewport * gisview)
+{
+	gisview->layers_snapshot_save();
+
 	/* Other viewport decoration items on top if they are enabled/in use. */
 	gisview->draw_decorations();
 
@@ -1079,6 +1131,101 @@ void Window::draw_tree_items(GisViewport * gisview)
 
 
 
+bool Window::can_draw_tree_items_progressively(GisViewport * gisview) const
+{
+	if (gisview != this->m_main_gisview || !Preferences::get_progressive_rendering()) {
+		return false;
+	}
+
+	/* There must be something to show in first stage and
+	   something to draw in second stage. */
+	const LayerAggregate * top_layer = this->m_layers_panel->top_layer();
+	const int n_base_layers = top_layer->get_base_layers_count();
+	return n_base_layers > 0 && n_base_layers < top_layer->child_rows_count();
+}
+
+
+
+
+void Window::draw_tree_items_base_stage(GisViewport * gisview, bool reuse_layers_cache, const RenderCancellationToken & token)
+{
+	this->begin_drawing_tree_items(gisview, reuse_layers_cache);
+
+	this->m_layers_panel->draw_tree_items(gisview, true, false, LayersDrawStage::Base, token);
+
+	/* Show base layers while remaining layers are waiting to be drawn. */
+	gisview->update();
+}
+
+
+
+
+void Window::draw_tree_items_remaining_stage(GisViewport * gisview, const RenderCancellationToken & token)
+{
+	this->m_layers_panel->draw_tree_items(gisview, true, false, LayersDrawStage::Remaining, token);
+	if (token.is_cancelled()) {
+		/* Pixmap of viewport is incomplete. Newer frame
+		   will draw viewport from scratch. */
+		return;
+	}
+
+	this->finish_drawing_tree_items(gisview);
+}
+
+
+
+
+/**
+   Redraw viewport after its center has been moved by pan tool
+
+   Contents of viewport are moved and layers are drawn only in the
+   part of viewport exposed by the move. Offsets of moves are
+   rounded to full pixels, so when the accumulated rounding error
+   becomes too large, the viewport is redrawn from scratch.
+*/
+void Window::draw_tree_items_after_pan(GisViewport * gisview, const Coord & old_center)
+{
+	double shift_x = 0.0;
+	double shift_y = 0.0;
+	QRegion exposed;
+
+	bool full_redraw = sg_ret::ok != gisview->get_center_shift(old_center, shift_x, shift_y);
+	if (!full_redraw) {
+		const int dx = (int) round(shift_x);
+		const int dy = (int) round(shift_y);
+		this->pan_error += sqrt((dx - shift_x) * (dx - shift_x) + (dy - shift_y) * (dy - shift_y));
+
+		full_redraw = this->pan_error > PAN_MAX_ERROR
+			|| sg_ret::ok != gisview->pan_sync(dx, dy, exposed);
+	}
+	if (full_redraw) {
+		this->draw_tree_items(gisview, true);
+		return;
+	}
+
+	/* Draw layers separately in each strip of exposed region,
+	   so that the layers only look at their items in the strip. */
+	for (const QRect & rect : exposed.rects()) {
+		gisview->get_painter().setClipRect(rect);
+		gisview->set_bbox_area(rect.adjusted(-PAN_EXPOSED_AREA_PADDING, -PAN_EXPOSED_AREA_PADDING, PAN_EXPOSED_AREA_PADDING, PAN_EXPOSED_AREA_PADDING));
+		this->m_layers_panel->draw_tree_items(gisview, true, false);
+	}
+	gisview->set_bbox_area(QRect());
+	gisview->get_painter().setClipping(false);
+	gisview->layers_snapshot_save();
+
+	gisview->draw_decorations();
+	if (1) { /* Debug. Draw on top of decorations. */
+		gisview->debug_draw_debugs();
+	}
+	gisview->update();
+
+	this->draw_sync();
+}
+
+
+
+
 void Window::draw_layer_cb(sg_uid_t uid) /* Slot. */
 {
 	qDebug() << SG_PREFIX_SLOT << "Will redraw all tree items after change made to layer with uid" << (qulonglong) uid;
@@ -1118,6 +1265,14 @@ LayersPanel * Window::layers_panel(void) const
 
 
 
+FrameScheduler * Window::frame_scheduler(void) const
+{
+	return this->m_frame_scheduler;
+}
+
+
+
+
 Toolbox * Window::toolbox(void) const
 {
 	return this->m_toolbox;
@@ -1334,14 +1489,25 @@ void Window::pan_move(QMouseEvent * ev)
 {
 	//qDebug() << SG_PREFIX_I;
 	if (this->pan_pos.x() != -1 && this->pan_pos.y() != -1) {
+		const Coord old_center = this->m_main_gisview->get_center_coord();
 		if (sg_ret::ok != this->pan_move_update_viewport(ev)) {
 			this->pan_off();
 			return;
 		}
 
+		if (!this->pan_move_in_progress) {
+			/* Cached images of layers would have to be
+			   moved with each small move of cursor,
+			   which is more costly than moving the
+			   viewport's pixmap. The cache is bypassed
+			   until the pan ends, and then its images
+			   are moved by the whole pan at once. */
+			this->m_main_gisview->set_layers_cache_usage(false);
+		}
+
 		this->pan_move_in_progress = true;
 		this->pan_pos = ev->localPos();
-		this->m_main_gisview->request_redraw("pan move");
+		this->m_frame_scheduler->request_pan_frame(old_center);
 	}
 }
 
@@ -1416,6 +1582,7 @@ void Window::pan_release(QMouseEvent * ev)
 
 void Window::pan_off(void)
 {
+	this->m_main_gisview->set_layers_cache_usage(true);
 	this->pan_move_in_progress = false;
 	this->pan_pos = ScreenPos(-1, -1);
 	this->pan_pos.ry() = -1;
@@ -1955,14 +2122,6 @@ bool Window::clear_highlight(void)
 
 
 
-void Window::set_redraw_trigger(TreeItem * tree_item)
-{
-	this->redraw_trigger = tree_item;
-}
-
-
-
-
 void Window::show_layer_defaults_cb(void)
 {
 	QAction * qa = (QAction *) QObject::sender();
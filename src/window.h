@@ -43,6 +43,7 @@
 #include "layer_trw_import.h"
 #include "measurements.h"
 #include "viewport.h"
+#include "frame_scheduler.h"
 
 
 
@@ -71,6 +72,7 @@ namespace SlavGPS {
 	class ScreenPos;
 	class DataSource;
 	class StatusBar;
+	class FrameScheduler;
 	enum class LayerKind;
 	enum class StatusBarField;
 
@@ -87,15 +89,31 @@ namespace SlavGPS {
 		~Window();
 		static Window * new_window();
 
-		void draw_tree_items(GisViewport * gisview);
+		/* With @param reuse_layers_cache set to false all
+		   layers are drawn from scratch. Set it to true only
+		   if the reason of redraw is a change of viewport's
+		   geometry or a change signalled with
+		   TreeItem::emit_tree_item_changed(). */
+		void draw_tree_items(GisViewport * gisview, bool reuse_layers_cache = false);
+		void draw_tree_items_after_pan(GisViewport * gisview, const Coord & old_center);
 		void draw_sync();
 
+		/* Progressive drawing: base layers are drawn and
+		   shown in first stage, and remaining layers are
+		   drawn on top of them in second stage, unless
+		   @param token is cancelled before or during the
+		   second stage. */
+		bool can_draw_tree_items_progressively(GisViewport * gisview) const;
+		void draw_tree_items_base_stage(GisViewport * gisview, bool reuse_layers_cache, const RenderCancellationToken & token);
+		void draw_tree_items_remaining_stage(GisViewport * gisview, const RenderCancellationToken & token);
+
 		void update_status_bar_on_redraw();
 
 		void handle_selection_of_tree_item(TreeItem & tree_item);
 
 		GisViewport * main_gisview(void) const;
 		LayersPanel * layers_panel(void) const;
+		FrameScheduler * frame_scheduler(void) const;
 		Toolbox * toolbox(void) const;
 		StatusBar * statusbar(void) const;
 		QDockWidget * tools_dock(void) const;
@@ -143,8 +161,6 @@ namespace SlavGPS {
 		QString get_current_document_file_name(void);
 
 
-		void set_redraw_trigger(TreeItem * tree_item);
-
 		void activate_tool_by_id(const SGObjectTypeID & tool_id);
 
 		void open_file(const QString & new_document_full_path, bool set_as_current_document);
@@ -177,7 +193,7 @@ namespace SlavGPS {
 
 		/* Draw all tree items from main tree items view to
 		   main GIS viewport of application. */
-		void draw_tree_items_cb(void);
+		void draw_tree_items_cb(bool reuse_layers_cache, bool in_background);
 
 		/* Draw all tree items from main tree items view to
 		   given GIS viewport. */
@@ -281,6 +297,9 @@ namespace SlavGPS {
 
 	private:
 
+		void begin_drawing_tree_items(GisViewport * gisview, bool reuse_layers_cache);
+		void finish_drawing_tree_items(GisViewport * gisview);
+
 		void create_layout(void);
 		void create_actions(void);
 		void create_ui(void);
@@ -312,9 +331,12 @@ namespace SlavGPS {
 		   is in upper-left corner. */
 		ScreenPos pan_pos; /* Last recorded position of cursor while panning. */
 		ScreenPos delayed_pan_pos; /* Temporary storage. */
+		/* Accumulated error of rounding offsets by which viewport's pixmap is moved during pan. */
+		double pan_error = 0.0;
 
 		GisViewport * m_main_gisview = nullptr;
 		LayersPanel * m_layers_panel = nullptr;
+		FrameScheduler * m_frame_scheduler = nullptr;
 		Toolbox * m_toolbox = nullptr;
 		StatusBar * m_statusbar = nullptr;
 		QMenuBar * m_menu_bar = nullptr;
@@ -338,7 +360,6 @@ namespace SlavGPS {
 		QMenu * submenu_file_acquire = nullptr;
 
 		/* Half-drawn update. */
-		TreeItem * redraw_trigger = nullptr;
 		Coord trigger_center;
 
 		QString current_document_full_path;
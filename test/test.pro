@@ -0,0 +1,14 @@
+# Unit tests that don't need the rest of the application.
+# Run them with "make check".
+TEMPLATE = app
+TARGET = test_trackpoints
+
+CONFIG += console testcase
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../src
+
+SOURCES += test_trackpoints.cpp \
+    ../src/layer_trw_trackpoints.cpp
+
+QMAKE_CXXFLAGS += -std=c++11 -Wall
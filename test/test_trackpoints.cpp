@@ -0,0 +1,345 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+#include <layer_trw_trackpoints.h>
+
+
+
+
+/* The container only stores pointers, so the test doesn't need full Trackpoint. */
+namespace SlavGPS {
+	class Trackpoint {
+	public:
+		int id = 0;
+	};
+}
+
+
+
+
+using namespace SlavGPS;
+
+
+
+
+static int n_errors = 0;
+
+#define CHECK(cond) \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		n_errors++; \
+	}
+
+
+
+
+/* Same lookup that is done when a trackpoint is selected and its
+   info is shown in status bar: previous trackpoint or NULL. */
+static Trackpoint * get_previous(TrackPoints & trackpoints, TrackPoints::iterator iter)
+{
+	auto prev = std::prev(iter);
+	return prev == trackpoints.end() ? NULL : *prev;
+}
+
+
+
+
+static void test_select(size_t n_points)
+{
+	std::vector<Trackpoint> storage(n_points);
+	TrackPoints trackpoints;
+	for (size_t i = 0; i < n_points; i++) {
+		storage[i].id = (int) i;
+		trackpoints.push_back(&storage[i]);
+	}
+
+	/* First trackpoint has no previous trackpoint. */
+	CHECK (std::prev(trackpoints.begin()) == trackpoints.end());
+	CHECK (NULL == get_previous(trackpoints, trackpoints.begin()));
+	CHECK (std::next(trackpoints.end()) == trackpoints.begin());
+
+	/* Last trackpoint is before end(). */
+	CHECK (*std::prev(trackpoints.end()) == &storage[n_points - 1]);
+
+	/* Every other trackpoint, including ones at chunk boundaries. */
+	size_t i = 0;
+	for (auto iter = trackpoints.begin(); iter != trackpoints.end(); iter++, i++) {
+		Trackpoint * prev = get_previous(trackpoints, iter);
+		if (0 == i) {
+			CHECK (NULL == prev);
+		} else {
+			CHECK (prev == &storage[i - 1]);
+		}
+	}
+	CHECK (i == n_points);
+}
+
+
+
+
+/* Compare trackpoints in container with expected trackpoints,
+   walking the container forward and backward. */
+static void check_contents(const TrackPoints & trackpoints, const std::vector<Trackpoint *> & expected, int line)
+{
+	const int errors_before = n_errors;
+
+	CHECK (trackpoints.size() == expected.size());
+	CHECK (trackpoints.empty() == expected.empty());
+
+	size_t i = 0;
+	for (auto iter = trackpoints.begin(); iter != trackpoints.end() && i < expected.size(); iter++, i++) {
+		CHECK (*iter == expected[i]);
+	}
+	CHECK (i == expected.size());
+
+	i = expected.size();
+	for (auto iter = trackpoints.end(); iter != trackpoints.begin() && i > 0; ) {
+		iter--;
+		i--;
+		CHECK (*iter == expected[i]);
+	}
+	CHECK (0 == i);
+
+	if (!expected.empty()) {
+		CHECK (trackpoints.front() == expected.front());
+		CHECK (trackpoints.back() == expected.back());
+	}
+
+	if (n_errors != errors_before) {
+		fprintf(stderr, "contents of container checked at line %d are invalid\n", line);
+	}
+}
+#define CHECK_CONTENTS(trackpoints, expected) check_contents(trackpoints, expected, __LINE__)
+
+
+
+
+static void fill(TrackPoints & trackpoints, std::vector<Trackpoint *> & expected, std::vector<Trackpoint> & storage, size_t n_points)
+{
+	for (size_t i = 0; i < n_points; i++) {
+		trackpoints.push_back(&storage[i]);
+		expected.push_back(&storage[i]);
+	}
+}
+
+
+
+
+static TrackPoints::iterator iterator_at(TrackPoints & trackpoints, size_t pos)
+{
+	return std::next(trackpoints.begin(), pos);
+}
+
+
+
+
+static void test_insert(void)
+{
+	const size_t n_points = 2 * TrackPoints::chunk_capacity + 3;
+
+	/* Positions at beginning, inside of chunk, at boundaries
+	   of chunks and before end. Inserting into full chunk
+	   splits the chunk. */
+	const size_t positions[] = { 0, 1, 10, TrackPoints::chunk_capacity / 2, TrackPoints::chunk_capacity - 1, TrackPoints::chunk_capacity, TrackPoints::chunk_capacity + 1, n_points - 1, n_points };
+	for (size_t pos : positions) {
+		std::vector<Trackpoint> storage(n_points + 1);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, n_points);
+
+		Trackpoint * new_tp = &storage[n_points];
+		auto iter = trackpoints.insert(iterator_at(trackpoints, pos), new_tp);
+		expected.insert(expected.begin() + pos, new_tp);
+
+		CHECK (*iter == new_tp);
+		CHECK (std::distance(trackpoints.begin(), iter) == (std::ptrdiff_t) pos);
+		CHECK_CONTENTS (trackpoints, expected);
+	}
+
+	/* Many insertions at the same position in the middle fill
+	   and split chunks repeatedly. */
+	{
+		std::vector<Trackpoint> storage(3 * TrackPoints::chunk_capacity + 2);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, 2);
+
+		for (size_t i = 2; i < storage.size(); i++) {
+			trackpoints.insert(iterator_at(trackpoints, 1), &storage[i]);
+			expected.insert(expected.begin() + 1, &storage[i]);
+		}
+		CHECK_CONTENTS (trackpoints, expected);
+	}
+
+	/* Inserting into empty container and at the front. */
+	{
+		std::vector<Trackpoint> storage(2);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+
+		trackpoints.insert(trackpoints.end(), &storage[1]);
+		trackpoints.push_front(&storage[0]);
+		expected.push_back(&storage[0]);
+		expected.push_back(&storage[1]);
+		CHECK_CONTENTS (trackpoints, expected);
+	}
+}
+
+
+
+
+static void test_erase(void)
+{
+	const size_t n_points = 2 * TrackPoints::chunk_capacity + 3;
+
+	/* Erasing single trackpoints. */
+	const size_t positions[] = { 0, 1, TrackPoints::chunk_capacity - 1, TrackPoints::chunk_capacity, n_points - 1 };
+	for (size_t pos : positions) {
+		std::vector<Trackpoint> storage(n_points);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, n_points);
+
+		auto iter = trackpoints.erase(iterator_at(trackpoints, pos));
+		expected.erase(expected.begin() + pos);
+
+		/* Returned iterator points to trackpoint that followed the erased one. */
+		if (pos == expected.size()) {
+			CHECK (iter == trackpoints.end());
+		} else {
+			CHECK (*iter == expected[pos]);
+		}
+		CHECK_CONTENTS (trackpoints, expected);
+	}
+
+	/* Erasing all trackpoints of a chunk one by one removes the chunk. */
+	{
+		std::vector<Trackpoint> storage(n_points);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, n_points);
+
+		auto iter = iterator_at(trackpoints, TrackPoints::chunk_capacity);
+		for (int i = 0; i < TrackPoints::chunk_capacity; i++) {
+			iter = trackpoints.erase(iter);
+		}
+		expected.erase(expected.begin() + TrackPoints::chunk_capacity, expected.begin() + 2 * TrackPoints::chunk_capacity);
+
+		CHECK (*iter == expected[TrackPoints::chunk_capacity]);
+		CHECK_CONTENTS (trackpoints, expected);
+	}
+
+	/* Erasing ranges: inside of a chunk, across chunks, and till end. */
+	const std::pair<size_t, size_t> ranges[] = { { 1, 5 }, { 5, 5 }, { 10, TrackPoints::chunk_capacity + 10 }, { 0, n_points - 1 }, { TrackPoints::chunk_capacity + 1, n_points }, { 0, n_points } };
+	for (const auto & range : ranges) {
+		std::vector<Trackpoint> storage(n_points);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, n_points);
+
+		auto iter = trackpoints.erase(iterator_at(trackpoints, range.first), iterator_at(trackpoints, range.second));
+		expected.erase(expected.begin() + range.first, expected.begin() + range.second);
+
+		if (range.first == expected.size()) {
+			CHECK (iter == trackpoints.end());
+		} else {
+			CHECK (*iter == expected[range.first]);
+		}
+		CHECK_CONTENTS (trackpoints, expected);
+	}
+}
+
+
+
+
+/* Splitting of track at given trackpoint: trackpoints from the
+   trackpoint till end are moved to a new track. */
+static void test_split(void)
+{
+	const size_t n_points = 3 * TrackPoints::chunk_capacity + 7;
+
+	const size_t positions[] = { 1, TrackPoints::chunk_capacity, TrackPoints::chunk_capacity + 1, n_points - 1 };
+	for (size_t pos : positions) {
+		std::vector<Trackpoint> storage(n_points);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, n_points);
+
+		TrackPoints new_trackpoints;
+		new_trackpoints.splice(new_trackpoints.end(), trackpoints, iterator_at(trackpoints, pos), trackpoints.end());
+
+		const std::vector<Trackpoint *> expected_new(expected.begin() + pos, expected.end());
+		expected.erase(expected.begin() + pos, expected.end());
+		CHECK_CONTENTS (trackpoints, expected);
+		CHECK_CONTENTS (new_trackpoints, expected_new);
+
+		/* Appending the whole track back (as when merging tracks). */
+		trackpoints.splice(trackpoints.end(), new_trackpoints, new_trackpoints.begin(), new_trackpoints.end());
+		expected.insert(expected.end(), expected_new.begin(), expected_new.end());
+		CHECK_CONTENTS (trackpoints, expected);
+		CHECK_CONTENTS (new_trackpoints, std::vector<Trackpoint *>());
+	}
+
+	/* Moving a range from the middle of a track. */
+	{
+		std::vector<Trackpoint> storage(n_points);
+		std::vector<Trackpoint *> expected;
+		TrackPoints trackpoints;
+		fill(trackpoints, expected, storage, n_points);
+
+		const size_t first = 10;
+		const size_t last = 2 * TrackPoints::chunk_capacity;
+		TrackPoints new_trackpoints;
+		new_trackpoints.splice(new_trackpoints.end(), trackpoints, iterator_at(trackpoints, first), iterator_at(trackpoints, last));
+
+		const std::vector<Trackpoint *> expected_new(expected.begin() + first, expected.begin() + last);
+		expected.erase(expected.begin() + first, expected.begin() + last);
+		CHECK_CONTENTS (trackpoints, expected);
+		CHECK_CONTENTS (new_trackpoints, expected_new);
+	}
+}
+
+
+
+
+int main(void)
+
+{
+	/* Going back from end() of empty container. */
+	TrackPoints empty;
+	CHECK (std::prev(empty.end()) == empty.end());
+	CHECK (empty.begin() == empty.end());
+
+	test_select(1);
+	test_select(TrackPoints::chunk_capacity);
+	test_select(3 * TrackPoints::chunk_capacity + 7);
+
+	test_insert();
+	test_erase();
+	test_split();
+
+	if (n_errors) {
+		fprintf(stderr, "%d check(s) failed\n", n_errors);
+		return 1;
+	}
+	return 0;
+}